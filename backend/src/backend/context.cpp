@@ -497,6 +497,9 @@ namespace gbe
         INSERT_REG(lsize0, LOCAL_SIZE_X, 1)
         INSERT_REG(lsize1, LOCAL_SIZE_Y, 1)
         INSERT_REG(lsize2, LOCAL_SIZE_Z, 1)
+        INSERT_REG(enqlsize0, ENQUEUED_LOCAL_SIZE_X, 1)
+        INSERT_REG(enqlsize1, ENQUEUED_LOCAL_SIZE_Y, 1)
+        INSERT_REG(enqlsize2, ENQUEUED_LOCAL_SIZE_Z, 1)
         INSERT_REG(gsize0, GLOBAL_SIZE_X, 1)
         INSERT_REG(gsize1, GLOBAL_SIZE_Y, 1)
         INSERT_REG(gsize2, GLOBAL_SIZE_Z, 1)
@@ -678,6 +681,9 @@ namespace gbe
         reg == ir::ocl::lsize0    ||
         reg == ir::ocl::lsize1    ||
         reg == ir::ocl::lsize2    ||
+        reg == ir::ocl::enqlsize0 ||
+        reg == ir::ocl::enqlsize1 ||
+        reg == ir::ocl::enqlsize2 ||
         reg == ir::ocl::gsize0    ||
         reg == ir::ocl::gsize1    ||
         reg == ir::ocl::gsize2    ||
@@ -28,6 +28,8 @@
 #include "backend/gen_encoder.hpp"
 #include "backend/gen_insn_selection.hpp"
 #include "backend/gen_insn_scheduling.hpp"
+#include "backend/gen_insn_peephole.hpp"
+#include "backend/gen_insn_compact.hpp"
 #include "backend/gen_reg_allocation.hpp"
 #include "backend/gen/gen_mesa_disasm.h"
 #include "ir/function.hpp"
@@ -1604,32 +1606,38 @@ namespace gbe
   }
 
   void GenContext::emitIndirectMoveInstruction(const SelectionInstruction &insn) {
-    GenRegister src = ra->genReg(insn.src(0));
-    if(isScalarReg(src.reg()))
-      src = GenRegister::retype(src, GEN_TYPE_UW);
+    GenRegister index = ra->genReg(insn.src(0));
+    if(isScalarReg(index.reg()))
+      index = GenRegister::retype(index, GEN_TYPE_UW);
     else
-      src = GenRegister::unpacked_uw(src.nr, src.subnr / typeSize(GEN_TYPE_UW));
+      index = GenRegister::unpacked_uw(index.nr, index.subnr / typeSize(GEN_TYPE_UW));
 
+    // The elements are contiguous and each of them uses simdWidth dwords
+    const GenRegister array = ra->genReg(insn.src(1));
     const GenRegister dst = ra->genReg(insn.dst(0));
     const GenRegister a0 = GenRegister::addr8(0);
-    uint32_t simdWidth = p->curr.execWidth;
+    const uint32_t simdWidth = p->curr.execWidth;
+    const uint32_t base = array.nr * GEN_REG_SIZE + array.subnr;
+    const uint32_t simdShift = simdWidth == 16 ? 4 : 3;
 
-    p->push();
-      p->curr.execWidth = 8;
-      p->curr.quarterControl = GEN_COMPRESSION_Q1;
-      p->MOV(a0, src);
-      p->MOV(dst, GenRegister::indirect(dst.type, 0, GEN_WIDTH_8));
-    p->pop();
-
-    if (simdWidth == 16) {
+    for (uint32_t quarter = 0; quarter < simdWidth / 8; ++quarter) {
+      // a0.x = base + 4 * (index.x * simdWidth + 8 * quarter + x)
       p->push();
         p->curr.execWidth = 8;
-        p->curr.quarterControl = GEN_COMPRESSION_Q2;
+        p->curr.quarterControl = quarter ? GEN_COMPRESSION_Q2 : GEN_COMPRESSION_Q1;
+        p->curr.predicate = GEN_PREDICATE_NONE;
+        p->curr.noMask = 1;
+        p->SHL(a0, GenRegister::Qn(index, quarter), GenRegister::immuw(simdShift));
+        p->ADD(a0, a0, GenRegister::immv(0x76543210));
+        p->SHL(a0, a0, GenRegister::immuw(2));
+        p->ADD(a0, a0, GenRegister::immuw(base + quarter * 8 * sizeof(uint32_t)));
+      p->pop();
 
-        const GenRegister nextDst = GenRegister::Qn(dst, 1);
-        const GenRegister nextSrc = GenRegister::Qn(src, 1);
-        p->MOV(a0, nextSrc);
-        p->MOV(nextDst, GenRegister::indirect(dst.type, 0, GEN_WIDTH_8));
+      // One address register per channel
+      p->push();
+        p->curr.execWidth = 8;
+        p->curr.quarterControl = quarter ? GEN_COMPRESSION_Q2 : GEN_COMPRESSION_Q1;
+        p->MOV(GenRegister::Qn(dst, quarter), GenRegister::indirect(dst.type, 0, GEN_WIDTH_1));
       p->pop();
     }
   }
@@ -1894,6 +1902,8 @@ namespace gbe
 
   BVAR(OCL_OUTPUT_REG_ALLOC, false);
   BVAR(OCL_OUTPUT_ASM, false);
+  BVAR(OCL_COMPACT_INSN, true);
+  BVAR(OCL_DEPENDENCY_CONTROL, true);
   bool GenContext::emitCode(void) {
     GenKernel *genKernel = static_cast<GenKernel*>(this->kernel);
     sel->select();
@@ -1901,26 +1911,46 @@ namespace gbe
     if (UNLIKELY(ra->allocate(*this->sel) == false))
       return false;
     schedulePostRegAllocation(*this, *this->sel);
+    peepholePostRegAllocation(*this, *this->sel);
     if (OCL_OUTPUT_REG_ALLOC)
       ra->outputAllocation();
     this->clearFlagRegister();
     this->emitStackPointer();
     this->emitInstructionStream();
     this->patchBranches();
-    genKernel->insnNum = p->store.size();
+    if (OCL_DEPENDENCY_CONTROL)
+      setDependencyControl(p->store);
+
+    // Compaction only changes the instruction sizes. We keep the position (in
+    // 8 bytes units) of every instruction to output the labels
+    vector<GenCompactInstruction> code;
+    vector<uint32_t> offsets;
+    uint32_t compactNum = 0;
+    if (OCL_COMPACT_INSN)
+      compactNum = compactInstructionStream(p->store, code, offsets);
+    else {
+      code.resize(p->store.size() * 2);
+      std::memcpy(&code[0], &p->store[0], p->store.size() * sizeof(GenInstruction));
+      for (uint32_t insnID = 0; insnID <= p->store.size(); ++insnID)
+        offsets.push_back(insnID * 2);
+    }
+    genKernel->insnNum = code.size() / 2;
     genKernel->insns = GBE_NEW_ARRAY_NO_ARG(GenInstruction, genKernel->insnNum);
-    std::memcpy(genKernel->insns, &p->store[0], genKernel->insnNum * sizeof(GenInstruction));
+    std::memcpy(genKernel->insns, &code[0], genKernel->insnNum * sizeof(GenInstruction));
     if (OCL_OUTPUT_ASM) {
-      std::cout << genKernel->getName() << "'s disassemble begin:" << std::endl;
+      std::cout << genKernel->getName() << "'s disassemble begin ("
+                << p->store.size() * sizeof(GenInstruction) << " -> "
+                << genKernel->getCodeSize() << " bytes, "
+                << compactNum << " compacted instructions):" << std::endl;
       ir::LabelIndex curLabel = (ir::LabelIndex)0;
       std::cout << "  L0:" << std::endl;
-      for (uint32_t insnID = 0; insnID < genKernel->insnNum; ++insnID) {
+      for (uint32_t insnID = 0; insnID < p->store.size(); ++insnID) {
         if (labelPos.find((ir::LabelIndex)(curLabel + 1))->second == insnID) {
           std::cout << "  L" << curLabel + 1 << ":" << std::endl;
           curLabel = (ir::LabelIndex)(curLabel + 1);
         }
-        std::cout << "    (" << std::setw(8) << insnID * 2 << ")  ";
-        gen_disasm(stdout, &p->store[insnID]);
+        std::cout << "    (" << std::setw(8) << offsets[insnID] << ")  ";
+        disasmInstruction(stdout, &code[offsets[insnID]]);
       }
       std::cout << genKernel->getName() << "'s disassemble end." << std::endl;
     }
@@ -901,5 +901,32 @@ struct GenInstruction
   } bits3;
 };
 
+/* Compacted (64 bits) instruction format. Most of the fields are indices in
+ * the hardware compaction tables (see gen_insn_compact.cpp)
+ */
+struct GenCompactInstruction
+{
+  struct {
+    uint32_t opcode:7;
+    uint32_t debug_control:1;
+    uint32_t control_index:5;
+    uint32_t data_type_index:5;
+    uint32_t sub_reg_index:5;
+    uint32_t acc_wr_control:1;
+    uint32_t destreg_or_condmod:4;
+    uint32_t flag_subreg_nr:1;
+    uint32_t cmpt_control:1;
+    uint32_t src0_index_lo:2;
+  } bits1;
+
+  struct {
+    uint32_t src0_index_hi:3;
+    uint32_t src1_index:5;
+    uint32_t dest_reg_nr:8;
+    uint32_t src0_reg_nr:8;
+    uint32_t src1_reg_nr:8;
+  } bits2;
+};
+
 #endif /* __GEN_DEFS_HPP__ */
 
@@ -0,0 +1,463 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file gen_insn_compact.cpp
+ */
+
+/*
+ * Overall idea:
+ * =============
+ *
+ * Gen7 (and Gen7.5) can execute 64 bits "compacted" instructions. The control,
+ * data type, sub-register and source region bits of the native 128 bits
+ * format are replaced by 5 bits indices into tables hardwired in the EU. The
+ * register numbers are kept as is and small immediates (13 bits signed) are
+ * stored in place of the second source index.
+ *
+ * We run once the whole stream has been emitted and the branches patched, so
+ * the encoder and the branch code keep working with fixed 16 bytes slots. Each
+ * instruction is compacted when possible, a new offset is computed for every
+ * instruction and the jumps (JMPI and the "add ip" long jump forms) are then
+ * rewritten with the new distances. Jumps and their companion instructions are
+ * never compacted so the jump sequences keep their shape.
+ *
+ * The compaction is only accepted if the decompaction gives back the exact
+ * same 128 bits (in debug mode, we also compare the disassembly of both).
+ */
+
+#include "backend/gen_insn_compact.hpp"
+#include "backend/gen/gen_mesa_disasm.h"
+#include "sys/platform.hpp"
+#include <cstring>
+#include <cstdlib>
+
+namespace gbe
+{
+  /*! Bits 23:8 and 31 (saturate) of the header and 90:89 (flag register) */
+  static const uint32_t controlIndexTable[32] = {
+    0b0000000000000000010,
+    0b0000100000000000000,
+    0b0000100000000000001,
+    0b0000100000000000010,
+    0b0000100000000000011,
+    0b0000100000000000100,
+    0b0000100000000000101,
+    0b0000100000000000111,
+    0b0000100000000001000,
+    0b0000100000000001001,
+    0b0000100000000001101,
+    0b0000110000000000000,
+    0b0000110000000000001,
+    0b0000110000000000010,
+    0b0000110000000000011,
+    0b0000110000000000100,
+    0b0000110000000000101,
+    0b0000110000000000111,
+    0b0000110000000001001,
+    0b0000110000000001101,
+    0b0000110000000010000,
+    0b0000110000100000000,
+    0b0001000000000000000,
+    0b0001000000000000010,
+    0b0001000000000000100,
+    0b0001000000100000000,
+    0b0010110000000000000,
+    0b0010110000000010000,
+    0b0011000000000000000,
+    0b0011000000100000000,
+    0b0101000000000000000,
+    0b0101000000100000000
+  };
+
+  /*! Bits 46:32 (register files and types) and 63:61 (destination region) */
+  static const uint32_t dataTypeTable[32] = {
+    0b001000000000000001,
+    0b001000000000100000,
+    0b001000000000100001,
+    0b001000000001100001,
+    0b001000000010111101,
+    0b001000001011111101,
+    0b001000001110100001,
+    0b001000001110100101,
+    0b001000001110111101,
+    0b001000010000100001,
+    0b001000110000100000,
+    0b001000110000100001,
+    0b001001010010100101,
+    0b001001110010100100,
+    0b001001110010100101,
+    0b001111001110111101,
+    0b001111011110011101,
+    0b001111011110111100,
+    0b001111011110111101,
+    0b001111111110111100,
+    0b000000001000001100,
+    0b001000000000111101,
+    0b001000000010100101,
+    0b001000010000100000,
+    0b001001010010100100,
+    0b001001110010000100,
+    0b001010010100001001,
+    0b001101111110111101,
+    0b001111111110111101,
+    0b001011110110101100,
+    0b001010010100101000,
+    0b001010110100101000
+  };
+
+  /*! Sub-register numbers: bits 52:48 (dst), 68:64 (src0) and 100:96 (src1) */
+  static const uint32_t subRegTable[32] = {
+    0b000000000000000,
+    0b000000000000001,
+    0b000000000001000,
+    0b000000000001111,
+    0b000000000010000,
+    0b000000010000000,
+    0b000000100000000,
+    0b000000110000000,
+    0b000001000000000,
+    0b000001000010000,
+    0b000010100000000,
+    0b001000000000000,
+    0b001000000000001,
+    0b001000010000001,
+    0b001000010000010,
+    0b001000010000011,
+    0b001000010000100,
+    0b001000010000111,
+    0b001000010001000,
+    0b001000010001110,
+    0b001000010001111,
+    0b001000110000000,
+    0b001000111101000,
+    0b010000000000000,
+    0b010000110000000,
+    0b011000000000000,
+    0b011110010000111,
+    0b100000000000000,
+    0b101000000000000,
+    0b110000000000000,
+    0b111000000000000,
+    0b111000000011100
+  };
+
+  /*! Source regions and modifiers: bits 88:77 (src0) and 120:109 (src1) */
+  static const uint32_t srcIndexTable[32] = {
+    0b000000000000,
+    0b000000000010,
+    0b000000010000,
+    0b000000010010,
+    0b000000011000,
+    0b000000100000,
+    0b000000101000,
+    0b000001001000,
+    0b000001010000,
+    0b000001110000,
+    0b000001111000,
+    0b001100000000,
+    0b001100000010,
+    0b001100001000,
+    0b001100010000,
+    0b001100010010,
+    0b001100100000,
+    0b001100101000,
+    0b001100111000,
+    0b001101000000,
+    0b001101000010,
+    0b001101001000,
+    0b001101010000,
+    0b001101100000,
+    0b001101101000,
+    0b001101110000,
+    0b001101110001,
+    0b001101111000,
+    0b010001101000,
+    0b010001101001,
+    0b010001101010,
+    0b010110001000
+  };
+
+  /*! Read the bits [high:low] of the native instruction (same qword) */
+  INLINE uint32_t getBits(const GenInstruction &insn, uint32_t high, uint32_t low) {
+    uint64_t qw[2];
+    GBE_ASSERT(high / 64 == low / 64 && high - low < 32);
+    std::memcpy(qw, &insn, sizeof(qw));
+    const uint64_t mask = (1ull << (high - low + 1)) - 1;
+    return uint32_t((qw[high / 64] >> (low % 64)) & mask);
+  }
+
+  /*! Write the bits [high:low] of the native instruction (same qword) */
+  INLINE void setBits(GenInstruction &insn, uint32_t high, uint32_t low, uint32_t value) {
+    uint64_t qw[2];
+    GBE_ASSERT(high / 64 == low / 64 && high - low < 32);
+    std::memcpy(qw, &insn, sizeof(qw));
+    const uint64_t mask = ((1ull << (high - low + 1)) - 1) << (low % 64);
+    qw[high / 64] = (qw[high / 64] & ~mask) | ((uint64_t(value) << (low % 64)) & mask);
+    std::memcpy(&insn, qw, sizeof(qw));
+  }
+
+  /*! Return the index of the bit pattern in the table or -1 */
+  INLINE int32_t findIndex(const uint32_t *table, uint32_t pattern) {
+    for (int32_t i = 0; i < 32; ++i)
+      if (table[i] == pattern) return i;
+    return -1;
+  }
+
+  /*! Both sources can hold an immediate. The value always sits in bits3 */
+  INLINE bool hasImmediate(const GenInstruction &insn) {
+    return insn.bits1.da1.src0_reg_file == GEN_IMMEDIATE_VALUE ||
+           insn.bits1.da1.src1_reg_file == GEN_IMMEDIATE_VALUE;
+  }
+
+  /*! Instructions we never compact */
+  INLINE bool isCompactable(const GenInstruction &insn) {
+    const uint32_t opcode = insn.header.opcode;
+    // Three sources instructions have their own (unsupported here) format
+    if (opcode == GEN_OPCODE_MAD)
+      return false;
+    // Keep the jump sequences (and the padding) with their 16 bytes slots
+    if (opcode == GEN_OPCODE_NOP)
+      return false;
+    if (opcode >= GEN_OPCODE_JMPI && opcode <= GEN_OPCODE_POP)
+      return false;
+    return insn.header.cmpt_control == 0;
+  }
+
+  /*! The send which ends the thread */
+  INLINE bool isEOT(const GenInstruction &insn) {
+    return (insn.header.opcode == GEN_OPCODE_SEND ||
+            insn.header.opcode == GEN_OPCODE_SENDC) &&
+           insn.bits3.generic_gen5.end_of_thread;
+  }
+
+  /*! "add ip ip imm" generated by GenEncoder::patchJMPI for long jumps */
+  INLINE bool isIPAdd(const GenInstruction &insn) {
+    return insn.header.opcode == GEN_OPCODE_ADD &&
+           insn.bits1.da1.dest_reg_file == GEN_ARCHITECTURE_REGISTER_FILE &&
+           insn.bits1.da1.dest_reg_nr == GEN_ARF_IP;
+  }
+
+#if GBE_DEBUG
+  /*! Disassemble into a string to compare both forms */
+  static std::string disasmToString(const GenInstruction &insn) {
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *file = open_memstream(&buffer, &size);
+    if (file == NULL) return std::string();
+    gen_disasm(file, &insn);
+    fclose(file);
+    const std::string str(buffer, size);
+    free(buffer);
+    return str;
+  }
+#endif /* GBE_DEBUG */
+
+  bool isCompacted(const void *insn) {
+    GenCompactInstruction compact;
+    std::memcpy(&compact, insn, sizeof(compact));
+    return compact.bits1.cmpt_control == 1;
+  }
+
+  void decompactInstruction(const GenCompactInstruction &compact, GenInstruction &insn) {
+    std::memset(&insn, 0, sizeof(GenInstruction));
+    const uint32_t control = controlIndexTable[compact.bits1.control_index];
+    const uint32_t dataType = dataTypeTable[compact.bits1.data_type_index];
+    const uint32_t subReg = subRegTable[compact.bits1.sub_reg_index];
+    const uint32_t src0Index = compact.bits1.src0_index_lo | (compact.bits2.src0_index_hi << 2);
+
+    insn.header.opcode = compact.bits1.opcode;
+    insn.header.debug_control = compact.bits1.debug_control;
+    insn.header.acc_wr_control = compact.bits1.acc_wr_control;
+    insn.header.destreg_or_condmod = compact.bits1.destreg_or_condmod;
+    setBits(insn, 23, 8, control & 0xffff);
+    setBits(insn, 31, 31, (control >> 16) & 0x1);
+    setBits(insn, 90, 89, control >> 17);
+    setBits(insn, 46, 32, dataType & 0x7fff);
+    setBits(insn, 63, 61, dataType >> 15);
+    setBits(insn, 52, 48, subReg & 0x1f);
+    setBits(insn, 68, 64, (subReg >> 5) & 0x1f);
+    setBits(insn, 60, 53, compact.bits2.dest_reg_nr);
+    setBits(insn, 76, 69, compact.bits2.src0_reg_nr);
+    setBits(insn, 88, 77, srcIndexTable[src0Index]);
+
+    // The data types tell us if the last source is an immediate (13 bits
+    // signed value) or a register
+    if (hasImmediate(insn)) {
+      const uint32_t imm = compact.bits2.src1_index | (compact.bits2.src1_reg_nr << 5);
+      insn.bits3.ud = (imm & 0x1000) ? (imm | 0xfffff000) : imm;
+    } else {
+      setBits(insn, 100, 96, subReg >> 10);
+      setBits(insn, 108, 101, compact.bits2.src1_reg_nr);
+      setBits(insn, 120, 109, srcIndexTable[compact.bits2.src1_index]);
+    }
+  }
+
+  bool compactInstruction(const GenInstruction &insn, GenCompactInstruction &compact) {
+    if (isCompactable(insn) == false)
+      return false;
+
+    // Bits the compacted format cannot express must be cleared
+    const bool isImm = hasImmediate(insn);
+    if (getBits(insn, 7, 7) || getBits(insn, 47, 47) || getBits(insn, 95, 91))
+      return false;
+    if (!isImm && getBits(insn, 127, 121))
+      return false;
+
+    // All the indices must be in the tables
+    const uint32_t control = getBits(insn, 23, 8) |
+                             (getBits(insn, 31, 31) << 16) |
+                             (getBits(insn, 90, 89) << 17);
+    const uint32_t dataType = getBits(insn, 46, 32) | (getBits(insn, 63, 61) << 15);
+    uint32_t subReg = getBits(insn, 52, 48) | (getBits(insn, 68, 64) << 5);
+    if (!isImm) subReg |= getBits(insn, 100, 96) << 10;
+    const int32_t controlIndex = findIndex(controlIndexTable, control);
+    const int32_t dataTypeIndex = findIndex(dataTypeTable, dataType);
+    const int32_t subRegIndex = findIndex(subRegTable, subReg);
+    const int32_t src0Index = findIndex(srcIndexTable, getBits(insn, 88, 77));
+    if (controlIndex < 0 || dataTypeIndex < 0 || subRegIndex < 0 || src0Index < 0)
+      return false;
+
+    std::memset(&compact, 0, sizeof(GenCompactInstruction));
+    compact.bits1.opcode = insn.header.opcode;
+    compact.bits1.debug_control = insn.header.debug_control;
+    compact.bits1.control_index = controlIndex;
+    compact.bits1.data_type_index = dataTypeIndex;
+    compact.bits1.sub_reg_index = subRegIndex;
+    compact.bits1.acc_wr_control = insn.header.acc_wr_control;
+    compact.bits1.destreg_or_condmod = insn.header.destreg_or_condmod;
+    compact.bits1.cmpt_control = 1;
+    compact.bits1.src0_index_lo = src0Index & 0x3;
+    compact.bits2.src0_index_hi = src0Index >> 2;
+    compact.bits2.dest_reg_nr = getBits(insn, 60, 53);
+    compact.bits2.src0_reg_nr = getBits(insn, 76, 69);
+    if (isImm) {
+      const uint32_t imm = insn.bits3.ud;
+      if ((imm & 0xfffff000) != 0 && (imm & 0xfffff000) != 0xfffff000)
+        return false;
+      compact.bits2.src1_index = imm & 0x1f;
+      compact.bits2.src1_reg_nr = (imm >> 5) & 0xff;
+    } else {
+      const int32_t src1Index = findIndex(srcIndexTable, getBits(insn, 120, 109));
+      if (src1Index < 0)
+        return false;
+      compact.bits2.src1_index = src1Index;
+      compact.bits2.src1_reg_nr = getBits(insn, 108, 101);
+    }
+
+    // Round trip: the hardware must see exactly what we emitted
+    GenInstruction check;
+    decompactInstruction(compact, check);
+    if (std::memcmp(&check, &insn, sizeof(GenInstruction)) != 0)
+      return false;
+#if GBE_DEBUG
+    GBE_ASSERTM(disasmToString(check) == disasmToString(insn),
+                "Compacted instruction does not disassemble as the original one");
+#endif /* GBE_DEBUG */
+    return true;
+  }
+
+  uint32_t compactInstructionStream(const vector<GenInstruction> &insns,
+                                    vector<GenCompactInstruction> &code,
+                                    vector<uint32_t> &offsets)
+  {
+    const uint32_t insnNum = insns.size();
+    vector<GenCompactInstruction> compacted(insnNum);
+    vector<uint8_t> isCompact(insnNum, 0), isPadded(insnNum, 0);
+    uint32_t compactNum = 0, offset = 0;
+
+    // First pass: compact what we can and compute the new offsets. The
+    // instruction following a JMPI may be the target of the "add ip" long jump
+    // or a skipped instruction so it keeps its size. Like Mesa, we put a
+    // compacted NOP before an EOT send which would not start on a 16 bytes
+    // boundary: the thread may hang otherwise. The jumps to the send skip it
+    offsets.resize(insnNum + 1);
+    for (uint32_t insnID = 0; insnID < insnNum; ++insnID) {
+      const bool afterJump = insnID > 0 &&
+        insns[insnID-1].header.opcode == GEN_OPCODE_JMPI;
+      if (isEOT(insns[insnID]) && offset % 2) {
+        isPadded[insnID] = 1;
+        offset += 1;
+      }
+      offsets[insnID] = offset;
+      if (!afterJump && !isIPAdd(insns[insnID]) &&
+          compactInstruction(insns[insnID], compacted[insnID])) {
+        isCompact[insnID] = 1;
+        compactNum++;
+        offset += 1;
+      } else
+        offset += 2;
+    }
+    offsets[insnNum] = offset;
+
+    // Second pass: emit the code and fix the jump distances. JMPI distances
+    // are in 8 bytes units relative to the next (16 bytes) instruction while
+    // "add ip" offsets are in bytes relative to the instruction itself
+    GenCompactInstruction nop;
+    std::memset(&nop, 0, sizeof(GenCompactInstruction));
+    nop.bits1.opcode = GEN_OPCODE_NOP;
+    nop.bits1.cmpt_control = 1;
+    code.clear();
+    code.reserve(offset + 1);
+    for (uint32_t insnID = 0; insnID < insnNum; ++insnID) {
+      if (isPadded[insnID])
+        code.push_back(nop);
+      if (isCompact[insnID]) {
+        code.push_back(compacted[insnID]);
+        continue;
+      }
+      GenInstruction insn = insns[insnID];
+      if (insn.header.opcode == GEN_OPCODE_JMPI) {
+        GBE_ASSERT(insn.bits1.da1.src1_reg_file == GEN_IMMEDIATE_VALUE);
+        const int32_t targetID = int32_t(insnID) + 1 + insn.bits3.d / 2;
+        GBE_ASSERT(targetID >= 0 && targetID <= int32_t(insnNum));
+        insn.bits3.d = int32_t(offsets[targetID]) - int32_t(offsets[insnID]) - 2;
+      } else if (isIPAdd(insn)) {
+        GBE_ASSERT(insn.bits1.da1.src1_reg_file == GEN_IMMEDIATE_VALUE);
+        const int32_t targetID = int32_t(insnID) + insn.bits3.d / int32_t(sizeof(GenInstruction));
+        GBE_ASSERT(targetID >= 0 && targetID <= int32_t(insnNum));
+        insn.bits3.d = (int32_t(offsets[targetID]) - int32_t(offsets[insnID])) * 8;
+      }
+      GenCompactInstruction halves[2];
+      std::memcpy(halves, &insn, sizeof(GenInstruction));
+      code.push_back(halves[0]);
+      code.push_back(halves[1]);
+    }
+
+    // The kernel size stays a multiple of 16 bytes
+    if (code.size() % 2)
+      code.push_back(nop);
+    return compactNum;
+  }
+
+  uint32_t disasmInstruction(FILE *file, const void *insn) {
+    if (isCompacted(insn)) {
+      GenCompactInstruction compact;
+      GenInstruction native;
+      std::memcpy(&compact, insn, sizeof(GenCompactInstruction));
+      decompactInstruction(compact, native);
+      gen_disasm(file, &native);
+      return sizeof(GenCompactInstruction);
+    } else {
+      gen_disasm(file, insn);
+      return sizeof(GenInstruction);
+    }
+  }
+
+} /* namespace gbe */
+
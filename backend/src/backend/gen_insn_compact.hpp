@@ -0,0 +1,62 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file gen_insn_compact.hpp
+ */
+
+#ifndef __GBE_GEN_INSN_COMPACT_HPP__
+#define __GBE_GEN_INSN_COMPACT_HPP__
+
+#include "backend/gen_defs.hpp"
+#include "sys/vector.hpp"
+#include <cstdio>
+
+namespace gbe
+{
+  /*! Try to compact the instruction. Only succeeds if the decompaction gives
+   *  back the exact same bits (checked)
+   */
+  bool compactInstruction(const GenInstruction &insn, GenCompactInstruction &compact);
+
+  /*! Expand a compacted instruction to its 128 bits form */
+  void decompactInstruction(const GenCompactInstruction &compact, GenInstruction &insn);
+
+  /*! True if the first 64 bits of the given instruction have the compaction
+   *  bit set (i.e. the instruction is 8 bytes long)
+   */
+  bool isCompacted(const void *insn);
+
+  /*! Compact the (already branch patched) instruction stream and fix the jump
+   *  distances. "code" receives the code in 8 bytes units (the total size is
+   *  always a multiple of 16 bytes) and "offsets" the new position in 8 bytes
+   *  units of each input instruction (plus the end of the stream). The EOT
+   *  sends always start on a 16 bytes boundary. Return the number of
+   *  compacted instructions
+   */
+  uint32_t compactInstructionStream(const vector<GenInstruction> &insns,
+                                    vector<GenCompactInstruction> &code,
+                                    vector<uint32_t> &offsets);
+
+  /*! Disassemble one instruction (compacted or not). Return its size in bytes */
+  uint32_t disasmInstruction(FILE *file, const void *insn);
+
+} /* namespace gbe */
+
+#endif /* __GBE_GEN_INSN_COMPACT_HPP__ */
+
@@ -0,0 +1,191 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file gen_insn_dependency.cpp
+ */
+
+/*
+ * Once the native instructions are emitted, we look for sequences of
+ * consecutive instructions writing disjoint parts of the same GRF (64 bits
+ * emulation, payloads built one element at a time, partial writes...). The
+ * hardware scoreboard serializes them while they do not depend on each other.
+ * So, the first instruction of such a chain does not clear the dependency
+ * (NoDDClr), the following ones do not check it (NoDDChk) and the last one is
+ * the only one to clear it.
+ */
+
+#include "backend/gen_insn_peephole.hpp"
+#include <algorithm>
+
+namespace gbe
+{
+  /*! Size in bytes of the elements of the (native) register type */
+  static INLINE uint32_t getNativeTypeSize(uint32_t type) {
+    switch (type) {
+      case GEN_TYPE_UB: case GEN_TYPE_B: return 1;
+      case GEN_TYPE_UW: case GEN_TYPE_W: return 2;
+      case GEN_TYPE_DF: return 8;
+      default: return 4;
+    }
+  }
+
+  /*! Decode the strides of the native encoding (0, 1, 2, 4...) */
+  static INLINE uint32_t getNativeStride(uint32_t stride) {
+    return stride == 0 ? 0 : 1 << (stride - 1);
+  }
+
+  /*! Bytes written by a native instruction as a mask relative to the start
+   *  of its first GRF. Return false if this is not a direct align1 GRF
+   *  destination or if it spans more than two GRFs
+   */
+  static bool getWrittenMask(const GenInstruction &insn, uint32_t &reg, uint64_t &mask) {
+    if (insn.header.access_mode != GEN_ALIGN_1 ||
+        insn.bits1.da1.dest_reg_file != GEN_GENERAL_REGISTER_FILE ||
+        insn.bits1.da1.dest_address_mode != GEN_ADDRESS_DIRECT)
+      return false;
+    const uint32_t elemNum = 1 << insn.header.execution_size;
+    const uint32_t typeSize = getNativeTypeSize(insn.bits1.da1.dest_reg_type);
+    const uint32_t hstride = std::max(getNativeStride(insn.bits1.da1.dest_horiz_stride), 1u);
+    const uint32_t first = insn.bits1.da1.dest_subreg_nr;
+    if (first + ((elemNum - 1) * hstride + 1) * typeSize > 2 * GEN_REG_SIZE)
+      return false;
+    const uint64_t elemMask = (1ull << typeSize) - 1;
+    reg = insn.bits1.da1.dest_reg_nr;
+    mask = 0;
+    for (uint32_t elemID = 0; elemID < elemNum; ++elemID)
+      mask |= elemMask << (first + elemID * hstride * typeSize);
+    return true;
+  }
+
+  /*! Byte range (in the whole GRF file) read by a direct align1 source. Return
+   *  false if we cannot tell (indirect access) and true with an empty range if
+   *  the source does not read any GRF
+   */
+  static bool getReadRange(const GenInstruction &insn, uint32_t srcID, uint32_t &first, uint32_t &last) {
+    first = 1; last = 0;
+    const uint32_t file = srcID == 0 ? insn.bits1.da1.src0_reg_file : insn.bits1.da1.src1_reg_file;
+    if (file != GEN_GENERAL_REGISTER_FILE)
+      return true;
+    // src1 is the immediate for the one source instructions
+    if (srcID == 1 && insn.bits1.da1.src0_reg_file == GEN_IMMEDIATE_VALUE)
+      return true;
+    const uint32_t addressMode = srcID == 0 ? insn.bits2.da1.src0_address_mode : insn.bits3.da1.src1_address_mode;
+    if (addressMode != GEN_ADDRESS_DIRECT)
+      return false;
+    const uint32_t type = srcID == 0 ? insn.bits1.da1.src0_reg_type : insn.bits1.da1.src1_reg_type;
+    const uint32_t nr = srcID == 0 ? insn.bits2.da1.src0_reg_nr : insn.bits3.da1.src1_reg_nr;
+    const uint32_t subnr = srcID == 0 ? insn.bits2.da1.src0_subreg_nr : insn.bits3.da1.src1_subreg_nr;
+    const uint32_t vstrideEnc = srcID == 0 ? insn.bits2.da1.src0_vert_stride : insn.bits3.da1.src1_vert_stride;
+    const uint32_t widthEnc = srcID == 0 ? insn.bits2.da1.src0_width : insn.bits3.da1.src1_width;
+    const uint32_t hstrideEnc = srcID == 0 ? insn.bits2.da1.src0_horiz_stride : insn.bits3.da1.src1_horiz_stride;
+    if (vstrideEnc == GEN_VERTICAL_STRIDE_ONE_DIMENSIONAL)
+      return false;
+    const uint32_t elemNum = 1 << insn.header.execution_size;
+    const uint32_t width = std::min(1u << widthEnc, elemNum);
+    const uint32_t rowNum = elemNum / width;
+    const uint32_t lastElem = (rowNum - 1) * getNativeStride(vstrideEnc) +
+                              (width - 1) * getNativeStride(hstrideEnc);
+    first = nr * GEN_REG_SIZE + subnr;
+    last = first + (lastElem + 1) * getNativeTypeSize(type) - 1;
+    return true;
+  }
+
+  /*! Instructions we may chain with dependency control hints */
+  static INLINE bool isChainable(const GenInstruction &insn) {
+    switch (insn.header.opcode) {
+      case GEN_OPCODE_SEND:
+      case GEN_OPCODE_SENDC:
+      case GEN_OPCODE_MATH:
+      case GEN_OPCODE_MAD:
+      case GEN_OPCODE_NOP:
+      case GEN_OPCODE_JMPI:
+        return false;
+      default: break;
+    }
+    // The hardware does not play well with predicated partial writes and we
+    // leave the explicit hints alone
+    return insn.header.predicate_control == GEN_PREDICATE_NONE &&
+           insn.header.dependency_control == GEN_DEPENDENCY_NORMAL;
+  }
+
+  uint32_t setDependencyControl(vector<GenInstruction> &insns) {
+    const uint32_t insnNum = insns.size();
+
+    // Chains never cross a jump or a jump target. Branches are already
+    // patched so the targets are known
+    vector<uint8_t> isTarget(insnNum + 1, 0);
+    for (uint32_t insnID = 0; insnID < insnNum; ++insnID) {
+      const GenInstruction &insn = insns[insnID];
+      if (insn.bits1.da1.src1_reg_file != GEN_IMMEDIATE_VALUE)
+        continue;
+      int32_t targetID = -1;
+      if (insn.header.opcode == GEN_OPCODE_JMPI)
+        targetID = int32_t(insnID) + 1 + insn.bits3.d / 2;
+      else if (insn.header.opcode == GEN_OPCODE_ADD &&
+               insn.bits1.da1.dest_reg_file == GEN_ARCHITECTURE_REGISTER_FILE &&
+               insn.bits1.da1.dest_reg_nr == GEN_ARF_IP)
+        targetID = int32_t(insnID) + insn.bits3.d / int32_t(sizeof(GenInstruction));
+      if (targetID >= 0 && targetID <= int32_t(insnNum))
+        isTarget[targetID] = 1;
+    }
+
+    // Current chain: first GRF, number of GRFs and bytes already written
+    bool inChain = false;
+    uint32_t chainReg = 0, chainRegNum = 0, hintNum = 0;
+    uint64_t chainMask = 0;
+    for (uint32_t insnID = 0; insnID < insnNum; ++insnID) {
+      const GenInstruction &insn = insns[insnID];
+      uint32_t reg = 0;
+      uint64_t mask = 0;
+      const bool writesGRF = isChainable(insn) && getWrittenMask(insn, reg, mask);
+      if (inChain && writesGRF && !isTarget[insnID] && reg == chainReg) {
+        // The first instruction of the chain checked the dependencies of its
+        // GRFs only. A write reaching the next GRF starts a new chain
+        const uint32_t regNum = mask >> GEN_REG_SIZE ? 2u : 1u;
+        bool extend = (mask & chainMask) == 0 && regNum <= chainRegNum;
+        // The chain only covers writes. Reading the registers in between
+        // needs the scoreboard
+        for (uint32_t srcID = 0; extend && srcID < 2; ++srcID) {
+          uint32_t first, last;
+          if (!getReadRange(insn, srcID, first, last))
+            extend = false;
+          else if (first <= last && first / GEN_REG_SIZE < chainReg + chainRegNum &&
+                   last / GEN_REG_SIZE >= chainReg)
+            extend = false;
+        }
+        if (extend) {
+          chainMask |= mask;
+          insns[insnID-1].header.dependency_control |= GEN_DEPENDENCY_NOTCLEARED;
+          insns[insnID].header.dependency_control = GEN_DEPENDENCY_NOTCHECKED;
+          hintNum++;
+          continue;
+        }
+      }
+
+      // Start a new chain with this instruction if possible
+      inChain = writesGRF;
+      chainReg = reg;
+      chainRegNum = mask >> GEN_REG_SIZE ? 2 : 1;
+      chainMask = mask;
+    }
+    return hintNum;
+  }
+
+} /* namespace gbe */
+
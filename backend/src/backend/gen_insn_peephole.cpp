@@ -0,0 +1,707 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file gen_insn_peephole.cpp
+ */
+
+/*
+ * Overall idea:
+ * =============
+ *
+ * The instruction selection is a simple tree matcher working on one IR
+ * instruction at a time. It therefore leaves a lot of copies behind: loads of
+ * immediates into temporaries, moves coming from the phi lowering, negations
+ * done in a separate move, results computed in a temporary and then copied
+ * into their final destination...
+ *
+ * Once the registers are allocated, we run a small peephole pass on each
+ * selection block. All the transformations are local to the block and only
+ * involve "simple" instructions i.e. instructions the GenContext emits as one
+ * ALU instruction writing nothing but their destination. Everything else
+ * (sends, branches, 64 bits emulation, instructions with temporaries...) is
+ * considered as a barrier.
+ *
+ * We still have the virtual registers in the selection instructions. So, we
+ * use them to decide if a value is a block local temporary (defined once, read
+ * once, not live out) while the register allocation is used to check that the
+ * physical GRFs we extend the lifetime of are not clobbered in between.
+ *
+ * The transformations are:
+ * - copy forwarding: mov t, a ; op d, t  ->  op d, a
+ * - modifier folding: mov t, -a ; op d, t -> op d, -a (same as above)
+ * - mov fusion: op t, x, y ; mov d, t  ->  op d, x, y
+ * - dead writes: op t, x, y with t never read
+ * - redundant compares and flag moves: the register allocator copies GRF
+ *   booleans into f0.1 before each use and back after each compare. We
+ *   remove the copies when the flag and the GRF already hold the same value
+ */
+
+#include "backend/gen_insn_peephole.hpp"
+#include "backend/gen_insn_selection.hpp"
+#include "backend/gen_reg_allocation.hpp"
+#include "sys/cvar.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace gbe
+{
+  /*! Number of physical flag registers we track (f0.0, f0.1, f1.0, f1.1) */
+  static const uint32_t MAX_FLAG_NUM = 4u;
+
+  /*! 64 bits values are split by the encoder so we leave them alone */
+  static INLINE bool is64Bits(const GenRegister &reg) {
+    return reg.type == GEN_TYPE_DF || reg.type == GEN_TYPE_L || reg.type == GEN_TYPE_UL;
+  }
+
+  static INLINE bool isFlag(const GenRegister &reg) {
+    return reg.file == GEN_ARCHITECTURE_REGISTER_FILE && (reg.nr & 0xf0) == GEN_ARF_FLAG;
+  }
+
+  static INLINE bool isVirtualGRF(const GenRegister &reg) {
+    return reg.file == GEN_GENERAL_REGISTER_FILE && reg.physical == 0;
+  }
+
+  static INLINE uint32_t getFlagIndex(const GenRegister &reg) {
+    return 2 * reg.flag_nr() + reg.flag_subnr();
+  }
+
+  static INLINE uint32_t getFlagIndex(const GenInstructionState &state) {
+    return 2 * state.flag + state.subFlag;
+  }
+
+  /*! Operands a simple instruction may use */
+  static INLINE bool isSimpleOperand(const GenRegister &reg) {
+    if (is64Bits(reg) || reg.address_mode != GEN_ADDRESS_DIRECT)
+      return false;
+    if (reg.file == GEN_GENERAL_REGISTER_FILE || reg.file == GEN_IMMEDIATE_VALUE)
+      return true;
+    return GenRegister::isNull(reg) || isFlag(reg);
+  }
+
+  /*! Instructions emitted as one ALU instruction only writing their
+   *  destination (and the flag for compares)
+   */
+  static bool isSimple(const SelectionInstruction &insn) {
+    switch (insn.opcode) {
+      case SEL_OP_MOV:
+      case SEL_OP_NOT:
+      case SEL_OP_FBH:
+      case SEL_OP_FBL:
+      case SEL_OP_RNDZ:
+      case SEL_OP_RNDE:
+      case SEL_OP_RNDD:
+      case SEL_OP_RNDU:
+      case SEL_OP_SEL:
+      case SEL_OP_AND:
+      case SEL_OP_OR:
+      case SEL_OP_XOR:
+      case SEL_OP_SHR:
+      case SEL_OP_SHL:
+      case SEL_OP_ASR:
+      case SEL_OP_ADD:
+      case SEL_OP_MUL:
+      case SEL_OP_MAD:
+      case SEL_OP_CMP:
+      case SEL_OP_SEL_CMP:
+        break;
+      default:
+        return false;
+    }
+    if (insn.state.accWrEnable || insn.state.physicalFlag == 0)
+      return false;
+    for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID)
+      if (isSimpleOperand(insn.dst(dstID)) == false)
+        return false;
+    for (uint32_t srcID = 0; srcID < insn.srcNum; ++srcID)
+      if (isSimpleOperand(insn.src(srcID)) == false)
+        return false;
+    return true;
+  }
+
+  /*! Instructions where source modifiers keep their arithmetic meaning */
+  static bool acceptsModifiers(const SelectionInstruction &insn) {
+    switch (insn.opcode) {
+      case SEL_OP_MOV:
+      case SEL_OP_RNDZ:
+      case SEL_OP_RNDE:
+      case SEL_OP_RNDD:
+      case SEL_OP_RNDU:
+      case SEL_OP_SEL:
+      case SEL_OP_ADD:
+      case SEL_OP_MUL:
+      case SEL_OP_MAD:
+      case SEL_OP_CMP:
+      case SEL_OP_SEL_CMP:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /*! Instructions that can take an immediate in their last source */
+  static bool acceptsImmediate(const SelectionInstruction &insn, uint32_t srcID) {
+    if (insn.opcode == SEL_OP_MOV)
+      return true;
+    if (insn.srcNum != 2 || srcID != 1 || insn.src(0).file == GEN_IMMEDIATE_VALUE)
+      return false;
+    switch (insn.opcode) {
+      case SEL_OP_SEL:
+      case SEL_OP_AND:
+      case SEL_OP_OR:
+      case SEL_OP_XOR:
+      case SEL_OP_SHR:
+      case SEL_OP_SHL:
+      case SEL_OP_ASR:
+      case SEL_OP_ADD:
+      case SEL_OP_MUL:
+      case SEL_OP_CMP:
+      case SEL_OP_SEL_CMP:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /*! Scalar or contiguous region (the encoder may split it in quarters) */
+  static INLINE bool isContiguousRegion(const GenRegister &reg) {
+    if (reg.hstride == GEN_HORIZONTAL_STRIDE_0)
+      return reg.vstride == GEN_VERTICAL_STRIDE_0;
+    const uint32_t vstride = reg.vstride == GEN_VERTICAL_STRIDE_0 ? 0 : 1 << (reg.vstride - 1);
+    return vstride == (1u << reg.width) * stride(reg.hstride);
+  }
+
+  /*! Exact same operand (register, region and modifiers) */
+  static INLINE bool sameOperand(const GenRegister &r0, const GenRegister &r1) {
+    if (r0.file != r1.file || r0.type != r1.type ||
+        r0.negation != r1.negation || r0.absolute != r1.absolute)
+      return false;
+    if (r0.file == GEN_IMMEDIATE_VALUE)
+      return r0.value.ud == r1.value.ud;
+    if (r0.physical != r1.physical || r0.subphysical != r1.subphysical)
+      return false;
+    if (r0.physical == 0 && r0.reg() != r1.reg())
+      return false;
+    return r0.nr == r1.nr && r0.subnr == r1.subnr &&
+           r0.vstride == r1.vstride && r0.width == r1.width &&
+           r0.hstride == r1.hstride && r0.quarter == r1.quarter &&
+           r0.address_mode == r1.address_mode;
+  }
+
+  /*! Both instructions run on the same channels */
+  static INLINE bool sameState(const GenInstructionState &s0, const GenInstructionState &s1) {
+    return s0.physicalFlag == s1.physicalFlag &&
+           s0.flag == s1.flag &&
+           s0.subFlag == s1.subFlag &&
+           s0.execWidth == s1.execWidth &&
+           s0.quarterControl == s1.quarterControl &&
+           s0.nibControl == s1.nibControl &&
+           s0.accWrEnable == s1.accWrEnable &&
+           s0.noMask == s1.noMask &&
+           s0.predicate == s1.predicate &&
+           s0.inversePredicate == s1.inversePredicate;
+  }
+
+  /*! Conservative range of GRFs touched by a physical operand */
+  static bool getGRFRange(const GenRegister &reg, uint32_t execWidth, bool isDst,
+                          uint32_t &first, uint32_t &last)
+  {
+    if (reg.file != GEN_GENERAL_REGISTER_FILE)
+      return false;
+    uint32_t elemNum;
+    if (isDst) {
+      const uint32_t hstride = std::max(stride(reg.hstride), 1u);
+      elemNum = (execWidth - 1) * hstride + 1;
+    } else {
+      const uint32_t width = 1 << reg.width;
+      const uint32_t vstride = reg.vstride == GEN_VERTICAL_STRIDE_0 ? 0 : 1 << (reg.vstride - 1);
+      const uint32_t hstride = stride(reg.hstride);
+      const uint32_t rows = execWidth > width ? execWidth / width : 1;
+      const uint32_t cols = std::min(execWidth, width);
+      elemNum = (rows - 1) * vstride + (cols - 1) * hstride + 1;
+    }
+    const uint32_t start = reg.nr * GEN_REG_SIZE + reg.subnr;
+    first = start / GEN_REG_SIZE;
+    last = (start + elemNum * typeSize(reg.type) - 1) / GEN_REG_SIZE;
+    return true;
+  }
+
+  /*! Per kernel statistics */
+  struct PeepholeStats
+  {
+    INLINE PeepholeStats(void) :
+      forwarded(0), folded(0), fused(0), dead(0), cmp(0), flag(0) {}
+    uint32_t forwarded; //!< Copies forwarded into their only reader
+    uint32_t folded;    //!< Copies with a source modifier folded in the reader
+    uint32_t fused;     //!< Moves merged into the instruction computing the value
+    uint32_t dead;      //!< Instructions writing a value never read
+    uint32_t cmp;       //!< Compares recomputing the flag they already set
+    uint32_t flag;      //!< Moves between a flag and a GRF already equal
+  };
+
+  /*! Runs the peephole optimizations block per block */
+  struct SelectionPeephole : public NonCopyable
+  {
+    SelectionPeephole(GenContext &ctx, Selection &selection);
+    /*! Transform the block in one scan */
+    void optimize(SelectionBlock &bb);
+    /*! Count the definitions and uses of the virtual registers of the block */
+    void countUses(SelectionBlock &bb);
+    /*! Try the rewrites on one instruction. Return true if the block changed */
+    bool rewrite(SelectionBlock &bb, SelectionInstruction &insn);
+    /*! Rewrite again the definitions of the values which lost a reader */
+    void revisit(SelectionBlock &bb);
+    /*! Unlink the instruction and update the counts and the scan position */
+    void remove(SelectionInstruction &insn);
+    /*! Virtual register only living inside the block */
+    bool isLocalTemporary(const SelectionBlock &bb, const GenRegister &reg) const;
+    /*! Does the instruction write (or read) a GRF used by the physical reg? */
+    bool touches(const SelectionInstruction &insn, const GenRegister &reg,
+                 uint32_t execWidth, bool isDst, bool withSources) const;
+    /*! mov t, a ; op d, t  ->  op d, a */
+    bool forwardCopy(SelectionBlock &bb, SelectionInstruction &mov);
+    /*! op t, x, y ; mov d, t  ->  op d, x, y */
+    bool fuseMov(SelectionBlock &bb, SelectionInstruction &op);
+    /*! Remove a simple instruction whose destination is never read */
+    bool removeDeadWrite(SelectionBlock &bb, SelectionInstruction &insn);
+    /*! Remove compares and flag moves recomputing a known value */
+    bool removeRedundantFlagWrites(SelectionBlock &bb);
+    /*! Get the allocated register */
+    INLINE GenRegister physical(const GenRegister &reg) const {
+      return ctx.ra->genReg(reg);
+    }
+    /*! Handle complete compilation */
+    GenContext &ctx;
+    /*! Code to transform */
+    Selection &selection;
+    /*! Number of definitions of each virtual register in the current block */
+    vector<uint32_t> defNum;
+    /*! Number of uses of each virtual register in the current block */
+    vector<uint32_t> useNum;
+    /*! Last definition of each virtual register in the current block */
+    vector<SelectionInstruction*> defInsn;
+    /*! Registers which lost a reader since the last revisit */
+    vector<ir::Register> lostUse;
+    /*! Instruction the scan of the block continues with */
+    SelectionInstruction *next;
+    /*! What we did */
+    PeepholeStats stats;
+  };
+
+  SelectionPeephole::SelectionPeephole(GenContext &ctx, Selection &selection) :
+    ctx(ctx), selection(selection), next(NULL)
+  {
+    const uint32_t regNum = selection.getRegNum();
+    defNum.resize(regNum);
+    useNum.resize(regNum);
+    defInsn.resize(regNum);
+  }
+
+  void SelectionPeephole::countUses(SelectionBlock &bb) {
+    for (auto &insn : bb.insnList) {
+      for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID)
+        if (isVirtualGRF(insn.dst(dstID)))
+          defNum[insn.dst(dstID).reg()] = useNum[insn.dst(dstID).reg()] = 0;
+      for (uint32_t srcID = 0; srcID < insn.srcNum; ++srcID)
+        if (isVirtualGRF(insn.src(srcID)))
+          defNum[insn.src(srcID).reg()] = useNum[insn.src(srcID).reg()] = 0;
+    }
+    for (auto &insn : bb.insnList) {
+      for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID)
+        if (isVirtualGRF(insn.dst(dstID))) {
+          defNum[insn.dst(dstID).reg()]++;
+          defInsn[insn.dst(dstID).reg()] = &insn;
+        }
+      for (uint32_t srcID = 0; srcID < insn.srcNum; ++srcID)
+        if (isVirtualGRF(insn.src(srcID)))
+          useNum[insn.src(srcID).reg()]++;
+    }
+  }
+
+  void SelectionPeephole::remove(SelectionInstruction &insn) {
+    if (&insn == next) {
+      intrusive_list<SelectionInstruction>::iterator it(&insn);
+      ++it;
+      next = it == insn.parent->insnList.end() ? NULL : &*it;
+    }
+    for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID)
+      if (isVirtualGRF(insn.dst(dstID))) {
+        const ir::Register reg = insn.dst(dstID).reg();
+        defNum[reg]--;
+        if (defInsn[reg] == &insn)
+          defInsn[reg] = NULL;
+      }
+    for (uint32_t srcID = 0; srcID < insn.srcNum; ++srcID)
+      if (isVirtualGRF(insn.src(srcID))) {
+        const ir::Register reg = insn.src(srcID).reg();
+        if (--useNum[reg] <= 1)
+          lostUse.push_back(reg);
+      }
+    intrusive_list<SelectionInstruction>::remove(&insn);
+  }
+
+  bool SelectionPeephole::isLocalTemporary(const SelectionBlock &bb, const GenRegister &reg) const {
+    if (isVirtualGRF(reg) == false)
+      return false;
+    const ir::Register vreg = reg.reg();
+    if (ctx.isSpecialReg(vreg) || selection.getRegisterFamily(vreg) == ir::FAMILY_BOOL)
+      return false;
+    if (ctx.getLiveOut(bb.bb).contains(vreg) || ctx.getExtraLiveOut(bb.bb).contains(vreg))
+      return false;
+    return true;
+  }
+
+  bool SelectionPeephole::touches(const SelectionInstruction &insn,
+                                  const GenRegister &reg,
+                                  uint32_t execWidth,
+                                  bool isDst,
+                                  bool withSources) const
+  {
+    uint32_t first, last;
+    if (getGRFRange(reg, execWidth, isDst, first, last) == false)
+      return false;
+    const uint32_t insnWidth = insn.state.execWidth;
+    for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID) {
+      uint32_t dstFirst, dstLast;
+      if (getGRFRange(physical(insn.dst(dstID)), insnWidth, true, dstFirst, dstLast))
+        if (dstFirst <= last && first <= dstLast)
+          return true;
+    }
+    if (withSources == false)
+      return false;
+    for (uint32_t srcID = 0; srcID < insn.srcNum; ++srcID) {
+      uint32_t srcFirst, srcLast;
+      if (getGRFRange(physical(insn.src(srcID)), insnWidth, false, srcFirst, srcLast))
+        if (srcFirst <= last && first <= srcLast)
+          return true;
+    }
+    return false;
+  }
+
+  bool SelectionPeephole::forwardCopy(SelectionBlock &bb, SelectionInstruction &mov) {
+    if (mov.opcode != SEL_OP_MOV || mov.state.saturate || isSimple(mov) == false)
+      return false;
+    const GenRegister t = mov.dst(0);
+    const GenRegister a = mov.src(0);
+    if (isLocalTemporary(bb, t) == false || t.type != a.type)
+      return false;
+    if (defNum[t.reg()] != 1 || useNum[t.reg()] != 1)
+      return false;
+    if (a.file == GEN_GENERAL_REGISTER_FILE) {
+      if (isContiguousRegion(a) == false)
+        return false;
+      if (a.physical == 0 &&
+          (a.reg() == t.reg() || selection.getRegisterFamily(a.reg()) == ir::FAMILY_BOOL))
+        return false;
+    } else if (a.file != GEN_IMMEDIATE_VALUE)
+      return false;
+
+    // Look for the only reader of t. The source must not be overwritten before
+    const GenRegister aPhysical = physical(a);
+    intrusive_list<SelectionInstruction>::iterator it(&mov);
+    for (++it; it != bb.insnList.end(); ++it) {
+      SelectionInstruction &insn = *it;
+      if (isSimple(insn) == false)
+        return false;
+      uint32_t srcID = 0;
+      for (; srcID < insn.srcNum; ++srcID)
+        if (isVirtualGRF(insn.src(srcID)) && insn.src(srcID).reg() == t.reg())
+          break;
+      if (srcID != insn.srcNum) {
+        const GenRegister use = insn.src(srcID);
+        if (sameState(mov.state, insn.state) == false)
+          return false;
+        GenRegister withoutModifiers = use;
+        withoutModifiers.negation = withoutModifiers.absolute = 0;
+        if (sameOperand(withoutModifiers, t) == false)
+          return false;
+        const bool hasModifiers = a.negation || a.absolute || use.negation || use.absolute;
+        if (hasModifiers && acceptsModifiers(insn) == false)
+          return false;
+        if (a.file == GEN_IMMEDIATE_VALUE) {
+          if (use.negation || use.absolute || acceptsImmediate(insn, srcID) == false)
+            return false;
+          if (a.type == GEN_TYPE_VF)
+            return false;
+        }
+        // 3 sources instructions only encode plain float GRF regions
+        if (insn.opcode == SEL_OP_MAD &&
+            (a.type != GEN_TYPE_F || a.file != GEN_GENERAL_REGISTER_FILE ||
+             a.hstride == GEN_HORIZONTAL_STRIDE_2 || a.hstride == GEN_HORIZONTAL_STRIDE_4))
+          return false;
+
+        GenRegister src = a;
+        if (a.file != GEN_IMMEDIATE_VALUE) {
+          if (use.absolute) {
+            src.absolute = 1;
+            src.negation = use.negation;
+          } else
+            src.negation = a.negation ^ use.negation;
+        }
+        insn.src(srcID) = src;
+        if (isVirtualGRF(a))
+          useNum[a.reg()]++;
+        useNum[t.reg()]--;
+        this->remove(mov);
+        if (a.negation || a.absolute)
+          stats.folded++;
+        else
+          stats.forwarded++;
+        return true;
+      }
+      if (a.file == GEN_GENERAL_REGISTER_FILE && touches(insn, aPhysical, mov.state.execWidth, false, false))
+        return false;
+    }
+    return false;
+  }
+
+  bool SelectionPeephole::fuseMov(SelectionBlock &bb, SelectionInstruction &op) {
+    if (op.opcode == SEL_OP_CMP || op.dstNum != 1 || isSimple(op) == false)
+      return false;
+    const GenRegister t = op.dst(0);
+    if (isLocalTemporary(bb, t) == false)
+      return false;
+    if (defNum[t.reg()] != 1 || useNum[t.reg()] != 1)
+      return false;
+
+    // Find the move reading t. Nothing in between may change the flags
+    intrusive_list<SelectionInstruction>::iterator it(&op);
+    SelectionInstruction *mov = NULL;
+    for (++it; it != bb.insnList.end(); ++it) {
+      SelectionInstruction &insn = *it;
+      if (isSimple(insn) == false)
+        return false;
+      uint32_t srcID = 0;
+      for (; srcID < insn.srcNum; ++srcID)
+        if (isVirtualGRF(insn.src(srcID)) && insn.src(srcID).reg() == t.reg())
+          break;
+      if (srcID != insn.srcNum) {
+        mov = &insn;
+        break;
+      }
+      if (insn.opcode == SEL_OP_CMP)
+        return false;
+      for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID)
+        if (isFlag(insn.dst(dstID)))
+          return false;
+    }
+    if (mov == NULL || mov->opcode != SEL_OP_MOV)
+      return false;
+    const GenRegister d = mov->dst(0);
+    if (sameOperand(mov->src(0), t) == false || sameState(op.state, mov->state) == false)
+      return false;
+    if (d.file != GEN_GENERAL_REGISTER_FILE || d.type != t.type)
+      return false;
+    if (isVirtualGRF(d) && selection.getRegisterFamily(d.reg()) == ir::FAMILY_BOOL)
+      return false;
+    // Integer saturation of the operation is not the saturation of the copy
+    if (mov->state.saturate && t.type != GEN_TYPE_F)
+      return false;
+    const GenRegister dPhysical = physical(d);
+    if (op.opcode == SEL_OP_MAD &&
+        (d.hstride != GEN_HORIZONTAL_STRIDE_1 || dPhysical.subnr % 16 != 0))
+      return false;
+
+    // The final destination is now written earlier
+    it = intrusive_list<SelectionInstruction>::iterator(&op);
+    for (++it; &*it != mov; ++it)
+      if (touches(*it, dPhysical, mov->state.execWidth, true, true))
+        return false;
+
+    op.dst(0) = d;
+    if (mov->state.saturate)
+      op.state.saturate = GEN_MATH_SATURATE_SATURATE;
+    defNum[t.reg()]--;
+    defInsn[t.reg()] = NULL;
+    if (isVirtualGRF(d)) {
+      defNum[d.reg()]++;
+      defInsn[d.reg()] = &op;
+    }
+    this->remove(*mov);
+    stats.fused++;
+    return true;
+  }
+
+  bool SelectionPeephole::removeDeadWrite(SelectionBlock &bb, SelectionInstruction &insn) {
+    if (insn.opcode == SEL_OP_CMP || insn.dstNum != 1 || isSimple(insn) == false)
+      return false;
+    const GenRegister dst = insn.dst(0);
+    if (isLocalTemporary(bb, dst) == false || useNum[dst.reg()] != 0)
+      return false;
+    this->remove(insn);
+    stats.dead++;
+    return true;
+  }
+
+  bool SelectionPeephole::removeRedundantFlagWrites(SelectionBlock &bb) {
+    // GRF known to hold the same value as each flag
+    GenRegister known[MAX_FLAG_NUM];
+    bool isKnown[MAX_FLAG_NUM] = {false};
+    // Last unpredicated compare that computed each flag
+    const SelectionInstruction *lastCmp[MAX_FLAG_NUM] = {NULL};
+    vector<SelectionInstruction*> toRemove;
+
+    for (auto &insn : bb.insnList) {
+      if (isSimple(insn) == false) {
+        for (uint32_t flagID = 0; flagID < MAX_FLAG_NUM; ++flagID) {
+          isKnown[flagID] = false;
+          lastCmp[flagID] = NULL;
+        }
+        continue;
+      }
+
+      // Unpredicated compare with the same sources as the previous one
+      if (insn.opcode == SEL_OP_CMP) {
+        const uint32_t flagID = getFlagIndex(insn.state);
+        const SelectionInstruction *prev = lastCmp[flagID];
+        if (prev != NULL &&
+            insn.extra.function == prev->extra.function &&
+            sameState(insn.state, prev->state) &&
+            sameOperand(physical(insn.src(0)), physical(prev->src(0))) &&
+            sameOperand(physical(insn.src(1)), physical(prev->src(1)))) {
+          toRemove.push_back(&insn);
+          stats.cmp++;
+          continue;
+        }
+        isKnown[flagID] = false;
+        lastCmp[flagID] = insn.state.predicate == GEN_PREDICATE_NONE ? &insn : NULL;
+        continue;
+      }
+
+      // Copies between the flags and the GRFs
+      const bool isFlagCopy = insn.opcode == SEL_OP_MOV &&
+                              insn.state.execWidth == 1 &&
+                              insn.state.predicate == GEN_PREDICATE_NONE &&
+                              insn.src(0).negation == 0 && insn.src(0).absolute == 0 &&
+                              (isFlag(insn.dst(0)) != isFlag(insn.src(0)));
+      const bool toFlag = isFlagCopy && isFlag(insn.dst(0));
+      const GenRegister flag = toFlag ? insn.dst(0) : insn.src(0);
+      const GenRegister grf = physical(toFlag ? insn.src(0) : insn.dst(0));
+      const bool isTracked = isFlagCopy &&
+                             grf.file == GEN_GENERAL_REGISTER_FILE &&
+                             grf.type == flag.type;
+      if (isTracked) {
+        const uint32_t flagID = getFlagIndex(flag);
+        if (isKnown[flagID] && sameOperand(known[flagID], grf)) {
+          toRemove.push_back(&insn);
+          stats.flag++;
+          continue;
+        }
+      }
+
+      // Invalidate what the instruction writes
+      for (uint32_t dstID = 0; dstID < insn.dstNum; ++dstID)
+        if (isFlag(insn.dst(dstID))) {
+          const uint32_t flagID = getFlagIndex(insn.dst(dstID));
+          isKnown[flagID] = false;
+          lastCmp[flagID] = NULL;
+        }
+      for (uint32_t flagID = 0; flagID < MAX_FLAG_NUM; ++flagID) {
+        if (isKnown[flagID] && touches(insn, known[flagID], 1, false, false))
+          isKnown[flagID] = false;
+        const SelectionInstruction *cmp = lastCmp[flagID];
+        if (cmp != NULL) {
+          const uint32_t cmpWidth = cmp->state.execWidth;
+          if (touches(insn, physical(cmp->src(0)), cmpWidth, false, false) ||
+              touches(insn, physical(cmp->src(1)), cmpWidth, false, false))
+            lastCmp[flagID] = NULL;
+        }
+      }
+
+      // The flag and the GRF now hold the same value
+      if (isTracked) {
+        const uint32_t flagID = getFlagIndex(flag);
+        known[flagID] = grf;
+        isKnown[flagID] = true;
+      }
+    }
+
+    for (auto insn : toRemove)
+      intrusive_list<SelectionInstruction>::remove(insn);
+    return toRemove.size() != 0;
+  }
+
+  bool SelectionPeephole::rewrite(SelectionBlock &bb, SelectionInstruction &insn) {
+    return this->removeDeadWrite(bb, insn) ||
+           this->forwardCopy(bb, insn) ||
+           this->fuseMov(bb, insn);
+  }
+
+  void SelectionPeephole::revisit(SelectionBlock &bb) {
+    while (lostUse.size() != 0) {
+      const ir::Register reg = lostUse.back();
+      lostUse.pop_back();
+      SelectionInstruction *def = defInsn[reg];
+      while (def != NULL && def->in_list() && this->rewrite(bb, *def)) {}
+    }
+  }
+
+  void SelectionPeephole::optimize(SelectionBlock &bb) {
+    if (bb.insnList.empty())
+      return;
+    this->countUses(bb);
+    lostUse.clear();
+
+    // A rewrite only takes readers away from the earlier instructions. So the
+    // scan goes on from the rewritten instruction and only the definitions
+    // of the values which lost a reader are looked at again
+    SelectionInstruction *insn = &*bb.insnList.begin();
+    while (insn != NULL) {
+      intrusive_list<SelectionInstruction>::iterator it(insn);
+      ++it;
+      next = it == bb.insnList.end() ? NULL : &*it;
+      if (this->rewrite(bb, *insn)) {
+        this->revisit(bb);
+        if (insn->in_list())
+          continue;
+      }
+      insn = next;
+    }
+    this->removeRedundantFlagWrites(bb);
+  }
+
+  BVAR(OCL_POST_ALLOC_PEEPHOLE, true);
+  BVAR(OCL_OUTPUT_PEEPHOLE, false);
+
+  uint32_t peepholePostRegAllocation(GenContext &ctx, Selection &selection) {
+    if (OCL_POST_ALLOC_PEEPHOLE == false)
+      return 0;
+    SelectionPeephole peephole(ctx, selection);
+    uint32_t insnNum = 0, removedNum = 0;
+    for (auto &bb : *selection.blockList) {
+      const uint32_t before = bb.insnList.size();
+      peephole.optimize(bb);
+      insnNum += before;
+      removedNum += before - bb.insnList.size();
+    }
+    if (OCL_OUTPUT_PEEPHOLE) {
+      const PeepholeStats &stats = peephole.stats;
+      std::cout << ctx.getFunction().getName() << "'s peephole: "
+                << insnNum << " -> " << insnNum - removedNum << " instructions ("
+                << stats.forwarded << " copies forwarded, "
+                << stats.folded << " modifiers folded, "
+                << stats.fused << " moves fused, "
+                << stats.dead << " dead writes, "
+                << stats.cmp << " compares, "
+                << stats.flag << " flag moves removed)" << std::endl;
+    }
+    return removedNum;
+  }
+
+} /* namespace gbe */
+
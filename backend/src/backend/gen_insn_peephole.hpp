@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file gen_insn_peephole.hpp
+ */
+
+#ifndef __GBE_GEN_INSN_PEEPHOLE_HPP__
+#define __GBE_GEN_INSN_PEEPHOLE_HPP__
+
+#include "backend/gen_defs.hpp"
+#include "sys/platform.hpp"
+#include "sys/vector.hpp"
+
+namespace gbe
+{
+  class Selection;  // Pre ISA code
+  class GenContext; // Handle compilation for Gen
+
+  /*! Local cleanups on the allocated selection blocks (copy forwarding, dead
+   *  writes, modifier folding, mov fusion and redundant flag moves). Return the
+   *  number of removed selection instructions
+   */
+  uint32_t peepholePostRegAllocation(GenContext &ctx, Selection &selection);
+
+  /*! Set the NoDDClr / NoDDChk dependency control bits on the sequences of
+   *  native instructions writing disjoint parts of the same GRF. Branches must
+   *  be patched. Return the number of instructions not checking dependencies
+   */
+  uint32_t setDependencyControl(vector<GenInstruction> &insns);
+
+} /* namespace gbe */
+
+#endif /* __GBE_GEN_INSN_PEEPHOLE_HPP__ */
+
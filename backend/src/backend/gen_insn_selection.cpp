@@ -504,8 +504,8 @@ namespace gbe
     void CMP(uint32_t conditional, Reg src0, Reg src1);
     /*! Select instruction with embedded comparison */
     void SEL_CMP(uint32_t conditional, Reg dst, Reg src0, Reg src1);
-    /* Constant buffer move instruction */
-    void INDIRECT_MOVE(Reg dst, Reg src);
+    /*! Read the element index of the (contiguous) array of registers */
+    void INDIRECT_MOVE(Reg dst, Reg index, const GenRegister *elem, uint32_t elemNum);
     /*! EOT is used to finish GPGPU threads */
     void EOT(void);
     /*! No-op */
@@ -934,10 +934,18 @@ namespace gbe
     insn->src(1) = src1;
     insn->extra.function = conditional;
   }
-  void Selection::Opaque::INDIRECT_MOVE(Reg dst, Reg src) {
-    SelectionInstruction *insn = this->appendInsn(SEL_OP_INDIRECT_MOVE, 1, 1);
+  void Selection::Opaque::INDIRECT_MOVE(Reg dst, Reg index, const GenRegister *elem, uint32_t elemNum) {
+    SelectionInstruction *insn = this->appendInsn(SEL_OP_INDIRECT_MOVE, 1, elemNum + 1);
+    SelectionVector *vector = this->appendVector();
     insn->dst(0) = dst;
-    insn->src(0) = src;
+    insn->src(0) = index;
+    for (uint32_t elemID = 0; elemID < elemNum; ++elemID)
+      insn->src(elemID + 1) = elem[elemID];
+
+    // The elements are addressed from the first one
+    vector->regNum = elemNum;
+    vector->isSrc = 1;
+    vector->reg = &insn->src(1);
   }
 
   void Selection::Opaque::ATOMIC(Reg dst, uint32_t function,
@@ -2161,7 +2169,10 @@ namespace gbe
           reg == ir::ocl::lid2 ||
           reg == ir::ocl::lsize0 ||
           reg == ir::ocl::lsize1||
-          reg == ir::ocl::lsize2)
+          reg == ir::ocl::lsize2 ||
+          reg == ir::ocl::enqlsize0 ||
+          reg == ir::ocl::enqlsize1 ||
+          reg == ir::ocl::enqlsize2)
         return true;
       else
         return false;
@@ -2249,6 +2260,25 @@ namespace gbe
   }
 #undef DECL_NOT_IMPLEMENTED_ONE_TO_MANY
 
+  /*! Indirect move pattern (private arrays kept in registers) */
+  DECL_PATTERN(IndirectMovInstruction)
+  {
+    INLINE bool emitOne(Selection::Opaque &sel, const ir::IndirectMovInstruction &insn) const
+    {
+      using namespace ir;
+      const Type type = insn.getType();
+      const uint32_t elemNum = insn.getElemNum();
+      const GenRegister dst = sel.selReg(insn.getDst(0), type);
+      const GenRegister index = sel.selReg(insn.getIndex(), TYPE_U32);
+      vector<GenRegister> elem(elemNum);
+      for (uint32_t elemID = 0; elemID < elemNum; ++elemID)
+        elem[elemID] = sel.selReg(insn.getElem(elemID), type);
+      sel.INDIRECT_MOVE(dst, index, elem.data(), elemNum);
+      return true;
+    }
+    DECL_CTOR(IndirectMovInstruction, 1, 1);
+  };
+
   /*! Load immediate pattern */
   DECL_PATTERN(LoadImmInstruction)
   {
@@ -2441,18 +2471,6 @@ namespace gbe
         sel.MOV(GenRegister::retype(value, GEN_TYPE_UB), GenRegister::unpacked_ub(dst));
     }
 
-    void emitIndirectMove(Selection::Opaque &sel,
-                         const ir::LoadInstruction &insn,
-                         GenRegister address) const
-    {
-      using namespace ir;
-      GBE_ASSERT(insn.getValueNum() == 1);   //todo: handle vec later
-
-      const GenRegister dst = sel.selReg(insn.getValue(0), insn.getValueType());
-      const GenRegister src = address;
-      sel.INDIRECT_MOVE(dst, src);
-    }
-
     INLINE bool emitOne(Selection::Opaque &sel, const ir::LoadInstruction &insn) const {
       using namespace ir;
       const GenRegister address = sel.selReg(insn.getAddress());
@@ -3317,6 +3335,7 @@ namespace gbe
     this->insert<SampleInstructionPattern>();
     this->insert<GetImageInfoInstructionPattern>();
     this->insert<GetSamplerInfoInstructionPattern>();
+    this->insert<IndirectMovInstructionPattern>();
 
     // Sort all the patterns with the number of instructions they output
     for (uint32_t op = 0; op < ir::OP_INVALID; ++op)
@@ -27,6 +27,7 @@
 #include "backend/gen_program.hpp"
 #include "backend/gen_context.hpp"
 #include "backend/gen_defs.hpp"
+#include "backend/gen_insn_compact.hpp"
 #include "backend/gen/gen_mesa_disasm.h"
 #include "backend/gen_reg_allocation.hpp"
 #include "ir/unit.hpp"
@@ -58,8 +59,10 @@ namespace gbe {
     char *buf = new char[4096];
     setbuffer(f, buf, 4096);
 
-    for (uint32_t i = 0; i < insnNum; i++) {
-      gen_disasm(f, insns+i);
+    // Compacted instructions are only 8 bytes long
+    const char *code = (const char *) insns;
+    for (size_t offset = 0; offset < getCodeSize();) {
+      offset += disasmInstruction(f, code + offset);
       outs << buf;
       fflush(f);
       setbuffer(f, NULL, 0);
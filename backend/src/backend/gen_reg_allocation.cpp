@@ -553,7 +553,9 @@ namespace gbe
         const uint32_t grfOffset = allocateReg(interval, size, alignment);
         if(grfOffset == 0) {
           GBE_ASSERT(!(reservedReg && family != ir::FAMILY_DWORD));
-          GBE_ASSERT(vector->regNum < RESERVED_REG_NUM_FOR_SPILL);
+          // Large vectors (like register arrays) cannot be filled back
+          if (vector->regNum >= RESERVED_REG_NUM_FOR_SPILL)
+            return false;
           for(int i = vector->regNum-1; i >= 0; i--) {
             if (!spillReg(vector->reg[i].reg()))
               return false;
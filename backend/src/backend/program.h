@@ -80,6 +80,9 @@ enum gbe_curbe_type {
   GBE_CURBE_EMASK,
   GBE_CURBE_NOT_EMASK,
   GBE_CURBE_BARRIER_MASK,
+  GBE_CURBE_ENQUEUED_LOCAL_SIZE_X,
+  GBE_CURBE_ENQUEUED_LOCAL_SIZE_Y,
+  GBE_CURBE_ENQUEUED_LOCAL_SIZE_Z,
 };
 
 /*! Extra arguments use the negative range of sub-values */
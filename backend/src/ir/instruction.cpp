@@ -485,6 +485,30 @@ namespace ir {
       Register dst[0];        //!< No destination
     };
 
+    class ALIGNED_INSTRUCTION IndirectMovInstruction :
+      public BasePolicy,
+      public NDstPolicy<IndirectMovInstruction, 1>,
+      public TupleSrcPolicy<IndirectMovInstruction>
+    {
+    public:
+      IndirectMovInstruction(Type type, Register dst, Tuple src, uint32_t elemNum) {
+        GBE_ASSERT(elemNum + 1u <= Instruction::MAX_SRC_NUM);
+        this->opcode = OP_INDIRECT_MOV;
+        this->type = type;
+        this->dst[0] = dst;
+        this->src = src;
+        this->srcNum = elemNum + 1u;
+      }
+      INLINE Type getType(void) const { return this->type; }
+      INLINE uint32_t getElemNum(void) const { return this->srcNum - 1u; }
+      INLINE bool wellFormed(const Function &fn, std::string &whyNot) const;
+      INLINE void out(std::ostream &out, const Function &fn) const;
+      Type type;       //!< Type of the elements
+      Register dst[1]; //!< Element read
+      Tuple src;       //!< Index and array elements
+      uint8_t srcNum;  //!< Number of elements + 1
+    };
+
     class ALIGNED_INSTRUCTION SampleInstruction : // TODO
       public BasePolicy,
       public TupleSrcPolicy<SampleInstruction>,
@@ -1000,6 +1024,32 @@ namespace ir {
       return wellFormedLoadStore(*this, fn, whyNot);
     }
 
+    INLINE bool IndirectMovInstruction::wellFormed(const Function &fn, std::string &whyNot) const
+    {
+      const RegisterFamily family = getFamily(this->type);
+      if (UNLIKELY(checkSpecialRegForWrite(dst[0], fn, whyNot) == false))
+        return false;
+      if (UNLIKELY(checkRegisterData(family, dst[0], fn, whyNot) == false))
+        return false;
+      if (UNLIKELY(src + srcNum > fn.tupleNum())) {
+        whyNot = "Out-of-bound index for indirect move";
+        return false;
+      }
+      const Register index = fn.getRegister(src, 0);
+      if (UNLIKELY(checkRegisterData(FAMILY_DWORD, index, fn, whyNot) == false))
+        return false;
+      for (uint32_t srcID = 1; srcID < srcNum; ++srcID) {
+        const Register regID = fn.getRegister(src, srcID);
+        if (UNLIKELY(checkRegisterData(family, regID, fn, whyNot) == false))
+          return false;
+      }
+      if (UNLIKELY(getFamilySize(family) != 4)) {
+        whyNot = "Only dword elements are supported by indirect move";
+        return false;
+      }
+      return true;
+    }
+
     // TODO
     INLINE bool SampleInstruction::wellFormed(const Function &fn, std::string &why) const
     { return true; }
@@ -1157,6 +1207,15 @@ namespace ir {
       out << "}";
     }
 
+    INLINE void IndirectMovInstruction::out(std::ostream &out, const Function &fn) const {
+      this->outOpcode(out);
+      out << "." << type << " %" << this->getDst(fn, 0)
+          << " %" << this->getSrc(fn, 0) << " {";
+      for (uint32_t i = 1; i < srcNum; ++i)
+        out << "%" << this->getSrc(fn, i) << (i != (srcNum-1u) ? " " : "");
+      out << "}";
+    }
+
     INLINE void LabelInstruction::out(std::ostream &out, const Function &fn) const {
       this->outOpcode(out);
       out << " $" << labelIndex;
@@ -1304,6 +1363,10 @@ START_INTROSPECTION(StoreInstruction)
 #include "ir/instruction.hxx"
 END_INTROSPECTION(StoreInstruction)
 
+START_INTROSPECTION(IndirectMovInstruction)
+#include "ir/instruction.hxx"
+END_INTROSPECTION(IndirectMovInstruction)
+
 START_INTROSPECTION(SyncInstruction)
 #include "ir/instruction.hxx"
 END_INTROSPECTION(SyncInstruction)
@@ -1484,6 +1547,8 @@ DECL_MEM_FN(LoadInstruction, uint32_t, getValueNum(void), getValueNum())
 DECL_MEM_FN(LoadInstruction, AddressSpace, getAddressSpace(void), getAddressSpace())
 DECL_MEM_FN(LoadInstruction, bool, isAligned(void), isAligned())
 DECL_MEM_FN(LoadImmInstruction, Type, getType(void), getType())
+DECL_MEM_FN(IndirectMovInstruction, Type, getType(void), getType())
+DECL_MEM_FN(IndirectMovInstruction, uint32_t, getElemNum(void), getElemNum())
 DECL_MEM_FN(LabelInstruction, LabelIndex, getLabelIndex(void), getLabelIndex())
 DECL_MEM_FN(BranchInstruction, bool, isPredicated(void), isPredicated())
 DECL_MEM_FN(BranchInstruction, LabelIndex, getLabelIndex(void), getLabelIndex())
@@ -1667,6 +1732,11 @@ DECL_MEM_FN(GetSamplerInfoInstruction, const uint8_t, getSamplerIndex(void), get
 
 #undef DECL_EMIT_FUNCTION
 
+  // INDIRECT_MOV
+  Instruction INDIRECT_MOV(Type type, Register dst, Tuple src, uint32_t elemNum) {
+    return internal::IndirectMovInstruction(type, dst, src, elemNum).convert();
+  }
+
   // FENCE
   Instruction SYNC(uint32_t parameters) {
     return internal::SyncInstruction(parameters).convert();
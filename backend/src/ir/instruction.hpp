@@ -330,6 +330,27 @@ namespace ir {
     static bool isClassOf(const Instruction &insn);
   };
 
+  /*! Indirect move reads one element of an array of registers. The first
+   *  source is the (per lane) index of the element. The next sources are the
+   *  array elements
+   */
+  class IndirectMovInstruction : public Instruction {
+  public:
+    /*! Type of the elements and of the destination */
+    Type getType(void) const;
+    /*! Number of elements in the array (ie srcNum-1) */
+    uint32_t getElemNum(void) const;
+    /*! Return the register that contains the index */
+    INLINE Register getIndex(void) const { return this->getSrc(0u); }
+    /*! Return the register of element elemID */
+    INLINE Register getElem(uint32_t elemID) const {
+      GBE_ASSERT(elemID < this->getElemNum());
+      return this->getSrc(elemID + 1u);
+    }
+    /*! Return true if the given instruction is an instance of this class */
+    static bool isClassOf(const Instruction &insn);
+  };
+
   /*! Load immediate instruction loads an typed immediate value into the given
    *  register. Since double and uint64_t values will not fit into an
    *  instruction, the immediate themselves are stored in the function core.
@@ -661,6 +682,8 @@ namespace ir {
   Instruction LOAD(Type type, Tuple dst, Register offset, AddressSpace space, uint32_t valueNum, bool dwAligned);
   /*! store.type.space offset {src1,...,src_valueNum} value */
   Instruction STORE(Type type, Tuple src, Register offset, AddressSpace space, uint32_t valueNum, bool dwAligned);
+  /*! indirect_mov.type dst {index, elem0,...,elem_elemNum} */
+  Instruction INDIRECT_MOV(Type type, Register dst, Tuple src, uint32_t elemNum);
   /*! loadi.type dst value */
   Instruction LOADI(Type type, Register dst, ImmediateIndex value);
   /*! sync.params... (see Sync instruction) */
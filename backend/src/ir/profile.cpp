@@ -41,7 +41,8 @@ namespace ir {
         "block_ip",
         "barrier_id", "thread_number",
         "work_dimension", "sampler_info",
-        "emask", "notemask", "barriermask", "retVal"
+        "emask", "notemask", "barriermask", "retVal",
+        "enqueued_local_size_0", "enqueued_local_size_1", "enqueued_local_size_2"
     };
 
 #if GBE_DEBUG
@@ -82,6 +83,9 @@ namespace ir {
       DECL_NEW_REG(FAMILY_WORD, notemask);
       DECL_NEW_REG(FAMILY_WORD, barriermask);
       DECL_NEW_REG(FAMILY_WORD, retVal);
+      DECL_NEW_REG(FAMILY_DWORD, enqlsize0);
+      DECL_NEW_REG(FAMILY_DWORD, enqlsize1);
+      DECL_NEW_REG(FAMILY_DWORD, enqlsize2);
     }
 #undef DECL_NEW_REG
 
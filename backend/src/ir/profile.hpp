@@ -69,7 +69,10 @@ namespace ir {
     static const Register notemask = Register(25); // store the !emask bits for the branching fix.
     static const Register barriermask = Register(26); // software mask for barrier.
     static const Register retVal = Register(27);   // helper register to do data flow analysis.
-    static const uint32_t regNum = 28;             // number of special registers
+    static const Register enqlsize0 = Register(28); // get_enqueued_local_size(0)
+    static const Register enqlsize1 = Register(29); // get_enqueued_local_size(1)
+    static const Register enqlsize2 = Register(30); // get_enqueued_local_size(2)
+    static const uint32_t regNum = 31;             // number of special registers
     extern const char *specialRegMean[];           // special register name.
   } /* namespace ocl */
 
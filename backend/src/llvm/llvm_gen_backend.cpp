@@ -449,6 +449,28 @@ namespace gbe
       PASS_EMIT_INSTRUCTIONS = 1
     } pass;
 
+    /*! Functions kept out-of-line (see llvm_subroutine.cpp). Their code is
+     *  emitted once after the kernel code. The arguments and the return value
+     *  go through dedicated registers. Each call site loads its index in the
+     *  (per lane) selector register and jumps to the entry label. Returning
+     *  dispatches to the label following the call site from the selector
+     */
+    struct Subroutine {
+      ir::LabelIndex entry;             //!< First block of the subroutine
+      ir::LabelIndex exit;              //!< Return dispatch block
+      ir::Register selector;            //!< Call site index for each lane
+      ir::Register ret;                 //!< Returned value (if any)
+      vector<ir::LabelIndex> returns;   //!< Label following each call site
+    };
+    /*! All subroutines used by the current kernel */
+    map<const Function*, Subroutine> subroutines;
+    /*! In emission order */
+    vector<Function*> subroutineList;
+    /*! Private arrays kept in registers (see llvm_private_array.cpp). One
+     *  dword register per element, indexed by function and array ID
+     */
+    map<std::pair<const Function*, uint32_t>, vector<ir::Register>> regArrays;
+
     LoopInfo *LI;
     const Module *TheModule;
 
@@ -484,7 +506,8 @@ namespace gbe
      if (F.hasAvailableExternallyLinkage())
        return false;
 
-      // As we inline all function calls, so skip non-kernel functions
+      // As we inline all function calls but the subroutines (emitted with
+      // the kernels calling them), skip non-kernel functions
       bool bKernel = isKernelFunction(F);
       if(!bKernel) return false;
 
@@ -501,6 +524,12 @@ namespace gbe
     void emitFunction(Function &F);
     /*! Handle input and output function parameters */
     void emitFunctionPrototype(Function &F);
+    /*! Find the subroutines the kernel calls and allocate their registers */
+    void allocateSubroutines(Function &F);
+    /*! Pass the arguments and jump to the subroutine */
+    void emitSubroutineCall(CallInst &I, Function &F);
+    /*! Jump back to the call sites */
+    void emitSubroutineReturn(const Subroutine &sub);
     /*! Emit the code for a basic block */
     void emitBasicBlock(BasicBlock *BB);
     /*! Each block end may require to emit MOVs for further PHIs */
@@ -562,6 +591,8 @@ namespace gbe
     void emitAtomicInst(CallInst &I, CallSite &CS, ir::AtomicOps opcode);
 
     uint8_t appendSampler(CallSite::arg_iterator AI);
+    /*! Registers of the private array accessed by the read / write call */
+    const vector<ir::Register> &getRegArray(CallInst &I);
 
     // These instructions are not supported at all
     void visitVAArgInst(VAArgInst &I) {NOT_SUPPORTED;}
@@ -1454,6 +1485,9 @@ namespace gbe
     ctx.startFunction(F.getName());
     this->regTranslator.clear();
     this->labelMap.clear();
+    this->subroutines.clear();
+    this->subroutineList.clear();
+    this->regArrays.clear();
     this->emitFunctionPrototype(F);
 
     this->allocateGlobalVariableRegister(F);
@@ -1462,20 +1496,37 @@ namespace gbe
     pass = PASS_EMIT_REGISTERS;
     for (inst_iterator I = inst_begin(&F), E = inst_end(&F); I != E; ++I)
       visit(*I);
+    this->allocateSubroutines(F);
 
     // First create all the labels (one per block) ...
     for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
       this->newLabelIndex(BB);
+    for (auto callee : subroutineList) {
+      for (Function::iterator BB = callee->begin(), E = callee->end(); BB != E; ++BB)
+        this->newLabelIndex(BB);
+      Subroutine &sub = subroutines[callee];
+      sub.entry = labelMap[&callee->getEntryBlock()];
+      sub.exit = ctx.label();
+    }
 
     // Then, for all branch instructions that have conditions, see if we can
     // simplify the code by inverting condition code
     for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
       this->simplifyTerminator(BB);
+    for (auto callee : subroutineList)
+      for (Function::iterator BB = callee->begin(), E = callee->end(); BB != E; ++BB)
+        this->simplifyTerminator(BB);
 
-    // ... then, emit the instructions for all basic blocks
+    // ... then, emit the instructions for all basic blocks. The subroutines
+    // come last and the return dispatches once all call sites are known
     pass = PASS_EMIT_INSTRUCTIONS;
     for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
       emitBasicBlock(BB);
+    for (auto callee : subroutineList)
+      for (Function::iterator BB = callee->begin(), E = callee->end(); BB != E; ++BB)
+        emitBasicBlock(BB);
+    for (auto callee : subroutineList)
+      this->emitSubroutineReturn(subroutines[callee]);
     ir::Function &fn = ctx.getFunction();
     ctx.endFunction();
 
@@ -1486,9 +1537,91 @@ namespace gbe
     if (OCL_OPTIMIZE_PHI_MOVES) this->removeMOVs(liveness, fn);
   }
 
+  void GenWriter::allocateSubroutines(Function &F) {
+    // Subroutines may call other subroutines
+    vector<Function*> toVisit(1, &F);
+    while (toVisit.empty() == false) {
+      Function *caller = toVisit.back();
+      toVisit.pop_back();
+      for (inst_iterator I = inst_begin(caller), E = inst_end(caller); I != E; ++I) {
+        CallInst *call = dyn_cast<CallInst>(&*I);
+        Function *callee = call ? call->getCalledFunction() : NULL;
+        if (callee == NULL || isSubroutineFunction(*callee) == false)
+          continue;
+        if (subroutines.find(callee) != subroutines.end())
+          continue;
+        Subroutine &sub = subroutines[callee];
+        sub.selector = ctx.reg(ir::FAMILY_WORD);
+        if (callee->getReturnType()->isVoidTy() == false)
+          sub.ret = ctx.reg(getFamily(ctx, callee->getReturnType()));
+        subroutineList.push_back(callee);
+        toVisit.push_back(callee);
+
+        // Arguments are plain registers here
+        for (Function::arg_iterator arg = callee->arg_begin(); arg != callee->arg_end(); ++arg)
+          this->newRegister(arg);
+        for (inst_iterator I = inst_begin(callee), E = inst_end(callee); I != E; ++I)
+          visit(*I);
+      }
+    }
+  }
+
+  void GenWriter::emitSubroutineCall(CallInst &I, Function &F) {
+    GBE_ASSERT(subroutines.find(&F) != subroutines.end());
+    Subroutine &sub = subroutines[&F];
+    uint32_t argID = 0;
+    for (Function::arg_iterator arg = F.arg_begin(); arg != F.arg_end(); ++arg, ++argID) {
+      const ir::Type type = getType(ctx, arg->getType());
+      const ir::Register dst = this->getRegister(arg);
+      const ir::Register src = this->getRegister(I.getArgOperand(argID));
+      ctx.MOV(type, dst, src);
+    }
+
+    // The code following the call goes in a new block we come back to
+    const uint32_t site = sub.returns.size();
+    const ir::LabelIndex back = ctx.label();
+    sub.returns.push_back(back);
+    ctx.LOADI(ir::TYPE_U16, sub.selector, ctx.newIntegerImmediate(site, ir::TYPE_U16));
+    ctx.BRA(sub.entry);
+    ctx.LABEL(back);
+    if (I.getType()->isVoidTy() == false) {
+      const ir::Type type = getType(ctx, I.getType());
+      ctx.MOV(type, this->getRegister(&I), sub.ret);
+    }
+  }
+
+  void GenWriter::emitSubroutineReturn(const Subroutine &sub) {
+    // Lanes may come from different call sites: one branch per call site
+    const uint32_t siteNum = sub.returns.size();
+    ctx.LABEL(sub.exit);
+    for (uint32_t site = 0; site + 1 < siteNum; ++site) {
+      const ir::Register index = ctx.reg(ir::FAMILY_WORD);
+      const ir::Register pred = ctx.reg(ir::FAMILY_BOOL);
+      ctx.LOADI(ir::TYPE_U16, index, ctx.newIntegerImmediate(site, ir::TYPE_U16));
+      ctx.EQ(ir::TYPE_U16, pred, sub.selector, index);
+      ctx.BRA(sub.returns[site], pred);
+      ctx.LABEL(ctx.label());
+    }
+    GBE_ASSERT(siteNum > 0);
+    ctx.BRA(sub.returns[siteNum-1]);
+  }
+
   void GenWriter::regAllocateReturnInst(ReturnInst &I) {}
 
   void GenWriter::emitReturnInst(ReturnInst &I) {
+    // Returning from a subroutine is a jump to its dispatch block
+    Function *F = I.getParent()->getParent();
+    auto it = subroutines.find(F);
+    if (it != subroutines.end()) {
+      const Subroutine &sub = it->second;
+      if (I.getNumOperands() > 0) {
+        const ir::Type type = getType(ctx, I.getOperand(0)->getType());
+        ctx.MOV(type, sub.ret, this->getRegister(I.getOperand(0)));
+      }
+      ctx.BRA(sub.exit);
+      return;
+    }
+
     const ir::Function &fn = ctx.getFunction();
     GBE_ASSERTM(fn.outputNum() <= 1, "no more than one value can be returned");
     if (fn.outputNum() == 1 && I.getNumOperands() > 0) {
@@ -1968,6 +2101,11 @@ namespace gbe
 
     // We only support a small number of intrinsics right now
     if (Function *F = I.getCalledFunction()) {
+      if (isSubroutineFunction(*F)) {
+        if (I.getType()->isVoidTy() == false)
+          this->newRegister(&I);
+        return;
+      }
       const Intrinsic::ID intrinsicID = (Intrinsic::ID) F->getIntrinsicID();
       if (intrinsicID != 0) {
         switch (F->getIntrinsicID()) {
@@ -2020,6 +2158,12 @@ namespace gbe
         regTranslator.newScalarProxy(ir::ocl::lsize1, dst); break;
       case GEN_OCL_GET_LOCAL_SIZE2:
         regTranslator.newScalarProxy(ir::ocl::lsize2, dst); break;
+      case GEN_OCL_GET_ENQUEUED_LOCAL_SIZE0:
+        regTranslator.newScalarProxy(ir::ocl::enqlsize0, dst); break;
+      case GEN_OCL_GET_ENQUEUED_LOCAL_SIZE1:
+        regTranslator.newScalarProxy(ir::ocl::enqlsize1, dst); break;
+      case GEN_OCL_GET_ENQUEUED_LOCAL_SIZE2:
+        regTranslator.newScalarProxy(ir::ocl::enqlsize2, dst); break;
       case GEN_OCL_GET_GLOBAL_SIZE0:
         regTranslator.newScalarProxy(ir::ocl::gsize0, dst); break;
       case GEN_OCL_GET_GLOBAL_SIZE1:
@@ -2183,6 +2327,13 @@ namespace gbe
       case GEN_OCL_CONV_F32_TO_F16:
         this->newRegister(&I);
         break;
+      case GEN_OCL_PRIVATE_ARRAY_READ:
+        this->getRegArray(I);
+        this->newRegister(&I);
+        break;
+      case GEN_OCL_PRIVATE_ARRAY_WRITE:
+        this->getRegArray(I);
+        break;
       default:
         GBE_ASSERTM(false, "Function call are not supported yet");
     };
@@ -2228,6 +2379,18 @@ namespace gbe
 
   /* append a new sampler. should be called before any reference to
    * a sampler_t value. */
+  const vector<ir::Register> &GenWriter::getRegArray(CallInst &I) {
+    const uint32_t arrayID = cast<ConstantInt>(I.getArgOperand(0))->getZExtValue();
+    const uint32_t elemNum = cast<ConstantInt>(I.getArgOperand(1))->getZExtValue();
+    const Function *F = I.getParent()->getParent();
+    vector<ir::Register> &elems = regArrays[std::make_pair(F, arrayID)];
+    if (elems.size() == 0)
+      for (uint32_t elemID = 0; elemID < elemNum; ++elemID)
+        elems.push_back(ctx.reg(ir::FAMILY_DWORD));
+    GBE_ASSERT(elems.size() == elemNum);
+    return elems;
+  }
+
   uint8_t GenWriter::appendSampler(CallSite::arg_iterator AI) {
     Constant *CPV = dyn_cast<Constant>(*AI);
     uint8_t index;
@@ -2248,6 +2411,10 @@ namespace gbe
 
   void GenWriter::emitCallInst(CallInst &I) {
     if (Function *F = I.getCalledFunction()) {
+      if (isSubroutineFunction(*F)) {
+        this->emitSubroutineCall(I, *F);
+        return;
+      }
       if (F->getIntrinsicID() != 0) {
         const ir::Function &fn = ctx.getFunction();
         switch (F->getIntrinsicID()) {
@@ -2753,6 +2920,43 @@ namespace gbe
           case GEN_OCL_CONV_F32_TO_F16:
             ctx.F32TO16(ir::TYPE_U16, ir::TYPE_FLOAT, getRegister(&I), getRegister(I.getOperand(0)));
             break;
+          case GEN_OCL_PRIVATE_ARRAY_READ:
+          {
+            const vector<ir::Register> &elems = this->getRegArray(I);
+            const ir::Register dst = this->getRegister(&I);
+            Value *index = I.getArgOperand(2);
+            if (ConstantInt *constantIndex = dyn_cast<ConstantInt>(index))
+              ctx.MOV(ir::TYPE_U32, dst, elems[constantIndex->getZExtValue()]);
+            else {
+              // Each lane reads its own element through the address register
+              vector<ir::Register> src;
+              src.push_back(this->getRegister(index));
+              for (auto elem : elems) src.push_back(elem);
+              const ir::Tuple srcTuple = ctx.arrayTuple(&src[0], src.size());
+              ctx.INDIRECT_MOV(ir::TYPE_U32, dst, srcTuple, elems.size());
+            }
+            break;
+          }
+          case GEN_OCL_PRIVATE_ARRAY_WRITE:
+          {
+            const vector<ir::Register> &elems = this->getRegArray(I);
+            const ir::Register value = this->getRegister(I.getArgOperand(3));
+            Value *index = I.getArgOperand(2);
+            if (ConstantInt *constantIndex = dyn_cast<ConstantInt>(index))
+              ctx.MOV(ir::TYPE_U32, elems[constantIndex->getZExtValue()], value);
+            else {
+              // No per lane indirect destination: select the written element
+              const ir::Register indexReg = this->getRegister(index);
+              for (uint32_t elemID = 0; elemID < elems.size(); ++elemID) {
+                const ir::Register elemIndex = ctx.reg(ir::FAMILY_DWORD);
+                const ir::Register pred = ctx.reg(ir::FAMILY_BOOL);
+                ctx.LOADI(ir::TYPE_U32, elemIndex, ctx.newIntegerImmediate(elemID, ir::TYPE_U32));
+                ctx.EQ(ir::TYPE_U32, pred, indexReg, elemIndex);
+                ctx.SEL(ir::TYPE_U32, elems[elemID], pred, value, elems[elemID]);
+              }
+            }
+            break;
+          }
 #undef DEF
           default: break;
         }
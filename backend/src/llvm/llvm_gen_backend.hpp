@@ -78,6 +78,9 @@ namespace gbe
   /*! whether this is a kernel function */
   bool isKernelFunction(const llvm::Function &f);
 
+  /*! whether this function is kept out-of-line and emitted as a subroutine */
+  bool isSubroutineFunction(const llvm::Function &f);
+
   /*! Create a Gen-IR unit */
   llvm::FunctionPass *createGenPass(ir::Unit &unit);
 
@@ -90,6 +93,12 @@ namespace gbe
   /*! Convert the Intrinsic call to gen function */
   llvm::BasicBlockPass *createIntrinsicLoweringPass();
 
+  /*! Select the functions we do not inline (see llvm_subroutine.cpp) */
+  llvm::ModulePass *createSubroutineSelectionPass();
+
+  /*! Keep the small private arrays in registers (see llvm_private_array.cpp) */
+  llvm::FunctionPass *createPrivateArrayPromotionPass();
+
 } /* namespace gbe */
 
 #endif /* __GBE_LLVM_GEN_BACKEND_HPP__ */
@@ -111,21 +111,30 @@ using namespace llvm;
 
 namespace gbe
 {
-  bool isKernelFunction(const llvm::Function &F) {
+  /*! Return true if the function is listed in the given named metadata */
+  static bool isFunctionInMetadata(const llvm::Function &F, const char *name) {
     const Module *module = F.getParent();
     const Module::NamedMDListType& globalMD = module->getNamedMDList();
-    bool bKernel = false;
+    bool bFound = false;
     for(auto i = globalMD.begin(); i != globalMD.end(); i++) {
       const NamedMDNode &md = *i;
-      if(strcmp(md.getName().data(), "opencl.kernels") != 0) continue;
+      if(strcmp(md.getName().data(), name) != 0) continue;
       uint32_t ops = md.getNumOperands();
       for(uint32_t x = 0; x < ops; x++) {
         MDNode* node = md.getOperand(x);
         Value * op = node->getOperand(0);
-        if(op == &F) bKernel = true;
+        if(op == &F) bFound = true;
       }
     }
-    return bKernel;
+    return bFound;
+  }
+
+  bool isKernelFunction(const llvm::Function &F) {
+    return isFunctionInMetadata(F, "opencl.kernels");
+  }
+
+  bool isSubroutineFunction(const llvm::Function &F) {
+    return isFunctionInMetadata(F, "gen.subroutines");
   }
 
   uint32_t getPadding(uint32_t offset, uint32_t align) {
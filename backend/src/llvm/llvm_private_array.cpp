@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file llvm_private_array.cpp
+ *
+ * Private arrays not broken up by SROA (dynamically indexed ones) end up in
+ * the stack, i.e. in scratch memory. When they are small and only accessed
+ * element per element, we rather keep them in registers: the loads and stores
+ * are replaced by __gen_ocl_private_array_read / __gen_ocl_private_array_write
+ * calls which GenWriter lowers to indirect register moves (reads) and to
+ * compares and selects (writes).
+ */
+
+#include "llvm/Config/config.h"
+#if LLVM_VERSION_MINOR <= 2
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/IntrinsicInst.h"
+#include "llvm/Module.h"
+#else
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#endif  /* LLVM_VERSION_MINOR <= 2 */
+#include "llvm/Pass.h"
+#if LLVM_VERSION_MINOR <= 1
+#include "llvm/Support/IRBuilder.h"
+#elif LLVM_VERSION_MINOR == 2
+#include "llvm/IRBuilder.h"
+#else
+#include "llvm/IR/IRBuilder.h"
+#endif /* LLVM_VERSION_MINOR <= 1 */
+
+#include "llvm/llvm_gen_backend.hpp"
+#include "sys/vector.hpp"
+#include "sys/cvar.hpp"
+
+using namespace llvm;
+
+namespace gbe
+{
+  /*! Largest private array (in bytes per work item) kept in registers. An
+   *  indirect move reads at most 16 sources: the index and 15 elements
+   */
+  IVAR(OCL_PRIVATE_ARRAY_GRF_SIZE, 0, 32, 60);
+
+  class PrivateArrayPromotion : public FunctionPass
+  {
+  public:
+    static char ID;
+    PrivateArrayPromotion(void) : FunctionPass(ID) {}
+
+    virtual const char *getPassName() const {
+      return "SPIR backend: keep small private arrays in registers";
+    }
+
+    virtual bool runOnFunction(Function &F);
+
+  private:
+    /*! Users of the value (copied since we may erase them) */
+    static vector<User*> getUsers(Value *value);
+    /*! Return true if the array is small enough and only loaded / stored
+     *  element per element
+     */
+    bool isPromotable(AllocaInst &alloca) const;
+    /*! Replace all the accesses to the array by register array accesses */
+    void promote(AllocaInst &alloca, uint32_t arrayID);
+    /*! Declarations of the read / write builtins */
+    Constant *readFn, *writeFn;
+  };
+
+  vector<User*> PrivateArrayPromotion::getUsers(Value *value) {
+    vector<User*> users;
+#if LLVM_VERSION_MINOR >= 5
+    for (Value::user_iterator U = value->user_begin(); U != value->user_end(); ++U)
+#else
+    for (Value::use_iterator U = value->use_begin(); U != value->use_end(); ++U)
+#endif /* LLVM_VERSION_MINOR >= 5 */
+      users.push_back(*U);
+    return users;
+  }
+
+  bool PrivateArrayPromotion::isPromotable(AllocaInst &alloca) const {
+    if (alloca.isArrayAllocation())
+      return false;
+    ArrayType *arrayType = dyn_cast<ArrayType>(alloca.getAllocatedType());
+    if (arrayType == NULL)
+      return false;
+    Type *elemType = arrayType->getElementType();
+    if (!elemType->isFloatTy() && !elemType->isIntegerTy(32))
+      return false;
+    const uint64_t elemNum = arrayType->getNumElements();
+    if (elemNum == 0 || elemNum * sizeof(uint32_t) > uint64_t(OCL_PRIVATE_ARRAY_GRF_SIZE))
+      return false;
+
+    for (auto user : getUsers(&alloca)) {
+      // Casts are only fine for the lifetime markers
+      if (BitCastInst *cast = dyn_cast<BitCastInst>(user)) {
+        for (auto castUser : getUsers(cast)) {
+          IntrinsicInst *intrinsic = dyn_cast<IntrinsicInst>(castUser);
+          if (intrinsic == NULL ||
+              (intrinsic->getIntrinsicID() != Intrinsic::lifetime_start &&
+               intrinsic->getIntrinsicID() != Intrinsic::lifetime_end))
+            return false;
+        }
+        continue;
+      }
+
+      // Only "gep array, 0, index" with an index we can check
+      GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(user);
+      if (gep == NULL || gep->getPointerOperand() != &alloca || gep->getNumIndices() != 2)
+        return false;
+      ConstantInt *first = dyn_cast<ConstantInt>(gep->getOperand(1));
+      if (first == NULL || first->isZero() == false)
+        return false;
+      Value *index = gep->getOperand(2);
+      if (index->getType()->isIntegerTy() == false)
+        return false;
+      if (ConstantInt *constantIndex = dyn_cast<ConstantInt>(index))
+        if (constantIndex->getZExtValue() >= elemNum)
+          return false;
+
+      // The element address does not escape
+      for (auto gepUser : getUsers(gep)) {
+        if (LoadInst *load = dyn_cast<LoadInst>(gepUser)) {
+          if (load->isVolatile())
+            return false;
+          continue;
+        }
+        if (StoreInst *store = dyn_cast<StoreInst>(gepUser)) {
+          if (store->isVolatile() || store->getPointerOperand() != gep)
+            return false;
+          continue;
+        }
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void PrivateArrayPromotion::promote(AllocaInst &alloca, uint32_t arrayID) {
+    LLVMContext &context = alloca.getContext();
+    ArrayType *arrayType = cast<ArrayType>(alloca.getAllocatedType());
+    Type *elemType = arrayType->getElementType();
+    Type *int32Type = Type::getInt32Ty(context);
+    Value *id = ConstantInt::get(int32Type, arrayID);
+    Value *elemNum = ConstantInt::get(int32Type, arrayType->getNumElements());
+
+    for (auto user : getUsers(&alloca)) {
+      Instruction *insn = cast<Instruction>(user);
+      if (isa<BitCastInst>(insn)) {
+        for (auto castUser : getUsers(insn))
+          cast<Instruction>(castUser)->eraseFromParent();
+        insn->eraseFromParent();
+        continue;
+      }
+      for (auto gepUser : getUsers(insn)) {
+        Instruction *access = cast<Instruction>(gepUser);
+        IRBuilder<> builder(access->getParent(), access);
+        Value *index = builder.CreateIntCast(insn->getOperand(2), int32Type, true);
+        if (LoadInst *load = dyn_cast<LoadInst>(access)) {
+          Value *args[] = {id, elemNum, index};
+          Value *value = builder.CreateCall(readFn, args);
+          if (elemType != int32Type)
+            value = builder.CreateBitCast(value, elemType);
+          load->replaceAllUsesWith(value);
+        } else {
+          StoreInst *store = cast<StoreInst>(access);
+          Value *value = store->getValueOperand();
+          if (elemType != int32Type)
+            value = builder.CreateBitCast(value, int32Type);
+          Value *args[] = {id, elemNum, index, value};
+          builder.CreateCall(writeFn, args);
+        }
+        access->eraseFromParent();
+      }
+      insn->eraseFromParent();
+    }
+    alloca.eraseFromParent();
+  }
+
+  bool PrivateArrayPromotion::runOnFunction(Function &F) {
+    if (OCL_PRIVATE_ARRAY_GRF_SIZE == 0)
+      return false;
+
+    vector<AllocaInst*> arrays;
+    for (Function::iterator BB = F.begin(); BB != F.end(); ++BB)
+      for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I)
+        if (AllocaInst *alloca = dyn_cast<AllocaInst>(I))
+          if (isPromotable(*alloca))
+            arrays.push_back(alloca);
+    if (arrays.size() == 0)
+      return false;
+
+    Module *M = F.getParent();
+    LLVMContext &context = M->getContext();
+    Type *int32Type = Type::getInt32Ty(context);
+    Type *voidType = Type::getVoidTy(context);
+    Type *readArgs[] = {int32Type, int32Type, int32Type};
+    Type *writeArgs[] = {int32Type, int32Type, int32Type, int32Type};
+    readFn = M->getOrInsertFunction("__gen_ocl_private_array_read",
+                                    FunctionType::get(int32Type, readArgs, false));
+    writeFn = M->getOrInsertFunction("__gen_ocl_private_array_write",
+                                     FunctionType::get(voidType, writeArgs, false));
+    // Reads only: they must stay ordered with the writes
+    if (Function *read = dyn_cast<Function>(readFn)) {
+      read->setOnlyReadsMemory();
+      read->setDoesNotThrow();
+    }
+    if (Function *write = dyn_cast<Function>(writeFn))
+      write->setDoesNotThrow();
+
+    for (uint32_t arrayID = 0; arrayID < arrays.size(); ++arrayID)
+      promote(*arrays[arrayID], arrayID);
+    return true;
+  }
+
+  char PrivateArrayPromotion::ID = 0;
+
+  FunctionPass *createPrivateArrayPromotionPass() {
+    return new PrivateArrayPromotion();
+  }
+} /* namespace gbe */
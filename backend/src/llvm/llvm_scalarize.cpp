@@ -781,9 +781,10 @@ namespace gbe {
     default: GBE_ASSERTM(false, "Unsupported calling convention");
     }
 
-    // As we inline all function calls, so skip non-kernel functions
+    // As we inline all function calls but the subroutines, so skip the other
+    // non-kernel functions
     bool bKernel = isKernelFunction(F);
-    if(!bKernel) return false;
+    if(!bKernel && !isSubroutineFunction(F)) return false;
 
     bool changed = false;
     module = F.getParent();
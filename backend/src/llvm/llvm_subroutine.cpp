@@ -0,0 +1,249 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file llvm_subroutine.cpp
+ *
+ * Everything is inlined by default. This pass runs before the inliner and
+ * decides which functions are rather kept out-of-line and emitted as Gen
+ * subroutines (see GenWriter::emitSubroutineCall): the ones whose fully
+ * inlined body is large and which are called several times by the kernels.
+ *
+ * The selected functions are tagged "noinline" and listed in the
+ * "gen.subroutines" named metadata.
+ */
+
+#include "llvm/Config/config.h"
+#if LLVM_VERSION_MINOR <= 2
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#else
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#endif  /* LLVM_VERSION_MINOR <= 2 */
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "llvm/llvm_gen_backend.hpp"
+#include "sys/map.hpp"
+#include "sys/set.hpp"
+#include "sys/vector.hpp"
+#include "sys/cvar.hpp"
+
+using namespace llvm;
+
+namespace gbe
+{
+  BVAR(OCL_SUBROUTINE, true);
+  IVAR(OCL_SUBROUTINE_MIN_SIZE, 0, 300, 0x7fffffff);
+  IVAR(OCL_SUBROUTINE_MIN_CALLS, 2, 2, 0x7fffffff);
+  BVAR(OCL_OUTPUT_SUBROUTINE, false);
+
+  class SubroutineSelection : public ModulePass
+  {
+  public:
+    static char ID;
+    SubroutineSelection(void) : ModulePass(ID) {
+#if LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 5
+      initializeCallGraphWrapperPassPass(*PassRegistry::getPassRegistry());
+#elif LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR == 4
+      initializeCallGraphPass(*PassRegistry::getPassRegistry());
+#else
+      initializeBasicCallGraphPass(*PassRegistry::getPassRegistry());
+#endif
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+#if LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 5
+      AU.addRequired<CallGraphWrapperPass>();
+#else
+      AU.addRequired<CallGraph>();
+#endif
+    }
+
+    virtual const char *getPassName() const {
+      return "SPIR backend: select the functions kept out-of-line";
+    }
+
+    virtual bool runOnModule(Module &M);
+
+  private:
+    /*! Arguments and return values go through registers: scalars only */
+    static bool isRegisterType(Type *type, bool isReturn);
+    /*! Return true if the function can be emitted as a subroutine */
+    bool isEligible(Function &F);
+    /*! Number of instructions of the function once everything is inlined */
+    uint32_t getInlinedSize(Function &F);
+    /*! Number of copies of the function we would emit with full inlining */
+    uint32_t getCallNum(Function &F);
+    /*! All the direct calls to each function */
+    map<Function*, vector<CallInst*>> callSites;
+    /*! Memoized sizes and call numbers */
+    map<Function*, uint32_t> sizes, callNums;
+    /*! Functions currently traversed (to stop on recursion) */
+    set<Function*> visiting;
+    /*! Functions in a cycle of the call graph */
+    set<Function*> recursive;
+  };
+
+  bool SubroutineSelection::isRegisterType(Type *type, bool isReturn) {
+    if (isReturn && type->isVoidTy())
+      return true;
+    if (type->isFloatTy() || type->isDoubleTy())
+      return true;
+    if (type->isIntegerTy()) {
+      const uint32_t width = type->getIntegerBitWidth();
+      return width == 8 || width == 16 || width == 32 || width == 64;
+    }
+    return false;
+  }
+
+  bool SubroutineSelection::isEligible(Function &F) {
+    if (F.isDeclaration() || F.isVarArg() || F.getIntrinsicID() != 0)
+      return false;
+    if (F.hasAvailableExternallyLinkage() || isKernelFunction(F))
+      return false;
+    // A subroutine body is emitted once per kernel without any stack: it
+    // cannot call itself, even through other functions
+    if (recursive.contains(&F))
+      return false;
+    if (isRegisterType(F.getReturnType(), true) == false)
+      return false;
+    for (Function::arg_iterator arg = F.arg_begin(); arg != F.arg_end(); ++arg)
+      if (isRegisterType(arg->getType(), false) == false)
+        return false;
+
+    // No private memory (it would be shared by all the call sites) and only
+    // direct calls
+    for (Function::iterator BB = F.begin(); BB != F.end(); ++BB)
+      for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+        if (isa<AllocaInst>(I))
+          return false;
+        if (CallInst *call = dyn_cast<CallInst>(I))
+          if (call->getCalledFunction() == NULL)
+            return false;
+      }
+    return true;
+  }
+
+  uint32_t SubroutineSelection::getInlinedSize(Function &F) {
+    auto it = sizes.find(&F);
+    if (it != sizes.end())
+      return it->second;
+    if (visiting.contains(&F))
+      return 0;
+    visiting.insert(&F);
+    uint32_t size = 0;
+    for (Function::iterator BB = F.begin(); BB != F.end(); ++BB)
+      for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+        size++;
+        if (CallInst *call = dyn_cast<CallInst>(I)) {
+          Function *callee = call->getCalledFunction();
+          if (callee && !callee->isDeclaration())
+            size += getInlinedSize(*callee);
+        }
+      }
+    visiting.erase(&F);
+    sizes[&F] = size;
+    return size;
+  }
+
+  uint32_t SubroutineSelection::getCallNum(Function &F) {
+    if (isKernelFunction(F))
+      return 1;
+    auto it = callNums.find(&F);
+    if (it != callNums.end())
+      return it->second;
+    if (visiting.contains(&F))
+      return 0;
+    visiting.insert(&F);
+    uint32_t callNum = 0;
+    for (auto call : callSites[&F])
+      callNum += getCallNum(*call->getParent()->getParent());
+    visiting.erase(&F);
+    callNums[&F] = callNum;
+    return callNum;
+  }
+
+  bool SubroutineSelection::runOnModule(Module &M) {
+    if (OCL_SUBROUTINE == false)
+      return false;
+
+#if LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 5
+    CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+#else
+    CallGraph &CG = getAnalysis<CallGraph>();
+#endif
+    for (scc_iterator<CallGraph*> SCC = scc_begin(&CG), E = scc_end(&CG); SCC != E; ++SCC) {
+      if (SCC.hasLoop() == false)
+        continue;
+      const std::vector<CallGraphNode*> &nodes = *SCC;
+      for (auto node : nodes)
+        if (Function *F = node->getFunction())
+          recursive.insert(F);
+    }
+
+    for (Module::iterator F = M.begin(); F != M.end(); ++F)
+      for (Function::iterator BB = F->begin(); BB != F->end(); ++BB)
+        for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I)
+          if (CallInst *call = dyn_cast<CallInst>(I))
+            if (Function *callee = call->getCalledFunction())
+              callSites[callee].push_back(call);
+
+    // Keep out-of-line what would be large and duplicated
+    vector<Function*> selected;
+    for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+      if (isEligible(*F) == false)
+        continue;
+      const uint32_t size = getInlinedSize(*F);
+      const uint32_t callNum = getCallNum(*F);
+      if (size < uint32_t(OCL_SUBROUTINE_MIN_SIZE) ||
+          callNum < uint32_t(OCL_SUBROUTINE_MIN_CALLS))
+        continue;
+      if (OCL_OUTPUT_SUBROUTINE)
+        llvm::outs() << "subroutine " << F->getName() << ": " << size
+                     << " instructions, " << callNum << " calls\n";
+      selected.push_back(F);
+    }
+    if (selected.size() == 0)
+      return false;
+
+    NamedMDNode *subroutines = M.getOrInsertNamedMetadata("gen.subroutines");
+    for (auto F : selected) {
+      const AttributeSet attributes = F->getAttributes();
+      F->setAttributes(attributes.removeAttribute(F->getContext(),
+                                                  AttributeSet::FunctionIndex,
+                                                  Attribute::AlwaysInline));
+      F->addFnAttr(Attribute::NoInline);
+      Value *op = F;
+      subroutines->addOperand(MDNode::get(M.getContext(), op));
+    }
+    return true;
+  }
+
+  char SubroutineSelection::ID = 0;
+
+  ModulePass *createSubroutineSelectionPass() {
+    return new SubroutineSelection();
+  }
+} /* namespace gbe */
+
@@ -112,6 +112,7 @@ namespace gbe
     MPM.add(createInstructionCombiningPass());// Clean up after IPCP & DAE
     MPM.add(createCFGSimplificationPass());   // Clean up after IPCP & DAE
     MPM.add(createPruneEHPass());             // Remove dead EH info
+    MPM.add(createSubroutineSelectionPass()); // Keep large functions out-of-line
     MPM.add(createFunctionInliningPass(200000));
     MPM.add(createFunctionAttrsPass());       // Set readonly/readnone attrs
 
@@ -192,6 +193,7 @@ namespace gbe
     passes.add(createIntrinsicLoweringPass());
     passes.add(createFunctionInliningPass(200000));
     passes.add(createScalarReplAggregatesPass()); // Break up allocas
+    passes.add(createPrivateArrayPromotionPass()); // Remaining small arrays in registers
     passes.add(createRemoveGEPPass(unit));
     passes.add(createConstantPropagationPass());
     passes.add(createLowerSwitchPass());
@@ -654,6 +654,7 @@ PURE CONST unsigned int __gen_ocl_##NAME##2(void);
 DECL_INTERNAL_WORK_ITEM_FN(get_group_id)
 DECL_INTERNAL_WORK_ITEM_FN(get_local_id)
 DECL_INTERNAL_WORK_ITEM_FN(get_local_size)
+DECL_INTERNAL_WORK_ITEM_FN(get_enqueued_local_size)
 DECL_INTERNAL_WORK_ITEM_FN(get_global_size)
 DECL_INTERNAL_WORK_ITEM_FN(get_global_offset)
 DECL_INTERNAL_WORK_ITEM_FN(get_num_groups)
@@ -670,13 +671,17 @@ INLINE unsigned NAME(unsigned int dim) {             \
 DECL_PUBLIC_WORK_ITEM_FN(get_group_id, 0)
 DECL_PUBLIC_WORK_ITEM_FN(get_local_id, 0)
 DECL_PUBLIC_WORK_ITEM_FN(get_local_size, 1)
+DECL_PUBLIC_WORK_ITEM_FN(get_enqueued_local_size, 1)
 DECL_PUBLIC_WORK_ITEM_FN(get_global_size, 1)
 DECL_PUBLIC_WORK_ITEM_FN(get_global_offset, 0)
 DECL_PUBLIC_WORK_ITEM_FN(get_num_groups, 1)
 #undef DECL_PUBLIC_WORK_ITEM_FN
 
+/* The last groups of a dimension may be smaller than the other ones: the
+ * global ID is based on the size the NDRange was enqueued with
+ */
 INLINE uint get_global_id(uint dim) {
-  return get_local_id(dim) + get_local_size(dim) * get_group_id(dim) + get_global_offset(dim);
+  return get_local_id(dim) + get_enqueued_local_size(dim) * get_group_id(dim) + get_global_offset(dim);
 }
 
 /////////////////////////////////////////////////////////////////////////////
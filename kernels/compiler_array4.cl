@@ -0,0 +1,14 @@
+__kernel void
+compiler_array4(__global int *src, __global float *dst)
+{
+  int array[8];
+  float scale[4];
+  int id = get_global_id(0);
+  for (int j = 0; j < 8; ++j)
+    array[j] = id + j;
+  for (int j = 0; j < 4; ++j)
+    scale[j] = 0.5f * j;
+  array[src[id] & 7] = src[id];
+  scale[src[id] & 3] += 1.f;
+  dst[id] = array[(src[id] + id) & 7] * scale[id & 3];
+}
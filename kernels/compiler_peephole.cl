@@ -0,0 +1,40 @@
+/* Values flowing through copies: selects and phis end as moves */
+kernel void compiler_peephole_copy(global int *src, global int *dst) {
+  int i = get_global_id(0);
+  int x = src[i];
+  int y = i & 1 ? x : i;
+  int z = y;
+  if (x > 8)
+    z = x + y;
+  dst[i] = z * 3;
+}
+
+/* Negated and absolute values read by arithmetic */
+kernel void compiler_peephole_abs_neg(global float *src, global float *dst) {
+  int i = get_global_id(0);
+  float x = src[2*i];
+  float y = src[2*i+1];
+  float a = -fabs(x);
+  float b = -y;
+  dst[i] = a * y + b - fabs(b);
+}
+
+/* Computations whose results are partly thrown away */
+kernel void compiler_peephole_dead(global uint *src, global uint *dst) {
+  int i = get_global_id(0);
+  uint x = src[i];
+  ulong w = (ulong) x * 0x9e3779b9u;
+  uint q = x / 7;
+  dst[i] = (uint) w + q;
+}
+
+/* The same comparison used several times */
+kernel void compiler_peephole_flag(global int *src, global int *dst) {
+  int i = get_global_id(0);
+  int x = src[2*i];
+  int y = src[2*i+1];
+  int m = x < y ? x : y;
+  int n = x < y ? 1 : 2;
+  int k = x < y ? y - x : x - y;
+  dst[i] = m + n * k;
+}
@@ -0,0 +1,25 @@
+#define ROUND(x, k) x = (x ^ (x >> 7)) * 0x9e3779b1u + k; k = k * 3u + 1u;
+#define ROUND4(x, k) ROUND(x, k) ROUND(x, k) ROUND(x, k) ROUND(x, k)
+#define ROUND16(x, k) ROUND4(x, k) ROUND4(x, k) ROUND4(x, k) ROUND4(x, k)
+
+/* Large enough and called from several places: kept out-of-line */
+uint scramble(uint x, uint k) {
+  ROUND16(x, k)
+  ROUND16(x, k)
+  ROUND16(x, k)
+  ROUND16(x, k)
+  return x;
+}
+
+__kernel void
+compiler_subroutine(__global uint *src, __global uint *dst) {
+  const int id = get_global_id(0);
+  const uint x = src[id];
+  uint y;
+  /* The lanes call it from different places */
+  if (id & 1)
+    y = scramble(x, 1u);
+  else
+    y = scramble(x + 7u, 2u) ^ scramble(x, 3u);
+  dst[id] = scramble(y, (uint) id);
+}
@@ -0,0 +1,9 @@
+kernel void runtime_non_uniform_wg(global uint4 *dst)
+{
+  const uint x = get_global_id(0) - get_global_offset(0);
+  const uint y = get_global_id(1) - get_global_offset(1);
+  const uint i = y * get_global_size(0) + x;
+  dst[2 * i + 0] = (uint4)(get_group_id(0), get_group_id(1), get_local_id(0), get_local_id(1));
+  dst[2 * i + 1] = (uint4)(get_local_size(0), get_local_size(1),
+                           get_enqueued_local_size(0), get_num_groups(0));
+}
@@ -0,0 +1,9 @@
+kernel void runtime_set_arg_overhead(global float *dst, global const float *src,
+                                     int a, float b, float4 c, uint d,
+                                     local float *tmp, constant float *cst)
+{
+  const int i = get_global_id(0);
+  tmp[get_local_id(0)] = src[i] * b + a;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  dst[i] = tmp[get_local_id(0)] + c.x + c.w + d + cst[i & 3];
+}
@@ -29,6 +29,7 @@
 #include "cl_image.h"
 #include "cl_sampler.h"
 #include "cl_alloc.h"
+#include "cl_trace.h"
 #include "cl_utils.h"
 
 #include "CL/cl.h"
@@ -62,12 +63,28 @@ typedef intptr_t cl_device_partition_property;
 	  return RET; \
 	} while(0)
 
+/* Without a pending dependency the command runs in place, unless it does
+ * not block and the queue has a worker to run it */
 inline cl_int
 handle_events(cl_command_queue queue, cl_int num, const cl_event *wait_list,
-              cl_event* event, enqueue_data* data, cl_command_type type)
+              cl_event* event, enqueue_data* data, cl_command_type type,
+              cl_bool blocking)
 {
-  cl_int status = cl_event_wait_events(num, wait_list, queue);
+  cl_int status, i;
   cl_event e;
+  cl_bool async, waits_user = CL_FALSE;
+
+  /* The host side commands may access what the accumulated NDRanges write:
+   * submit them first */
+  if (!cl_event_is_gpu_command_type(type))
+    cl_command_queue_flush(queue);
+
+  async = cl_command_queue_is_behind(queue) ||
+          (queue->worker && !blocking && !cl_event_is_gpu_command_type(type));
+  if (async)
+    status = CL_ENQUEUE_EXECUTE_DEFER;
+  else
+    status = cl_event_wait_events(num, wait_list, queue);
   if(event != NULL || status == CL_ENQUEUE_EXECUTE_DEFER) {
     e = cl_event_new(queue->ctx, queue, type, event!=NULL);
 
@@ -80,7 +97,16 @@ handle_events(cl_command_queue queue, cl_int num, const cl_event *wait_list,
     if(event != NULL)
       *event = e;
     if(status == CL_ENQUEUE_EXECUTE_DEFER) {
-      cl_event_new_enqueue_callback(e, data, num, wait_list);
+      /* Blocking calls wait for the command unless it depends on user events */
+      for(i=0; i<num; i++)
+        waits_user |= cl_event_is_deferring(wait_list[i]);
+      if(async && blocking && queue->barrier_index == 0 && !waits_user) {
+        cl_event_add_ref(e);
+        cl_event_new_enqueue_callback(e, data, num, wait_list);
+        cl_event_wait(e);
+        cl_event_delete(e);
+      } else
+        cl_event_new_enqueue_callback(e, data, num, wait_list);
     }
   }
   return status;
@@ -175,6 +201,7 @@ clGetPlatformIDs(cl_uint          num_entries,
                  cl_platform_id * platforms,
                  cl_uint *        num_platforms)
 {
+  CL_TRACE_API();
   if(UNLIKELY(platforms == NULL && num_platforms == NULL))
     return CL_INVALID_VALUE;
   if(UNLIKELY(num_entries == 0 && platforms != NULL))
@@ -190,6 +217,7 @@ clGetPlatformInfo(cl_platform_id    platform,
                   void *            param_value,
                   size_t *          param_value_size_ret)
 {
+  CL_TRACE_API();
   /* Only one platform. This is easy */
   if (UNLIKELY(platform != NULL && platform != intel_platform))
     return CL_INVALID_PLATFORM;
@@ -208,6 +236,7 @@ clGetDeviceIDs(cl_platform_id platform,
                cl_device_id * devices,
                cl_uint *      num_devices)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   /* Check parameter consistency */
@@ -236,6 +265,7 @@ clGetDeviceInfo(cl_device_id   device,
                 void *         param_value,
                 size_t *       param_value_size_ret)
 {
+  CL_TRACE_API();
   return cl_get_device_info(device,
                             param_name,
                             param_value_size,
@@ -250,6 +280,7 @@ clCreateSubDevices(cl_device_id                         in_device,
                    cl_device_id *                       out_devices,
                    cl_uint *                            num_devices_ret)
 {
+  CL_TRACE_API();
   NOT_IMPLEMENTED;
   return 0;
 }
@@ -257,6 +288,7 @@ clCreateSubDevices(cl_device_id                         in_device,
 cl_int
 clRetainDevice(cl_device_id device)
 {
+  CL_TRACE_API();
   // XXX stub for C++ Bindings
   return CL_SUCCESS;
 }
@@ -264,6 +296,7 @@ clRetainDevice(cl_device_id device)
 cl_int
 clReleaseDevice(cl_device_id device)
 {
+  CL_TRACE_API();
   // XXX stub for C++ Bindings
   return CL_SUCCESS;
 }
@@ -276,6 +309,7 @@ clCreateContext(const cl_context_properties *  properties,
                 void *                         user_data,
                 cl_int *                       errcode_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   cl_context context = NULL;
 
@@ -306,6 +340,7 @@ clCreateContextFromType(const cl_context_properties *  properties,
                         void *                         user_data,
                         cl_int *                       errcode_ret)
 {
+  CL_TRACE_API();
   cl_context context = NULL;
   cl_int err = CL_SUCCESS;
   cl_device_id devices[1];
@@ -342,6 +377,7 @@ error:
 cl_int
 clRetainContext(cl_context context)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
   cl_context_add_ref(context);
@@ -352,6 +388,7 @@ error:
 cl_int
 clReleaseContext(cl_context context)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
   cl_context_delete(context);
@@ -366,6 +403,7 @@ clGetContextInfo(cl_context      context,
                  void *          param_value,
                  size_t *        param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
 
@@ -398,6 +436,7 @@ clCreateCommandQueue(cl_context                   context,
                      cl_command_queue_properties  properties,
                      cl_int *                     errcode_ret)
 {
+  CL_TRACE_API();
   cl_command_queue queue = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -405,11 +444,6 @@ clCreateCommandQueue(cl_context                   context,
   INVALID_DEVICE_IF (device != context->device);
   INVALID_VALUE_IF (properties & ~(CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE));
 
-  if(properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {/*not supported now.*/
-    err = CL_INVALID_QUEUE_PROPERTIES;
-    goto error;
-  }
-
   queue = cl_context_create_queue(context, device, properties, &err);
 error:
   if (errcode_ret)
@@ -420,6 +454,7 @@ error:
 cl_int
 clRetainCommandQueue(cl_command_queue command_queue)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_QUEUE (command_queue);
   cl_command_queue_add_ref(command_queue);
@@ -430,6 +465,7 @@ error:
 cl_int
 clReleaseCommandQueue(cl_command_queue command_queue)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_QUEUE (command_queue);
   cl_command_queue_delete(command_queue);
@@ -444,6 +480,7 @@ clGetCommandQueueInfo(cl_command_queue       command_queue,
                       void *                 param_value,
                       size_t *               param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_QUEUE (command_queue);
 
@@ -471,6 +508,7 @@ clCreateBuffer(cl_context    context,
                void *        host_ptr,
                cl_int *      errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -489,6 +527,7 @@ clCreateSubBuffer(cl_mem                buffer,
                   const void *          buffer_create_info,
                   cl_int *              errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
 
@@ -510,6 +549,7 @@ clCreateImage(cl_context context,
               void *host_ptr,
               cl_int * errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -536,6 +576,7 @@ clCreateImage2D(cl_context              context,
                 void *                  host_ptr,
                 cl_int *                errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -571,6 +612,7 @@ clCreateImage3D(cl_context              context,
                 void *                  host_ptr,
                 cl_int *                errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -598,6 +640,7 @@ error:
 cl_int
 clRetainMemObject(cl_mem memobj)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM (memobj);
   cl_mem_add_ref(memobj);
@@ -608,6 +651,7 @@ error:
 cl_int
 clReleaseMemObject(cl_mem memobj)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM (memobj);
   cl_mem_delete(memobj);
@@ -623,6 +667,7 @@ clGetSupportedImageFormats(cl_context         ctx,
                            cl_image_format *  image_formats,
                            cl_uint *          num_image_formats)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (ctx);
   if (UNLIKELY(num_entries == 0 && image_formats != NULL)) {
@@ -651,6 +696,7 @@ clGetMemObjectInfo(cl_mem      memobj,
                    void *      param_value,
                    size_t *    param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM(memobj);
 
@@ -670,6 +716,7 @@ clGetImageInfo(cl_mem         mem,
                void *         param_value,
                size_t *       param_value_size_ret)
 {
+  CL_TRACE_API();
   return cl_get_image_info(mem,
                            param_name,
                            param_value_size,
@@ -682,6 +729,7 @@ clSetMemObjectDestructorCallback(cl_mem  memobj,
                                  void (CL_CALLBACK *pfn_notify) (cl_mem, void*),
                                  void * user_data)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM(memobj);
   INVALID_VALUE_IF (pfn_notify == 0);
@@ -709,6 +757,7 @@ clCreateSampler(cl_context         context,
                 cl_filter_mode     filter,
                 cl_int *           errcode_ret)
 {
+  CL_TRACE_API();
   cl_sampler sampler = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -722,6 +771,7 @@ error:
 cl_int
 clRetainSampler(cl_sampler sampler)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_SAMPLER (sampler);
   cl_sampler_add_ref(sampler);
@@ -732,6 +782,7 @@ error:
 cl_int
 clReleaseSampler(cl_sampler sampler)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_SAMPLER (sampler);
   cl_sampler_delete(sampler);
@@ -746,6 +797,7 @@ clGetSamplerInfo(cl_sampler       sampler,
                  void *           param_value,
                  size_t *         param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_SAMPLER (sampler);
 
@@ -774,6 +826,7 @@ clCreateProgramWithSource(cl_context     context,
                           const size_t * lengths,
                           cl_int *       errcode_ret)
 {
+  CL_TRACE_API();
   cl_program program = NULL;
   cl_int err = CL_SUCCESS;
   cl_uint i;
@@ -807,6 +860,7 @@ clCreateProgramWithBinary(cl_context             context,
                           cl_int *               binary_status,
                           cl_int *               errcode_ret)
 {
+  CL_TRACE_API();
   cl_program program = NULL;
   cl_int err = CL_SUCCESS;
 
@@ -826,6 +880,7 @@ error:
 cl_int
 clRetainProgram(cl_program program)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_PROGRAM (program);
   cl_program_add_ref(program);
@@ -836,6 +891,7 @@ error:
 cl_int
 clReleaseProgram(cl_program program)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_PROGRAM (program);
   cl_program_delete(program);
@@ -851,6 +907,7 @@ clBuildProgram(cl_program            program,
                void (CL_CALLBACK *pfn_notify) (cl_program, void*),
                void *                user_data)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_PROGRAM(program);
   INVALID_VALUE_IF (num_devices > 1);
@@ -882,6 +939,7 @@ error:
 cl_int
 clUnloadCompiler(void)
 {
+  CL_TRACE_API();
   return CL_SUCCESS;
 }
 
@@ -892,6 +950,7 @@ clGetProgramInfo(cl_program       program,
                  void *           param_value,
                  size_t *         param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   char * ret_str = "";
 
@@ -958,6 +1017,7 @@ clGetProgramBuildInfo(cl_program             program,
                       void *                 param_value,
                       size_t *               param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   char * ret_str = "";
 
@@ -998,6 +1058,7 @@ clCreateKernel(cl_program   program,
                const char * kernel_name,
                cl_int *     errcode_ret)
 {
+  CL_TRACE_API();
   cl_kernel kernel = NULL;
   cl_int err = CL_SUCCESS;
 
@@ -1021,6 +1082,7 @@ clCreateKernelsInProgram(cl_program      program,
                          cl_kernel *     kernels,
                          cl_uint *       num_kernels_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   CHECK_PROGRAM (program);
@@ -1046,6 +1108,7 @@ error:
 cl_int
 clRetainKernel(cl_kernel kernel)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_KERNEL(kernel);
   cl_kernel_add_ref(kernel);
@@ -1056,6 +1119,7 @@ error:
 cl_int
 clReleaseKernel(cl_kernel kernel)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_KERNEL(kernel);
   cl_kernel_delete(kernel);
@@ -1069,6 +1133,7 @@ clSetKernelArg(cl_kernel     kernel,
                size_t        arg_size,
                const void *  arg_value)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_KERNEL(kernel);
   err = cl_kernel_set_arg(kernel, arg_index, arg_size, arg_value);
@@ -1083,6 +1148,7 @@ clGetKernelInfo(cl_kernel        kernel,
                 void *           param_value,
                 size_t *         param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err;
 
   CHECK_KERNEL(kernel);
@@ -1116,6 +1182,7 @@ clGetKernelWorkGroupInfo(cl_kernel                   kernel,
                          void *                      param_value,
                          size_t *                    param_value_size_ret)
 {
+  CL_TRACE_API();
   return cl_get_kernel_workgroup_info(kernel,
                                       device,
                                       param_name,
@@ -1128,6 +1195,7 @@ cl_int
 clWaitForEvents(cl_uint          num_events,
                 const cl_event * event_list)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   cl_context ctx = NULL;
 
@@ -1136,8 +1204,12 @@ clWaitForEvents(cl_uint          num_events,
 
   TRY(cl_event_check_waitlist, num_events, event_list, NULL, ctx);
 
+  /* The deferred commands complete in other threads */
   while(cl_event_wait_events(num_events, event_list, NULL) == CL_ENQUEUE_EXECUTE_DEFER) {
-    usleep(8000);       //sleep 8ms to wait other thread
+    cl_uint i;
+    for(i=0; i<num_events; i++)
+      if(cl_event_is_deferring(event_list[i]))
+        cl_event_wait(event_list[i]);
   }
 
 error:
@@ -1151,6 +1223,7 @@ clGetEventInfo(cl_event      event,
                void *        param_value,
                size_t *      param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_EVENT(event);
 
@@ -1179,6 +1252,7 @@ cl_event
 clCreateUserEvent(cl_context context,
                   cl_int *   errcode_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   cl_event event = NULL;
   CHECK_CONTEXT(context);
@@ -1194,6 +1268,7 @@ error:
 cl_int
 clRetainEvent(cl_event  event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   CHECK_EVENT(event);
@@ -1206,6 +1281,7 @@ error:
 cl_int
 clReleaseEvent(cl_event  event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   CHECK_EVENT(event);
@@ -1219,6 +1295,7 @@ cl_int
 clSetUserEventStatus(cl_event    event,
                      cl_int      execution_status)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   CHECK_EVENT(event);
@@ -1242,6 +1319,7 @@ clSetEventCallback(cl_event     event,
                    void (CL_CALLBACK * pfn_notify) (cl_event, cl_int, void *),
                    void *       user_data)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   CHECK_EVENT(event);
@@ -1265,6 +1343,7 @@ clGetEventProfilingInfo(cl_event             event,
                         void *               param_value,
                         size_t *             param_value_size_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   cl_ulong ret_val;
 
@@ -1310,16 +1389,21 @@ error:
 cl_int
 clFlush(cl_command_queue command_queue)
 {
-  /* have nothing to do now, as currently
-   * clEnqueueNDRangeKernel will flush at
-   * the end of each calling. we may need
-   * to optimize it latter.*/
-  return 0;
+  CL_TRACE_API();
+  cl_int err = CL_SUCCESS;
+
+  /* Submit the NDRanges accumulated in the batch buffer */
+  CHECK_QUEUE (command_queue);
+  err = cl_command_queue_flush(command_queue);
+
+error:
+  return err;
 }
 
 cl_int
 clFinish(cl_command_queue command_queue)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
 
   CHECK_QUEUE (command_queue);
@@ -1340,6 +1424,7 @@ clEnqueueReadBuffer(cl_command_queue command_queue,
                     const cl_event * event_wait_list,
                     cl_event *       event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, defer_enqueue_data = { 0 };
   CHECK_QUEUE(command_queue);
@@ -1369,7 +1454,7 @@ clEnqueueReadBuffer(cl_command_queue command_queue,
   data->size    = size;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_READ_BUFFER) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_READ_BUFFER, blocking_read) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -1394,6 +1479,7 @@ clEnqueueReadBufferRect(cl_command_queue command_queue,
                         const cl_event * event_wait_list,
                         cl_event *       event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1454,7 +1540,7 @@ clEnqueueReadBufferRect(cl_command_queue command_queue,
   data->host_slice_pitch = host_slice_pitch;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_READ_BUFFER_RECT) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_READ_BUFFER_RECT, blocking_read) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -1474,6 +1560,7 @@ clEnqueueWriteBuffer(cl_command_queue    command_queue,
                      const cl_event *    event_wait_list,
                      cl_event *          event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1504,7 +1591,7 @@ clEnqueueWriteBuffer(cl_command_queue    command_queue,
   data->size      = size;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_WRITE_BUFFER) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_WRITE_BUFFER, blocking_write) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -1529,6 +1616,7 @@ clEnqueueWriteBufferRect(cl_command_queue     command_queue,
                          const cl_event *     event_wait_list,
                          cl_event *           event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1589,7 +1677,7 @@ clEnqueueWriteBufferRect(cl_command_queue     command_queue,
   data->host_slice_pitch = host_slice_pitch;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_WRITE_BUFFER_RECT) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_WRITE_BUFFER_RECT, blocking_write) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -1609,6 +1697,7 @@ clEnqueueCopyBuffer(cl_command_queue     command_queue,
                     const cl_event *     event_wait_list,
                     cl_event *           event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1668,7 +1757,7 @@ clEnqueueCopyBuffer(cl_command_queue     command_queue,
   data->queue = command_queue;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_COPY_BUFFER) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_COPY_BUFFER, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
     if (event && (*event)->type != CL_COMMAND_USER
             && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
       cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
@@ -1682,6 +1771,74 @@ error:
   return err;
 }
 
+cl_int
+clEnqueueFillBuffer(cl_command_queue     command_queue,
+                    cl_mem               buffer,
+                    const void *         pattern,
+                    size_t               pattern_size,
+                    size_t               offset,
+                    size_t               size,
+                    cl_uint              num_events_in_wait_list,
+                    const cl_event *     event_wait_list,
+                    cl_event *           event)
+{
+  CL_TRACE_API();
+  cl_int err = CL_SUCCESS;
+  enqueue_data *data, no_wait_data = { 0 };
+
+  CHECK_QUEUE(command_queue);
+  CHECK_MEM(buffer);
+
+  if (command_queue->ctx != buffer->ctx) {
+    err = CL_INVALID_CONTEXT;
+    goto error;
+  }
+
+  if (IS_IMAGE(buffer)) {
+    err = CL_INVALID_MEM_OBJECT;
+    goto error;
+  }
+
+  if (pattern == NULL || pattern_size == 0 || pattern_size > 128 ||
+      (pattern_size & (pattern_size - 1)) != 0) {
+    err = CL_INVALID_VALUE;
+    goto error;
+  }
+
+  if (offset % pattern_size || size % pattern_size ||
+      offset + size > buffer->size) {
+    err = CL_INVALID_VALUE;
+    goto error;
+  }
+
+  TRY(cl_event_check_waitlist, num_events_in_wait_list, event_wait_list, event, buffer->ctx);
+
+  /* Only recorded in the batch: when the fill has to wait, handle_events gives
+   * the batch to its event which submits it once the wait list completed */
+  if (size) {
+    err = cl_mem_fill(command_queue, pattern, pattern_size, buffer, offset, size);
+    if (err != CL_SUCCESS)
+      goto error;
+  }
+
+  data = &no_wait_data;
+  data->type = EnqueueFillBuffer;
+  data->queue = command_queue;
+
+  if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
+                   event, data, CL_COMMAND_FILL_BUFFER, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
+    if (event && (*event)->type != CL_COMMAND_USER
+            && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
+      cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
+    }
+
+    err = cl_command_queue_flush(command_queue);
+  }
+
+error:
+  return err;
+}
+
 cl_int
 clEnqueueCopyBufferRect(cl_command_queue     command_queue,
                         cl_mem               src_buffer,
@@ -1697,6 +1854,7 @@ clEnqueueCopyBufferRect(cl_command_queue     command_queue,
                         const cl_event *     event_wait_list,
                         cl_event *           event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1768,7 +1926,7 @@ clEnqueueCopyBufferRect(cl_command_queue     command_queue,
   data->queue = command_queue;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_COPY_BUFFER_RECT) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_COPY_BUFFER_RECT, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
     if (event && (*event)->type != CL_COMMAND_USER
             && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
       cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
@@ -1794,6 +1952,7 @@ clEnqueueReadImage(cl_command_queue      command_queue,
                    const cl_event *      event_wait_list,
                    cl_event *            event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1851,7 +2010,7 @@ clEnqueueReadImage(cl_command_queue      command_queue,
   data->slice_pitch = slice_pitch;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_READ_IMAGE) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_READ_IMAGE, blocking_read) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -1873,6 +2032,7 @@ clEnqueueWriteImage(cl_command_queue     command_queue,
                     const cl_event *     event_wait_list,
                     cl_event *           event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -1930,7 +2090,7 @@ clEnqueueWriteImage(cl_command_queue     command_queue,
   data->slice_pitch = slice_pitch;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_WRITE_IMAGE) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_WRITE_IMAGE, blocking_write) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -1950,6 +2110,7 @@ clEnqueueCopyImage(cl_command_queue      command_queue,
                    const cl_event *      event_wait_list,
                    cl_event *            event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
   cl_bool overlap = CL_TRUE;
@@ -2007,7 +2168,72 @@ clEnqueueCopyImage(cl_command_queue      command_queue,
   data->queue = command_queue;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_COPY_IMAGE) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_COPY_IMAGE, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
+    if (event && (*event)->type != CL_COMMAND_USER
+            && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
+      cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
+    }
+
+    err = cl_command_queue_flush(command_queue);
+  }
+
+error:
+  return err;
+}
+
+cl_int
+clEnqueueFillImage(cl_command_queue   command_queue,
+                   cl_mem             image,
+                   const void *       fill_color,
+                   const size_t *     origin,
+                   const size_t *     region,
+                   cl_uint            num_events_in_wait_list,
+                   const cl_event *   event_wait_list,
+                   cl_event *         event)
+{
+  CL_TRACE_API();
+  cl_int err = CL_SUCCESS;
+  enqueue_data *data, no_wait_data = { 0 };
+
+  CHECK_QUEUE(command_queue);
+  CHECK_IMAGE(image, dst_image);
+  if (command_queue->ctx != image->ctx) {
+    err = CL_INVALID_CONTEXT;
+    goto error;
+  }
+
+  if (!fill_color) {
+    err = CL_INVALID_VALUE;
+    goto error;
+  }
+
+  if (!origin || !region || origin[0] + region[0] > dst_image->w ||
+      origin[1] + region[1] > dst_image->h || origin[2] + region[2] > dst_image->depth) {
+    err = CL_INVALID_VALUE;
+    goto error;
+  }
+
+  if (dst_image->image_type != CL_MEM_OBJECT_IMAGE3D && (origin[2] != 0 || region[2] != 1)) {
+    err = CL_INVALID_VALUE;
+    goto error;
+  }
+
+  TRY(cl_event_check_waitlist, num_events_in_wait_list, event_wait_list, event, image->ctx);
+
+  /* Only recorded in the batch: when the fill has to wait, handle_events gives
+   * the batch to its event which submits it once the wait list completed */
+  if (region[0] && region[1] && region[2]) {
+    err = cl_mem_fill_image(command_queue, fill_color, dst_image, origin, region);
+    if (err != CL_SUCCESS)
+      goto error;
+  }
+
+  data = &no_wait_data;
+  data->type = EnqueueFillImage;
+  data->queue = command_queue;
+
+  if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
+                   event, data, CL_COMMAND_FILL_IMAGE, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
     if (event && (*event)->type != CL_COMMAND_USER
             && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
       cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
@@ -2031,6 +2257,7 @@ clEnqueueCopyImageToBuffer(cl_command_queue  command_queue,
                            const cl_event *  event_wait_list,
                            cl_event *        event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -2068,7 +2295,7 @@ clEnqueueCopyImageToBuffer(cl_command_queue  command_queue,
   data->queue = command_queue;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_COPY_IMAGE_TO_BUFFER) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_COPY_IMAGE_TO_BUFFER, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
     if (event && (*event)->type != CL_COMMAND_USER
             && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
       cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
@@ -2092,6 +2319,7 @@ clEnqueueCopyBufferToImage(cl_command_queue  command_queue,
                            const cl_event *  event_wait_list,
                            cl_event *        event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -2129,7 +2357,7 @@ clEnqueueCopyBufferToImage(cl_command_queue  command_queue,
   data->queue = command_queue;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_COPY_BUFFER_TO_IMAGE) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_COPY_BUFFER_TO_IMAGE, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
     if (event && (*event)->type != CL_COMMAND_USER
             && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
       cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
@@ -2148,7 +2376,7 @@ static cl_int _cl_map_mem(cl_mem mem, void **ptr, void **mem_ptr, size_t offset,
   int err = CL_SUCCESS;
   size_t sub_offset = 0;
 
-  if(mem->type == CL_MEM_SUBBUFFER_TYPE) {
+  if(!IS_IMAGE(mem)) {
     struct _cl_mem_buffer* buffer = (struct _cl_mem_buffer*)mem;
     sub_offset = buffer->sub_offset;
   }
@@ -2158,7 +2386,7 @@ static cl_int _cl_map_mem(cl_mem mem, void **ptr, void **mem_ptr, size_t offset,
     goto error;
   }
   *ptr = (char*)(*ptr) + offset + sub_offset;
-  if(mem->flags & CL_MEM_USE_HOST_PTR) {
+  if((mem->flags & CL_MEM_USE_HOST_PTR) && !mem->is_userptr) {
     assert(mem->host_ptr);
     //only calc ptr here, will do memcpy in enqueue
     *mem_ptr = mem->host_ptr + offset + sub_offset;
@@ -2225,6 +2453,7 @@ clEnqueueMapBuffer(cl_command_queue  command_queue,
                    cl_event *        event,
                    cl_int *          errcode_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   void *ptr = NULL;
   void *mem_ptr = NULL;
@@ -2265,7 +2494,7 @@ clEnqueueMapBuffer(cl_command_queue  command_queue,
   data->ptr         = ptr;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_MAP_BUFFER) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_MAP_BUFFER, blocking_map) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -2290,6 +2519,7 @@ clEnqueueMapImage(cl_command_queue   command_queue,
                   cl_event *         event,
                   cl_int *           errcode_ret)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   void *ptr  = NULL;
   void *mem_ptr = NULL;
@@ -2361,7 +2591,7 @@ clEnqueueMapImage(cl_command_queue   command_queue,
   data->offset      = offset;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_MAP_IMAGE) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_MAP_IMAGE, blocking_map) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -2380,6 +2610,7 @@ clEnqueueUnmapMemObject(cl_command_queue  command_queue,
                         const cl_event *  event_wait_list,
                         cl_event *        event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   enqueue_data *data, no_wait_data = { 0 };
 
@@ -2398,7 +2629,7 @@ clEnqueueUnmapMemObject(cl_command_queue  command_queue,
   data->ptr         = mapped_ptr;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_UNMAP_MEM_OBJECT) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_UNMAP_MEM_OBJECT, CL_TRUE) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -2418,11 +2649,13 @@ clEnqueueNDRangeKernel(cl_command_queue  command_queue,
                        const cl_event *  event_wait_list,
                        cl_event *        event)
 {
+  CL_TRACE_API();
   size_t fixed_global_off[] = {0,0,0};
   size_t fixed_global_sz[] = {1,1,1};
   size_t fixed_local_sz[] = {1,1,1};
   cl_int err = CL_SUCCESS;
   cl_uint i;
+  cl_bool batched;
   enqueue_data *data, no_wait_data = { 0 };
 
   CHECK_QUEUE(command_queue);
@@ -2448,10 +2681,11 @@ clEnqueueNDRangeKernel(cl_command_queue  command_queue,
       }
     }
 
-  /* Local sizes must be non-null and divide global sizes */
+  /* Local sizes must be non-null. They do not have to divide the global sizes:
+   * the last groups of each dimension are then smaller */
   if (local_work_size != NULL)
     for (i = 0; i < work_dim; ++i)
-      if (UNLIKELY(local_work_size[i] == 0 || global_work_size[i] % local_work_size[i])) {
+      if (UNLIKELY(local_work_size[i] == 0)) {
         err = CL_INVALID_WORK_GROUP_SIZE;
         goto error;
       }
@@ -2472,19 +2706,11 @@ clEnqueueNDRangeKernel(cl_command_queue  command_queue,
   if (local_work_size != NULL) {
     for (i = 0; i < work_dim; ++i)
       fixed_local_sz[i] = local_work_size[i];
-  } else {
-    uint j, maxDimSize = 64 /* from 64? */, maxGroupSize = 256; //MAX_WORK_GROUP_SIZE may too large
-    for (i = 0; i< work_dim; i++) {
-      for (j = maxDimSize; j > 1; j--) {
-        if (global_work_size[i] % j == 0 && j <= maxGroupSize) {
-          fixed_local_sz[i] = j;
-          maxGroupSize = maxGroupSize /j;
-          maxDimSize = maxGroupSize > maxDimSize ? maxDimSize : maxGroupSize;
-          break;  //choose next work_dim
-        }
-      }
-    }
-  }
+  } else if (kernel->compile_wg_sz[0] || kernel->compile_wg_sz[1] || kernel->compile_wg_sz[2]) {
+    for (i = 0; i < work_dim; ++i)
+      fixed_local_sz[i] = kernel->compile_wg_sz[i];
+  } else
+    cl_kernel_auto_local_sz(kernel, work_dim, global_work_size, fixed_local_sz);
 
   if (global_work_size != NULL)
     for (i = 0; i < work_dim; ++i)
@@ -2503,28 +2729,41 @@ clEnqueueNDRangeKernel(cl_command_queue  command_queue,
     }
   }
 
-  /* Do device specific checks are enqueue the kernel */
-  err = cl_command_queue_ND_range(command_queue,
-                                  kernel,
-                                  work_dim,
-                                  fixed_global_off,
-                                  fixed_global_sz,
-                                  fixed_local_sz);
+  /* Do device specific checks are enqueue the kernel. Without event to track,
+   * consecutive NDRanges share the same batch buffer which is submitted by
+   * clFlush / clFinish, before host side commands or when it is full */
+  batched = cl_command_queue_can_batch(command_queue, num_events_in_wait_list, event);
+  if (batched)
+    err = cl_command_queue_batch_ND_range(command_queue,
+                                          kernel,
+                                          work_dim,
+                                          fixed_global_off,
+                                          fixed_global_sz,
+                                          fixed_local_sz);
+  else
+    err = cl_command_queue_ND_range(command_queue,
+                                    kernel,
+                                    work_dim,
+                                    fixed_global_off,
+                                    fixed_global_sz,
+                                    fixed_local_sz);
   if(err != CL_SUCCESS)
     goto error;
 
   data = &no_wait_data;
   data->type = EnqueueNDRangeKernel;
   data->queue = command_queue;
+  data->kernel = kernel;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_NDRANGE_KERNEL) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_NDRANGE_KERNEL, CL_FALSE) == CL_ENQUEUE_EXECUTE_IMM) {
     if (event && (*event)->type != CL_COMMAND_USER
             && (*event)->queue->props & CL_QUEUE_PROFILING_ENABLE) {
       cl_event_get_timestamp(*event, CL_PROFILING_COMMAND_SUBMIT);
     }
 
-    err = cl_command_queue_flush(command_queue);
+    if (!batched)
+      err = cl_command_queue_flush(command_queue);
   }
 
 error:
@@ -2538,6 +2777,7 @@ clEnqueueTask(cl_command_queue   command_queue,
               const cl_event *   event_wait_list,
               cl_event *         event)
 {
+  CL_TRACE_API();
   const size_t global_size[3] = {1, 0, 0};
   const size_t local_size[3]  = {1, 0, 0};
 
@@ -2557,6 +2797,7 @@ clEnqueueNativeKernel(cl_command_queue   command_queue,
                       const cl_event *   event_wait_list,
                       cl_event *         event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   void *new_args = NULL;
   enqueue_data *data, no_wait_data = { 0 };
@@ -2602,7 +2843,7 @@ clEnqueueNativeKernel(cl_command_queue   command_queue,
   data->user_func   = user_func;
 
   if(handle_events(command_queue, num_events_in_wait_list, event_wait_list,
-                   event, data, CL_COMMAND_NATIVE_KERNEL) == CL_ENQUEUE_EXECUTE_IMM) {
+                   event, data, CL_COMMAND_NATIVE_KERNEL, CL_TRUE) == CL_ENQUEUE_EXECUTE_IMM) {
     err = cl_enqueue_handle(event ? *event : NULL, data);
     if(event) cl_event_set_status(*event, CL_COMPLETE);
   }
@@ -2615,6 +2856,7 @@ cl_int
 clEnqueueMarker(cl_command_queue     command_queue,
                 cl_event *           event)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_QUEUE(command_queue);
   if(event == NULL) {
@@ -2632,6 +2874,7 @@ clEnqueueWaitForEvents(cl_command_queue  command_queue,
                        cl_uint           num_events,
                        const cl_event *  event_list)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_QUEUE(command_queue);
   err = clWaitForEvents(num_events, event_list);
@@ -2643,6 +2886,7 @@ error:
 cl_int
 clEnqueueBarrier(cl_command_queue  command_queue)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_QUEUE(command_queue);
   cl_command_queue_set_barrier(command_queue);
@@ -2658,6 +2902,7 @@ error:
 void*
 clGetExtensionFunctionAddress(const char *func_name)
 {
+  CL_TRACE_API();
   if (func_name == NULL)
     return NULL;
 #ifdef HAS_OCLIcd
@@ -2683,16 +2928,23 @@ clGetExtensionFunctionAddress(const char *func_name)
 cl_int
 clReportUnfreedIntel(void)
 {
+  CL_TRACE_API();
   return cl_report_unfreed();
 }
 
 void*
 clMapBufferIntel(cl_mem mem, cl_int *errcode_ret)
 {
+  CL_TRACE_API();
   void *ptr = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_MEM (mem);
+  /* No queue given: submit the NDRanges which may write the buffer */
+  cl_command_queue_flush_all(mem->ctx);
+  cl_mem_touch(mem);
   ptr = cl_mem_map(mem);
+  if (ptr && !IS_IMAGE(mem))
+    ptr = (char*)ptr + cl_mem_buffer(mem)->sub_offset;
 error:
   if (errcode_ret)
     *errcode_ret = err;
@@ -2702,8 +2954,10 @@ error:
 cl_int
 clUnmapBufferIntel(cl_mem mem)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM (mem);
+  cl_mem_touch(mem);
   err = cl_mem_unmap(mem);
 error:
   return err;
@@ -2712,10 +2966,16 @@ error:
 void*
 clMapBufferGTTIntel(cl_mem mem, cl_int *errcode_ret)
 {
+  CL_TRACE_API();
   void *ptr = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_MEM (mem);
+  /* No queue given: submit the NDRanges which may write the buffer */
+  cl_command_queue_flush_all(mem->ctx);
+  cl_mem_touch(mem);
   ptr = cl_mem_map_gtt(mem);
+  if (ptr && !IS_IMAGE(mem))
+    ptr = (char*)ptr + cl_mem_buffer(mem)->sub_offset;
 error:
   if (errcode_ret)
     *errcode_ret = err;
@@ -2725,8 +2985,10 @@ error:
 cl_int
 clUnmapBufferGTTIntel(cl_mem mem)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM (mem);
+  cl_mem_touch(mem);
   err = cl_mem_unmap_gtt(mem);
 error:
   return err;
@@ -2735,6 +2997,7 @@ error:
 cl_int
 clPinBufferIntel(cl_mem mem)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM (mem);
   cl_mem_pin(mem);
@@ -2745,6 +3008,7 @@ error:
 cl_int
 clUnpinBufferIntel(cl_mem mem)
 {
+  CL_TRACE_API();
   cl_int err = CL_SUCCESS;
   CHECK_MEM (mem);
   cl_mem_unpin(mem);
@@ -2755,6 +3019,7 @@ error:
 cl_int
 clGetGenVersionIntel(cl_device_id device, cl_int *ver)
 {
+  CL_TRACE_API();
   return cl_device_get_version(device, ver);
 }
 
@@ -2765,6 +3030,7 @@ clCreateProgramWithLLVMIntel(cl_context              context,
                              const char *            filename,
                              cl_int *                errcode_ret)
 {
+  CL_TRACE_API();
   return cl_program_create_from_llvm(context,
                                      num_devices,
                                      devices,
@@ -2777,6 +3043,7 @@ clCreateBufferFromLibvaIntel(cl_context  context,
                              unsigned int bo_name,
                              cl_int *errorcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -2794,6 +3061,7 @@ clCreateImageFromLibvaIntel(cl_context context,
                             const cl_libva_image *info,
                             cl_int *errorcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
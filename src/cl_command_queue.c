@@ -28,15 +28,20 @@
 #include "cl_alloc.h"
 #include "cl_driver.h"
 #include "cl_khr_icd.h"
+#include "cl_event.h"
+#include "cl_worker.h"
+#include "cl_trace.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 LOCAL cl_command_queue
 cl_command_queue_new(cl_context ctx)
 {
   cl_command_queue queue = NULL;
+  pthread_mutexattr_t attr;
 
   assert(ctx);
   TRY_ALLOC_NO_ERR (queue, CALLOC(struct _cl_command_queue));
@@ -44,9 +49,16 @@ cl_command_queue_new(cl_context ctx)
   queue->magic = CL_MAGIC_QUEUE_HEADER;
   queue->ref_n = 1;
   queue->ctx = ctx;
+  /* The constant buffer upload flushes the queue while an NDRange is batched */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&queue->batch_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  pthread_mutex_init(&queue->async_lock, NULL);
   if ((queue->thread_data = cl_thread_data_create()) == NULL) {
     goto error;
   }
+  queue->worker = cl_worker_new();
 
   /* Append the command queue in the list */
   pthread_mutex_lock(&ctx->queue_lock);
@@ -67,6 +79,76 @@ error:
   goto exit;
 }
 
+static void
+cl_command_queue_submit(cl_gpgpu gpgpu)
+{
+  cl_gpgpu_flush(gpgpu);
+  if (cl_trace_enabled())
+    cl_trace_gpu_submitted(gpgpu);
+}
+
+/* Submits the NDRanges batched by the threads (but the one of gpgpu). If bufs
+ * is not NULL, it returns their batch buffers referenced to wait for them
+ */
+static uint32_t
+cl_command_queue_submit_batches(cl_command_queue queue, cl_gpgpu gpgpu, void ***bufs)
+{
+  uint32_t i, buf_n = 0;
+
+  pthread_mutex_lock(&queue->batch_lock);
+    if (bufs != NULL && queue->batch_gpgpu_n != 0)
+      *bufs = cl_calloc(queue->batch_gpgpu_n, sizeof(void *));
+    for (i = 0; i < queue->batch_gpgpu_n; ++i) {
+      if (queue->batch_gpgpus[i] == gpgpu)
+        continue;
+      cl_command_queue_submit(queue->batch_gpgpus[i]);
+      if (bufs != NULL && *bufs != NULL)
+        (*bufs)[buf_n++] = cl_gpgpu_ref_batch_buf(queue->batch_gpgpus[i]);
+    }
+    queue->batch_gpgpu_n = 0;
+    if (gpgpu != NULL)
+      cl_command_queue_submit(gpgpu);
+  pthread_mutex_unlock(&queue->batch_lock);
+  return buf_n;
+}
+
+/* Called with the batch lock held */
+static void
+cl_command_queue_add_batch_gpgpu(cl_command_queue queue, cl_gpgpu gpgpu)
+{
+  uint32_t i;
+
+  for (i = 0; i < queue->batch_gpgpu_n; ++i)
+    if (queue->batch_gpgpus[i] == gpgpu)
+      return;
+  if (queue->batch_gpgpu_n == queue->batch_gpgpu_sz) {
+    const uint32_t sz = queue->batch_gpgpu_sz ? 2 * queue->batch_gpgpu_sz : 4;
+    cl_gpgpu *gpgpus = cl_realloc(queue->batch_gpgpus, sz * sizeof(cl_gpgpu));
+    /* Without room, the NDRanges are submitted right away */
+    if (gpgpus == NULL) {
+      cl_command_queue_submit(gpgpu);
+      return;
+    }
+    queue->batch_gpgpus = gpgpus;
+    queue->batch_gpgpu_sz = sz;
+  }
+  queue->batch_gpgpus[queue->batch_gpgpu_n++] = gpgpu;
+}
+
+LOCAL void
+cl_command_queue_forget_gpgpu(cl_command_queue queue, cl_gpgpu gpgpu)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&queue->batch_lock);
+    for (i = 0; i < queue->batch_gpgpu_n; ++i)
+      if (queue->batch_gpgpus[i] == gpgpu) {
+        queue->batch_gpgpus[i] = queue->batch_gpgpus[--queue->batch_gpgpu_n];
+        break;
+      }
+  pthread_mutex_unlock(&queue->batch_lock);
+}
+
 LOCAL void
 cl_command_queue_delete(cl_command_queue queue)
 {
@@ -83,6 +165,13 @@ cl_command_queue_delete(cl_command_queue queue)
     if (queue->ctx->queues == queue)
       queue->ctx->queues = queue->next;
   pthread_mutex_unlock(&queue->ctx->queue_lock);
+  cl_worker_delete(queue->worker);
+  queue->worker = NULL;
+  cl_event_delete(queue->async_last);
+  /* The gpgpus of the other threads outlive the queue */
+  cl_command_queue_submit_batches(queue, NULL, NULL);
+  if (cl_trace_enabled())
+    cl_trace_gpu_collect(queue, NULL, 1);
   if (queue->fulsim_out != NULL) {
     cl_mem_delete(queue->fulsim_out);
     queue->fulsim_out = NULL;
@@ -93,6 +182,9 @@ cl_command_queue_delete(cl_command_queue queue)
   cl_mem_delete(queue->perf);
   cl_context_delete(queue->ctx);
   cl_free(queue->wait_events);
+  cl_free(queue->batch_gpgpus);
+  pthread_mutex_destroy(&queue->batch_lock);
+  pthread_mutex_destroy(&queue->async_lock);
   queue->magic = CL_MAGIC_DEAD_HEADER; /* For safety */
   cl_free(queue);
 }
@@ -103,23 +195,6 @@ cl_command_queue_add_ref(cl_command_queue queue)
   atomic_inc(&queue->ref_n);
 }
 
-static void
-set_image_info(char *curbe,
-               struct ImageInfo * image_info,
-               struct _cl_mem_image *image)
-{
-  if (image_info->wSlot >= 0)
-    *(uint32_t*)(curbe + image_info->wSlot) = image->w;
-  if (image_info->hSlot >= 0)
-    *(uint32_t*)(curbe + image_info->hSlot) = image->h;
-  if (image_info->depthSlot >= 0)
-    *(uint32_t*)(curbe + image_info->depthSlot) = image->depth;
-  if (image_info->channelOrderSlot >= 0)
-    *(uint32_t*)(curbe + image_info->channelOrderSlot) = image->fmt.image_channel_order;
-  if (image_info->dataTypeSlot >= 0)
-    *(uint32_t*)(curbe + image_info->dataTypeSlot) = image->fmt.image_channel_data_type;
-}
-
 LOCAL cl_int
 cl_command_queue_bind_image(cl_command_queue queue, cl_kernel k)
 {
@@ -129,9 +204,8 @@ cl_command_queue_bind_image(cl_command_queue queue, cl_kernel k)
   for (i = 0; i < k->image_sz; i++) {
     int id = k->images[i].arg_idx;
     struct _cl_mem_image *image;
-    assert(gbe_kernel_get_arg_type(k->opaque, id) == GBE_ARG_IMAGE);
+    assert(k->arg_info[id].type == GBE_ARG_IMAGE);
     image = cl_mem_image(k->args[id].mem);
-    set_image_info(k->curbe, &k->images[i], image);
     cl_gpgpu_bind_image(gpgpu, k->images[i].idx, image->base.bo, image->offset,
                         image->intel_fmt, image->image_type,
                         image->w, image->h, image->depth,
@@ -150,16 +224,15 @@ cl_command_queue_bind_surface(cl_command_queue queue, cl_kernel k)
   enum gbe_arg_type arg_type; /* kind of argument */
   for (i = 0; i < k->arg_n; ++i) {
     uint32_t offset; // location of the address in the curbe
-    arg_type = gbe_kernel_get_arg_type(k->opaque, i);
+    arg_type = k->arg_info[i].type;
     if (arg_type != GBE_ARG_GLOBAL_PTR || !k->args[i].mem)
       continue;
-    offset = gbe_kernel_get_curbe_offset(k->opaque, GBE_CURBE_KERNEL_ARGUMENT, i);
-    if (k->args[i].mem->type == CL_MEM_SUBBUFFER_TYPE) {
-      struct _cl_mem_buffer* buffer = (struct _cl_mem_buffer*)k->args[i].mem;
-      cl_gpgpu_bind_buf(gpgpu, k->args[i].mem->bo, offset, buffer->sub_offset, cc_llc_l3);
-    } else {
-      cl_gpgpu_bind_buf(gpgpu, k->args[i].mem->bo, offset, 0, cc_llc_l3);
-    }
+    offset = k->arg_info[i].offset;
+    /* The kernel may write it */
+    cl_mem_touch(k->args[i].mem);
+    /* Sub-buffers and pooled buffers start inside their buffer object */
+    struct _cl_mem_buffer* buffer = (struct _cl_mem_buffer*)k->args[i].mem;
+    cl_gpgpu_bind_buf(gpgpu, k->args[i].mem->bo, offset, buffer->sub_offset, cc_llc_l3);
   }
 
   return CL_SUCCESS;
@@ -207,7 +280,7 @@ cl_fulsim_dump_all_surfaces(cl_command_queue queue, cl_kernel k)
   /* Bind user defined surface */
   for (i = 0; i < k->arg_n; ++i) {
     size_t chunk_n, chunk_remainder;
-    if (gbe_kernel_get_arg_type(k->opaque, i) != GBE_ARG_GLOBAL_PTR)
+    if (k->arg_info[i].type != GBE_ARG_GLOBAL_PTR)
       continue;
     mem = (cl_mem) k->args[i].mem;
     CHECK_MEM(mem);
@@ -315,7 +388,7 @@ cl_fulsim_read_all_surfaces(cl_command_queue queue, cl_kernel k)
   int i, curr = 0;
   /* Bind user defined surface */
   for (i = 0; i < k->arg_n; ++i) {
-    if (gbe_kernel_get_arg_type(k->opaque, i) != GBE_ARG_GLOBAL_PTR)
+    if (k->arg_info[i].type != GBE_ARG_GLOBAL_PTR)
       continue;
     mem = (cl_mem) k->args[i].mem;
     CHECK_MEM(mem);
@@ -356,7 +429,10 @@ error:
 }
 #endif
 
-extern cl_int cl_command_queue_ND_range_gen7(cl_command_queue, cl_kernel, uint32_t, const size_t *, const size_t *, const size_t *);
+extern cl_int cl_command_queue_ND_range_gen7(cl_command_queue, cl_kernel, uint32_t,
+                                             const size_t *, const size_t *, const size_t *,
+                                             const size_t *, const size_t *, const size_t *,
+                                             cl_bool);
 
 static cl_int
 cl_kernel_check_args(cl_kernel k)
@@ -368,20 +444,35 @@ cl_kernel_check_args(cl_kernel k)
   return CL_SUCCESS;
 }
 
-LOCAL cl_int
-cl_command_queue_ND_range(cl_command_queue queue,
-                          cl_kernel k,
-                          const uint32_t work_dim,
-                          const size_t *global_wk_off,
-                          const size_t *global_wk_sz,
-                          const size_t *local_wk_sz)
+static cl_int
+cl_command_queue_emit_ND_range(cl_command_queue queue,
+                               cl_kernel k,
+                               const uint32_t work_dim,
+                               const size_t *global_wk_off,
+                               const size_t *global_wk_sz,
+                               const size_t *local_wk_sz,
+                               cl_bool batch)
 {
+  CL_TRACE_SCOPE("ND range", "enqueue");
   const int32_t ver = cl_driver_get_ver(queue->ctx->drv);
+  size_t full_n[3], edge_sz[3];
+  uint32_t i, part, walker_n = 0;
   cl_int err = CL_SUCCESS;
+  cl_bool locked = CL_FALSE;
 
   /* Check that the user did not forget any argument */
   TRY (cl_kernel_check_args, k);
 
+  /* Start from an empty batch buffer if the call is submitted on its own.
+   * Otherwise, any thread may submit the batched NDRanges: the batch buffer
+   * is only built under the lock
+   */
+  if (batch) {
+    pthread_mutex_lock(&queue->batch_lock);
+    locked = CL_TRUE;
+  } else
+    TRY (cl_command_queue_flush, queue);
+
 #if USE_FULSIM
   cl_buffer_mgr bufmgr = NULL;
   FILE *file = NULL;
@@ -394,11 +485,34 @@ cl_command_queue_ND_range(cl_command_queue queue,
   }
 #endif /* USE_FULSIM */
 
-  if (ver == 7 || ver == 75)
-    TRY (cl_command_queue_ND_range_gen7, queue, k, work_dim, global_wk_off, global_wk_sz, local_wk_sz);
-  else
+  if (ver != 7 && ver != 75)
     FATAL ("Unknown Gen Device");
 
+  /* When the local size does not divide the global size, the last group of
+   * the dimension is smaller. A walker only runs groups of the same size: the
+   * full groups and the edge ones of each dimension are run by different
+   * walkers, up to 8 of them appended to the same batch buffer
+   */
+  for (i = 0; i < 3; ++i) {
+    full_n[i] = global_wk_sz[i] / local_wk_sz[i];
+    edge_sz[i] = global_wk_sz[i] % local_wk_sz[i];
+  }
+  for (part = 0; part < 8; ++part) {
+    size_t group_off[3], group_n[3], group_wk_sz[3];
+    for (i = 0; i < 3; ++i) {
+      const int edge = (part >> i) & 1;
+      group_off[i] = edge ? full_n[i] : 0;
+      group_n[i] = edge ? (edge_sz[i] ? 1 : 0) : full_n[i];
+      group_wk_sz[i] = edge ? edge_sz[i] : local_wk_sz[i];
+    }
+    if (group_n[0] == 0 || group_n[1] == 0 || group_n[2] == 0)
+      continue;
+    TRY (cl_command_queue_ND_range_gen7, queue, k, work_dim, global_wk_off, global_wk_sz,
+         local_wk_sz, group_off, group_n, group_wk_sz, walker_n++ == 0);
+  }
+  if (cl_trace_enabled())
+    cl_trace_gpu_walker(queue, cl_get_thread_gpgpu(queue), cl_kernel_get_name(k));
+
 #if USE_FULSIM
   if (run_it != NULL && strcmp(run_it, "1") == 0) {
     TRY (cl_fulsim_dump_all_surfaces, queue, k);
@@ -410,24 +524,123 @@ cl_command_queue_ND_range(cl_command_queue queue,
 #endif /* USE_FULSIM */
 
 error:
+  if (locked) {
+    cl_command_queue_add_batch_gpgpu(queue, cl_get_thread_gpgpu(queue));
+    pthread_mutex_unlock(&queue->batch_lock);
+  }
   return err;
 }
 
+LOCAL cl_int
+cl_command_queue_ND_range(cl_command_queue queue,
+                          cl_kernel k,
+                          const uint32_t work_dim,
+                          const size_t *global_wk_off,
+                          const size_t *global_wk_sz,
+                          const size_t *local_wk_sz)
+{
+  return cl_command_queue_emit_ND_range(queue, k, work_dim, global_wk_off,
+                                        global_wk_sz, local_wk_sz, CL_FALSE);
+}
+
+LOCAL cl_int
+cl_command_queue_batch_ND_range(cl_command_queue queue,
+                                cl_kernel k,
+                                const uint32_t work_dim,
+                                const size_t *global_wk_off,
+                                const size_t *global_wk_sz,
+                                const size_t *local_wk_sz)
+{
+  return cl_command_queue_emit_ND_range(queue, k, work_dim, global_wk_off,
+                                        global_wk_sz, local_wk_sz, CL_TRUE);
+}
+
+DEFINE_ENV_INT(cl_command_queue_batching, "OCL_BATCH_NDRANGE", 1)
+
+LOCAL cl_bool
+cl_command_queue_can_batch(cl_command_queue queue,
+                           cl_uint num_events_in_wait_list,
+                           const cl_event *event)
+{
+  /* Events need their own batch buffer (it tells when they complete) and so
+   * does the profiling */
+  return cl_command_queue_batching() &&
+         event == NULL &&
+         num_events_in_wait_list == 0 &&
+         queue->wait_events_num == 0 &&
+         !cl_command_queue_is_behind(queue) &&
+         !(queue->props & CL_QUEUE_PROFILING_ENABLE);
+}
+
 LOCAL cl_int
 cl_command_queue_flush(cl_command_queue queue)
 {
+  CL_TRACE_SCOPE("flush", "driver");
   GET_QUEUE_THREAD_GPGPU(queue);
 
-  cl_gpgpu_flush(gpgpu);
-
-  cl_invalid_thread_gpgpu(queue);
+  /* The gpgpus are kept: their state buffers are recycled by the next calls */
+  cl_command_queue_submit_batches(queue, gpgpu, NULL);
   return CL_SUCCESS;
 }
 
+LOCAL cl_bool
+cl_command_queue_batch_uses(cl_command_queue queue, cl_buffer bo)
+{
+  cl_bool uses = CL_FALSE;
+  uint32_t i;
+
+  pthread_mutex_lock(&queue->batch_lock);
+    for (i = 0; i < queue->batch_gpgpu_n && !uses; ++i) {
+      void *batch = cl_gpgpu_ref_batch_buf(queue->batch_gpgpus[i]);
+      uses = batch != NULL && cl_buffer_references((cl_buffer) batch, bo);
+      cl_gpgpu_unref_batch_buf(batch);
+    }
+  pthread_mutex_unlock(&queue->batch_lock);
+  return uses;
+}
+
+LOCAL void
+cl_command_queue_flush_all(cl_context ctx)
+{
+  cl_command_queue queue;
+  pthread_mutex_lock(&ctx->queue_lock);
+    for (queue = ctx->queues; queue != NULL; queue = queue->next)
+      cl_command_queue_flush(queue);
+  pthread_mutex_unlock(&ctx->queue_lock);
+}
+
+LOCAL cl_bool
+cl_command_queue_is_behind(cl_command_queue queue)
+{
+  cl_bool behind;
+
+  pthread_mutex_lock(&queue->async_lock);
+    behind = queue->async_last != NULL && cl_event_is_deferring(queue->async_last);
+  pthread_mutex_unlock(&queue->async_lock);
+  return behind;
+}
+
 LOCAL cl_int
 cl_command_queue_finish(cl_command_queue queue)
 {
+  CL_TRACE_SCOPE("finish", "wait");
+  if (queue->worker)
+    cl_worker_wait_idle(queue->worker);
+
+  GET_QUEUE_THREAD_GPGPU(queue);
+  void **bufs = NULL;
+  uint32_t i, buf_n;
+
+  /* Submit the accumulated NDRanges first, the ones of the other threads too */
+  buf_n = cl_command_queue_submit_batches(queue, gpgpu, &bufs);
   cl_gpgpu_sync(cl_get_thread_batch_buf());
+  for (i = 0; i < buf_n; ++i) {
+    cl_gpgpu_sync(bufs[i]);
+    cl_gpgpu_unref_batch_buf(bufs[i]);
+  }
+  cl_free(bufs);
+  if (cl_trace_enabled())
+    cl_trace_gpu_collect(queue, gpgpu, 1);
   return CL_SUCCESS;
 }
 
@@ -501,6 +714,9 @@ cl_command_queue_remove_event(cl_command_queue queue, cl_event event)
 LOCAL void
 cl_command_queue_set_barrier(cl_command_queue queue)
 {
+    /* Out of order queues: the commands given to the worker are not chained */
+    if (queue->worker && (queue->props & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
+      cl_worker_wait_idle(queue->worker);
     queue->barrier_index = queue->wait_events_num;
 }
 
@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 struct intel_gpgpu;
+struct _cl_worker;
 
 /* Basically, this is a (kind-of) batch buffer */
 struct _cl_command_queue {
@@ -39,6 +40,13 @@ struct _cl_command_queue {
   cl_int    wait_events_size;          /* The size of array that wait_events point to */
   cl_int    barrier_index;             /* Indicate event count in wait_events as barrier events */
   cl_event  last_event;                /* The last event in the queue, for enqueue mark used */
+  struct _cl_worker *worker;           /* Runs the host side commands (may be NULL) */
+  cl_event  async_last;                /* Last deferred command of an in order queue with a worker */
+  pthread_mutex_t async_lock;          /* Protects async_last */
+  pthread_mutex_t batch_lock;          /* Protects the batched NDRanges (recursive) */
+  cl_gpgpu *batch_gpgpus;              /* Gpgpus of the threads with NDRanges batched on the queue */
+  uint32_t  batch_gpgpu_n;             /* Number of them */
+  uint32_t  batch_gpgpu_sz;            /* Size of the batch_gpgpus array */
   cl_command_queue_properties  props;  /* Queue properties */
   cl_command_queue prev, next;         /* We chain the command queues together */
   void *thread_data;                   /* Used to store thread context data */
@@ -71,15 +79,59 @@ extern cl_int cl_command_queue_ND_range(cl_command_queue queue,
                                         const size_t *global_work_size,
                                         const size_t *local_work_size);
 
+/* Same but the NDRange is appended to the batch buffer of the previous ones.
+ * It is submitted by cl_command_queue_flush, from any thread (or when full)
+ */
+extern cl_int cl_command_queue_batch_ND_range(cl_command_queue queue,
+                                              cl_kernel ker,
+                                              const uint32_t work_dim,
+                                              const size_t *global_work_offset,
+                                              const size_t *global_work_size,
+                                              const size_t *local_work_size);
+
+/* Return true if an NDRange with these events may be batched (see
+ * OCL_BATCH_NDRANGE)
+ */
+extern cl_bool cl_command_queue_can_batch(cl_command_queue queue,
+                                          cl_uint num_events_in_wait_list,
+                                          const cl_event *event);
+
 /* The memory object where to report the performance */
 extern cl_int cl_command_queue_set_report_buffer(cl_command_queue, cl_mem);
 
 /* Fulsim will dump this buffer (mostly to check its consistency */
 cl_int cl_command_queue_set_fulsim_buffer(cl_command_queue, cl_mem);
 
-/* Flush for the command queue */
+/* The __constant arguments of a deferred NDRange. The commands it waits for
+ * may write them: they are copied again in its constant buffer when it runs
+ */
+typedef struct cl_constant_copy cl_constant_copy;
+
+/* NULL if the kernel has no __constant argument */
+extern cl_constant_copy *cl_constant_copy_new(cl_kernel);
+
+/* Copy the arguments in the constant buffer */
+extern void cl_constant_copy_run(cl_constant_copy *);
+
+extern void cl_constant_copy_delete(cl_constant_copy *);
+
+/* Flush for the command queue: the NDRanges batched by all the threads */
 extern cl_int cl_command_queue_flush(cl_command_queue);
 
+/* Tell if an NDRange batched on the queue and not submitted yet uses bo */
+extern cl_bool cl_command_queue_batch_uses(cl_command_queue, cl_buffer bo);
+
+/* The gpgpu of a thread is going away: the queue must not submit it anymore */
+extern void cl_command_queue_forget_gpgpu(cl_command_queue, cl_gpgpu);
+
+/* Flush all the command queues of the context */
+extern void cl_command_queue_flush_all(cl_context);
+
+/* True if the next command of this in order queue must wait for the ones
+ * deferred before it
+ */
+extern cl_bool cl_command_queue_is_behind(cl_command_queue);
+
 /* Wait for the completion of the command queue */
 extern cl_int cl_command_queue_finish(cl_command_queue);
 
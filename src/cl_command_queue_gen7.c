@@ -23,18 +23,74 @@
 #include "cl_kernel.h"
 #include "cl_device_id.h"
 #include "cl_mem.h"
+#include "cl_trace.h"
 #include "cl_utils.h"
 #include "cl_alloc.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <emmintrin.h>
 
 static INLINE size_t cl_kernel_compute_batch_sz(cl_kernel k) { return 256+32; }
 
 /* "Varing" payload is the part of the curbe that changes accross threads in the
- *  same work group. Right now, it consists in local IDs and block IPs
+ *  same work group. Right now, it consists in local IDs and block IPs. The
+ *  payload of one thread is laid out as the IDs X, Y, Z (uint32_t) and the
+ *  block IPs (uint16_t), simd_sz lanes each
  */
+#define PAYLOAD_SZ(SIMD_SZ) ((SIMD_SZ) * (3 * sizeof(uint32_t) + sizeof(uint16_t)))
+
+static void
+cl_build_varying_payload(char *data,
+                         const size_t *local_wk_sz,
+                         size_t simd_sz,
+                         size_t thread_n)
+{
+  const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+  const size_t local_sz = local_wk_sz[0] * local_wk_sz[1] * local_wk_sz[2];
+  size_t i = 0, j = 0, k = 0, t, l, curr = 0;
+
+  for (t = 0; t < thread_n; ++t, data += PAYLOAD_SZ(simd_sz)) {
+    uint32_t *ids0 = (uint32_t *) data;
+    uint32_t *ids1 = ids0 + simd_sz;
+    uint32_t *ids2 = ids1 + simd_sz;
+    uint16_t *ips = (uint16_t *) (ids2 + simd_sz);
+    const size_t active_n = local_sz - curr < simd_sz ? local_sz - curr : simd_sz;
+
+    /* Four lanes at once as long as they stay on the same row */
+    for (l = 0; l < active_n;) {
+      if (l + 4 <= active_n && i + 4 <= local_wk_sz[0]) {
+        _mm_storeu_si128((__m128i *) (ids0 + l), _mm_add_epi32(_mm_set1_epi32(i), lanes));
+        _mm_storeu_si128((__m128i *) (ids1 + l), _mm_set1_epi32(j));
+        _mm_storeu_si128((__m128i *) (ids2 + l), _mm_set1_epi32(k));
+        l += 4;
+        i += 4;
+      } else {
+        ids0[l] = i;
+        ids1[l] = j;
+        ids2[l] = k;
+        l++;
+        i++;
+      }
+      if (i == local_wk_sz[0]) {
+        i = 0;
+        if (++j == local_wk_sz[1]) {
+          j = 0;
+          ++k;
+        }
+      }
+    }
+    for (; l < simd_sz; ++l)
+      ids0[l] = ids1[l] = ids2[l] = 0;
+    curr += active_n;
+
+    /* 0xffff means that the lane is inactivated */
+    memset(ips, 0, sizeof(uint16_t) * active_n);
+    memset(ips + active_n, 0xff, sizeof(uint16_t) * (simd_sz - active_n));
+  }
+}
+
 static cl_int
 cl_set_varying_payload(const cl_kernel ker,
                        char *data,
@@ -43,51 +99,52 @@ cl_set_varying_payload(const cl_kernel ker,
                        size_t cst_sz,
                        size_t thread_n)
 {
-  uint32_t *ids[3] = {NULL,NULL,NULL};
-  uint16_t *block_ips = NULL;
-  size_t i, j, k, curr = 0;
-  int32_t id_offset[3], ip_offset;
+  cl_thread_payload *payload = &ker->payload;
+  const int32_t *id_offset = ker->patch.local_id;
+  const int32_t ip_offset = ker->patch.block_ip;
+  const size_t ids_sz = sizeof(uint32_t) * simd_sz;
+  const size_t ips_sz = sizeof(uint16_t) * simd_sz;
+  const char *src = NULL;
+  size_t i;
   cl_int err = CL_SUCCESS;
 
-  id_offset[0] = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_LOCAL_ID_X, 0);
-  id_offset[1] = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_LOCAL_ID_Y, 0);
-  id_offset[2] = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_LOCAL_ID_Z, 0);
-  ip_offset = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_BLOCK_IP, 0);
   assert(id_offset[0] >= 0 &&
          id_offset[1] >= 0 &&
          id_offset[2] >= 0 &&
          ip_offset >= 0);
 
-  TRY_ALLOC(ids[0], (uint32_t*) alloca(sizeof(uint32_t)*thread_n*simd_sz));
-  TRY_ALLOC(ids[1], (uint32_t*) alloca(sizeof(uint32_t)*thread_n*simd_sz));
-  TRY_ALLOC(ids[2], (uint32_t*) alloca(sizeof(uint32_t)*thread_n*simd_sz));
-  TRY_ALLOC(block_ips, (uint16_t*) alloca(sizeof(uint16_t)*thread_n*simd_sz));
-
-  /* 0xffff means that the lane is inactivated */
-  memset(block_ips, 0xff, sizeof(uint16_t)*thread_n*simd_sz);
-
-  /* Compute the IDs and the block IPs */
-  for (k = 0; k < local_wk_sz[2]; ++k)
-  for (j = 0; j < local_wk_sz[1]; ++j)
-  for (i = 0; i < local_wk_sz[0]; ++i, ++curr) {
-    ids[0][curr] = i;
-    ids[1][curr] = j;
-    ids[2][curr] = k;
-    block_ips[curr] = 0;
+  /* The payload only depends on the local size: rebuild it when it changes */
+  if (payload->data == NULL ||
+      payload->simd_sz != simd_sz ||
+      memcmp(payload->local_wk_sz, local_wk_sz, sizeof(payload->local_wk_sz))) {
+    if (payload->data)
+      cl_free(payload->data);
+    payload->data = NULL;
+    TRY_ALLOC (payload->data, (char*) cl_malloc(thread_n * PAYLOAD_SZ(simd_sz)));
+    cl_build_varying_payload(payload->data, local_wk_sz, simd_sz, thread_n);
+    memcpy(payload->local_wk_sz, local_wk_sz, sizeof(payload->local_wk_sz));
+    payload->simd_sz = simd_sz;
   }
 
-  /* Copy them to the curbe buffer */
-  curr = 0;
-  for (i = 0; i < thread_n; ++i, data += cst_sz) {
-    uint32_t *ids0 = (uint32_t *) (data + id_offset[0]);
-    uint32_t *ids1 = (uint32_t *) (data + id_offset[1]);
-    uint32_t *ids2 = (uint32_t *) (data + id_offset[2]);
-    uint16_t *ips  = (uint16_t *) (data + ip_offset);
-    for (j = 0; j < simd_sz; ++j, ++curr) {
-      ids0[j] = ids[0][curr];
-      ids1[j] = ids[1][curr];
-      ids2[j] = ids[2][curr];
-      ips[j] = block_ips[curr];
+  /* The compiler allocates the local IDs next to each other and usually the
+   * block IPs right after them: copy as much as possible at once
+   */
+  const int ids_packed = id_offset[1] == id_offset[0] + (int32_t) ids_sz &&
+                         id_offset[2] == id_offset[1] + (int32_t) ids_sz;
+  const int all_packed = ids_packed && ip_offset == id_offset[2] + (int32_t) ids_sz;
+  src = payload->data;
+  for (i = 0; i < thread_n; ++i, data += cst_sz, src += PAYLOAD_SZ(simd_sz)) {
+    if (all_packed)
+      memcpy(data + id_offset[0], src, PAYLOAD_SZ(simd_sz));
+    else {
+      if (ids_packed)
+        memcpy(data + id_offset[0], src, 3 * ids_sz);
+      else {
+        memcpy(data + id_offset[0], src, ids_sz);
+        memcpy(data + id_offset[1], src + ids_sz, ids_sz);
+        memcpy(data + id_offset[2], src + 2 * ids_sz, ids_sz);
+      }
+      memcpy(data + ip_offset, src + 3 * ids_sz, ips_sz);
     }
   }
 
@@ -95,27 +152,143 @@ error:
   return err;
 }
 
+/* The constant buffer holds the global constants of the program and the data
+ * of the __constant arguments. It is kept on the kernel and only built again
+ * when an argument is set or when the content of one of them changed
+ */
+static int
+cl_constant_buffer_is_valid(cl_kernel ker)
+{
+  uint32_t arg;
+  if (ker->cst_bo == NULL || ker->cst_dirty)
+    return 0;
+  for (arg = 0; arg < ker->arg_n; ++arg) {
+    cl_mem mem = ker->args[arg].mem;
+    if (ker->arg_info[arg].type == GBE_ARG_CONSTANT_PTR && mem &&
+        cl_mem_write_gen(mem) != ker->args[arg].cst_gen)
+      return 0;
+  }
+  return 1;
+}
+
 static void
+cl_constant_buffer_copy_arg(char *cst_addr, uint32_t offset, cl_mem mem)
+{
+  char *addr = (char*) cl_mem_map(mem);
+  memcpy(cst_addr + offset, addr + cl_mem_buffer(mem)->sub_offset, mem->size);
+  cl_mem_unmap(mem);
+}
+
+struct cl_constant_copy {
+  cl_kernel ker;              /* Its constant buffer is not recycled meanwhile */
+  cl_buffer bo;               /* Constant buffer of the NDRange */
+  uint32_t arg_n;             /* Number of __constant arguments */
+  cl_mem mem[];               /* Then their offsets in the buffer */
+};
+
+LOCAL cl_constant_copy *
+cl_constant_copy_new(cl_kernel ker)
+{
+  cl_constant_copy *copy = NULL;
+  uint32_t *offsets, arg, n = 0;
+
+  if (ker->cst_bo == NULL)
+    return NULL;
+  for (arg = 0; arg < ker->arg_n; ++arg)
+    if (ker->arg_info[arg].type == GBE_ARG_CONSTANT_PTR && ker->args[arg].mem)
+      n++;
+  if (n == 0)
+    return NULL;
+  copy = cl_malloc(sizeof(*copy) + n * (sizeof(cl_mem) + sizeof(uint32_t)));
+  if (copy == NULL)
+    return NULL;
+  offsets = (uint32_t *) (copy->mem + n);
+  copy->ker = ker;
+  copy->bo = ker->cst_bo;
+  copy->arg_n = 0;
+  cl_kernel_add_ref(ker);
+  cl_buffer_reference(copy->bo);
+  atomic_inc(&ker->cst_copy_n);
+  for (arg = 0; arg < ker->arg_n; ++arg) {
+    cl_mem mem = ker->args[arg].mem;
+    if (ker->arg_info[arg].type != GBE_ARG_CONSTANT_PTR || mem == NULL)
+      continue;
+    cl_mem_add_ref(mem);
+    offsets[copy->arg_n] = ker->args[arg].cst_offset;
+    copy->mem[copy->arg_n++] = mem;
+  }
+  return copy;
+}
+
+LOCAL void
+cl_constant_copy_run(cl_constant_copy *copy)
+{
+  const uint32_t *offsets;
+  char *cst_addr;
+  uint32_t i, changed = 0;
+
+  if (copy == NULL)
+    return;
+  offsets = (const uint32_t *) (copy->mem + copy->arg_n);
+  cl_buffer_map(copy->bo, 1);
+  cst_addr = cl_buffer_get_virtual(copy->bo);
+  for (i = 0; i < copy->arg_n; ++i) {
+    cl_mem mem = copy->mem[i];
+    char *addr = (char*) cl_mem_map(mem) + cl_mem_buffer(mem)->sub_offset;
+    if (memcmp(cst_addr + offsets[i], addr, mem->size) != 0) {
+      memcpy(cst_addr + offsets[i], addr, mem->size);
+      changed = 1;
+    }
+    cl_mem_unmap(mem);
+  }
+  cl_buffer_unmap(copy->bo);
+
+  /* The enqueues sharing the buffer were made with the previous content */
+  if (changed && copy->bo == copy->ker->cst_bo)
+    copy->ker->cst_dirty = 1;
+}
+
+LOCAL void
+cl_constant_copy_delete(cl_constant_copy *copy)
+{
+  uint32_t i;
+  if (copy == NULL)
+    return;
+  for (i = 0; i < copy->arg_n; ++i)
+    cl_mem_delete(copy->mem[i]);
+  if (copy->bo == copy->ker->cst_bo)
+    atomic_dec(&copy->ker->cst_copy_n);
+  cl_kernel_delete(copy->ker);
+  cl_buffer_unreference(copy->bo);
+  cl_free(copy);
+}
+
+static cl_int
 cl_upload_constant_buffer(cl_command_queue queue, cl_kernel ker)
 {
   /* calculate constant buffer size
    * we need raw_size & aligned_size
    */
-  GET_QUEUE_THREAD_GPGPU(queue);
   int32_t arg;
   size_t offset = 0;
   uint32_t raw_size = 0, aligned_size =0;
   gbe_program prog = ker->program->opaque;
-  const int32_t arg_n = gbe_kernel_get_arg_num(ker->opaque);
+  const int32_t arg_n = ker->arg_n;
   size_t global_const_size = gbe_program_get_global_constant_size(prog);
+  cl_buffer bo = NULL;
+  cl_int err = CL_SUCCESS;
+
+  if (cl_constant_buffer_is_valid(ker))
+    return CL_SUCCESS;
+
   aligned_size = raw_size = global_const_size;
   /* Reserve 8 bytes to get rid of 0 address */
   if(global_const_size == 0) aligned_size = 8;
 
   for (arg = 0; arg < arg_n; ++arg) {
-    const enum gbe_arg_type type = gbe_kernel_get_arg_type(ker->opaque, arg);
+    const enum gbe_arg_type type = ker->arg_info[arg].type;
     if (type == GBE_ARG_CONSTANT_PTR && ker->args[arg].mem) {
-      uint32_t alignment = gbe_kernel_get_arg_align(ker->opaque, arg);
+      uint32_t alignment = ker->arg_info[arg].align;
       assert(alignment != 0);
       cl_mem mem = ker->args[arg].mem;
       raw_size += mem->size;
@@ -123,10 +296,39 @@ cl_upload_constant_buffer(cl_command_queue queue, cl_kernel ker)
       aligned_size += mem->size;
     }
   }
-  if(raw_size == 0)
-     return;
+  ker->cst_sz = 0;
+  if(raw_size == 0) {
+    if (ker->cst_bo)
+      cl_buffer_unreference(ker->cst_bo);
+    ker->cst_bo = NULL;
+    return CL_SUCCESS;
+  }
 
-  cl_buffer bo = cl_gpgpu_alloc_constant_buffer(gpgpu, aligned_size);
+  /* The batched enqueues may write the __constant arguments */
+  for (arg = 0; arg < arg_n; ++arg)
+    if (ker->arg_info[arg].type == GBE_ARG_CONSTANT_PTR && ker->args[arg].mem &&
+        cl_command_queue_batch_uses(queue, ker->args[arg].mem->bo)) {
+      TRY (cl_command_queue_flush, queue);
+      break;
+    }
+
+  /* The previous buffer is written again once no enqueue uses it anymore */
+  bo = ker->cst_bo;
+  if (bo != NULL &&
+      (ker->cst_copy_n != 0 ||
+       cl_buffer_get_size(bo) < aligned_size ||
+       cl_buffer_is_busy(bo) ||
+       cl_command_queue_batch_uses(queue, bo))) {
+    cl_buffer_unreference(bo);
+    bo = NULL;
+  }
+  ker->cst_bo = NULL;
+  if (bo == NULL) {
+    bo = cl_buffer_alloc(cl_context_get_bufmgr(queue->ctx), "CONSTANT_BUFFER", aligned_size, 64);
+    if (bo == NULL)
+      return CL_OUT_OF_RESOURCES;
+    ker->cst_copy_n = 0;
+  }
   cl_buffer_map(bo, 1);
   char * cst_addr = cl_buffer_get_virtual(bo);
 
@@ -144,23 +346,28 @@ cl_upload_constant_buffer(cl_command_queue queue, cl_kernel ker)
   /* upload constant buffer argument */
   int32_t curbe_offset = 0;
   for (arg = 0; arg < arg_n; ++arg) {
-    const enum gbe_arg_type type = gbe_kernel_get_arg_type(ker->opaque, arg);
+    const enum gbe_arg_type type = ker->arg_info[arg].type;
     if (type == GBE_ARG_CONSTANT_PTR && ker->args[arg].mem) {
       cl_mem mem = ker->args[arg].mem;
-      uint32_t alignment = gbe_kernel_get_arg_align(ker->opaque, arg);
+      uint32_t alignment = ker->arg_info[arg].align;
       offset = ALIGN(offset, alignment);
-      curbe_offset = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_KERNEL_ARGUMENT, arg);
+      curbe_offset = ker->arg_info[arg].offset;
       assert(curbe_offset >= 0);
       *(uint32_t *) (ker->curbe + curbe_offset) = offset;
 
-      cl_buffer_map(mem->bo, 1);
-      void * addr = cl_buffer_get_virtual(mem->bo);
-      memcpy(cst_addr + offset, addr, mem->size);
-      cl_buffer_unmap(mem->bo);
+      ker->args[arg].cst_gen = cl_mem_write_gen(mem);
+      ker->args[arg].cst_offset = offset;
+      cl_constant_buffer_copy_arg(cst_addr, offset, mem);
       offset += mem->size;
     }
   }
   cl_buffer_unmap(bo);
+  ker->cst_bo = bo;
+  ker->cst_sz = aligned_size;
+  ker->cst_dirty = 0;
+
+error:
+  return err;
 }
 
 /* Will return the total amount of slm used */
@@ -170,30 +377,35 @@ cl_curbe_fill(cl_kernel ker,
               const size_t *global_wk_off,
               const size_t *global_wk_sz,
               const size_t *local_wk_sz,
+              const size_t *group_wk_sz,
               size_t thread_n)
 {
+  const cl_curbe_patch *patch = &ker->patch;
   int32_t offset;
-#define UPLOAD(ENUM, VALUE) \
-  if ((offset = gbe_kernel_get_curbe_offset(ker->opaque, ENUM, 0)) >= 0) \
+#define UPLOAD(OFFSET, VALUE) \
+  if ((offset = patch->OFFSET) >= 0) \
     *((uint32_t *) (ker->curbe + offset)) = VALUE;
-  UPLOAD(GBE_CURBE_LOCAL_SIZE_X, local_wk_sz[0]);
-  UPLOAD(GBE_CURBE_LOCAL_SIZE_Y, local_wk_sz[1]);
-  UPLOAD(GBE_CURBE_LOCAL_SIZE_Z, local_wk_sz[2]);
-  UPLOAD(GBE_CURBE_GLOBAL_SIZE_X, global_wk_sz[0]);
-  UPLOAD(GBE_CURBE_GLOBAL_SIZE_Y, global_wk_sz[1]);
-  UPLOAD(GBE_CURBE_GLOBAL_SIZE_Z, global_wk_sz[2]);
-  UPLOAD(GBE_CURBE_GLOBAL_OFFSET_X, global_wk_off[0]);
-  UPLOAD(GBE_CURBE_GLOBAL_OFFSET_Y, global_wk_off[1]);
-  UPLOAD(GBE_CURBE_GLOBAL_OFFSET_Z, global_wk_off[2]);
-  UPLOAD(GBE_CURBE_GROUP_NUM_X, global_wk_sz[0]/local_wk_sz[0]);
-  UPLOAD(GBE_CURBE_GROUP_NUM_Y, global_wk_sz[1]/local_wk_sz[1]);
-  UPLOAD(GBE_CURBE_GROUP_NUM_Z, global_wk_sz[2]/local_wk_sz[2]);
-  UPLOAD(GBE_CURBE_THREAD_NUM, thread_n);
-  UPLOAD(GBE_CURBE_WORK_DIM, work_dim);
+  UPLOAD(local_size[0], group_wk_sz[0]);
+  UPLOAD(local_size[1], group_wk_sz[1]);
+  UPLOAD(local_size[2], group_wk_sz[2]);
+  UPLOAD(enqueued_local_size[0], local_wk_sz[0]);
+  UPLOAD(enqueued_local_size[1], local_wk_sz[1]);
+  UPLOAD(enqueued_local_size[2], local_wk_sz[2]);
+  UPLOAD(global_size[0], global_wk_sz[0]);
+  UPLOAD(global_size[1], global_wk_sz[1]);
+  UPLOAD(global_size[2], global_wk_sz[2]);
+  UPLOAD(global_offset[0], global_wk_off[0]);
+  UPLOAD(global_offset[1], global_wk_off[1]);
+  UPLOAD(global_offset[2], global_wk_off[2]);
+  UPLOAD(group_num[0], (global_wk_sz[0] + local_wk_sz[0] - 1) / local_wk_sz[0]);
+  UPLOAD(group_num[1], (global_wk_sz[1] + local_wk_sz[1] - 1) / local_wk_sz[1]);
+  UPLOAD(group_num[2], (global_wk_sz[2] + local_wk_sz[2] - 1) / local_wk_sz[2]);
+  UPLOAD(thread_num, thread_n);
+  UPLOAD(work_dim, work_dim);
 #undef UPLOAD
 
   /* Upload sampler information. */
-  offset = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_SAMPLER_INFO, 0);
+  offset = patch->sampler_info;
   if (offset >= 0) {
     uint32_t i;
     for(i = 0; i < ker->sampler_sz; i++, offset += 2) {
@@ -201,27 +413,19 @@ cl_curbe_fill(cl_kernel ker,
     }
   }
 
-  /* Write identity for the stack pointer. This is required by the stack pointer
-   * computation in the kernel
-   */
-  if ((offset = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_STACK_POINTER, 0)) >= 0) {
-    const uint32_t simd_sz = gbe_kernel_get_simd_width(ker->opaque);
-    uint32_t *stackptr = (uint32_t *) (ker->curbe + offset);
-    int32_t i;
-    for (i = 0; i < (int32_t) simd_sz; ++i) stackptr[i] = i;
-  }
+  /* The identity for the stack pointer is in the curbe of the template */
   /* Handle the various offsets to SLM */
-  const int32_t arg_n = gbe_kernel_get_arg_num(ker->opaque);
-  int32_t arg, slm_offset = gbe_kernel_get_slm_size(ker->opaque);
+  const int32_t arg_n = ker->arg_n;
+  int32_t arg, slm_offset = ker->slm_sz;
   ker->local_mem_sz = 0;
   for (arg = 0; arg < arg_n; ++arg) {
-    const enum gbe_arg_type type = gbe_kernel_get_arg_type(ker->opaque, arg);
+    const enum gbe_arg_type type = ker->arg_info[arg].type;
     if (type != GBE_ARG_LOCAL_PTR)
       continue;
-    uint32_t align = gbe_kernel_get_arg_align(ker->opaque, arg);
+    uint32_t align = ker->arg_info[arg].align;
     assert(align != 0);
     slm_offset = ALIGN(slm_offset, align);
-    offset = gbe_kernel_get_curbe_offset(ker->opaque, GBE_CURBE_KERNEL_ARGUMENT, arg);
+    offset = ker->arg_info[arg].offset;
     assert(offset >= 0);
     uint32_t *slmptr = (uint32_t *) (ker->curbe + offset);
     *slmptr = slm_offset;
@@ -237,9 +441,7 @@ cl_bind_stack(cl_gpgpu gpgpu, cl_kernel ker)
   cl_context ctx = ker->program->ctx;
   cl_device_id device = ctx->device;
   const int32_t per_lane_stack_sz = ker->stack_size;
-  const int32_t value = GBE_CURBE_EXTRA_ARGUMENT;
-  const int32_t sub_value = GBE_STACK_BUFFER;
-  const int32_t offset = gbe_kernel_get_curbe_offset(ker->opaque, value, sub_value);
+  const int32_t offset = ker->patch.stack_buffer;
   int32_t stack_sz = per_lane_stack_sz;
 
   /* No stack required for this kernel */
@@ -250,28 +452,37 @@ cl_bind_stack(cl_gpgpu gpgpu, cl_kernel ker)
    * the size we need for the complete machine
    */
   assert(offset >= 0);
-  stack_sz *= gbe_kernel_get_simd_width(ker->opaque);
+  stack_sz *= ker->simd_width;
   stack_sz *= device->max_compute_unit;
   cl_gpgpu_set_stack(gpgpu, offset, stack_sz, cc_llc_l3);
 }
 
+/* Runs the group_n groups starting at group_off, which all have group_wk_sz
+ * work items. local_wk_sz is the local size of the NDRange
+ */
 LOCAL cl_int
 cl_command_queue_ND_range_gen7(cl_command_queue queue,
                                cl_kernel ker,
                                const uint32_t work_dim,
                                const size_t *global_wk_off,
                                const size_t *global_wk_sz,
-                               const size_t *local_wk_sz)
+                               const size_t *local_wk_sz,
+                               const size_t *group_off,
+                               const size_t *group_n,
+                               const size_t *group_wk_sz,
+                               cl_bool first_walker)
 {
+  CL_TRACE_SCOPE("ND range gen7", "enqueue");
   GET_QUEUE_THREAD_GPGPU(queue);
   cl_context ctx = queue->ctx;
   char *final_curbe = NULL;  /* Includes them and one sub-buffer per group */
   cl_gpgpu_kernel kernel;
   const uint32_t simd_sz = cl_kernel_get_simd_width(ker);
   size_t i, batch_sz = 0u, local_sz = 0u;
-  size_t cst_sz = ker->curbe_sz= gbe_kernel_get_curbe_size(ker->opaque);
-  int32_t scratch_sz = gbe_kernel_get_scratch_size(ker->opaque);
+  size_t cst_sz = ker->curbe_sz;
+  int32_t scratch_sz = ker->scratch_sz;
   size_t thread_n = 0u;
+  int profiling = GPGPU_NO_PROFILING;
   cl_int err = CL_SUCCESS;
 
   /* Setup kernel */
@@ -280,10 +491,11 @@ cl_command_queue_ND_range_gen7(cl_command_queue queue,
   kernel.bo = ker->bo;
   kernel.barrierID = 0;
   kernel.slm_sz = 0;
-  kernel.use_slm = gbe_kernel_use_slm(ker->opaque);
+  kernel.use_slm = ker->use_slm;
 
   /* Compute the number of HW threads we need */
   TRY (cl_kernel_work_group_sz, ker, local_wk_sz, 3, &local_sz);
+  local_sz = group_wk_sz[0] * group_wk_sz[1] * group_wk_sz[2];
   kernel.thread_n = thread_n = (local_sz + simd_sz - 1) / simd_sz;
   kernel.curbe_sz = cst_sz;
 
@@ -293,18 +505,24 @@ cl_command_queue_ND_range_gen7(cl_command_queue queue,
   }
   /* Curbe step 1: fill the constant urb buffer data shared by all threads */
   if (ker->curbe) {
-    kernel.slm_sz = cl_curbe_fill(ker, work_dim, global_wk_off, global_wk_sz, local_wk_sz, thread_n);
+    TRY (cl_kernel_own_curbe, ker);
+    kernel.slm_sz = cl_curbe_fill(ker, work_dim, global_wk_off, global_wk_sz,
+                                  local_wk_sz, group_wk_sz, thread_n);
     if (kernel.slm_sz > ker->program->ctx->device->local_mem_size) {
       fprintf(stderr, "Beignet: Out of shared local memory %d.\n", kernel.slm_sz);
       return CL_OUT_OF_RESOURCES;
     }
   }
 
-  /* Setup the kernel */
-  if (queue->props & CL_QUEUE_PROFILING_ENABLE)
-    cl_gpgpu_state_init(gpgpu, ctx->device->max_compute_unit, cst_sz / 32, 1);
-  else
-    cl_gpgpu_state_init(gpgpu, ctx->device->max_compute_unit, cst_sz / 32, 0);
+  /* Before the GPU states: it may submit the previous enqueues */
+  TRY (cl_upload_constant_buffer, queue, ker);
+
+  /* Setup the kernel. The tracer reads the timestamps of the NDRanges too.
+   * They span all the walkers of the NDRange
+   */
+  if ((queue->props & CL_QUEUE_PROFILING_ENABLE) || cl_trace_enabled())
+    profiling = first_walker ? GPGPU_PROFILING_NEW : GPGPU_PROFILING_KEEP;
+  cl_gpgpu_state_init(gpgpu, ctx->device->max_compute_unit, cst_sz / 32, profiling);
 
   /* Bind user buffers */
   cl_command_queue_bind_surface(queue, ker);
@@ -318,18 +536,20 @@ cl_command_queue_ND_range_gen7(cl_command_queue queue,
   /* Bind a stack if needed */
   cl_bind_stack(gpgpu, ker);
 
-  cl_upload_constant_buffer(queue, ker);
+  if (ker->cst_bo)
+    cl_gpgpu_bind_constant_buffer(gpgpu, ker->cst_bo, ker->cst_sz);
 
   cl_gpgpu_states_setup(gpgpu, &kernel);
 
   /* Curbe step 2. Give the localID and upload it to video memory */
   if (ker->curbe) {
+    CL_TRACE_SCOPE("curbe upload", "enqueue");
     assert(cst_sz > 0);
     TRY_ALLOC (final_curbe, (char*) alloca(thread_n * cst_sz));
     for (i = 0; i < thread_n; ++i) {
         memcpy(final_curbe + cst_sz * i, ker->curbe, cst_sz);
     }
-    TRY (cl_set_varying_payload, ker, final_curbe, local_wk_sz, simd_sz, cst_sz, thread_n);
+    TRY (cl_set_varying_payload, ker, final_curbe, group_wk_sz, simd_sz, cst_sz, thread_n);
     cl_gpgpu_upload_curbes(gpgpu, final_curbe, thread_n*cst_sz);
   }
 
@@ -339,8 +559,13 @@ cl_command_queue_ND_range_gen7(cl_command_queue queue,
   cl_set_thread_batch_buf(cl_gpgpu_ref_batch_buf(gpgpu));
   cl_gpgpu_batch_start(gpgpu);
 
+  /* Mapping a pooled buffer only waits for the batch of its last NDRange */
+  for (i = 0; i < ker->arg_n; ++i)
+    if (ker->arg_info[i].type == GBE_ARG_GLOBAL_PTR && ker->args[i].mem)
+      cl_mem_set_batch(ker->args[i].mem, (cl_buffer) cl_get_thread_batch_buf());
+
   /* Issue the GPGPU_WALKER command */
-  cl_gpgpu_walker(gpgpu, simd_sz, thread_n, global_wk_off, global_wk_sz, local_wk_sz);
+  cl_gpgpu_walker(gpgpu, simd_sz, thread_n, group_off, group_n, group_wk_sz);
 
   /* Close the batch buffer and submit it */
   cl_gpgpu_batch_end(gpgpu, 0);
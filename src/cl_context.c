@@ -28,6 +28,7 @@
 #include "cl_khr_icd.h"
 #include "cl_kernel.h"
 #include "cl_program.h"
+#include "cl_event.h"
 
 #include "CL/cl.h"
 #include "CL/cl_gl.h"
@@ -164,6 +165,7 @@ LOCAL cl_context
 cl_context_new(struct _cl_context_prop *props)
 {
   cl_context ctx = NULL;
+  uint32_t i;
 
   TRY_ALLOC_NO_ERR (ctx, CALLOC(struct _cl_context));
   TRY_ALLOC_NO_ERR (ctx->drv, cl_driver_new(props));
@@ -174,8 +176,10 @@ cl_context_new(struct _cl_context_prop *props)
   ctx->ver = cl_driver_get_ver(ctx->drv);
   pthread_mutex_init(&ctx->program_lock, NULL);
   pthread_mutex_init(&ctx->queue_lock, NULL);
-  pthread_mutex_init(&ctx->buffer_lock, NULL);
   pthread_mutex_init(&ctx->sampler_lock, NULL);
+  for (i = 0; i < CL_CONTEXT_LIST_N; ++i)
+    pthread_mutex_init(&ctx->lists[i].lock, NULL);
+  cl_mem_pool_init(&ctx->buffer_pool, ctx);
 
 exit:
   return ctx;
@@ -188,6 +192,8 @@ error:
 LOCAL void
 cl_context_delete(cl_context ctx)
 {
+  uint32_t i;
+
   if (UNLIKELY(ctx == NULL))
     return;
 
@@ -200,10 +206,15 @@ cl_context_delete(cl_context ctx)
    */
   assert(ctx->queues == NULL);
   assert(ctx->programs == NULL);
-  assert(ctx->buffers == NULL);
+  for (i = 0; i < CL_CONTEXT_LIST_N; ++i) {
+    assert(ctx->lists[i].buffers == NULL);
+    assert(ctx->lists[i].events == NULL);
+    pthread_mutex_destroy(&ctx->lists[i].lock);
+  }
   assert(ctx->drv);
   cl_free(ctx->prop_user);
   cl_set_thread_batch_buf(NULL);
+  cl_mem_pool_destroy(&ctx->buffer_pool);
   cl_driver_delete(ctx->drv);
   ctx->magic = CL_MAGIC_DEAD_HEADER; /* For safety */
   cl_free(ctx);
@@ -216,6 +227,70 @@ cl_context_add_ref(cl_context ctx)
   atomic_inc(&ctx->ref_n);
 }
 
+/* Spread the objects over the lists. Allocations are at least 16 bytes apart
+ * and the neighbours often come from the same thread
+ */
+static INLINE struct _cl_context_list*
+cl_context_list(cl_context ctx, const void *obj)
+{
+  const uintptr_t addr = (uintptr_t) obj;
+  return &ctx->lists[((addr >> 4) ^ (addr >> 12)) % CL_CONTEXT_LIST_N];
+}
+
+LOCAL void
+cl_context_add_buffer(cl_context ctx, cl_mem mem)
+{
+  struct _cl_context_list *list = cl_context_list(ctx, mem);
+  pthread_mutex_lock(&list->lock);
+    mem->prev = NULL;
+    mem->next = list->buffers;
+    if (list->buffers != NULL)
+      list->buffers->prev = mem;
+    list->buffers = mem;
+  pthread_mutex_unlock(&list->lock);
+}
+
+LOCAL void
+cl_context_remove_buffer(cl_context ctx, cl_mem mem)
+{
+  struct _cl_context_list *list = cl_context_list(ctx, mem);
+  pthread_mutex_lock(&list->lock);
+    if (mem->prev)
+      mem->prev->next = mem->next;
+    if (mem->next)
+      mem->next->prev = mem->prev;
+    if (list->buffers == mem)
+      list->buffers = mem->next;
+  pthread_mutex_unlock(&list->lock);
+}
+
+LOCAL void
+cl_context_add_event(cl_context ctx, cl_event event)
+{
+  struct _cl_context_list *list = cl_context_list(ctx, event);
+  pthread_mutex_lock(&list->lock);
+    event->prev = NULL;
+    event->next = list->events;
+    if (list->events != NULL)
+      list->events->prev = event;
+    list->events = event;
+  pthread_mutex_unlock(&list->lock);
+}
+
+LOCAL void
+cl_context_remove_event(cl_context ctx, cl_event event)
+{
+  struct _cl_context_list *list = cl_context_list(ctx, event);
+  pthread_mutex_lock(&list->lock);
+    if (event->prev)
+      event->prev->next = event->next;
+    if (event->next)
+      event->next->prev = event->prev;
+    if (list->events == event)
+      list->events = event->next;
+  pthread_mutex_unlock(&list->lock);
+}
+
 LOCAL cl_command_queue
 cl_context_create_queue(cl_context ctx,
                         cl_device_id device,
@@ -247,52 +322,65 @@ cl_context_get_bufmgr(cl_context ctx)
   return cl_driver_get_bufmgr(ctx->drv);
 }
 
-cl_kernel
-cl_context_get_static_kernel(cl_context ctx, cl_int index, const char * str_kernel, const char * str_option)
+/* The internal programs only depend on their index: they are compiled or
+ * loaded once per process and never released. A context wraps them in its own
+ * programs, which only upload the code of their kernels
+ */
+static pthread_mutex_t cl_internal_program_lock = PTHREAD_MUTEX_INITIALIZER;
+static gbe_program cl_internal_programs[CL_INTERNAL_KERNEL_MAX];
+
+static gbe_program
+cl_internal_program_get(cl_int index, const char *str_kernel, size_t size,
+                        const char *str_option, int from_bin)
+{
+  gbe_program opaque;
+
+  pthread_mutex_lock(&cl_internal_program_lock);
+  if ((opaque = cl_internal_programs[index]) == NULL) {
+    if (from_bin)
+      opaque = gbe_program_new_from_binary(str_kernel, size);
+    else {
+      char log[256];
+      size_t log_sz = 0;
+      opaque = gbe_program_new_from_source(str_kernel, sizeof(log), str_option, log, &log_sz);
+    }
+    cl_internal_programs[index] = opaque;
+  }
+  pthread_mutex_unlock(&cl_internal_program_lock);
+  return opaque;
+}
+
+static cl_kernel
+cl_context_get_internal_kernel(cl_context ctx, cl_int index, const char *str_kernel,
+                               size_t size, const char *str_option, int from_bin)
 {
-  cl_int ret;
+  gbe_program opaque;
+
   if (!ctx->internal_prgs[index])
   {
-    size_t length = strlen(str_kernel) + 1;
-    ctx->internal_prgs[index] = cl_program_create_from_source(ctx, 1, &str_kernel, &length, NULL);
-
-    if (!ctx->internal_prgs[index])
+    opaque = cl_internal_program_get(index, str_kernel, size, str_option, from_bin);
+    if (!opaque)
       return NULL;
 
-    ret = cl_program_build(ctx->internal_prgs[index], str_option);
-    if (ret != CL_SUCCESS)
+    ctx->internal_prgs[index] = cl_program_create_from_gbe(ctx, opaque, NULL);
+    if (!ctx->internal_prgs[index])
       return NULL;
 
-    ctx->internal_prgs[index]->is_built = 1;
-
     ctx->internel_kernels[index] = cl_kernel_dup(ctx->internal_prgs[index]->ker[0]);
   }
 
   return ctx->internel_kernels[index];
 }
 
+cl_kernel
+cl_context_get_static_kernel(cl_context ctx, cl_int index, const char * str_kernel, const char * str_option)
+{
+  return cl_context_get_internal_kernel(ctx, index, str_kernel, 0, str_option, 0);
+}
+
 cl_kernel
 cl_context_get_static_kernel_form_bin(cl_context ctx, cl_int index,
                   const char * str_kernel, size_t size, const char * str_option)
 {
-  cl_int ret;
-  cl_int binary_status = CL_SUCCESS;
-  if (!ctx->internal_prgs[index])
-  {
-    ctx->internal_prgs[index] = cl_program_create_from_binary(ctx, 1, &ctx->device,
-      &size, (const unsigned char **)&str_kernel, &binary_status, &ret);
-
-    if (!ctx->internal_prgs[index])
-      return NULL;
-
-    ret = cl_program_build(ctx->internal_prgs[index], str_option);
-    if (ret != CL_SUCCESS)
-      return NULL;
-
-    ctx->internal_prgs[index]->is_built = 1;
-
-    ctx->internel_kernels[index] = cl_kernel_dup(ctx->internal_prgs[index]->ker[0]);
-  }
-
-  return ctx->internel_kernels[index];
+  return cl_context_get_internal_kernel(ctx, index, str_kernel, size, str_option, 1);
 }
@@ -21,6 +21,7 @@
 #define __CL_CONTEXT_H__
 
 #include "cl_internals.h"
+#include "cl_mem_pool.h"
 #include "cl_driver.h"
 #include "CL/cl.h"
 #include "cl_khr_icd.h"
@@ -40,10 +41,8 @@ enum _cl_gl_context_type {
 };
 
 enum _cl_internal_ker_type {
-  CL_ENQUEUE_COPY_BUFFER_ALIGN1 = 0,
-  CL_ENQUEUE_COPY_BUFFER_ALIGN4,
+  CL_ENQUEUE_COPY_BUFFER_UNALIGN = 0,  //copy buffer and buffer rect, any alignment
   CL_ENQUEUE_COPY_BUFFER_ALIGN16,
-  CL_ENQUEUE_COPY_BUFFER_RECT,
   CL_ENQUEUE_COPY_IMAGE_0,             //copy image 2d to image 2d
   CL_ENQUEUE_COPY_IMAGE_1,             //copy image 3d to image 2d
   CL_ENQUEUE_COPY_IMAGE_2,             //copy image 2d to image 3d
@@ -52,6 +51,11 @@ enum _cl_internal_ker_type {
   CL_ENQUEUE_COPY_IMAGE_TO_BUFFER_1,   //copy image 3d tobuffer
   CL_ENQUEUE_COPY_BUFFER_TO_IMAGE_0,   //copy buffer to image 2d
   CL_ENQUEUE_COPY_BUFFER_TO_IMAGE_1,   //copy buffer to image 3d
+  CL_ENQUEUE_FILL_BUFFER_UNALIGN,      //fill buffer, pattern up to 16 bytes, any offset
+  CL_ENQUEUE_FILL_BUFFER_ALIGN16,      //fill buffer, pattern up to 16 bytes, 16 bytes aligned
+  CL_ENQUEUE_FILL_BUFFER_ALIGN128,     //fill buffer, pattern of 32 to 128 bytes
+  CL_ENQUEUE_FILL_IMAGE_0,             //fill image 2d
+  CL_ENQUEUE_FILL_IMAGE_1,             //fill image 3d
   CL_INTERNAL_KERNEL_MAX
 };
 
@@ -67,6 +71,18 @@ struct _cl_context_prop {
   };
 };
 
+/* The buffers and the events are chained in several lists, each with its own
+ * lock, so that threads creating and releasing them do not serialize on one
+ * context lock. The list of an object is picked from its address
+ */
+#define CL_CONTEXT_LIST_N 16
+
+struct _cl_context_list {
+  pthread_mutex_t lock;             /* To allocate and deallocate the objects */
+  cl_mem buffers;                   /* Memory objects of the list */
+  cl_event events;                  /* Event objects of the list */
+} __attribute__((aligned(64)));     /* One cache line each */
+
 #define IS_EGL_CONTEXT(ctx)  (ctx->props.gl_type == CL_GL_EGL_DISPLAY)
 #define EGL_DISP(ctx)   (EGLDisplay)(ctx->props.egl_display)
 #define EGL_CTX(ctx)    (EGLContext)(ctx->props.gl_context)
@@ -79,14 +95,13 @@ struct _cl_context {
   cl_device_id device;              /* All information about the GPU device */
   cl_command_queue queues;          /* All command queues currently allocated */
   cl_program programs;              /* All programs currently allocated */
-  cl_mem buffers;                   /* All memory object currently allocated */
   cl_sampler samplers;              /* All sampler object currently allocated */
-  cl_event   events;                /* All event object currently allocated */
   pthread_mutex_t queue_lock;       /* To allocate and deallocate queues */
   pthread_mutex_t program_lock;     /* To allocate and deallocate programs */
-  pthread_mutex_t buffer_lock;      /* To allocate and deallocate buffers */
   pthread_mutex_t sampler_lock;     /* To allocate and deallocate samplers */
-  pthread_mutex_t event_lock;       /* To allocate and deallocate events */
+  struct _cl_context_list lists[CL_CONTEXT_LIST_N];
+                                    /* All memory and event objects currently allocated */
+  cl_mem_pool buffer_pool;          /* Sub-allocates the small buffers */
   cl_program internal_prgs[CL_INTERNAL_KERNEL_MAX];
                                     /* All programs internal used, for example clEnqueuexxx api use */
   cl_kernel  internel_kernels[CL_INTERNAL_KERNEL_MAX];
@@ -118,6 +133,18 @@ extern void cl_context_delete(cl_context);
 /* Increment the context reference counter */
 extern void cl_context_add_ref(cl_context);
 
+/* Chain a new buffer in the context */
+extern void cl_context_add_buffer(cl_context, cl_mem);
+
+/* Unchain a buffer being deleted */
+extern void cl_context_remove_buffer(cl_context, cl_mem);
+
+/* Chain a new event in the context */
+extern void cl_context_add_event(cl_context, cl_event);
+
+/* Unchain an event being deleted */
+extern void cl_context_remove_event(cl_context, cl_event);
+
 /* Create the command queue from the given context and device */
 extern cl_command_queue cl_context_create_queue(cl_context,
                                                 cl_device_id,
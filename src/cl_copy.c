@@ -0,0 +1,369 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cl_copy.h"
+#include "cl_utils.h"
+
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* AVX2 is not in the build flags: the functions using it are compiled for it
+ * alone and only called when the CPU has it
+ */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CL_COPY_AVX2 1
+#include <immintrin.h>
+#endif
+
+enum {
+  CL_COPY_STREAM_MIN = 1024 * 1024,    /* Smaller copies stay in the caches */
+  CL_COPY_THREAD_MIN = 2 * 1024 * 1024,/* Bytes per thread at least */
+  CL_COPY_THREAD_MAX = 4,
+  CL_COPY_CHUNK = 64 * 1024            /* Rows of the large linear copies */
+};
+
+typedef void (*cl_copy_row_fn)(char *dst, const char *src, size_t n);
+
+static void
+cl_copy_row_memcpy(char *dst, const char *src, size_t n)
+{
+  memcpy(dst, src, n);
+}
+
+/* Streaming stores: the destination is written by full lines without being
+ * read first nor kept in the caches
+ */
+static void
+cl_copy_row_stream_sse2(char *dst, const char *src, size_t n)
+{
+  size_t head = (16 - ((uintptr_t) dst & 15)) & 15;
+  if (head > n)
+    head = n;
+  memcpy(dst, src, head);
+  dst += head; src += head; n -= head;
+
+  for (; n >= 64; n -= 64, dst += 64, src += 64) {
+    const __m128i a = _mm_loadu_si128((const __m128i *) (src + 0));
+    const __m128i b = _mm_loadu_si128((const __m128i *) (src + 16));
+    const __m128i c = _mm_loadu_si128((const __m128i *) (src + 32));
+    const __m128i d = _mm_loadu_si128((const __m128i *) (src + 48));
+    _mm_stream_si128((__m128i *) (dst + 0), a);
+    _mm_stream_si128((__m128i *) (dst + 16), b);
+    _mm_stream_si128((__m128i *) (dst + 32), c);
+    _mm_stream_si128((__m128i *) (dst + 48), d);
+  }
+  for (; n >= 16; n -= 16, dst += 16, src += 16)
+    _mm_stream_si128((__m128i *) dst, _mm_loadu_si128((const __m128i *) src));
+  memcpy(dst, src, n);
+}
+
+#if CL_COPY_AVX2
+__attribute__((target("avx2"))) static void
+cl_copy_row_stream_avx2(char *dst, const char *src, size_t n)
+{
+  size_t head = (32 - ((uintptr_t) dst & 31)) & 31;
+  if (head > n)
+    head = n;
+  memcpy(dst, src, head);
+  dst += head; src += head; n -= head;
+
+  for (; n >= 128; n -= 128, dst += 128, src += 128) {
+    const __m256i a = _mm256_loadu_si256((const __m256i *) (src + 0));
+    const __m256i b = _mm256_loadu_si256((const __m256i *) (src + 32));
+    const __m256i c = _mm256_loadu_si256((const __m256i *) (src + 64));
+    const __m256i d = _mm256_loadu_si256((const __m256i *) (src + 96));
+    _mm256_stream_si256((__m256i *) (dst + 0), a);
+    _mm256_stream_si256((__m256i *) (dst + 32), b);
+    _mm256_stream_si256((__m256i *) (dst + 64), c);
+    _mm256_stream_si256((__m256i *) (dst + 96), d);
+  }
+  for (; n >= 32; n -= 32, dst += 32, src += 32)
+    _mm256_stream_si256((__m256i *) dst, _mm256_loadu_si256((const __m256i *) src));
+  memcpy(dst, src, n);
+}
+#endif /* CL_COPY_AVX2 */
+
+/* Streaming loads: write-combined memory is not cached, these loads fetch a
+ * full line in a streaming buffer instead of one load per access
+ */
+static void
+cl_copy_row_stream_load(char *dst, const char *src, size_t n)
+{
+  size_t head = (16 - ((uintptr_t) src & 15)) & 15;
+  if (head > n)
+    head = n;
+  memcpy(dst, src, head);
+  dst += head; src += head; n -= head;
+
+  for (; n >= 64; n -= 64, dst += 64, src += 64) {
+    const __m128i a = _mm_stream_load_si128((__m128i *) (src + 0));
+    const __m128i b = _mm_stream_load_si128((__m128i *) (src + 16));
+    const __m128i c = _mm_stream_load_si128((__m128i *) (src + 32));
+    const __m128i d = _mm_stream_load_si128((__m128i *) (src + 48));
+    _mm_storeu_si128((__m128i *) (dst + 0), a);
+    _mm_storeu_si128((__m128i *) (dst + 16), b);
+    _mm_storeu_si128((__m128i *) (dst + 32), c);
+    _mm_storeu_si128((__m128i *) (dst + 48), d);
+  }
+  for (; n >= 16; n -= 16, dst += 16, src += 16)
+    _mm_storeu_si128((__m128i *) dst, _mm_stream_load_si128((__m128i *) src));
+  memcpy(dst, src, n);
+}
+
+static cl_copy_row_fn
+cl_copy_select(size_t total, int flags)
+{
+  static int avx2 = -1;
+
+  if (flags & CL_COPY_MEMCPY)
+    return cl_copy_row_memcpy;
+  if (flags & CL_COPY_SRC_WC)
+    return cl_copy_row_stream_load;
+  if (!(flags & CL_COPY_DST_WC) && total < CL_COPY_STREAM_MIN)
+    return cl_copy_row_memcpy;
+#if CL_COPY_AVX2
+  if (avx2 < 0) {
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") != 0;
+  }
+  if (avx2)
+    return cl_copy_row_stream_avx2;
+#endif /* CL_COPY_AVX2 */
+  (void) avx2;
+  return cl_copy_row_stream_sse2;
+}
+
+DEFINE_ENV_INT(cl_copy_thread_env, "OCL_COPY_THREADS",
+               MIN(sysconf(_SC_NPROCESSORS_ONLN), CL_COPY_THREAD_MAX))
+
+/* Maximum number of threads for one copy (OCL_COPY_THREADS) */
+static size_t
+cl_copy_thread_max(void)
+{
+  return MAX(cl_copy_thread_env(), 1);
+}
+
+/* The rows [first, last) of a rectangle, all the slices following each other */
+typedef struct _cl_copy_job {
+  char *dst;
+  const char *src;
+  size_t dst_row_pitch, dst_slice_pitch;
+  size_t src_row_pitch, src_slice_pitch;
+  size_t row_sz, row_n;
+  size_t first, last;
+  cl_copy_row_fn row;
+} cl_copy_job;
+
+static void*
+cl_copy_job_run(void *arg)
+{
+  const cl_copy_job *job = (const cl_copy_job *) arg;
+  size_t i;
+
+  for (i = job->first; i < job->last; ++i) {
+    const size_t z = i / job->row_n, y = i % job->row_n;
+    job->row(job->dst + z * job->dst_slice_pitch + y * job->dst_row_pitch,
+             job->src + z * job->src_slice_pitch + y * job->src_row_pitch,
+             job->row_sz);
+  }
+  /* Order the streaming stores before the buffer is handed to the GPU */
+  _mm_sfence();
+  return NULL;
+}
+
+/* Threads sharing the large copies with the calling thread. They are started
+ * by the first copy needing them and then wait for the next ones. One copy
+ * uses them at a time: a concurrent copy is done by its calling thread alone
+ */
+static struct {
+  pthread_mutex_t busy;        /* Held by the copy using the threads */
+  pthread_mutex_t lock;        /* Protects the fields below */
+  pthread_cond_t ready, done;
+  pthread_t threads[CL_COPY_THREAD_MAX - 1];
+  size_t seen[CL_COPY_THREAD_MAX - 1]; /* Last copy each thread looked at */
+  size_t thread_n;             /* Threads started */
+  size_t copy;                 /* Incremented for each copy */
+  cl_copy_job *jobs;           /* One job per thread of the current copy */
+  size_t job_n;
+  size_t pending;              /* Jobs not finished yet */
+  int quit;
+} cl_copy_pool = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
+
+static void*
+cl_copy_pool_thread(void *arg)
+{
+  const size_t id = (size_t) arg;
+
+  pthread_mutex_lock(&cl_copy_pool.lock);
+  for (;;) {
+    while (!cl_copy_pool.quit && cl_copy_pool.seen[id] == cl_copy_pool.copy)
+      pthread_cond_wait(&cl_copy_pool.ready, &cl_copy_pool.lock);
+    if (cl_copy_pool.quit)
+      break;
+    cl_copy_pool.seen[id] = cl_copy_pool.copy;
+    if (id >= cl_copy_pool.job_n)
+      continue;
+    pthread_mutex_unlock(&cl_copy_pool.lock);
+    cl_copy_job_run(&cl_copy_pool.jobs[id]);
+    pthread_mutex_lock(&cl_copy_pool.lock);
+    if (--cl_copy_pool.pending == 0)
+      pthread_cond_signal(&cl_copy_pool.done);
+  }
+  pthread_mutex_unlock(&cl_copy_pool.lock);
+  return NULL;
+}
+
+static void
+cl_copy_pool_stop(void)
+{
+  size_t i;
+
+  pthread_mutex_lock(&cl_copy_pool.lock);
+    cl_copy_pool.quit = 1;
+    pthread_cond_broadcast(&cl_copy_pool.ready);
+  pthread_mutex_unlock(&cl_copy_pool.lock);
+  for (i = 0; i < cl_copy_pool.thread_n; ++i)
+    pthread_join(cl_copy_pool.threads[i], NULL);
+}
+
+/* Start the missing threads (busy is held). Return how many are running */
+static size_t
+cl_copy_pool_start(size_t thread_n)
+{
+  if (cl_copy_pool.thread_n == 0 && thread_n != 0)
+    atexit(cl_copy_pool_stop);
+  while (cl_copy_pool.thread_n < thread_n) {
+    const size_t id = cl_copy_pool.thread_n;
+    pthread_mutex_lock(&cl_copy_pool.lock);
+      cl_copy_pool.seen[id] = cl_copy_pool.copy;
+    pthread_mutex_unlock(&cl_copy_pool.lock);
+    if (pthread_create(&cl_copy_pool.threads[id], NULL,
+                       cl_copy_pool_thread, (void *) id) != 0)
+      break;
+    cl_copy_pool.thread_n++;
+  }
+  return cl_copy_pool.thread_n;
+}
+
+/* Run the jobs: the first ones by the threads, the last one in place */
+static void
+cl_copy_pool_run(cl_copy_job *jobs, size_t job_n)
+{
+  pthread_mutex_lock(&cl_copy_pool.lock);
+    cl_copy_pool.jobs = jobs;
+    cl_copy_pool.job_n = job_n - 1;
+    cl_copy_pool.pending = job_n - 1;
+    cl_copy_pool.copy++;
+    pthread_cond_broadcast(&cl_copy_pool.ready);
+  pthread_mutex_unlock(&cl_copy_pool.lock);
+
+  cl_copy_job_run(&jobs[job_n - 1]);
+
+  pthread_mutex_lock(&cl_copy_pool.lock);
+    while (cl_copy_pool.pending != 0)
+      pthread_cond_wait(&cl_copy_pool.done, &cl_copy_pool.lock);
+  pthread_mutex_unlock(&cl_copy_pool.lock);
+}
+
+LOCAL void
+cl_copy_rect(void *dst, size_t dst_row_pitch, size_t dst_slice_pitch,
+             const void *src, size_t src_row_pitch, size_t src_slice_pitch,
+             size_t row_sz, size_t row_n, size_t slice_n, int flags)
+{
+  const size_t total = row_sz * row_n * slice_n;
+  const size_t rows = row_n * slice_n;
+  cl_copy_job jobs[CL_COPY_THREAD_MAX];
+  size_t thread_n = total / CL_COPY_THREAD_MIN, i;
+  int pooled = 0;
+
+  if (total == 0)
+    return;
+  if (flags & CL_COPY_MEMCPY)
+    thread_n = 1;
+  if (thread_n > cl_copy_thread_max())
+    thread_n = cl_copy_thread_max();
+  if (thread_n > CL_COPY_THREAD_MAX)
+    thread_n = CL_COPY_THREAD_MAX;
+  if (thread_n > rows)
+    thread_n = rows;
+  if (thread_n == 0)
+    thread_n = 1;
+
+  /* The threads are busy with another copy: do this one alone */
+  if (thread_n > 1) {
+    if (pthread_mutex_trylock(&cl_copy_pool.busy) == 0) {
+      pooled = 1;
+      thread_n = cl_copy_pool_start(thread_n - 1) + 1;
+    } else
+      thread_n = 1;
+  }
+
+  /* Contiguous rectangles are one row for a single thread */
+  if (thread_n == 1 &&
+      dst_row_pitch == row_sz && src_row_pitch == row_sz &&
+      (slice_n == 1 || (dst_slice_pitch == row_sz * row_n && src_slice_pitch == row_sz * row_n))) {
+    row_sz = total;
+    row_n = slice_n = 1;
+  }
+
+  for (i = 0; i < thread_n; ++i) {
+    jobs[i].dst = (char *) dst;
+    jobs[i].src = (const char *) src;
+    jobs[i].dst_row_pitch = dst_row_pitch;
+    jobs[i].dst_slice_pitch = dst_slice_pitch;
+    jobs[i].src_row_pitch = src_row_pitch;
+    jobs[i].src_slice_pitch = src_slice_pitch;
+    jobs[i].row_sz = row_sz;
+    jobs[i].row_n = row_n;
+    jobs[i].first = row_n * slice_n * i / thread_n;
+    jobs[i].last = row_n * slice_n * (i + 1) / thread_n;
+    jobs[i].row = cl_copy_select(total, flags);
+  }
+
+  if (thread_n == 1)
+    cl_copy_job_run(&jobs[0]);
+  else
+    cl_copy_pool_run(jobs, thread_n);
+  if (pooled)
+    pthread_mutex_unlock(&cl_copy_pool.busy);
+}
+
+LOCAL void
+cl_copy(void *dst, const void *src, size_t n, int flags)
+{
+  const size_t row_n = n / CL_COPY_CHUNK;
+  const size_t tail = n % CL_COPY_CHUNK;
+
+  /* Large copies are split in rows to be shared by the threads */
+  if (n < 2 * CL_COPY_THREAD_MIN || (flags & CL_COPY_MEMCPY)) {
+    cl_copy_rect(dst, n, n, src, n, n, n, 1, 1, flags);
+    return;
+  }
+  cl_copy_rect(dst, CL_COPY_CHUNK, 0, src, CL_COPY_CHUNK, 0, CL_COPY_CHUNK, row_n, 1, flags);
+  if (tail)
+    cl_copy_rect((char *) dst + row_n * CL_COPY_CHUNK, tail, tail,
+                 (const char *) src + row_n * CL_COPY_CHUNK, tail, tail, tail, 1, 1, flags);
+}
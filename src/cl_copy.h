@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CL_COPY_H__
+#define __CL_COPY_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Host side copies between the user memory and the mapped buffer objects.
+ * Large copies bypass the caches with streaming stores (SSE2 or AVX2), reads
+ * from write-combined mappings (GTT) use streaming loads (SSE4.1) and the
+ * large rectangles are split by rows over several threads
+ */
+enum {
+  CL_COPY_SRC_WC = 1 << 0,   /* Source is a write-combined mapping */
+  CL_COPY_DST_WC = 1 << 1,   /* Destination is a write-combined mapping */
+  CL_COPY_MEMCPY = 1 << 2    /* Plain memcpy, one row after the other */
+};
+
+/* Copy n bytes */
+extern void cl_copy(void *dst, const void *src, size_t n, int flags);
+
+/* Copy slice_n slices of row_n rows of row_sz bytes */
+extern void cl_copy_rect(void *dst, size_t dst_row_pitch, size_t dst_slice_pitch,
+                         const void *src, size_t src_row_pitch, size_t src_slice_pitch,
+                         size_t row_sz, size_t row_n, size_t slice_n, int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CL_COPY_H__ */
+
@@ -39,6 +39,7 @@ static struct _cl_device_id intel_ivb_gt2_device = {
   INIT_ICD(dispatch)
   .max_compute_unit = 128,
   .max_thread_per_unit = 8,
+  .half_slice_n = 2,
   .max_work_item_sizes = {512, 512, 512},
   .max_work_group_size = 1024,
   .max_clock_frequency = 1000,
@@ -50,6 +51,7 @@ static struct _cl_device_id intel_ivb_gt1_device = {
   INIT_ICD(dispatch)
   .max_compute_unit = 64,
   .max_thread_per_unit = 8,
+  .half_slice_n = 1,
   .max_work_item_sizes = {512, 512, 512},
   .max_work_group_size = 512,
   .max_clock_frequency = 1000,
@@ -62,6 +64,7 @@ static struct _cl_device_id intel_hsw_device = {
   INIT_ICD(dispatch)
   .max_compute_unit = 64,
   .max_thread_per_unit = 8,
+  .half_slice_n = 2,
   .max_work_item_sizes = {512, 512, 512},
   .max_work_group_size = 512,
   .max_clock_frequency = 1000,
@@ -383,7 +386,7 @@ cl_get_kernel_workgroup_info(cl_kernel kernel,
     DECL_FIELD(PREFERRED_WORK_GROUP_SIZE_MULTIPLE, device->preferred_wg_sz_mul)
     case CL_KERNEL_LOCAL_MEM_SIZE:
       {
-        size_t local_mem_sz =  gbe_kernel_get_slm_size(kernel->opaque) + kernel->local_mem_sz;
+        size_t local_mem_sz =  kernel->slm_sz + kernel->local_mem_sz;
         _DECL_FIELD(local_mem_sz)
       }
     DECL_FIELD(COMPILE_WORK_GROUP_SIZE, kernel->compile_wg_sz)
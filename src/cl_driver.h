@@ -59,6 +59,13 @@ typedef enum cl_gpgpu_tiling {
   GPGPU_TILE_Y  = 2,
 } cl_gpgpu_tiling;
 
+/* Timestamps written around the walkers */
+typedef enum cl_gpgpu_profiling {
+  GPGPU_NO_PROFILING   = 0,  /* No timestamp */
+  GPGPU_PROFILING_NEW  = 1,  /* First walker of an NDRange: new timestamp buffer */
+  GPGPU_PROFILING_KEEP = 2,  /* Next walkers: the first start and last end are kept */
+} cl_gpgpu_profiling;
+
 /* Cache control options */
 typedef enum cl_cache_control {
   cc_gtt      = 0x0,
@@ -129,7 +136,7 @@ extern cl_gpgpu_set_stack_cb *cl_gpgpu_set_stack;
 typedef void (cl_gpgpu_set_scratch_cb)(cl_gpgpu, uint32_t per_thread_size);
 extern cl_gpgpu_set_scratch_cb *cl_gpgpu_set_scratch;
 
-/* Configure internal state */
+/* Configure internal state (profiling is a cl_gpgpu_profiling) */
 typedef void (cl_gpgpu_state_init_cb)(cl_gpgpu, uint32_t max_threads, uint32_t size_cs_entry, int profiling);
 extern cl_gpgpu_state_init_cb *cl_gpgpu_state_init;
 
@@ -141,8 +148,9 @@ extern cl_gpgpu_set_perf_counters_cb *cl_gpgpu_set_perf_counters;
 typedef void (cl_gpgpu_upload_curbes_cb)(cl_gpgpu, const void* data, uint32_t size);
 extern cl_gpgpu_upload_curbes_cb *cl_gpgpu_upload_curbes;
 
-typedef cl_buffer (cl_gpgpu_alloc_constant_buffer_cb)(cl_gpgpu, uint32_t size);
-extern cl_gpgpu_alloc_constant_buffer_cb *cl_gpgpu_alloc_constant_buffer;
+/* Bind the buffer holding the __constant data (owned by the caller) */
+typedef void (cl_gpgpu_bind_constant_buffer_cb)(cl_gpgpu, cl_buffer bo, uint32_t size);
+extern cl_gpgpu_bind_constant_buffer_cb *cl_gpgpu_bind_constant_buffer;
 
 /* Setup all indirect states */
 typedef void (cl_gpgpu_states_setup_cb)(cl_gpgpu, cl_gpgpu_kernel *kernel);
@@ -208,12 +216,13 @@ extern cl_gpgpu_ref_batch_buf_cb *cl_gpgpu_ref_batch_buf;
 typedef void (cl_gpgpu_unref_batch_buf_cb)(void*);
 extern cl_gpgpu_unref_batch_buf_cb *cl_gpgpu_unref_batch_buf;
 
-/* Will spawn all threads */
+/* Will spawn all threads of the group_n groups of local_wk_sz work items
+ * starting at group ID group_off */
 typedef void (cl_gpgpu_walker_cb)(cl_gpgpu,
                                   uint32_t simd_sz,
                                   uint32_t thread_n,
-                                  const size_t global_wk_off[3],
-                                  const size_t global_wk_sz[3],
+                                  const size_t group_off[3],
+                                  const size_t group_n[3],
                                   const size_t local_wk_sz[3]);
 extern cl_gpgpu_walker_cb *cl_gpgpu_walker;
 
@@ -224,10 +233,18 @@ extern cl_gpgpu_walker_cb *cl_gpgpu_walker;
 typedef cl_buffer (cl_buffer_alloc_cb)(cl_buffer_mgr, const char*, size_t, size_t);
 extern cl_buffer_alloc_cb *cl_buffer_alloc;
 
+/* Wrap page aligned host memory in a buffer. NULL if the kernel cannot */
+typedef cl_buffer (cl_buffer_alloc_userptr_cb)(cl_buffer_mgr, const char*, void*, size_t, unsigned long);
+extern cl_buffer_alloc_userptr_cb *cl_buffer_alloc_userptr;
+
 /* Set a buffer's tiling mode */
 typedef cl_buffer (cl_buffer_set_tiling_cb)(cl_buffer, int tiling, size_t stride);
 extern cl_buffer_set_tiling_cb *cl_buffer_set_tiling;
 
+/* Get the bit 6 swizzling of a tiled buffer (a cl_tiling_swizzle_t) */
+typedef int (cl_buffer_get_swizzle_cb)(cl_buffer);
+extern cl_buffer_get_swizzle_cb *cl_buffer_get_swizzle;
+
 #include "cl_context.h"
 #include "cl_mem.h"
 typedef struct _cl_context *cl_context;
@@ -297,6 +314,14 @@ extern cl_buffer_subdata_cb *cl_buffer_subdata;
 typedef int (cl_buffer_wait_rendering_cb) (cl_buffer);
 extern cl_buffer_wait_rendering_cb *cl_buffer_wait_rendering;
 
+/* Tell if the GPU still renders with this buffer */
+typedef int (cl_buffer_is_busy_cb) (cl_buffer);
+extern cl_buffer_is_busy_cb *cl_buffer_is_busy;
+
+/* Tell if a batch buffer (not submitted yet) uses the other buffer */
+typedef int (cl_buffer_references_cb) (cl_buffer batch, cl_buffer);
+extern cl_buffer_references_cb *cl_buffer_references;
+
 /* Get the device id */
 typedef int (cl_driver_get_device_id_cb)(void);
 extern cl_driver_get_device_id_cb *cl_driver_get_device_id;
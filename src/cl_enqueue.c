@@ -26,6 +26,7 @@
 #include "cl_driver.h"
 #include "cl_event.h"
 #include "cl_command_queue.h"
+#include "cl_copy.h"
 #include "cl_utils.h"
 
 
@@ -43,7 +44,7 @@ cl_int cl_enqueue_read_buffer(enqueue_data* data)
     goto error;
   }
 
-  memcpy(data->ptr, (char*)src_ptr + data->offset + buffer->sub_offset, data->size);
+  cl_copy(data->ptr, (char*)src_ptr + data->offset + buffer->sub_offset, data->size, 0);
 
   err = cl_mem_unmap_auto(data->mem_obj);
 
@@ -67,30 +68,14 @@ cl_int cl_enqueue_read_buffer_rect(enqueue_data* data)
   }
 
    size_t offset = origin[0] + data->row_pitch*origin[1] + data->slice_pitch*origin[2];
-   src_ptr = (char*)src_ptr + offset;
+   src_ptr = (char*)src_ptr + offset + cl_mem_buffer(data->mem_obj)->sub_offset;
 
    offset = host_origin[0] + data->host_row_pitch*host_origin[1] + data->host_slice_pitch*host_origin[2];
    dst_ptr = (char *)data->ptr + offset;
 
-   if (data->row_pitch == region[0] && data->row_pitch == data->host_row_pitch &&
-       (region[2] == 1 || (data->slice_pitch == region[0]*region[1] && data->slice_pitch == data->host_slice_pitch)))
-   {
-     memcpy(dst_ptr, src_ptr, region[2] == 1 ? data->row_pitch*region[1] : data->slice_pitch*region[2]);
-   }
-   else {
-     cl_uint y, z;
-     for (z = 0; z < region[2]; z++) {
-       const char* src = src_ptr;
-       char* dst = dst_ptr;
-       for (y = 0; y < region[1]; y++) {
-         memcpy(dst, src, region[0]);
-         src += data->row_pitch;
-         dst += data->host_row_pitch;
-       }
-       src_ptr = (char*)src_ptr + data->slice_pitch;
-       dst_ptr = (char*)dst_ptr + data->host_slice_pitch;
-     }
-   }
+   cl_copy_rect(dst_ptr, data->host_row_pitch, data->host_slice_pitch,
+                src_ptr, data->row_pitch, data->slice_pitch,
+                region[0], region[1], region[2], 0);
 
   err = cl_mem_unmap_auto(data->mem_obj);
 
@@ -112,7 +97,8 @@ cl_int cl_enqueue_write_buffer(enqueue_data *data)
     goto error;
   }
 
-  memcpy((char*)dst_ptr + data->offset + buffer->sub_offset, data->const_ptr, data->size);
+  cl_copy((char*)dst_ptr + data->offset + buffer->sub_offset, data->const_ptr, data->size, 0);
+  cl_mem_touch(mem);
 
   err = cl_mem_unmap_auto(data->mem_obj);
 
@@ -136,30 +122,15 @@ cl_int cl_enqueue_write_buffer_rect(enqueue_data *data)
   }
 
   size_t offset = origin[0] + data->row_pitch*origin[1] + data->slice_pitch*origin[2];
-  dst_ptr = (char *)dst_ptr + offset;
+  dst_ptr = (char *)dst_ptr + offset + cl_mem_buffer(data->mem_obj)->sub_offset;
 
   offset = host_origin[0] + data->host_row_pitch*host_origin[1] + data->host_slice_pitch*host_origin[2];
   src_ptr = (char*)data->const_ptr + offset;
 
-  if (data->row_pitch == region[0] && data->row_pitch == data->host_row_pitch &&
-      (region[2] == 1 || (data->slice_pitch == region[0]*region[1] && data->slice_pitch == data->host_slice_pitch)))
-  {
-    memcpy(dst_ptr, src_ptr, region[2] == 1 ? data->row_pitch*region[1] : data->slice_pitch*region[2]);
-  }
-  else {
-    cl_uint y, z;
-    for (z = 0; z < region[2]; z++) {
-      const char* src = src_ptr;
-      char* dst = dst_ptr;
-      for (y = 0; y < region[1]; y++) {
-        memcpy(dst, src, region[0]);
-        src += data->host_row_pitch;
-        dst += data->row_pitch;
-      }
-      src_ptr = (char*)src_ptr + data->host_slice_pitch;
-      dst_ptr = (char*)dst_ptr + data->slice_pitch;
-    }
-  }
+  cl_copy_rect(dst_ptr, data->row_pitch, data->slice_pitch,
+               src_ptr, data->host_row_pitch, data->host_slice_pitch,
+               region[0], region[1], region[2], 0);
+  cl_mem_touch(data->mem_obj);
 
   err = cl_mem_unmap_auto(data->mem_obj);
 
@@ -178,6 +149,16 @@ cl_int cl_enqueue_read_image(enqueue_data *data)
   const size_t* origin = data->origin;
   const size_t* region = data->region;
 
+  if (cl_mem_image_cpu_tiling(image)) {
+    if (!(src_ptr = cl_mem_map(mem))) {
+      err = CL_MAP_FAILURE;
+      goto error;
+    }
+    cl_mem_image_tiling_copy(image, src_ptr, origin, region, data->ptr,
+                             data->row_pitch, data->slice_pitch, CL_FALSE);
+    return cl_mem_unmap(mem);
+  }
+
   if (!(src_ptr = cl_mem_map_auto(mem))) {
     err = CL_MAP_FAILURE;
     goto error;
@@ -186,25 +167,11 @@ cl_int cl_enqueue_read_image(enqueue_data *data)
   size_t offset = image->bpp*origin[0] + image->row_pitch*origin[1] + image->slice_pitch*origin[2];
   src_ptr = (char*)src_ptr + offset;
 
-  if (!origin[0] && region[0] == image->w && data->row_pitch == image->row_pitch &&
-      (region[2] == 1 || (!origin[1] && region[1] == image->h && data->slice_pitch == image->slice_pitch)))
-  {
-    memcpy(data->ptr, src_ptr, region[2] == 1 ? data->row_pitch*region[1] : data->slice_pitch*region[2]);
-  }
-  else {
-    cl_uint y, z;
-    for (z = 0; z < region[2]; z++) {
-      const char* src = src_ptr;
-      char* dst = data->ptr;
-      for (y = 0; y < region[1]; y++) {
-        memcpy(dst, src, image->bpp*region[0]);
-        src += image->row_pitch;
-        dst += data->row_pitch;
-      }
-      src_ptr = (char*)src_ptr + image->slice_pitch;
-      data->ptr = (char*)data->ptr + data->slice_pitch;
-    }
-  }
+  /* Tiled images are read through the write-combined GTT mapping */
+  cl_copy_rect(data->ptr, data->row_pitch, data->slice_pitch,
+               src_ptr, image->row_pitch, image->slice_pitch,
+               image->bpp*region[0], region[1], region[2],
+               image->tiling != CL_NO_TILE ? CL_COPY_SRC_WC : 0);
 
  err = cl_mem_unmap_auto(mem);
 
@@ -221,6 +188,17 @@ cl_int cl_enqueue_write_image(enqueue_data *data)
   cl_mem mem = data->mem_obj;
   CHECK_IMAGE(mem, image);
 
+  if (cl_mem_image_cpu_tiling(image)) {
+    if (!(dst_ptr = cl_mem_map(mem))) {
+      err = CL_MAP_FAILURE;
+      goto error;
+    }
+    cl_mem_image_tiling_copy(image, dst_ptr, data->origin, data->region,
+                             (void*)data->const_ptr, data->row_pitch,
+                             data->slice_pitch, CL_TRUE);
+    return cl_mem_unmap(mem);
+  }
+
   if (!(dst_ptr = cl_mem_map_auto(mem))) {
     err = CL_MAP_FAILURE;
     goto error;
@@ -229,7 +207,8 @@ cl_int cl_enqueue_write_image(enqueue_data *data)
   cl_mem_copy_image_region(data->origin, data->region, dst_ptr,
                            image->row_pitch, image->slice_pitch,
                            data->const_ptr, data->row_pitch,
-                           data->slice_pitch, image);
+                           data->slice_pitch, image,
+                           image->tiling != CL_NO_TILE ? CL_COPY_DST_WC : 0);
   err = cl_mem_unmap_auto(mem);
 
 error:
@@ -254,10 +233,12 @@ cl_int cl_enqueue_map_buffer(enqueue_data *data)
 
   ptr = (char*)ptr + data->offset + buffer->sub_offset;
   assert(data->ptr == ptr);
+  cl_mem_touch(mem);
 
-  if(mem->flags & CL_MEM_USE_HOST_PTR) {
+  /* The userptr buffers are the host memory: nothing to copy */
+  if((mem->flags & CL_MEM_USE_HOST_PTR) && !mem->is_userptr) {
     assert(mem->host_ptr);
-    memcpy(mem->host_ptr + data->offset, ptr, data->size);
+    cl_copy(mem->host_ptr + data->offset, ptr, data->size, CL_COPY_SRC_WC);
   }
 
 error:
@@ -282,7 +263,8 @@ cl_int cl_enqueue_map_image(enqueue_data *data)
     assert(mem->host_ptr);
     cl_mem_copy_image_region(data->origin, data->region,
                              mem->host_ptr, image->host_row_pitch, image->host_slice_pitch,
-                             data->ptr, data->row_pitch, data->slice_pitch, image);
+                             data->ptr, data->row_pitch, data->slice_pitch, image,
+                             CL_COPY_SRC_WC);
   }
 
 error:
@@ -314,15 +296,16 @@ cl_int cl_enqueue_unmap_mem_object(enqueue_data *data)
   /* can not find a mapped address? */
   INVALID_VALUE_IF(i == memobj->mapped_ptr_sz);
 
-  if (memobj->flags & CL_MEM_USE_HOST_PTR) {
+  if ((memobj->flags & CL_MEM_USE_HOST_PTR) && !memobj->is_userptr) {
     assert(mapped_ptr >= memobj->host_ptr &&
       mapped_ptr + mapped_size <= memobj->host_ptr + memobj->size);
     /* Sync the data. */
-    memcpy(v_ptr, mapped_ptr, mapped_size);
+    cl_copy(v_ptr, mapped_ptr, mapped_size, CL_COPY_DST_WC);
   } else {
     assert(v_ptr == mapped_ptr);
   }
 
+  cl_mem_touch(memobj);
   cl_mem_unmap_gtt(memobj);
 
   /* shrink the mapped slot. */
@@ -366,11 +349,14 @@ cl_int cl_enqueue_native_kernel(enqueue_data *data)
       CHECK_MEM(buffer);
 
       *((void **)args_mem_loc[i]) = cl_mem_map_auto(buffer);
+      if (!IS_IMAGE(buffer))
+        *((char **)args_mem_loc[i]) += cl_mem_buffer(buffer)->sub_offset;
   }
   data->user_func(data->ptr);
 
   for (i=0; i<num_mem_objects; ++i)
   {
+      cl_mem_touch(mem_list[i]);
       cl_mem_unmap_auto(mem_list[i]);
   }
 
@@ -411,7 +397,12 @@ cl_int cl_enqueue_handle(cl_event event, enqueue_data* data)
     case EnqueueCopyImage:
     case EnqueueCopyBufferToImage:
     case EnqueueCopyImageToBuffer:
+    case EnqueueFillBuffer:
+    case EnqueueFillImage:
+      cl_gpgpu_event_resume((cl_gpgpu_event)data->ptr);
+      return CL_SUCCESS;
     case EnqueueNDRangeKernel:
+      cl_constant_copy_run(data->cst_copy);
       cl_gpgpu_event_resume((cl_gpgpu_event)data->ptr);
       return CL_SUCCESS;
     case EnqueueNativeKernel:
@@ -41,6 +41,8 @@ typedef enum {
   EnqueueNDRangeKernel,
   EnqueueNativeKernel,
   EnqueueMarker,
+  EnqueueFillBuffer,
+  EnqueueFillImage,
   EnqueueInvalid
 } enqueue_type;
 
@@ -61,6 +63,8 @@ typedef struct _enqueue_data {
   void *            ptr;              /* Ptr for write and return value */
   const cl_mem*     mem_list;         /* mem_list of clEnqueueNativeKernel */
   void (*user_func)(void *);          /* pointer to a host-callable user function */
+  cl_kernel         kernel;           /* NDRange kernel, only until it is deferred */
+  struct cl_constant_copy *cst_copy;  /* __constant arguments copied when it runs */
 } enqueue_data;
 
 /* Do real enqueue commands */
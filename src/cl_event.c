@@ -24,11 +24,14 @@
 #include "cl_khr_icd.h"
 #include "cl_kernel.h"
 #include "cl_command_queue.h"
+#include "cl_mem.h"
+#include "cl_worker.h"
+#include "cl_trace.h"
 
 #include <assert.h>
 #include <stdio.h>
 
-inline cl_bool
+cl_bool
 cl_event_is_gpu_command_type(cl_command_type type)
 {
   switch(type) {
@@ -37,6 +40,8 @@ cl_event_is_gpu_command_type(cl_command_type type)
     case CL_COMMAND_COPY_IMAGE_TO_BUFFER:
     case CL_COMMAND_COPY_BUFFER_TO_IMAGE:
     case CL_COMMAND_COPY_BUFFER_RECT:
+    case CL_COMMAND_FILL_BUFFER:
+    case CL_COMMAND_FILL_IMAGE:
     case CL_COMMAND_TASK:
     case CL_COMMAND_NDRANGE_KERNEL:
       return CL_TRUE;
@@ -55,14 +60,11 @@ cl_event cl_event_new(cl_context ctx, cl_command_queue queue, cl_command_type ty
   SET_ICD(event->dispatch)
   event->magic = CL_MAGIC_EVENT_HEADER;
   event->ref_n = 1;
+  pthread_mutex_init(&event->lock, NULL);
+  pthread_cond_init(&event->cond, NULL);
 
   /* Append the event in the context event list */
-  pthread_mutex_lock(&ctx->event_lock);
-    event->next = ctx->events;
-    if (ctx->events != NULL)
-      ctx->events->prev = event;
-    ctx->events = event;
-  pthread_mutex_unlock(&ctx->event_lock);
+  cl_context_add_event(ctx, event);
   event->ctx   = ctx;
   cl_context_add_ref(ctx);
 
@@ -81,7 +83,7 @@ cl_event cl_event_new(cl_context ctx, cl_command_queue queue, cl_command_type ty
   cl_event_add_ref(event);       //dec when complete
   event->user_cb = NULL;
   event->enqueue_cb = NULL;
-  event->waits_head = NULL;
+  event->succs = NULL;
   event->emplict = emplict;
   if(queue && event->gpgpu_event)
     queue->last_event = event;
@@ -124,19 +126,13 @@ void cl_event_delete(cl_event event)
 
   /* Remove it from the list */
   assert(event->ctx);
-  pthread_mutex_lock(&event->ctx->event_lock);
-
-  if (event->prev)
-    event->prev->next = event->next;
-  if (event->next)
-    event->next->prev = event->prev;
-  /* if this is the head, update head pointer ctx->events */
-  if (event->ctx->events == event)
-    event->ctx->events = event->next;
-
-  pthread_mutex_unlock(&event->ctx->event_lock);
+  cl_context_remove_event(event->ctx, event);
   cl_context_delete(event->ctx);
 
+  assert(event->succ_n == 0);
+  cl_free(event->succs);
+  pthread_mutex_destroy(&event->lock);
+  pthread_cond_destroy(&event->cond);
   cl_free(event);
 }
 
@@ -210,25 +206,26 @@ error:
   goto exit;
 }
 
+/* Pending events a deferred command must wait on: the user events and the
+ * other deferred commands. The other commands are already submitted
+ */
+cl_bool
+cl_event_is_deferring(cl_event event)
+{
+  return event->status > CL_COMPLETE &&
+         (event->type == CL_COMMAND_USER || event->enqueue_cb != NULL);
+}
+
 cl_int cl_event_wait_events(cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
                             cl_command_queue queue)
 {
-  cl_int i, j;
-
-  /* Check whether wait user events */
-  for(i=0; i<num_events_in_wait_list; i++) {
-    if(event_wait_list[i]->status <= CL_COMPLETE)
-      continue;
+  CL_TRACE_SCOPE("wait events", "wait");
+  cl_int i;
 
-    /* Need wait on user event, return and do enqueue defer */
-    if((event_wait_list[i]->type == CL_COMMAND_USER) ||
-       (event_wait_list[i]->enqueue_cb &&
-       (event_wait_list[i]->enqueue_cb->wait_user_events != NULL))){
-      for(j=0; j<num_events_in_wait_list; j++)
-        cl_event_add_ref(event_wait_list[j]);  //add defer enqueue's wait event reference
+  /* Need wait on user event or deferred enqueue, return and do enqueue defer */
+  for(i=0; i<num_events_in_wait_list; i++)
+    if(cl_event_is_deferring(event_wait_list[i]))
       return CL_ENQUEUE_EXECUTE_DEFER;
-    }
-  }
 
   if(queue && queue->barrier_index > 0) {
     return CL_ENQUEUE_EXECUTE_DEFER;
@@ -238,10 +235,6 @@ cl_int cl_event_wait_events(cl_uint num_events_in_wait_list, const cl_event *eve
   for(i=0; i<num_events_in_wait_list; i++) {
     if(event_wait_list[i]->status <= CL_COMPLETE)
       continue;
-
-    //enqueue callback haven't finish, in another thread, wait
-    if(event_wait_list[i]->enqueue_cb != NULL)
-      return CL_ENQUEUE_EXECUTE_DEFER;
     if(event_wait_list[i]->gpgpu_event)
       cl_gpgpu_event_update_status(event_wait_list[i]->gpgpu_event, 1);
     cl_event_set_status(event_wait_list[i], CL_COMPLETE);  //Execute user's callback
@@ -249,14 +242,60 @@ cl_int cl_event_wait_events(cl_uint num_events_in_wait_list, const cl_event *eve
   return CL_ENQUEUE_EXECUTE_IMM;
 }
 
+/* Make cb wait on the event if it is still deferring. Return true if it does */
+static cl_bool
+cl_event_add_successor(cl_event event, enqueue_callback *cb)
+{
+  cl_bool added = CL_FALSE;
+
+  pthread_mutex_lock(&event->lock);
+  if(cl_event_is_deferring(event)) {
+    if(event->succ_n == event->succ_size) {
+      const cl_uint size = event->succ_size ? 2 * event->succ_size : 4;
+      enqueue_callback **succs = cl_realloc(event->succs, size * sizeof(enqueue_callback*));
+      if(UNLIKELY(succs == NULL))
+        goto exit;
+      event->succs = succs;
+      event->succ_size = size;
+    }
+    event->succs[event->succ_n++] = cb;
+    atomic_inc(&cb->dep_n);
+    added = CL_TRUE;
+  }
+exit:
+  pthread_mutex_unlock(&event->lock);
+  return added;
+}
+
+/* The commands ready to run. They are queued by the thread completing their
+ * last event so that long dependency chains do not recurse
+ */
+typedef struct _ready_list {
+  enqueue_callback *head, *tail;
+} ready_list;
+
+static void
+cl_event_push_ready(ready_list *ready, enqueue_callback *cb)
+{
+  cb->next = NULL;
+  if(ready->tail)
+    ready->tail->next = cb;
+  else
+    ready->head = cb;
+  ready->tail = cb;
+}
+
+static void cl_event_run_ready(ready_list *ready);
+static void cl_event_run_command(enqueue_callback *cb, ready_list *ready);
+
 void cl_event_new_enqueue_callback(cl_event event,
                                             enqueue_data *data,
                                             cl_uint num_events_in_wait_list,
                                             const cl_event *event_wait_list)
 {
-  enqueue_callback *cb, *node;
-  user_event *user_events, *u_ev;
+  enqueue_callback *cb = NULL;
   cl_command_queue queue = event->queue;
+  ready_list ready = {NULL, NULL};
   cl_int i;
   GET_QUEUE_THREAD_GPGPU(data->queue);
 
@@ -264,144 +303,102 @@ void cl_event_new_enqueue_callback(cl_event event,
   TRY_ALLOC_NO_ERR (cb, CALLOC(enqueue_callback));
   cb->num_events = num_events_in_wait_list;
   TRY_ALLOC_NO_ERR (cb->wait_list, CALLOC_ARRAY(cl_event, num_events_in_wait_list));
-  for(i=0; i<num_events_in_wait_list; i++)
+  for(i=0; i<num_events_in_wait_list; i++) {
     cb->wait_list[i] = event_wait_list[i];
+    cl_event_add_ref(cb->wait_list[i]);  //dec when the enqueue is done
+  }
   cb->event = event;
   cb->next = NULL;
-  cb->wait_user_events = NULL;
-
-  if(queue && queue->barrier_index > 0) {
-    for(i=0; i<queue->barrier_index; i++) {
-      /* Insert the enqueue_callback to user event list */
-      node = queue->wait_events[i]->waits_head;
-      if(node == NULL)
-        queue->wait_events[i]->waits_head = cb;
-      else
-        while((node != cb) && node->next)
-          node = node->next;
-        if(node == cb)   //wait on dup user event
-          continue;
-        node->next = cb;
-
-      /* Insert the user event to enqueue_callback's wait_user_events */
-      TRY_ALLOC_NO_ERR (u_ev, CALLOC(user_event));
-      u_ev->event = queue->wait_events[i];
-      u_ev->next = cb->wait_user_events;
-      cb->wait_user_events = u_ev;
-    }
-  }
-
-  /* Find out all user events that events in event_wait_list wait */
-  for(i=0; i<num_events_in_wait_list; i++) {
-    if(event_wait_list[i]->status <= CL_COMPLETE)
-      continue;
+  cb->dep_n = 1;  //Held until all the dependencies are recorded
 
-    if(event_wait_list[i]->type == CL_COMMAND_USER) {
-      /* Insert the enqueue_callback to user event list */
-      node = event_wait_list[i]->waits_head;
-      if(node == NULL)
-        event_wait_list[i]->waits_head = cb;
-      else {
-        while((node != cb) && node->next)
-          node = node->next;
-        if(node == cb)   //wait on dup user event
-          continue;
-        node->next = cb;
-      }
-      /* Insert the user event to enqueue_callback's wait_user_events */
-      TRY_ALLOC_NO_ERR (u_ev, CALLOC(user_event));
-      u_ev->event = event_wait_list[i];
-      u_ev->next = cb->wait_user_events;
-      cb->wait_user_events = u_ev;
-      cl_command_queue_insert_event(event->queue, event_wait_list[i]);
-    } else if(event_wait_list[i]->enqueue_cb != NULL) {
-      user_events = event_wait_list[i]->enqueue_cb->wait_user_events;
-      while(user_events != NULL) {
-        /* Insert the enqueue_callback to user event's  waits_tail */
-        node = user_events->event->waits_head;
-        while((node != cb) && node->next)
-          node = node->next;
-        if(node == cb) {  //wait on dup user event
-          user_events = user_events->next;
-          continue;
-        }
-        node->next = cb;
-
-        /* Insert the user event to enqueue_callback's wait_user_events */
-        TRY_ALLOC_NO_ERR (u_ev, CALLOC(user_event));
-        u_ev->event = user_events->event;
-        u_ev->next = cb->wait_user_events;
-        cb->wait_user_events = u_ev;
-        user_events = user_events->next;
-        cl_command_queue_insert_event(event->queue, event_wait_list[i]);
-      }
-    }
-  }
   if(data->queue != NULL && event->gpgpu_event != NULL) {
     cl_gpgpu_event_pending(gpgpu, event->gpgpu_event);
     data->ptr = (void *)event->gpgpu_event;
   }
   cb->data = *data;
+  if(cb->data.mem_obj)
+    cl_mem_add_ref(cb->data.mem_obj);  //dec when the enqueue is done
+  /* The commands the NDRange waits for may write its __constant arguments */
+  if(cb->data.type == EnqueueNDRangeKernel && cb->data.kernel)
+    cb->data.cst_copy = cl_constant_copy_new(cb->data.kernel);
+  cb->data.kernel = NULL;
   event->enqueue_cb = cb;
 
+  /* The events before the barrier block all the following enqueues */
+  if(queue && queue->barrier_index > 0)
+    for(i=0; i<queue->barrier_index; i++)
+      cl_event_add_successor(queue->wait_events[i], cb);
+
+  /* In order queues with a worker: each deferred command follows the previous one */
+  if(queue && queue->worker && !(queue->props & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)) {
+    cl_event prev;
+    cl_event_add_ref(event);
+    pthread_mutex_lock(&queue->async_lock);
+      prev = queue->async_last;
+      if(prev)
+        cl_event_add_successor(prev, cb);
+      queue->async_last = event;
+    pthread_mutex_unlock(&queue->async_lock);
+    if(prev)
+      cl_event_delete(prev);
+  }
+
+  /* The wait list may be the queue wait_events (markers) which we modify */
+  for(i=0; i<num_events_in_wait_list; i++)
+    if(cl_event_add_successor(cb->wait_list[i], cb))
+      cl_command_queue_insert_event(queue, cb->wait_list[i]);
+
+  /* All of them may have completed in the meantime */
+  if(atomic_dec(&cb->dep_n) == 1) {
+    cl_event_push_ready(&ready, cb);
+    cl_event_run_ready(&ready);
+  }
+
 exit:
   return;
 error:
   if(cb) {
-    while(cb->wait_user_events) {
-      u_ev = cb->wait_user_events;
-      cb->wait_user_events = cb->wait_user_events->next;
-      cl_free(u_ev);
-    }
-    if(cb->wait_list)
+    if(cb->wait_list) {
+      for(i=0; i<num_events_in_wait_list; i++)
+        cl_event_delete(cb->wait_list[i]);
       cl_free(cb->wait_list);
+    }
     cl_free(cb);
   }
   goto exit;
 }
 
-void cl_event_set_status(cl_event event, cl_int status)
+/* Change the status, call the user callbacks and, on completion, release
+ * the deferred commands waiting on the event. The ones with no more pending
+ * events are added to ready
+ */
+static void
+cl_event_update(cl_event event, cl_int status, ready_list *ready)
 {
   user_callback *user_cb;
-  user_event    *u_ev, *u_ev_next;
-  cl_int ret, i;
-  cl_event evt;
-
-  pthread_mutex_lock(&event->ctx->event_lock);
-  if(status >= event->status) {
-    pthread_mutex_unlock(&event->ctx->event_lock);
-    return;
-  }
-  if(event->status <= CL_COMPLETE) {
-    event->status = status;    //have done enqueue before or doing in another thread
-    pthread_mutex_unlock(&event->ctx->event_lock);
+  enqueue_callback **succs = NULL;
+  cl_uint succ_n = 0, i;
+  cl_int prev;
+
+  pthread_mutex_lock(&event->lock);
+  prev = event->status;
+  if(status >= prev) {
+    pthread_mutex_unlock(&event->lock);
     return;
   }
-
+  event->status = status;
   if(status <= CL_COMPLETE) {
-    if(event->enqueue_cb) {
-      cl_enqueue_handle(event, &event->enqueue_cb->data);
-      if(event->gpgpu_event)
-        cl_gpgpu_event_update_status(event->gpgpu_event, 1);  //now set complet, need refine
-      event->status = status;  //Change the event status after enqueue and befor unlock
-
-      pthread_mutex_unlock(&event->ctx->event_lock);
-      for(i=0; i<event->enqueue_cb->num_events; i++)
-        cl_event_delete(event->enqueue_cb->wait_list[i]);
-      pthread_mutex_lock(&event->ctx->event_lock);
-
-      if(event->enqueue_cb->wait_list)
-        cl_free(event->enqueue_cb->wait_list);
-      cl_free(event->enqueue_cb);
-      event->enqueue_cb = NULL;
-    }
+    succs = event->succs;
+    succ_n = event->succ_n;
+    event->succs = NULL;
+    event->succ_n = event->succ_size = 0;
+    pthread_cond_broadcast(&event->cond);
   }
-  if(event->status >= status)  //maybe changed in other threads
-    event->status = status;
-  pthread_mutex_unlock(&event->ctx->event_lock);
+  pthread_mutex_unlock(&event->lock);
 
-  if(event->status <= CL_COMPLETE)
-    cl_event_delete(event);
+  /* Have done enqueue before or doing in another thread */
+  if(prev <= CL_COMPLETE)
+    return;
 
   /* Call user callback */
   user_cb = event->user_cb;
@@ -413,55 +410,106 @@ void cl_event_set_status(cl_event event, cl_int status)
     user_cb = user_cb->next;
   }
 
-  if(event->type != CL_COMMAND_USER)
+  if(status > CL_COMPLETE)
     return;
 
-  /* Check all defer enqueue */
-  enqueue_callback *cb, *enqueue_cb = event->waits_head;
-  while(enqueue_cb) {
-    /* Remove this user event in enqueue_cb */
-    while(enqueue_cb->wait_user_events &&
-          enqueue_cb->wait_user_events->event == event) {
-      u_ev = enqueue_cb->wait_user_events;
-      enqueue_cb->wait_user_events = enqueue_cb->wait_user_events->next;
-      cl_free(u_ev);
-    }
+  for(i=0; i<succ_n; i++) {
+    enqueue_callback *cb = succs[i];
+    //remove the event from the waiting command's queue
+    if(cb->event->queue)
+      cl_command_queue_remove_event(cb->event->queue, event);
+    if(atomic_dec(&cb->dep_n) == 1)
+      cl_event_push_ready(ready, cb);
+  }
+  cl_free(succs);
 
-    u_ev = enqueue_cb->wait_user_events;
-    while(u_ev) {
-      u_ev_next = u_ev->next;
-      if(u_ev_next && u_ev_next->event == event) {
-        u_ev->next = u_ev_next->next;
-        cl_free(u_ev_next);
-      } else
-        u_ev->next = u_ev_next;
-    }
+  cl_event_delete(event);  //The reference taken at creation
+}
 
-    /* Still wait on other user events */
-    if(enqueue_cb->wait_user_events != NULL) {
-      enqueue_cb = enqueue_cb->next;
+/* Run one deferred command in this thread */
+static void
+cl_event_run_command(enqueue_callback *cb, ready_list *ready)
+{
+  cl_event event = cb->event;
+  cl_int i;
+
+  /* The submitted commands it waits on are done first */
+  for(i=0; i<cb->num_events; i++) {
+    cl_event wait = cb->wait_list[i];
+    if(wait->status <= CL_COMPLETE)
       continue;
-    }
+    if(wait->gpgpu_event)
+      cl_gpgpu_event_update_status(wait->gpgpu_event, 1);
+    cl_event_update(wait, CL_COMPLETE, ready);
+  }
 
-    //remove user event frome enqueue_cb's ctx
-    cl_command_queue_remove_event(enqueue_cb->event->queue, event);
+  /* Call the pending operation */
+  cl_event_add_ref(event);
+  cl_enqueue_handle(event, &cb->data);
+  if(event->gpgpu_event)
+    cl_gpgpu_event_update_status(event->gpgpu_event, 1);  //now set complet, need refine
+  cl_event_update(event, CL_COMPLETE, ready);
+  event->enqueue_cb = NULL;
 
-    /* All user events complete, now wait enqueue events */
-    ret = cl_event_wait_events(enqueue_cb->num_events, enqueue_cb->wait_list,
-                               enqueue_cb->event->queue);
-    assert(ret != CL_ENQUEUE_EXECUTE_DEFER);
+  for(i=0; i<cb->num_events; i++)
+    cl_event_delete(cb->wait_list[i]);
+  if(cb->data.mem_obj)
+    cl_mem_delete(cb->data.mem_obj);
+  cl_constant_copy_delete(cb->data.cst_copy);
+  cl_free(cb->wait_list);
+  cl_free(cb);
 
-    cb = enqueue_cb;
-    enqueue_cb = enqueue_cb->next;
+  if(event->emplict == CL_FALSE)
+    cl_event_delete(event);
+  cl_event_delete(event);
+}
 
-    /* Call the pending operation */
-    evt = cb->event;
-    cl_event_set_status(cb->event, CL_COMPLETE);
-    if(evt->emplict == CL_FALSE) {
-      cl_event_delete(evt);
-    }
+/* Run the deferred commands until no more are ready. The host side commands
+ * of the queues with a worker are handed over to it
+ */
+static void
+cl_event_run_ready(ready_list *ready)
+{
+  while(ready->head) {
+    enqueue_callback *cb = ready->head;
+    cl_command_queue queue = cb->event->queue;
+    ready->head = cb->next;
+    if(ready->head == NULL)
+      ready->tail = NULL;
+
+    if(queue && queue->worker &&
+       !cl_event_is_gpu_command_type(cb->event->type) &&
+       !cl_worker_is_self(queue->worker))
+      cl_worker_push(queue->worker, cb);
+    else
+      cl_event_run_command(cb, ready);
   }
-  event->waits_head = NULL;
+}
+
+void cl_event_run_deferred(enqueue_callback *cb)
+{
+  ready_list ready = {NULL, NULL};
+  cl_event_run_command(cb, &ready);
+  cl_event_run_ready(&ready);
+}
+
+void cl_event_wait(cl_event event)
+{
+  pthread_mutex_lock(&event->lock);
+  while(event->status > CL_COMPLETE)
+    pthread_cond_wait(&event->cond, &event->lock);
+  pthread_mutex_unlock(&event->lock);
+}
+
+void cl_event_set_status(cl_event event, cl_int status)
+{
+  ready_list ready = {NULL, NULL};
+
+  /* The deferred enqueues are run when their dependencies complete */
+  if(status <= CL_COMPLETE && event->enqueue_cb)
+    return;
+  cl_event_update(event, status, &ready);
+  cl_event_run_ready(&ready);
 }
 
 void cl_event_update_status(cl_event event)
@@ -488,6 +536,8 @@ cl_int cl_event_marker(cl_command_queue queue, cl_event* event)
     return CL_SUCCESS;
   }
 
+  /* The NDRanges accumulated without event complete before the marker too */
+  cl_command_queue_finish(queue);
   if(queue->last_event && queue->last_event->gpgpu_event) {
     cl_gpgpu_event_update_status(queue->last_event->gpgpu_event, 1);
   }
@@ -21,27 +21,28 @@
 #define __CL_EVENT_H__
 
 #include <semaphore.h>
+#include <pthread.h>
 
 #include "cl_internals.h"
 #include "cl_driver.h"
 #include "cl_enqueue.h"
+#include "cl_utils.h"
 #include "CL/cl.h"
 
 #define CL_ENQUEUE_EXECUTE_IMM   0
 #define CL_ENQUEUE_EXECUTE_DEFER 1
 
-typedef struct _user_event {
-  cl_event            event;   /* The user event */
-  struct _user_event* next;    /* Next user event in list */
-} user_event;
-
+/* A command deferred until the events it waits on complete. The commands and
+ * the events form a dependency graph: each event lists the commands waiting on
+ * it and each command counts the events it still waits on
+ */
 typedef struct _enqueue_callback {
   cl_event           event;            /* The event relative this enqueue callback */
   enqueue_data       data;             /* Hold all enqueue callback's infomation */
   cl_uint            num_events;       /* num events in wait list */
   cl_event*          wait_list;        /* All event wait list this callback wait on */
-  user_event*        wait_user_events; /* The head of user event list the callback wait on */
-  struct _enqueue_callback*  next;     /* The  next enqueue callback in wait list */
+  atomic_t           dep_n;            /* Number of pending events it waits on */
+  struct _enqueue_callback*  next;     /* The next command ready to run */
 } enqueue_callback;
 
 typedef void (CL_CALLBACK *EVENT_NOTIFY)(cl_event event, cl_int event_command_exec_status, void *user_data);
@@ -65,8 +66,12 @@ struct _cl_event {
   cl_int             status;      /* The execution status */
   cl_gpgpu_event     gpgpu_event; /* The event object communicate with hardware */
   user_callback*     user_cb;     /* The event callback functions */
+  pthread_mutex_t    lock;        /* Protects the status and the successors */
+  pthread_cond_t     cond;        /* Signaled on completion */
   enqueue_callback*  enqueue_cb;  /* This event's enqueue */
-  enqueue_callback*  waits_head;  /* The head of enqueues list wait on this event */
+  enqueue_callback** succs;       /* The deferred commands waiting on this event */
+  cl_uint            succ_n;      /* Number of deferred commands waiting on it */
+  cl_uint            succ_size;   /* Capacity of succs */
   cl_bool            emplict;     /* Identify this event whether created by api emplict*/
   cl_ulong           timestamp[4];/* The time stamps for profiling. */
 };
@@ -83,8 +88,14 @@ cl_int cl_event_set_callback(cl_event, cl_int, EVENT_NOTIFY, void *);
 cl_int cl_event_check_waitlist(cl_uint, const cl_event *, cl_event *, cl_context);
 /* Wait the all events in wait list complete */
 cl_int cl_event_wait_events(cl_uint, const cl_event *, cl_command_queue);
+/* Return true if the event is a user event or a deferred command not done yet */
+cl_bool cl_event_is_deferring(cl_event);
 /* New a enqueue suspend task */
 void cl_event_new_enqueue_callback(cl_event, enqueue_data *, cl_uint, const cl_event *);
+/* Run a ready deferred command and the ones it releases, in this thread */
+void cl_event_run_deferred(enqueue_callback *);
+/* Block until the event completes */
+void cl_event_wait(cl_event);
 /* Set the event status and call all callbacks */
 void cl_event_set_status(cl_event, cl_int);
 /* Check and update event status */
@@ -93,5 +104,7 @@ void cl_event_update_status(cl_event);
 cl_int cl_event_marker(cl_command_queue, cl_event*);
 /* Do the event profiling */
 cl_int cl_event_get_timestamp(cl_event event, cl_profiling_info param_name);
+/* Return true if the command is executed by the GPU */
+cl_bool cl_event_is_gpu_command_type(cl_command_type type);
 #endif /* __CL_EVENT_H__ */
 
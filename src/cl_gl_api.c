@@ -34,6 +34,7 @@
 #include "cl_image.h"
 #include "cl_sampler.h"
 #include "cl_alloc.h"
+#include "cl_trace.h"
 #include "cl_utils.h"
 
 #include "CL/cl.h"
@@ -55,6 +56,7 @@ clCreateFromGLBuffer(cl_context    context,
                      GLuint        bufobj,
                      cl_int *      errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -75,6 +77,7 @@ clCreateFromGLTexture2D(cl_context    context,
                         GLuint texture,
                         cl_int *      errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -95,6 +98,7 @@ clCreateFromGLTexture3D(cl_context    context,
                         GLuint texture,
                         cl_int *      errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
@@ -115,6 +119,7 @@ clCreateFromGLTexture(cl_context      context,
                       cl_GLuint       texture,
                       cl_int *        errcode_ret)
 {
+  CL_TRACE_API();
   cl_mem mem = NULL;
   cl_int err = CL_SUCCESS;
   CHECK_CONTEXT (context);
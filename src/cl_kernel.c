@@ -27,6 +27,7 @@
 #include "cl_khr_icd.h"
 #include "CL/cl.h"
 #include "cl_sampler.h"
+#include "cl_local_size.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -34,6 +35,29 @@
 #include <stdint.h>
 #include <assert.h>
 
+static void
+cl_kernel_template_delete(cl_kernel_template *tpl)
+{
+  if (tpl == NULL) return;
+  if (atomic_dec(&tpl->ref_n) > 1) return;
+  if (tpl->bo)
+    cl_buffer_unreference(tpl->bo);
+  if (tpl->arg_info)
+    cl_free(tpl->arg_info);
+  if (tpl->images)
+    cl_free(tpl->images);
+  if (tpl->curbe)
+    cl_free(tpl->curbe);
+  cl_free(tpl);
+}
+
+/* The curbe shared with the template, if any */
+static INLINE const char*
+cl_kernel_shared_curbe(cl_kernel k)
+{
+  return k->tpl ? k->tpl->curbe : NULL;
+}
+
 LOCAL void
 cl_kernel_delete(cl_kernel k)
 {
@@ -42,21 +66,22 @@ cl_kernel_delete(cl_kernel k)
 
   /* We are not done with the kernel */
   if (atomic_dec(&k->ref_n) > 1) return;
-  /* Release one reference on all bos we own */
-  if (k->bo)       cl_buffer_unreference(k->bo);
   /* This will be true for kernels created by clCreateKernel */
   if (k->ref_its_program) cl_program_delete(k->program);
-  /* Release the curbe if allocated */
-  if (k->curbe) cl_free(k->curbe);
-  /* Release the argument array if required */
+  /* Release the curbe if it was copied */
+  if (k->curbe && k->curbe != cl_kernel_shared_curbe(k)) cl_free(k->curbe);
+  /* The argument array is allocated with the kernel */
   if (k->args) {
     for (i = 0; i < k->arg_n; ++i)
       if (k->args[i].mem != NULL)
         cl_mem_delete(k->args[i].mem);
-    cl_free(k->args);
   }
-  if (k->image_sz)
-    cl_free(k->images);
+  /* Release the code, the argument descriptors and the images */
+  cl_kernel_template_delete(k->tpl);
+  if (k->payload.data)
+    cl_free(k->payload.data);
+  if (k->cst_bo)
+    cl_buffer_unreference(k->cst_bo);
   k->magic = CL_MAGIC_DEAD_HEADER; /* For safety */
   cl_free(k);
 }
@@ -92,21 +117,63 @@ cl_kernel_add_ref(cl_kernel k)
   atomic_inc(&k->ref_n);
 }
 
+LOCAL cl_int
+cl_kernel_own_curbe(cl_kernel k)
+{
+  const char *shared = cl_kernel_shared_curbe(k);
+  char *curbe = NULL;
+
+  if (LIKELY(k->curbe != shared || k->curbe_sz == 0))
+    return CL_SUCCESS;
+  if (UNLIKELY((curbe = cl_malloc(k->curbe_sz)) == NULL))
+    return CL_OUT_OF_HOST_MEMORY;
+  if (shared)
+    memcpy(curbe, shared, k->curbe_sz);
+  else
+    memset(curbe, 0, k->curbe_sz);
+  k->curbe = curbe;
+  return CL_SUCCESS;
+}
+
+/* The sizes and format of an image argument are read from the curbe */
+static void
+cl_kernel_set_image_info(char *curbe,
+                         const struct ImageInfo *image_info,
+                         const struct _cl_mem_image *image)
+{
+  if (image_info->wSlot >= 0)
+    *(uint32_t*)(curbe + image_info->wSlot) = image->w;
+  if (image_info->hSlot >= 0)
+    *(uint32_t*)(curbe + image_info->hSlot) = image->h;
+  if (image_info->depthSlot >= 0)
+    *(uint32_t*)(curbe + image_info->depthSlot) = image->depth;
+  if (image_info->channelOrderSlot >= 0)
+    *(uint32_t*)(curbe + image_info->channelOrderSlot) = image->fmt.image_channel_order;
+  if (image_info->dataTypeSlot >= 0)
+    *(uint32_t*)(curbe + image_info->dataTypeSlot) = image->fmt.image_channel_data_type;
+}
+
+/* Everything comes from the argument descriptors built with the kernel: no
+ * call to the compiler library here. Setting the same memory object again
+ * leaves its reference and the constant buffer alone
+ */
 LOCAL cl_int
 cl_kernel_set_arg(cl_kernel k, cl_uint index, size_t sz, const void *value)
 {
-  uint32_t offset;            /* where to patch */
+  const cl_kernel_arg_info *info;
+  cl_argument *arg;
   enum gbe_arg_type arg_type; /* kind of argument */
-  size_t arg_sz;              /* size of the argument */
-  cl_mem mem;                 /* for __global, __constant and image arguments */
+  cl_mem mem = NULL;          /* for __global, __constant and image arguments */
+  cl_sampler sampler;
 
   if (UNLIKELY(index >= k->arg_n))
     return CL_INVALID_ARG_INDEX;
-  arg_type = gbe_kernel_get_arg_type(k->opaque, index);
-  arg_sz = gbe_kernel_get_arg_size(k->opaque, index);
+  info = &k->arg_info[index];
+  arg = &k->args[index];
+  arg_type = info->type;
 
-  if (UNLIKELY(arg_type != GBE_ARG_LOCAL_PTR && arg_sz != sz)) {
-    if (arg_sz == 2 && arg_type == GBE_ARG_VALUE && sz == sizeof(cl_sampler)) {
+  if (UNLIKELY(arg_type != GBE_ARG_LOCAL_PTR && info->size != sz)) {
+    if (info->size == 2 && arg_type == GBE_ARG_VALUE && sz == sizeof(cl_sampler)) {
       /* FIXME, this is a workaround for the case when a kernel arg
          defined a sampler_t but doesn't use it.*/
       arg_type = GBE_ARG_SAMPLER;
@@ -114,98 +181,189 @@ cl_kernel_set_arg(cl_kernel k, cl_uint index, size_t sz, const void *value)
       return CL_INVALID_ARG_SIZE;
   }
 
-  if(UNLIKELY(arg_type == GBE_ARG_LOCAL_PTR && sz == 0))
-    return CL_INVALID_ARG_SIZE;
-  if(arg_type == GBE_ARG_VALUE) {
-    if(UNLIKELY(value == NULL))
-      return CL_INVALID_ARG_VALUE;
-  } else if(arg_type == GBE_ARG_LOCAL_PTR) {
-    if(UNLIKELY(value != NULL))
-      return CL_INVALID_ARG_VALUE;
-  } else if(arg_type == GBE_ARG_SAMPLER) {
-    if (UNLIKELY(value == NULL))
-      return CL_INVALID_ARG_VALUE;
-
-    cl_sampler s = *(cl_sampler*)value;
-    if(s->magic != CL_MAGIC_SAMPLER_HEADER)
-      return CL_INVALID_SAMPLER;
-  } else {
-    // should be image, GLOBAL_PTR, CONSTANT_PTR
-    if (UNLIKELY(value == NULL && arg_type == GBE_ARG_IMAGE))
-      return CL_INVALID_ARG_VALUE;
-    if(value != NULL) {
-      mem = *(cl_mem*)value;
-      if (UNLIKELY(mem->magic != CL_MAGIC_MEM_HEADER))
-        return CL_INVALID_MEM_OBJECT;
-
-      if (UNLIKELY((arg_type == GBE_ARG_IMAGE && !IS_IMAGE(mem))
-         || (arg_type != GBE_ARG_IMAGE && IS_IMAGE(mem))))
+  switch (arg_type) {
+    /* Copy the value directly into the curbe */
+    case GBE_ARG_VALUE:
+      if (UNLIKELY(value == NULL))
+        return CL_INVALID_ARG_VALUE;
+      assert(info->offset + sz <= k->curbe_sz);
+      if (UNLIKELY(cl_kernel_own_curbe(k) != CL_SUCCESS))
+        return CL_OUT_OF_HOST_MEMORY;
+      memcpy(k->curbe + info->offset, value, sz);
+      break;
+
+    /* For a local pointer just save the size */
+    case GBE_ARG_LOCAL_PTR:
+      if (UNLIKELY(sz == 0))
+        return CL_INVALID_ARG_SIZE;
+      if (UNLIKELY(value != NULL))
+        return CL_INVALID_ARG_VALUE;
+      arg->local_sz = sz;
+      arg->is_set = 1;
+      return CL_SUCCESS;
+
+    case GBE_ARG_SAMPLER:
+      if (UNLIKELY(value == NULL))
+        return CL_INVALID_ARG_VALUE;
+      sampler = *(cl_sampler *) value;
+      if (UNLIKELY(sampler->magic != CL_MAGIC_SAMPLER_HEADER))
+        return CL_INVALID_SAMPLER;
+      arg->sampler = sampler;
+      if (info->sampler_slot >= 0)
+        cl_set_sampler_arg_slot(k, info->sampler_slot, sampler);
+      break;
+
+    /* Images, __global and __constant pointers. The buffers may be NULL */
+    default:
+      if (value != NULL && (mem = *(cl_mem *) value) != NULL) {
+        if (UNLIKELY(mem->magic != CL_MAGIC_MEM_HEADER))
+          return CL_INVALID_MEM_OBJECT;
+        if (UNLIKELY((arg_type == GBE_ARG_IMAGE) != (IS_IMAGE(mem) != 0)))
           return CL_INVALID_ARG_VALUE;
-    }
+        if (info->image_slot >= 0) {
+          if (UNLIKELY(cl_kernel_own_curbe(k) != CL_SUCCESS))
+            return CL_OUT_OF_HOST_MEMORY;
+          cl_kernel_set_image_info(k->curbe, &k->images[info->image_slot], cl_mem_image(mem));
+        }
+      } else if (UNLIKELY(arg_type == GBE_ARG_IMAGE))
+        return CL_INVALID_ARG_VALUE;
+      else {
+        if (UNLIKELY(cl_kernel_own_curbe(k) != CL_SUCCESS))
+          return CL_OUT_OF_HOST_MEMORY;
+        *((uint32_t *) (k->curbe + info->offset)) = 0;
+      }
+
+      if (arg->is_set && arg->mem == mem)
+        return CL_SUCCESS;
+      /* The constant buffer must be built again */
+      if (arg_type == GBE_ARG_CONSTANT_PTR)
+        k->cst_dirty = 1;
+      if (mem)
+        cl_mem_add_ref(mem);
+      if (arg->mem)
+        cl_mem_delete(arg->mem);
+      arg->mem = mem;
+      arg->local_sz = 0;
+      arg->is_set = 1;
+      return CL_SUCCESS;
   }
 
-  /* Copy the structure or the value directly into the curbe */
-  if (arg_type == GBE_ARG_VALUE) {
-    offset = gbe_kernel_get_curbe_offset(k->opaque, GBE_CURBE_KERNEL_ARGUMENT, index);
-    assert(offset + sz <= k->curbe_sz);
-    memcpy(k->curbe + offset, value, sz);
-    k->args[index].local_sz = 0;
-    k->args[index].is_set = 1;
-    k->args[index].mem = NULL;
-    return CL_SUCCESS;
-  }
+  arg->local_sz = 0;
+  arg->is_set = 1;
+  arg->mem = NULL;
+  return CL_SUCCESS;
+}
 
-  /* For a local pointer just save the size */
-  if (arg_type == GBE_ARG_LOCAL_PTR) {
-    k->args[index].local_sz = sz;
-    k->args[index].is_set = 1;
-    k->args[index].mem = NULL;
-    return CL_SUCCESS;
-  }
+LOCAL uint32_t
+cl_kernel_get_simd_width(cl_kernel k)
+{
+  assert(k != NULL);
+  return k->simd_width;
+}
 
-  /* Is it a sampler*/
-  if (arg_type == GBE_ARG_SAMPLER) {
-    cl_sampler sampler;
-    memcpy(&sampler, value, sz);
-    k->args[index].local_sz = 0;
-    k->args[index].is_set = 1;
-    k->args[index].mem = NULL;
-    k->args[index].sampler = sampler;
-    cl_set_sampler_arg_slot(k, index, sampler);
-    return CL_SUCCESS;
-  }
+/* Resolve once all the curbe offsets and argument properties used when the
+ * kernel is enqueued. This avoids the look ups in the compiler structures
+ */
+static cl_int
+cl_kernel_setup_patch(cl_kernel k, cl_kernel_template *tpl)
+{
+  gbe_kernel opaque = k->opaque;
+  cl_curbe_patch *patch = &k->patch;
+  cl_int err = CL_SUCCESS;
+  uint32_t i;
 
-  if(value == NULL) {
-    /* for buffer object GLOBAL_PTR CONSTANT_PTR, it maybe NULL */
-    int32_t offset = gbe_kernel_get_curbe_offset(k->opaque, GBE_CURBE_KERNEL_ARGUMENT, index);
-    *((uint32_t *)(k->curbe + offset)) = 0;
-    assert(arg_type == GBE_ARG_GLOBAL_PTR || arg_type == GBE_ARG_CONSTANT_PTR);
-
-    if (k->args[index].mem)
-      cl_mem_delete(k->args[index].mem);
-    k->args[index].mem = NULL;
-    k->args[index].is_set = 1;
-    k->args[index].local_sz = 0;
+#define OFFSET(ENUM) gbe_kernel_get_curbe_offset(opaque, ENUM, 0)
+  patch->local_id[0] = OFFSET(GBE_CURBE_LOCAL_ID_X);
+  patch->local_id[1] = OFFSET(GBE_CURBE_LOCAL_ID_Y);
+  patch->local_id[2] = OFFSET(GBE_CURBE_LOCAL_ID_Z);
+  patch->block_ip = OFFSET(GBE_CURBE_BLOCK_IP);
+  patch->local_size[0] = OFFSET(GBE_CURBE_LOCAL_SIZE_X);
+  patch->local_size[1] = OFFSET(GBE_CURBE_LOCAL_SIZE_Y);
+  patch->local_size[2] = OFFSET(GBE_CURBE_LOCAL_SIZE_Z);
+  patch->enqueued_local_size[0] = OFFSET(GBE_CURBE_ENQUEUED_LOCAL_SIZE_X);
+  patch->enqueued_local_size[1] = OFFSET(GBE_CURBE_ENQUEUED_LOCAL_SIZE_Y);
+  patch->enqueued_local_size[2] = OFFSET(GBE_CURBE_ENQUEUED_LOCAL_SIZE_Z);
+  patch->global_size[0] = OFFSET(GBE_CURBE_GLOBAL_SIZE_X);
+  patch->global_size[1] = OFFSET(GBE_CURBE_GLOBAL_SIZE_Y);
+  patch->global_size[2] = OFFSET(GBE_CURBE_GLOBAL_SIZE_Z);
+  patch->global_offset[0] = OFFSET(GBE_CURBE_GLOBAL_OFFSET_X);
+  patch->global_offset[1] = OFFSET(GBE_CURBE_GLOBAL_OFFSET_Y);
+  patch->global_offset[2] = OFFSET(GBE_CURBE_GLOBAL_OFFSET_Z);
+  patch->group_num[0] = OFFSET(GBE_CURBE_GROUP_NUM_X);
+  patch->group_num[1] = OFFSET(GBE_CURBE_GROUP_NUM_Y);
+  patch->group_num[2] = OFFSET(GBE_CURBE_GROUP_NUM_Z);
+  patch->thread_num = OFFSET(GBE_CURBE_THREAD_NUM);
+  patch->work_dim = OFFSET(GBE_CURBE_WORK_DIM);
+  patch->sampler_info = OFFSET(GBE_CURBE_SAMPLER_INFO);
+  patch->stack_pointer = OFFSET(GBE_CURBE_STACK_POINTER);
+#undef OFFSET
+  patch->stack_buffer = gbe_kernel_get_curbe_offset(opaque,
+                                                    GBE_CURBE_EXTRA_ARGUMENT,
+                                                    GBE_STACK_BUFFER);
+
+  k->simd_width = gbe_kernel_get_simd_width(opaque);
+  k->use_slm = gbe_kernel_use_slm(opaque);
+  k->slm_sz = gbe_kernel_get_slm_size(opaque);
+  k->scratch_sz = gbe_kernel_get_scratch_size(opaque);
+  for (i = 0; i < 3; ++i)
+    k->required_wg_sz[i] = gbe_kernel_get_required_work_group_size(opaque, i);
+
+  if (k->payload.data)
+    cl_free(k->payload.data);
+  k->payload.data = NULL;
+
+  if (k->arg_n == 0)
     return CL_SUCCESS;
+  TRY_ALLOC(tpl->arg_info, cl_calloc(k->arg_n, sizeof(cl_kernel_arg_info)));
+  k->arg_info = tpl->arg_info;
+  for (i = 0; i < k->arg_n; ++i) {
+    cl_kernel_arg_info *info = &k->arg_info[i];
+    info->type = gbe_kernel_get_arg_type(opaque, i);
+    info->size = gbe_kernel_get_arg_size(opaque, i);
+    info->align = gbe_kernel_get_arg_align(opaque, i);
+    info->offset = gbe_kernel_get_curbe_offset(opaque, GBE_CURBE_KERNEL_ARGUMENT, i);
+    info->sampler_slot = info->image_slot = -1;
   }
 
-  mem = *(cl_mem*) value;
-
-  cl_mem_add_ref(mem);
-  if (k->args[index].mem)
-    cl_mem_delete(k->args[index].mem);
-  k->args[index].mem = mem;
-  k->args[index].is_set = 1;
-  k->args[index].local_sz = 0;
+error:
+  return err;
+}
 
-  return CL_SUCCESS;
+/* Where the sampler and image arguments go, once the samplers and images of
+ * the kernel are known */
+static void
+cl_kernel_setup_slots(cl_kernel k)
+{
+  uint32_t i;
+  if (k->arg_info == NULL)
+    return;
+  for (i = 0; i < k->arg_n; ++i)
+    k->arg_info[i].sampler_slot = cl_get_sampler_arg_slot(k, i);
+  for (i = 0; i < k->image_sz; ++i)
+    k->arg_info[k->images[i].arg_idx].image_slot = i;
 }
 
-LOCAL uint32_t
-cl_kernel_get_simd_width(cl_kernel k)
+/* The curbe of a kernel with no argument set. The stack pointer identity
+ * depends on the SIMD width only and is written once here
+ */
+static cl_int
+cl_kernel_setup_curbe(cl_kernel k, cl_kernel_template *tpl)
 {
-  assert(k != NULL);
-  return gbe_kernel_get_simd_width(k->opaque);
+  const int32_t offset = k->patch.stack_pointer;
+  cl_int err = CL_SUCCESS;
+  uint32_t i;
+
+  if (k->curbe_sz == 0)
+    return CL_SUCCESS;
+  TRY_ALLOC(tpl->curbe, cl_calloc(1, k->curbe_sz));
+  k->curbe = tpl->curbe;
+  if (offset >= 0) {
+    uint32_t *stackptr = (uint32_t *) (tpl->curbe + offset);
+    for (i = 0; i < k->simd_width; ++i) stackptr[i] = i;
+  }
+
+error:
+  return err;
 }
 
 LOCAL void
@@ -213,14 +371,24 @@ cl_kernel_setup(cl_kernel k, gbe_kernel opaque)
 {
   cl_context ctx = k->program->ctx;
   cl_buffer_mgr bufmgr = cl_context_get_bufmgr(ctx);
+  cl_kernel_template *tpl = NULL;
 
-  if(k->bo != NULL)
-    cl_buffer_unreference(k->bo);
+  if (k->curbe && k->curbe != cl_kernel_shared_curbe(k))
+    cl_free(k->curbe);
+  cl_kernel_template_delete(k->tpl);
+  k->tpl = NULL;
+  k->bo = NULL;
+  k->arg_info = NULL;
+  k->images = NULL;
+  k->curbe = NULL;
+  TRY_ALLOC_NO_ERR (tpl, CALLOC(cl_kernel_template));
+  tpl->ref_n = 1;
+  k->tpl = tpl;
 
   /* Allocate the gen code here */
   const uint32_t code_sz = gbe_kernel_get_code_size(opaque);
   const char *code = gbe_kernel_get_code(opaque);
-  k->bo = cl_buffer_alloc(bufmgr, "CL kernel", code_sz, 64u);
+  k->bo = tpl->bo = cl_buffer_alloc(bufmgr, "CL kernel", code_sz, 64u);
   k->arg_n = gbe_kernel_get_arg_num(opaque);
 
   /* Upload the code */
@@ -229,6 +397,10 @@ cl_kernel_setup(cl_kernel k, gbe_kernel opaque)
 
   /* Create the curbe */
   k->curbe_sz = gbe_kernel_get_curbe_size(k->opaque);
+  if (cl_kernel_setup_patch(k, tpl) != CL_SUCCESS)
+    goto error;
+  if (cl_kernel_setup_curbe(k, tpl) != CL_SUCCESS)
+    goto error;
 
   /* Get sampler data & size */
   k->sampler_sz = gbe_kernel_get_sampler_size(k->opaque);
@@ -241,16 +413,25 @@ cl_kernel_setup(cl_kernel k, gbe_kernel opaque)
   k->image_sz = gbe_kernel_get_image_size(k->opaque);
   assert(k->sampler_sz <= GEN_MAX_SURFACES);
   if (k->image_sz > 0) {
-    TRY_ALLOC_NO_ERR(k->images, cl_calloc(k->image_sz, sizeof(k->images[0])));
-    gbe_kernel_get_image_data(k->opaque, k->images);
-  } else
-    k->images = NULL;
+    TRY_ALLOC_NO_ERR(tpl->images, cl_calloc(k->image_sz, sizeof(tpl->images[0])));
+    gbe_kernel_get_image_data(k->opaque, tpl->images);
+    k->images = tpl->images;
+  }
+  cl_kernel_setup_slots(k);
   return;
 error:
-  cl_buffer_unreference(k->bo);
+  cl_kernel_template_delete(k->tpl);
+  k->tpl = NULL;
   k->bo = NULL;
+  k->arg_info = NULL;
+  k->images = NULL;
+  k->curbe = NULL;
 }
 
+/* The copies share the template of the program kernel. The argument array
+ * comes with the structure and the curbe is copied when it is first written:
+ * a copy is one allocation
+ */
 LOCAL cl_kernel
 cl_kernel_dup(cl_kernel from)
 {
@@ -258,9 +439,14 @@ cl_kernel_dup(cl_kernel from)
 
   if (UNLIKELY(from == NULL))
     return NULL;
-  TRY_ALLOC_NO_ERR (to, CALLOC(struct _cl_kernel));
+  TRY_ALLOC_NO_ERR (to, cl_calloc(1, sizeof(struct _cl_kernel) +
+                                     from->arg_n * sizeof(cl_argument)));
   SET_ICD(to->dispatch)
+  to->tpl = from->tpl;
   to->bo = from->bo;
+  to->arg_info = from->arg_info;
+  to->images = from->images;
+  to->curbe = (char *) cl_kernel_shared_curbe(from);
   to->opaque = from->opaque;
   to->ref_n = 1;
   to->magic = CL_MAGIC_KERNEL_HEADER;
@@ -271,18 +457,18 @@ cl_kernel_dup(cl_kernel from)
   to->image_sz = from->image_sz;
   memcpy(to->compile_wg_sz, from->compile_wg_sz, sizeof(from->compile_wg_sz));
   to->stack_size = from->stack_size;
+  to->patch = from->patch;
+  to->simd_width = from->simd_width;
+  to->use_slm = from->use_slm;
+  to->slm_sz = from->slm_sz;
+  to->scratch_sz = from->scratch_sz;
+  memcpy(to->required_wg_sz, from->required_wg_sz, sizeof(from->required_wg_sz));
   if (to->sampler_sz)
     memcpy(to->samplers, from->samplers, to->sampler_sz * sizeof(uint32_t));
-  if (to->image_sz) {
-    TRY_ALLOC_NO_ERR(to->images, cl_calloc(to->image_sz, sizeof(to->images[0])));
-    memcpy(to->images, from->images, to->image_sz * sizeof(to->images[0]));
-  } else
-    to->images = NULL;
-  TRY_ALLOC_NO_ERR(to->args, cl_calloc(to->arg_n, sizeof(cl_argument)));
-  if (to->curbe_sz) TRY_ALLOC_NO_ERR(to->curbe, cl_calloc(1, to->curbe_sz));
+  to->args = (cl_argument *) (to + 1);
 
-  /* Retain the bos */
-  if (from->bo)       cl_buffer_reference(from->bo);
+  /* Retain the code and the argument descriptors */
+  if (to->tpl)        atomic_inc(&to->tpl->ref_n);
 
   /* We retain the program destruction since this kernel (user allocated)
    * depends on the program for some of its pointers
@@ -310,7 +496,7 @@ cl_kernel_work_group_sz(cl_kernel ker,
   cl_uint i;
 
   for (i = 0; i < wk_dim; ++i) {
-    const uint32_t required_sz = gbe_kernel_get_required_work_group_size(ker->opaque, i);
+    const uint32_t required_sz = ker->required_wg_sz[i];
     if (required_sz != 0 && required_sz != local_wk_sz[i]) {
       err = CL_INVALID_WORK_ITEM_SIZE;
       goto error;
@@ -330,4 +516,48 @@ error:
   return err;
 }
 
+/* The walker runs at most 64 threads per group */
+#define GEN_MAX_THREAD_PER_GROUP 64
+
+LOCAL void
+cl_kernel_auto_local_sz(cl_kernel ker,
+                        uint32_t wk_dim,
+                        const size_t *global_wk_sz,
+                        size_t *local_wk_sz)
+{
+  cl_local_size_cache *cache = &ker->auto_local;
+  const cl_device_id device = ker->program->ctx->device;
+  size_t global[3] = {1,1,1};
+  uint32_t slm_sz = ker->slm_sz, i;
+  cl_local_size_info info;
+
+  /* The __local arguments are part of the SLM of a group */
+  for (i = 0; i < ker->arg_n; ++i)
+    slm_sz += ker->args[i].local_sz;
+  for (i = 0; i < wk_dim; ++i)
+    global[i] = global_wk_sz[i];
+
+  if (cache->work_dim == wk_dim && cache->slm_sz == slm_sz &&
+      memcmp(cache->global_wk_sz, global, sizeof(global)) == 0) {
+    memcpy(local_wk_sz, cache->local_wk_sz, sizeof(cache->local_wk_sz));
+    return;
+  }
 
+  info.max_group_sz = device->max_work_group_size;
+  for (i = 0; i < 3; ++i)
+    info.max_item_sz[i] = device->max_work_item_sizes[i];
+  info.simd_width = ker->simd_width;
+  info.thread_per_group = GEN_MAX_THREAD_PER_GROUP;
+  /* max_compute_unit counts the hardware threads, not the EUs */
+  info.eu_n = device->max_compute_unit / device->max_thread_per_unit;
+  info.thread_per_eu = device->max_thread_per_unit;
+  info.half_slice_n = device->half_slice_n;
+  info.slm_sz = device->local_mem_size;
+  info.group_slm_sz = slm_sz;
+  cl_local_size_pick(&info, wk_dim, global, local_wk_sz);
+
+  memcpy(cache->global_wk_sz, global, sizeof(global));
+  memcpy(cache->local_wk_sz, local_wk_sz, sizeof(cache->local_wk_sz));
+  cache->work_dim = wk_dim;
+  cache->slm_sz = slm_sz;
+}
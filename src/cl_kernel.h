@@ -22,6 +22,7 @@
 
 #include "cl_internals.h"
 #include "cl_driver.h"
+#include "cl_utils.h"
 #include "program.h"
 #include "CL/cl.h"
 
@@ -39,17 +40,78 @@ typedef struct cl_argument {
   cl_sampler sampler;   /* For sampler. */
   uint32_t local_sz:31; /* For __local size specification */
   uint32_t is_set:1;    /* All args must be set before NDRange */
+  int cst_gen;          /* Content of mem copied in the constant buffer */
+  uint32_t cst_offset;  /* Where it is in the constant buffer */
 } cl_argument;
 
+/* What the runtime needs to know about one argument. It is queried once from
+ * the compiler when the kernel is set up
+ */
+typedef struct cl_kernel_arg_info {
+  enum gbe_arg_type type; /* Kind of argument */
+  uint32_t size;          /* Size in bytes of its value */
+  uint32_t align;         /* Alignment for __local and __constant pointers */
+  int32_t offset;         /* Where it is in the curbe (-1 if not there) */
+  int32_t sampler_slot;   /* Its entry in the kernel samplers (-1 if none) */
+  int32_t image_slot;     /* Its entry in the kernel images (-1 if none) */
+} cl_kernel_arg_info;
+
+/* Curbe offsets of the values the runtime patches at each enqueue (-1 if the
+ * kernel does not use the value)
+ */
+typedef struct cl_curbe_patch {
+  int32_t local_id[3];
+  int32_t block_ip;
+  int32_t local_size[3];
+  int32_t enqueued_local_size[3];
+  int32_t global_size[3];
+  int32_t global_offset[3];
+  int32_t group_num[3];
+  int32_t thread_num;
+  int32_t work_dim;
+  int32_t sampler_info;
+  int32_t stack_pointer;
+  int32_t stack_buffer;
+} cl_curbe_patch;
+
+/* Local IDs and block IPs of all the threads of a work group as they are copied
+ * in the curbe of each thread. Only the last local size is kept
+ */
+typedef struct cl_thread_payload {
+  size_t local_wk_sz[3];      /* Local size it was built for */
+  size_t simd_sz;             /* SIMD width it was built for */
+  char *data;                 /* One payload per thread */
+} cl_thread_payload;
+
+/* Local size picked for the last global size enqueued without one */
+typedef struct cl_local_size_cache {
+  size_t global_wk_sz[3];     /* Global size it was picked for */
+  size_t local_wk_sz[3];      /* Picked local size */
+  uint32_t work_dim;          /* 0 when empty */
+  uint32_t slm_sz;            /* SLM of one group it was picked for */
+} cl_local_size_cache;
+
+/* What the kernels created from the same compiled kernel share. It is built
+ * by cl_kernel_setup and never changes after that
+ */
+typedef struct cl_kernel_template {
+  volatile int ref_n;         /* The program kernel and all its copies */
+  cl_buffer bo;               /* The code itself */
+  cl_kernel_arg_info *arg_info; /* Argument types, sizes and curbe offsets */
+  struct ImageInfo *images;   /* images defined in kernel args */
+  char *curbe;                /* Curbe before any argument is set */
+} cl_kernel_template;
+
 /* One OCL function */
 struct _cl_kernel {
   DEFINE_ICD(dispatch)
   uint64_t magic;             /* To identify it as a kernel */
   volatile int ref_n;         /* We reference count this object */
+  cl_kernel_template *tpl;    /* Read only part (bo, arg_info, images) */
   cl_buffer bo;               /* The code itself */
   cl_program program;         /* Owns this structure (and pointers) */
   gbe_kernel opaque;          /* (Opaque) compiler structure for the OCL kernel */
-  char *curbe;                /* One curbe per kernel */
+  char *curbe;                /* The template one until it is written */
   size_t curbe_sz;            /* Size of it */
   uint32_t samplers[GEN_MAX_SAMPLERS]; /* samplers defined in kernel & kernel args */
   size_t sampler_sz;          /* sampler size defined in kernel & kernel args. */
@@ -59,7 +121,20 @@ struct _cl_kernel {
   size_t compile_wg_sz[3];    /* Required workgroup size by __attribute__((reqd_work_gro
                                  up_size(X, Y, Z))) qualifier.*/
   size_t stack_size;          /* stack size per work item. */
-  cl_argument *args;          /* To track argument setting */
+  cl_argument *args;          /* To track argument setting (after the structure) */
+  cl_kernel_arg_info *arg_info; /* Argument types, sizes and curbe offsets */
+  cl_curbe_patch patch;       /* Curbe offsets patched at each enqueue */
+  cl_thread_payload payload;  /* Cached local IDs and block IPs */
+  cl_local_size_cache auto_local; /* Local size when the user gives none */
+  cl_buffer cst_bo;           /* Global constants and __constant arguments */
+  uint32_t cst_sz;            /* Size of it */
+  uint32_t cst_dirty;         /* A __constant argument was set after it */
+  atomic_t cst_copy_n;        /* Deferred NDRanges which still copy into it */
+  uint32_t simd_width;        /* SIMD width of the code */
+  uint32_t use_slm;           /* Required to reconfigure the L3 complex */
+  int32_t slm_sz;             /* SLM used by the kernel local variables */
+  int32_t scratch_sz;         /* Scratch memory per thread */
+  uint32_t required_wg_sz[3]; /* Required work group size (0 if none) */
   uint32_t arg_n:31;          /* Number of arguments */
   uint32_t ref_its_program:1; /* True only for the user kernel (created by clCreateKernel) */
 };
@@ -87,6 +162,9 @@ extern cl_kernel cl_kernel_dup(cl_kernel);
 /* Add one more reference on the kernel object */
 extern void cl_kernel_add_ref(cl_kernel);
 
+/* Copy the curbe of the template before writing it */
+extern cl_int cl_kernel_own_curbe(cl_kernel);
+
 /* Set the argument before kernel execution */
 extern int cl_kernel_set_arg(cl_kernel,
                              uint32_t    arg_index,
@@ -100,5 +178,12 @@ cl_kernel_work_group_sz(cl_kernel ker,
                         cl_uint wk_dim,
                         size_t *wk_grp_sz);
 
+/* Local size of the enqueues without one, cached for the last global size */
+extern void
+cl_kernel_auto_local_sz(cl_kernel ker,
+                        uint32_t wk_dim,
+                        const size_t *global_wk_sz,
+                        size_t *local_wk_sz);
+
 #endif /* __CL_KERNEL_H__ */
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cl_local_size.h"
+#include "cl_utils.h"
+
+/* Fraction of the thread slots of the device kept busy over the whole range,
+ * times the fraction of the SIMD lanes of these threads doing work. The groups
+ * resident on one half slice are bounded by its threads and its SLM, and the
+ * last wave of groups may leave the device partially idle
+ */
+static double
+cl_local_size_score(const cl_local_size_info *info, size_t group_sz, size_t group_n)
+{
+  const size_t thread_n = (group_sz + info->simd_width - 1) / info->simd_width;
+  const size_t hw_thread_n = (size_t) info->eu_n * info->thread_per_eu;
+  size_t resident_n, wave_n;
+
+  if (thread_n > info->thread_per_group)
+    return 0.;
+  resident_n = hw_thread_n / info->half_slice_n / thread_n;
+  if (info->group_slm_sz)
+    resident_n = MIN(resident_n, info->slm_sz / info->group_slm_sz);
+  if (resident_n == 0)
+    return 0.;
+  resident_n *= info->half_slice_n;
+  wave_n = (group_n + resident_n - 1) / resident_n;
+
+  return (double) (group_n * thread_n) / (double) (wave_n * hw_thread_n) *
+         (double) group_sz / (double) (thread_n * info->simd_width);
+}
+
+/* Every combination of divisors is tried. Equal scores go to the largest
+ * groups, which are cheaper to dispatch, then to the widest ones along x
+ */
+LOCAL void
+cl_local_size_pick(const cl_local_size_info *info, uint32_t work_dim,
+                   const size_t *global_sz, size_t *local_sz)
+{
+  size_t global[3] = {1,1,1}, max_item[3] = {1,1,1};
+  size_t best_sz = 0, x, y, z;
+  double best = 0.;
+  uint32_t i;
+
+  for (i = 0; i < work_dim; ++i) {
+    global[i] = global_sz[i];
+    max_item[i] = MIN(info->max_item_sz[i], info->max_group_sz);
+  }
+  local_sz[0] = local_sz[1] = local_sz[2] = 1;
+
+  for (x = 1; x <= MIN(global[0], max_item[0]); ++x) {
+    if (global[0] % x)
+      continue;
+    for (y = 1; y <= MIN(global[1], max_item[1]) && x * y <= info->max_group_sz; ++y) {
+      if (global[1] % y)
+        continue;
+      for (z = 1; z <= MIN(global[2], max_item[2]) && x * y * z <= info->max_group_sz; ++z) {
+        const size_t group_sz = x * y * z;
+        double score;
+        if (global[2] % z)
+          continue;
+        score = cl_local_size_score(info, group_sz,
+                                    global[0] / x * (global[1] / y) * (global[2] / z));
+        if (score <= 0.)
+          continue;
+        if (score > best + 1e-6 ||
+            (score > best - 1e-6 && (group_sz > best_sz ||
+                                     (group_sz == best_sz && x > local_sz[0])))) {
+          best = score;
+          best_sz = group_sz;
+          local_sz[0] = x;
+          local_sz[1] = y;
+          local_sz[2] = z;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CL_LOCAL_SIZE_H__
+#define __CL_LOCAL_SIZE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What the local size heuristic knows about the kernel and the device. A work
+ * group runs on the EUs of one half slice and shares its SLM
+ */
+typedef struct cl_local_size_info {
+  size_t max_group_sz;        /* Work items per group (device limit) */
+  size_t max_item_sz[3];      /* Work items per group and dimension */
+  uint32_t simd_width;        /* Work items per hardware thread */
+  uint32_t thread_per_group;  /* Hardware threads per group (walker limit) */
+  uint32_t eu_n;              /* EUs of the device */
+  uint32_t thread_per_eu;     /* Hardware threads of one EU */
+  uint32_t half_slice_n;      /* Half slices sharing the EUs */
+  uint32_t slm_sz;            /* SLM of one half slice */
+  uint32_t group_slm_sz;      /* SLM used by one group (0 if none) */
+} cl_local_size_info;
+
+/* Choose the local size dividing global_sz which keeps the most hardware
+ * threads busy with the least idle SIMD lanes. Pure function of its inputs
+ */
+extern void cl_local_size_pick(const cl_local_size_info *info, uint32_t work_dim,
+                               const size_t *global_sz, size_t *local_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CL_LOCAL_SIZE_H__ */
@@ -27,11 +27,13 @@
 #include "cl_khr_icd.h"
 #include "cl_kernel.h"
 #include "cl_command_queue.h"
+#include "cl_copy.h"
 
 #include "CL/cl.h"
 #include "CL/cl_intel.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define FIELD_SIZE(CASE,TYPE)               \
@@ -124,7 +126,7 @@ cl_get_mem_object_info(cl_mem mem,
       *((size_t *)param_value) = 0;
     } else {
       struct _cl_mem_buffer* buf = (struct _cl_mem_buffer*)mem;
-      *((size_t *)param_value) = buf->sub_offset;
+      *((size_t *)param_value) = buf->sub_offset - buf->parent->sub_offset;
     }
     break;
   }
@@ -228,10 +230,18 @@ cl_mem_allocate(enum cl_mem_type type,
     if ((flags & CL_MEM_PINNABLE) || is_tiled)
       alignment = 4096;
 
-    /* Allocate space in memory */
+    /* Allocate space in memory. Small buffers share larger buffer objects */
     bufmgr = cl_context_get_bufmgr(ctx);
     assert(bufmgr);
-    mem->bo = cl_buffer_alloc(bufmgr, "CL memory object", sz, alignment);
+    if (type == CL_MEM_BUFFER_TYPE && alignment <= CL_MEM_POOL_MIN_CHUNK &&
+        (flags & CL_MEM_USE_HOST_PTR) == 0) {
+      struct _cl_mem_buffer *buffer = cl_mem_buffer(mem);
+      buffer->slab = cl_mem_pool_alloc(&ctx->buffer_pool, bufmgr, sz, &buffer->sub_offset);
+      if (buffer->slab)
+        mem->bo = buffer->slab->bo;
+    }
+    if (mem->bo == NULL)
+      mem->bo = cl_buffer_alloc(bufmgr, "CL memory object", sz, alignment);
     if (UNLIKELY(mem->bo == NULL)) {
       err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
       goto error;
@@ -241,13 +251,7 @@ cl_mem_allocate(enum cl_mem_type type,
 
   cl_context_add_ref(ctx);
   mem->ctx = ctx;
-    /* Append the buffer in the context buffer list */
-  pthread_mutex_lock(&ctx->buffer_lock);
-  mem->next = ctx->buffers;
-  if (ctx->buffers != NULL)
-    ctx->buffers->prev = mem;
-  ctx->buffers = mem;
-  pthread_mutex_unlock(&ctx->buffer_lock);
+  cl_context_add_buffer(ctx, mem);
 
 exit:
   if (errcode)
@@ -260,6 +264,36 @@ error:
 
 }
 
+DEFINE_ENV_INT(cl_mem_userptr_enabled, "OCL_USERPTR", 1)
+
+/* Page aligned host memory given with CL_MEM_USE_HOST_PTR becomes the buffer
+ * itself. The last page is used whole. NULL when it cannot be wrapped
+ */
+static cl_mem
+cl_mem_new_userptr_buffer(cl_context ctx, cl_mem_flags flags, size_t sz, void *data)
+{
+  cl_int err = CL_SUCCESS;
+  cl_mem mem = NULL;
+  cl_buffer bo = NULL;
+
+  if (!cl_mem_userptr_enabled() || ((uintptr_t) data & 4095) != 0)
+    return NULL;
+  bo = cl_buffer_alloc_userptr(cl_context_get_bufmgr(ctx), "CL userptr memory object",
+                               data, ALIGN(sz, 4096), 0);
+  if (bo == NULL)
+    return NULL;
+  mem = cl_mem_allocate(CL_MEM_BUFFER_TYPE, ctx, flags, 0, CL_FALSE, &err);
+  if (mem == NULL || err != CL_SUCCESS) {
+    cl_buffer_unreference(bo);
+    return NULL;
+  }
+  mem->bo = bo;
+  mem->size = sz;
+  mem->host_ptr = data;
+  mem->is_userptr = CL_TRUE;
+  return mem;
+}
+
 LOCAL cl_mem
 cl_mem_new_buffer(cl_context ctx,
                   cl_mem_flags flags,
@@ -334,6 +368,12 @@ cl_mem_new_buffer(cl_context ctx,
     goto error;
   }
 
+  if (flags & CL_MEM_USE_HOST_PTR) {
+    mem = cl_mem_new_userptr_buffer(ctx, flags, sz, data);
+    if (mem != NULL)
+      goto exit;
+  }
+
   /* Create the buffer in video memory */
   mem = cl_mem_allocate(CL_MEM_BUFFER_TYPE, ctx, flags, sz, CL_FALSE, &err);
   if (mem == NULL || err != CL_SUCCESS)
@@ -341,7 +381,7 @@ cl_mem_new_buffer(cl_context ctx,
 
   /* Copy the data if required */
   if (flags & CL_MEM_COPY_HOST_PTR || flags & CL_MEM_USE_HOST_PTR)
-    cl_buffer_subdata(mem->bo, 0, sz, data);
+    cl_buffer_subdata(mem->bo, cl_mem_buffer(mem)->sub_offset, sz, data);
 
   if (flags & CL_MEM_USE_HOST_PTR || flags & CL_MEM_COPY_HOST_PTR)
     mem->host_ptr = data;
@@ -427,20 +467,15 @@ cl_mem_new_sub_buffer(cl_mem buffer,
 
   mem->bo = buffer->bo;
   mem->size = info->size;
-  sub_buf->sub_offset = info->origin;
+  sub_buf->sub_offset = ((struct _cl_mem_buffer*)buffer)->sub_offset + info->origin;
   if (buffer->flags & CL_MEM_USE_HOST_PTR || buffer->flags & CL_MEM_COPY_HOST_PTR) {
     mem->host_ptr = buffer->host_ptr;
   }
+  mem->is_userptr = buffer->is_userptr;
 
   cl_context_add_ref(buffer->ctx);
   mem->ctx = buffer->ctx;
-  /* Append the buffer in the context buffer list */
-  pthread_mutex_lock(&buffer->ctx->buffer_lock);
-  mem->next = buffer->ctx->buffers;
-  if (buffer->ctx->buffers != NULL)
-    buffer->ctx->buffers->prev = mem;
-  buffer->ctx->buffers = mem;
-  pthread_mutex_unlock(&buffer->ctx->buffer_lock);
+  cl_context_add_buffer(buffer->ctx, mem);
 
 exit:
   if (errcode_ret)
@@ -456,28 +491,47 @@ void
 cl_mem_copy_image_region(const size_t *origin, const size_t *region,
                          void *dst, size_t dst_row_pitch, size_t dst_slice_pitch,
                          const void *src, size_t src_row_pitch, size_t src_slice_pitch,
-                         const struct _cl_mem_image *image)
+                         const struct _cl_mem_image *image, int copy_flags)
 {
   size_t offset = image->bpp * origin[0] + dst_row_pitch * origin[1] + dst_slice_pitch * origin[2];
   dst = (char*)dst + offset;
-  if (!origin[0] && region[0] == image->w && dst_row_pitch == src_row_pitch &&
-      (region[2] == 1 || (!origin[1] && region[1] == image->h && dst_slice_pitch == src_slice_pitch)))
-  {
-    memcpy(dst, src, region[2] == 1 ? src_row_pitch*region[1] : src_slice_pitch*region[2]);
-  }
-  else {
-    cl_uint y, z;
-    for (z = 0; z < region[2]; z++) {
-      const char* src_ptr = src;
-      char* dst_ptr = dst;
-      for (y = 0; y < region[1]; y++) {
-        memcpy(dst_ptr, src_ptr, image->bpp*region[0]);
-        src_ptr += src_row_pitch;
-        dst_ptr += dst_row_pitch;
-      }
-      src = (char*)src + src_slice_pitch;
-      dst = (char*)dst + dst_slice_pitch;
-    }
+  cl_copy_rect(dst, dst_row_pitch, dst_slice_pitch,
+               src, src_row_pitch, src_slice_pitch,
+               image->bpp*region[0], region[1], region[2], copy_flags);
+}
+
+DEFINE_ENV_INT(cl_mem_cpu_tiling_enabled, "OCL_CPU_TILING", 1)
+
+LOCAL cl_bool
+cl_mem_image_cpu_tiling(const struct _cl_mem_image *image)
+{
+  return image->tiling != CL_NO_TILE &&
+         image->swizzle != CL_SWIZZLE_UNKNOWN &&
+         image->offset == 0 && image->tile_x == 0 && image->tile_y == 0 &&
+         cl_mem_cpu_tiling_enabled() != 0;
+}
+
+LOCAL void
+cl_mem_image_tiling_copy(const struct _cl_mem_image *image, void *tiled,
+                         const size_t *origin, const size_t *region,
+                         void *host, size_t host_row_pitch, size_t host_slice_pitch,
+                         cl_bool to_image)
+{
+  /* The slices of 3D images follow each other in the rows of one surface */
+  const size_t slice_h = image->slice_pitch / image->row_pitch;
+  size_t z;
+
+  for (z = 0; z < region[2]; ++z) {
+    const size_t y = origin[1] + (origin[2] + z) * slice_h;
+    char *linear = (char*)host + z * host_slice_pitch;
+    if (to_image)
+      cl_tiling_tile(tiled, image->row_pitch, image->tiling, image->swizzle,
+                     image->bpp * origin[0], y, linear, host_row_pitch,
+                     image->bpp * region[0], region[1]);
+    else
+      cl_tiling_untile(linear, host_row_pitch, tiled, image->row_pitch,
+                       image->tiling, image->swizzle, image->bpp * origin[0], y,
+                       image->bpp * region[0], region[1]);
   }
 }
 
@@ -487,21 +541,25 @@ cl_mem_copy_image(struct _cl_mem_image *image,
 		  size_t slice_pitch,
 		  void* host_ptr)
 {
-  char* dst_ptr = cl_mem_map_auto((cl_mem)image);
+  char* dst_ptr = NULL;
   size_t origin[3] = {0, 0, 0};
   size_t region[3] = {image->w, image->h, image->depth};
 
+  if (cl_mem_image_cpu_tiling(image)) {
+    dst_ptr = cl_mem_map((cl_mem)image);
+    cl_mem_image_tiling_copy(image, dst_ptr, origin, region,
+                             host_ptr, row_pitch, slice_pitch, CL_TRUE);
+    cl_mem_unmap((cl_mem)image);
+    return;
+  }
+
+  dst_ptr = cl_mem_map_auto((cl_mem)image);
   cl_mem_copy_image_region(origin, region, dst_ptr, image->row_pitch, image->slice_pitch,
-                           host_ptr, row_pitch, slice_pitch, image);
+                           host_ptr, row_pitch, slice_pitch, image,
+                           image->tiling != CL_NO_TILE ? CL_COPY_DST_WC : 0);
   cl_mem_unmap_auto((cl_mem)image);
 }
 
-static const uint32_t tile_sz = 4096; /* 4KB per tile */
-static const uint32_t tilex_w = 512;  /* tileX width in bytes */
-static const uint32_t tilex_h = 8;    /* tileX height in number of rows */
-static const uint32_t tiley_w = 128;  /* tileY width in bytes */
-static const uint32_t tiley_h = 32;   /* tileY height in number of rows */
-
 static cl_mem
 _cl_mem_new_image(cl_context ctx,
                   cl_mem_flags flags,
@@ -588,11 +646,11 @@ _cl_mem_new_image(cl_context ctx,
     aligned_pitch = w * bpp;
     aligned_h     = h;
   } else if (tiling == CL_TILE_X) {
-    aligned_pitch = ALIGN(w * bpp, tilex_w);
-    aligned_h     = ALIGN(h, tilex_h);
+    aligned_pitch = ALIGN(w * bpp, CL_TILEX_W);
+    aligned_h     = ALIGN(h, CL_TILEX_H);
   } else if (tiling == CL_TILE_Y) {
-    aligned_pitch = ALIGN(w * bpp, tiley_w);
-    aligned_h     = ALIGN(h, tiley_h);
+    aligned_pitch = ALIGN(w * bpp, CL_TILEY_W);
+    aligned_h     = ALIGN(h, CL_TILEY_H);
   }
 
   sz = aligned_pitch * aligned_h * depth;
@@ -608,6 +666,8 @@ _cl_mem_new_image(cl_context ctx,
   cl_mem_image_init(cl_mem_image(mem), w, h, image_type, depth, *fmt,
                     intel_fmt, bpp, aligned_pitch, aligned_slice_pitch, tiling,
                     0, 0, 0);
+  if (tiling != CL_NO_TILE)
+    cl_mem_image(mem)->swizzle = cl_buffer_get_swizzle(mem->bo);
 
   /* Copy the data if required */
   if (flags & (CL_MEM_COPY_HOST_PTR | CL_MEM_USE_HOST_PTR)) {
@@ -673,15 +733,7 @@ cl_mem_delete(cl_mem mem)
 
   /* Remove it from the list */
   assert(mem->ctx);
-  pthread_mutex_lock(&mem->ctx->buffer_lock);
-    if (mem->prev)
-      mem->prev->next = mem->next;
-    if (mem->next)
-      mem->next->prev = mem->prev;
-    if (mem->ctx->buffers == mem)
-      mem->ctx->buffers = mem->next;
-  pthread_mutex_unlock(&mem->ctx->buffer_lock);
-  cl_context_delete(mem->ctx);
+  cl_context_remove_buffer(mem->ctx, mem);
 
   /* Someone still mapped, unmap */
   if(mem->map_ref > 0) {
@@ -722,10 +774,17 @@ cl_mem_delete(cl_mem mem)
       buffer->parent->subs = buffer->sub_next;
     pthread_mutex_unlock(&buffer->parent->sub_lock);
     cl_mem_delete((cl_mem )(buffer->parent));
+  } else if (mem->type == CL_MEM_BUFFER_TYPE && cl_mem_buffer(mem)->slab) {
+    struct _cl_mem_buffer* buffer = (struct _cl_mem_buffer*)mem;
+    if (buffer->batch)
+      cl_buffer_unreference(buffer->batch);
+    cl_mem_pool_free(&mem->ctx->buffer_pool, buffer->slab, buffer->sub_offset);
   } else if (LIKELY(mem->bo != NULL)) {
     cl_buffer_unreference(mem->bo);
   }
 
+  /* The context owns the buffer pool */
+  cl_context_delete(mem->ctx);
   cl_free(mem);
 }
 
@@ -740,11 +799,63 @@ cl_mem_add_ref(cl_mem mem)
 #define LOCAL_SZ_1   4
 #define LOCAL_SZ_2   4
 
+/* The buffer copies and fills only stream memory: the work groups are made as
+ * large as possible to cut the dispatch cost per lane, but small copies keep
+ * at least 8 of them so that they still spread over several EUs
+ */
+#define COPY_LOCAL_SZ 128
+
+static void
+cl_mem_copy_work_size(cl_command_queue queue, size_t lane_n, size_t *global_sz, size_t *local_sz)
+{
+  size_t local = MIN(COPY_LOCAL_SZ, queue->ctx->device->max_work_group_size);
+  while (local > LOCAL_SZ_0 && lane_n < 8 * local)
+    local /= 2;
+  *local_sz = local;
+  *global_sz = ALIGN(lane_n, local);
+}
+
+static cl_kernel
+cl_mem_copy_unalign_kernel(cl_command_queue queue)
+{
+  extern char cl_internal_copy_buf_unalign_str[];
+  extern int cl_internal_copy_buf_unalign_str_size;
+
+  return cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_COPY_BUFFER_UNALIGN,
+           cl_internal_copy_buf_unalign_str, (size_t)cl_internal_copy_buf_unalign_str_size, NULL);
+}
+
+/* Copy rows of bytes with cl_internal_copy_buf_unalign.cl, one lane per 16
+ * bytes chunk of the destination rows
+ */
+static cl_int
+cl_mem_copy_unalign(cl_command_queue queue, cl_kernel ker, cl_mem src_buf, cl_mem dst_buf,
+                    size_t src_offset, size_t dst_offset, const size_t *region,
+                    size_t src_row_pitch, size_t src_slice_pitch,
+                    size_t dst_row_pitch, size_t dst_slice_pitch,
+                    const size_t *global_sz, const size_t *local_sz)
+{
+  size_t global_off[] = {0,0,0};
+
+  cl_kernel_set_arg(ker, 0, sizeof(cl_mem), &src_buf);
+  cl_kernel_set_arg(ker, 1, sizeof(cl_int), &src_offset);
+  cl_kernel_set_arg(ker, 2, sizeof(cl_mem), &dst_buf);
+  cl_kernel_set_arg(ker, 3, sizeof(cl_int), &dst_offset);
+  cl_kernel_set_arg(ker, 4, sizeof(cl_int), &region[0]);
+  cl_kernel_set_arg(ker, 5, sizeof(cl_int), &region[1]);
+  cl_kernel_set_arg(ker, 6, sizeof(cl_int), &region[2]);
+  cl_kernel_set_arg(ker, 7, sizeof(cl_int), &src_row_pitch);
+  cl_kernel_set_arg(ker, 8, sizeof(cl_int), &src_slice_pitch);
+  cl_kernel_set_arg(ker, 9, sizeof(cl_int), &dst_row_pitch);
+  cl_kernel_set_arg(ker, 10, sizeof(cl_int), &dst_slice_pitch);
+
+  return cl_command_queue_ND_range(queue, ker, 3, global_off, global_sz, local_sz);
+}
+
 LOCAL cl_int
 cl_mem_copy(cl_command_queue queue, cl_mem src_buf, cl_mem dst_buf,
             size_t src_offset, size_t dst_offset, size_t cb)
 {
-  cl_int ret;
   cl_kernel ker;
   size_t global_off[] = {0,0,0};
   size_t global_sz[] = {1,1,1};
@@ -753,21 +864,18 @@ cl_mem_copy(cl_command_queue queue, cl_mem src_buf, cl_mem dst_buf,
   /* We use one kernel to copy the data. The kernel is lazily created. */
   assert(src_buf->ctx == dst_buf->ctx);
 
-  if ((cb % 4) || (src_offset % 4) || (dst_offset % 4)) {
-    extern char cl_internal_copy_buf_align1_str[];
-    extern int cl_internal_copy_buf_align1_str_size;
-
-    ker = cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_COPY_BUFFER_ALIGN1,
-             cl_internal_copy_buf_align1_str, (size_t)cl_internal_copy_buf_align1_str_size, NULL);
-  } else if ((cb % 16) || (src_offset % 16) || (dst_offset % 16)) {
-    extern char cl_internal_copy_buf_align4_str[];
-    extern int cl_internal_copy_buf_align4_str_size;
-
-    ker = cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_COPY_BUFFER_ALIGN4,
-             cl_internal_copy_buf_align4_str, (size_t)cl_internal_copy_buf_align4_str_size, NULL);
-    cb = cb/4;
-    src_offset = src_offset/4;
-    dst_offset = dst_offset/4;
+  /* Anything not 16 bytes aligned on both sides goes through the unaligned
+   * kernel which still moves 16 bytes per lane, except at the two ends */
+  if ((cb % 16) || (src_offset % 16) || (dst_offset % 16)) {
+    const size_t region[] = {cb, 1, 1};
+    const size_t lane_n = (dst_offset + cb + 15) / 16 - dst_offset / 16;
+
+    ker = cl_mem_copy_unalign_kernel(queue);
+    if (!ker)
+      return CL_OUT_OF_RESOURCES;
+    cl_mem_copy_work_size(queue, lane_n, &global_sz[0], &local_sz[0]);
+    return cl_mem_copy_unalign(queue, ker, src_buf, dst_buf, src_offset, dst_offset,
+                               region, 0, 0, 0, 0, global_sz, local_sz);
   } else {
     extern char cl_internal_copy_buf_align16_str[];
     extern int cl_internal_copy_buf_align16_str_size;
@@ -775,19 +883,14 @@ cl_mem_copy(cl_command_queue queue, cl_mem src_buf, cl_mem dst_buf,
     ker = cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_COPY_BUFFER_ALIGN16,
              cl_internal_copy_buf_align16_str, (size_t)cl_internal_copy_buf_align16_str_size, NULL);
     cb = cb/16;
-    src_offset = src_offset/4;
-    dst_offset = dst_offset/4;
+    src_offset = src_offset/16;
+    dst_offset = dst_offset/16;
   }
 
   if (!ker)
     return CL_OUT_OF_RESOURCES;
 
-  if (cb < LOCAL_SZ_0) {
-    local_sz[0] = 1;
-  } else {
-    local_sz[0] = LOCAL_SZ_0;
-  }
-  global_sz[0] = ((cb + LOCAL_SZ_0 - 1)/LOCAL_SZ_0)*LOCAL_SZ_0;
+  cl_mem_copy_work_size(queue, cb, &global_sz[0], &local_sz[0]);
 
   cl_kernel_set_arg(ker, 0, sizeof(cl_mem), &src_buf);
   cl_kernel_set_arg(ker, 1, sizeof(int), &src_offset);
@@ -795,9 +898,72 @@ cl_mem_copy(cl_command_queue queue, cl_mem src_buf, cl_mem dst_buf,
   cl_kernel_set_arg(ker, 3, sizeof(int), &dst_offset);
   cl_kernel_set_arg(ker, 4, sizeof(int), &cb);
 
-  ret = cl_command_queue_ND_range(queue, ker, 1, global_off, global_sz, local_sz);
+  return cl_command_queue_ND_range(queue, ker, 1, global_off, global_sz, local_sz);
+}
 
-  return ret;
+/* Patterns of up to 16 bytes are repeated on the host to fill one uint4 which
+ * each lane of the kernels stores at once. The offset is a multiple of the
+ * pattern size, so the byte b of the buffer always gets the byte b % 16 of it.
+ * Larger patterns are passed as up to 8 uint4 and each lane stores a full one
+ */
+LOCAL cl_int
+cl_mem_fill(cl_command_queue queue, const void *pattern, size_t pattern_size,
+            cl_mem buffer, size_t offset, size_t size)
+{
+  cl_kernel ker;
+  size_t global_off[] = {0,0,0};
+  size_t global_sz[] = {1,1,1};
+  size_t local_sz[] = {1,1,1};
+  size_t lane_n;
+  uint8_t pattern16[16];
+  cl_uint i;
+
+  if (pattern_size > 16) {
+    extern char cl_internal_fill_buf_align128_str[];
+    extern int cl_internal_fill_buf_align128_str_size;
+    cl_uint pattern_n = pattern_size / 16;
+
+    ker = cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_FILL_BUFFER_ALIGN128,
+             cl_internal_fill_buf_align128_str, (size_t)cl_internal_fill_buf_align128_str_size, NULL);
+    if (!ker)
+      return CL_OUT_OF_RESOURCES;
+    for (i = 0; i < 8; i++)
+      cl_kernel_set_arg(ker, 3 + i, 16, (const char *) pattern + 16 * (i % pattern_n));
+    cl_kernel_set_arg(ker, 11, sizeof(cl_uint), &pattern_n);
+    lane_n = size = size / pattern_size;
+    offset = offset / 16;
+  } else {
+    for (i = 0; i < 16; i++)
+      pattern16[i] = ((const uint8_t *) pattern)[i % pattern_size];
+
+    if ((offset % 16) || (size % 16)) {
+      extern char cl_internal_fill_buf_unalign_str[];
+      extern int cl_internal_fill_buf_unalign_str_size;
+
+      ker = cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_FILL_BUFFER_UNALIGN,
+               cl_internal_fill_buf_unalign_str, (size_t)cl_internal_fill_buf_unalign_str_size, NULL);
+      lane_n = (offset + size + 15) / 16 - offset / 16;
+    } else {
+      extern char cl_internal_fill_buf_align16_str[];
+      extern int cl_internal_fill_buf_align16_str_size;
+
+      ker = cl_context_get_static_kernel_form_bin(queue->ctx, CL_ENQUEUE_FILL_BUFFER_ALIGN16,
+               cl_internal_fill_buf_align16_str, (size_t)cl_internal_fill_buf_align16_str_size, NULL);
+      lane_n = size = size / 16;
+      offset = offset / 16;
+    }
+    if (!ker)
+      return CL_OUT_OF_RESOURCES;
+    cl_kernel_set_arg(ker, 3, sizeof(pattern16), pattern16);
+  }
+
+  cl_mem_copy_work_size(queue, lane_n, &global_sz[0], &local_sz[0]);
+
+  cl_kernel_set_arg(ker, 0, sizeof(cl_mem), &buffer);
+  cl_kernel_set_arg(ker, 1, sizeof(int), &offset);
+  cl_kernel_set_arg(ker, 2, sizeof(int), &size);
+
+  return cl_command_queue_ND_range(queue, ker, 1, global_off, global_sz, local_sz);
 }
 
 LOCAL cl_int
@@ -805,61 +971,30 @@ cl_mem_copy_buffer_rect(cl_command_queue queue, cl_mem src_buf, cl_mem dst_buf,
                        const size_t *src_origin, const size_t *dst_origin, const size_t *region,
                        size_t src_row_pitch, size_t src_slice_pitch,
                        size_t dst_row_pitch, size_t dst_slice_pitch) {
-  cl_int ret;
   cl_kernel ker;
-  size_t global_off[] = {0,0,0};
   size_t global_sz[] = {1,1,1};
-  size_t local_sz[] = {LOCAL_SZ_0,LOCAL_SZ_1,LOCAL_SZ_1};
+  size_t local_sz[] = {LOCAL_SZ_0,LOCAL_SZ_1,LOCAL_SZ_2};
+  size_t src_offset = src_origin[2]*src_slice_pitch + src_origin[1]*src_row_pitch + src_origin[0];
+  size_t dst_offset = dst_origin[2]*dst_slice_pitch + dst_origin[1]*dst_row_pitch + dst_origin[0];
+
+  /* Up to one more chunk per row than its size when it is not aligned */
   if(region[1] == 1) local_sz[1] = 1;
   if(region[2] == 1) local_sz[2] = 1;
-  global_sz[0] = ((region[0] + local_sz[0] - 1) / local_sz[0]) * local_sz[0];
+  global_sz[0] = (region[0] + 15) / 16 + ((dst_offset | dst_row_pitch | dst_slice_pitch) % 16 != 0);
+  global_sz[0] = ((global_sz[0] + local_sz[0] - 1) / local_sz[0]) * local_sz[0];
   global_sz[1] = ((region[1] + local_sz[1] - 1) / local_sz[1]) * local_sz[1];
   global_sz[2] = ((region[2] + local_sz[2] - 1) / local_sz[2]) * local_sz[2];
-  cl_int index = CL_ENQUEUE_COPY_BUFFER_RECT;
-  cl_int src_offset = src_origin[2]*src_slice_pitch + src_origin[1]*src_row_pitch + src_origin[0];
-  cl_int dst_offset = dst_origin[2]*dst_slice_pitch + dst_origin[1]*dst_row_pitch + dst_origin[0];
-
-  static const char *str_kernel =
-      "kernel void __cl_cpy_buffer_rect ( \n"
-      "       global char* src, global char* dst, \n"
-      "       unsigned int region0, unsigned int region1, unsigned int region2, \n"
-      "       unsigned int src_offset, unsigned int dst_offset, \n"
-      "       unsigned int src_row_pitch, unsigned int src_slice_pitch, \n"
-      "       unsigned int dst_row_pitch, unsigned int dst_slice_pitch) { \n"
-      "  int i = get_global_id(0); \n"
-      "  int j = get_global_id(1); \n"
-      "  int k = get_global_id(2); \n"
-      "  if((i >= region0) || (j>= region1) || (k>=region2)) \n"
-      "    return; \n"
-      "  src_offset += k * src_slice_pitch + j * src_row_pitch + i; \n"
-      "  dst_offset += k * dst_slice_pitch + j * dst_row_pitch + i; \n"
-      "  dst[dst_offset] = src[src_offset]; \n"
-      "}";
-
 
   /* We use one kernel to copy the data. The kernel is lazily created. */
   assert(src_buf->ctx == dst_buf->ctx);
 
-  /* setup the kernel and run. */
-  ker = cl_context_get_static_kernel(queue->ctx, index, str_kernel, NULL);
+  ker = cl_mem_copy_unalign_kernel(queue);
   if (!ker)
     return CL_OUT_OF_RESOURCES;
 
-  cl_kernel_set_arg(ker, 0, sizeof(cl_mem), &src_buf);
-  cl_kernel_set_arg(ker, 1, sizeof(cl_mem), &dst_buf);
-  cl_kernel_set_arg(ker, 2, sizeof(cl_int), &region[0]);
-  cl_kernel_set_arg(ker, 3, sizeof(cl_int), &region[1]);
-  cl_kernel_set_arg(ker, 4, sizeof(cl_int), &region[2]);
-  cl_kernel_set_arg(ker, 5, sizeof(cl_int), &src_offset);
-  cl_kernel_set_arg(ker, 6, sizeof(cl_int), &dst_offset);
-  cl_kernel_set_arg(ker, 7, sizeof(cl_int), &src_row_pitch);
-  cl_kernel_set_arg(ker, 8, sizeof(cl_int), &src_slice_pitch);
-  cl_kernel_set_arg(ker, 9, sizeof(cl_int), &dst_row_pitch);
-  cl_kernel_set_arg(ker, 10, sizeof(cl_int), &dst_slice_pitch);
-
-  ret = cl_command_queue_ND_range(queue, ker, 1, global_off, global_sz, local_sz);
-
-  return ret;
+  return cl_mem_copy_unalign(queue, ker, src_buf, dst_buf, src_offset, dst_offset, region,
+                             src_row_pitch, src_slice_pitch, dst_row_pitch, dst_slice_pitch,
+                             global_sz, local_sz);
 }
 
 LOCAL cl_int
@@ -987,6 +1122,92 @@ fail:
   return ret;
 }
 
+/* The fill color is given as float4, int4 or uint4 depending on the channel
+ * type of the image, the kernel reinterprets the same 16 bytes accordingly
+ */
+LOCAL cl_int
+cl_mem_fill_image(cl_command_queue queue, const void *pattern, struct _cl_mem_image* image,
+                  const size_t *origin, const size_t *region)
+{
+  cl_kernel ker;
+  size_t global_off[] = {0,0,0};
+  size_t global_sz[] = {1,1,1};
+  size_t local_sz[] = {LOCAL_SZ_0,LOCAL_SZ_1,LOCAL_SZ_2};
+  cl_int index = CL_ENQUEUE_FILL_IMAGE_0;
+  char option[40] = "";
+  cl_uint kind;
+
+  if(region[1] == 1) local_sz[1] = 1;
+  if(region[2] == 1) local_sz[2] = 1;
+  global_sz[0] = ((region[0] + local_sz[0] - 1) / local_sz[0]) * local_sz[0];
+  global_sz[1] = ((region[1] + local_sz[1] - 1) / local_sz[1]) * local_sz[1];
+  global_sz[2] = ((region[2] + local_sz[2] - 1) / local_sz[2]) * local_sz[2];
+
+  if(image->image_type == CL_MEM_OBJECT_IMAGE3D) {
+    strcat(option, "-D IMAGE_3D");
+    index += 1;
+  }
+
+  switch (image->fmt.image_channel_data_type) {
+    case CL_SIGNED_INT8:
+    case CL_SIGNED_INT16:
+    case CL_SIGNED_INT32:   kind = 1; break;
+    case CL_UNSIGNED_INT8:
+    case CL_UNSIGNED_INT16:
+    case CL_UNSIGNED_INT32: kind = 2; break;
+    default:                kind = 0;
+  }
+
+  static const char *str_kernel =
+      "#ifdef IMAGE_3D \n"
+      "  #define IMAGE_TYPE image3d_t \n"
+      "  #define COORD_TYPE int4 \n"
+      "#else \n"
+      "  #define IMAGE_TYPE image2d_t \n"
+      "  #define COORD_TYPE int2 \n"
+      "#endif \n"
+      "kernel void __cl_fill_image ( \n"
+      "       __write_only IMAGE_TYPE image, uint4 pattern, unsigned int kind, \n"
+      "       unsigned int region0, unsigned int region1, unsigned int region2, \n"
+      "       unsigned int origin0, unsigned int origin1, unsigned int origin2) { \n"
+      "  int i = get_global_id(0); \n"
+      "  int j = get_global_id(1); \n"
+      "  int k = get_global_id(2); \n"
+      "  COORD_TYPE coord; \n"
+      "  if((i >= region0) || (j>= region1) || (k>=region2)) \n"
+      "    return; \n"
+      "  coord.x = origin0 + i; \n"
+      "  coord.y = origin1 + j; \n"
+      "#ifdef IMAGE_3D \n"
+      "  coord.z = origin2 + k; \n"
+      "  coord.w = 0; \n"
+      "#endif \n"
+      "  if (kind == 0) \n"
+      "    write_imagef(image, coord, as_float4(pattern)); \n"
+      "  else if (kind == 1) \n"
+      "    write_imagei(image, coord, as_int4(pattern)); \n"
+      "  else \n"
+      "    write_imageui(image, coord, pattern); \n"
+      "}";
+
+  /* We use one kernel per dimension to fill the image. It is lazily created. */
+  ker = cl_context_get_static_kernel(queue->ctx, index, str_kernel, option);
+  if (!ker)
+    return CL_OUT_OF_RESOURCES;
+
+  cl_kernel_set_arg(ker, 0, sizeof(cl_mem), &image);
+  cl_kernel_set_arg(ker, 1, 16, pattern);
+  cl_kernel_set_arg(ker, 2, sizeof(cl_uint), &kind);
+  cl_kernel_set_arg(ker, 3, sizeof(cl_int), &region[0]);
+  cl_kernel_set_arg(ker, 4, sizeof(cl_int), &region[1]);
+  cl_kernel_set_arg(ker, 5, sizeof(cl_int), &region[2]);
+  cl_kernel_set_arg(ker, 6, sizeof(cl_int), &origin[0]);
+  cl_kernel_set_arg(ker, 7, sizeof(cl_int), &origin[1]);
+  cl_kernel_set_arg(ker, 8, sizeof(cl_int), &origin[2]);
+
+  return cl_command_queue_ND_range(queue, ker, 3, global_off, global_sz, local_sz);
+}
+
 LOCAL cl_int
 cl_mem_copy_image_to_buffer(cl_command_queue queue, struct _cl_mem_image* image, cl_mem buffer,
                          const size_t *src_origin, const size_t dst_offset, const size_t *region) {
@@ -1180,9 +1401,67 @@ cl_mem_copy_buffer_to_image(cl_command_queue queue, cl_mem buffer, struct _cl_me
 }
 
 
+/* The userptr bos have no GTT mapping: their pages are already the host ones,
+ * the maps only wait for the GPU and get the CPU caches in sync
+ */
+/* The pooled buffer holding the memory object or NULL */
+static struct _cl_mem_buffer*
+cl_mem_pooled(cl_mem mem)
+{
+  struct _cl_mem_buffer *buffer;
+  if (IS_IMAGE(mem))
+    return NULL;
+  buffer = cl_mem_buffer(mem);
+  if (mem->type == CL_MEM_SUBBUFFER_TYPE)
+    buffer = buffer->parent;
+  return buffer->slab ? buffer : NULL;
+}
+
+LOCAL void
+cl_mem_set_batch(cl_mem mem, cl_buffer batch)
+{
+  struct _cl_mem_buffer *buffer = cl_mem_pooled(mem);
+  cl_buffer prev;
+  if (buffer == NULL)
+    return;
+  cl_buffer_reference(batch);
+  pthread_mutex_lock(&mem->ctx->buffer_pool.lock);
+    prev = buffer->batch;
+    buffer->batch = batch;
+  pthread_mutex_unlock(&mem->ctx->buffer_pool.lock);
+  if (prev)
+    cl_buffer_unreference(prev);
+}
+
+/* A regular mapping of the slab would wait for the GPU to be done with all its
+ * chunks. Only wait for the last batch using this one
+ */
+static void*
+cl_mem_map_pooled(cl_mem mem, struct _cl_mem_buffer *buffer)
+{
+  cl_buffer batch;
+  pthread_mutex_lock(&mem->ctx->buffer_pool.lock);
+    batch = buffer->batch;
+    if (batch)
+      cl_buffer_reference(batch);
+  pthread_mutex_unlock(&mem->ctx->buffer_pool.lock);
+  if (batch) {
+    cl_buffer_wait_rendering(batch);
+    cl_buffer_unreference(batch);
+  }
+  cl_buffer_map_gtt_unsync(mem->bo);
+  assert(cl_buffer_get_virtual(mem->bo));
+  return cl_buffer_get_virtual(mem->bo);
+}
+
 LOCAL void*
 cl_mem_map(cl_mem mem)
 {
+  struct _cl_mem_buffer *pooled = cl_mem_pooled(mem);
+  if (pooled)
+    return cl_mem_map_pooled(mem, pooled);
+  if (mem->is_userptr)
+    cl_buffer_wait_rendering(mem->bo);
   cl_buffer_map(mem->bo, 1);
   assert(cl_buffer_get_virtual(mem->bo));
   return cl_buffer_get_virtual(mem->bo);
@@ -1198,6 +1477,11 @@ cl_mem_unmap(cl_mem mem)
 LOCAL void*
 cl_mem_map_gtt(cl_mem mem)
 {
+  struct _cl_mem_buffer *pooled = cl_mem_pooled(mem);
+  if (pooled)
+    return cl_mem_map_pooled(mem, pooled);
+  if (mem->is_userptr)
+    return cl_mem_map(mem);
   cl_buffer_map_gtt(mem->bo);
   assert(cl_buffer_get_virtual(mem->bo));
   return cl_buffer_get_virtual(mem->bo);
@@ -1206,6 +1490,10 @@ cl_mem_map_gtt(cl_mem mem)
 LOCAL void *
 cl_mem_map_gtt_unsync(cl_mem mem)
 {
+  if (mem->is_userptr) {
+    cl_buffer_map(mem->bo, 1);
+    return cl_buffer_get_virtual(mem->bo);
+  }
   cl_buffer_map_gtt_unsync(mem->bo);
   assert(cl_buffer_get_virtual(mem->bo));
   return cl_buffer_get_virtual(mem->bo);
@@ -1214,6 +1502,8 @@ cl_mem_map_gtt_unsync(cl_mem mem)
 LOCAL cl_int
 cl_mem_unmap_gtt(cl_mem mem)
 {
+  if (mem->is_userptr)
+    return cl_mem_unmap(mem);
   cl_buffer_unmap_gtt(mem->bo);
   return CL_SUCCESS;
 }
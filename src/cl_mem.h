@@ -24,6 +24,8 @@
 #include "cl_driver_type.h"
 #include "CL/cl.h"
 #include "cl_khr_icd.h"
+#include "cl_utils.h"
+#include "cl_tiling.h"
 #include <assert.h>
 
 #ifndef CL_VERSION_1_2
@@ -31,6 +33,8 @@
 #define CL_MEM_OBJECT_IMAGE1D_ARRAY                 0x10F5
 #define CL_MEM_OBJECT_IMAGE1D_BUFFER                0x10F6
 #define CL_MEM_OBJECT_IMAGE2D_ARRAY                 0x10F3
+#define CL_COMMAND_FILL_BUFFER                      0x1207
+#define CL_COMMAND_FILL_IMAGE                       0x1208
 typedef struct _cl_image_desc {
     cl_mem_object_type      image_type;
     size_t                  image_width;
@@ -45,12 +49,6 @@ typedef struct _cl_image_desc {
 } cl_image_desc;
 #endif
 
-typedef enum cl_image_tiling {
-  CL_NO_TILE = 0,
-  CL_TILE_X  = 1,
-  CL_TILE_Y  = 2
-} cl_image_tiling_t;
-
 typedef struct _cl_mapped_ptr {
   void * ptr;
   void * v_ptr;
@@ -88,6 +86,8 @@ typedef  struct _cl_mem {
   int mapped_ptr_sz;        /* The array size of mapped_ptr. */
   int map_ref;              /* The mapped count. */
   cl_mem_dstr_cb *dstr_cb;  /* The destroy callback. */
+  atomic_t write_gen;       /* Incremented each time the content may change */
+  cl_bool is_userptr;       /* The bo is the host_ptr pages themselves */
 } _cl_mem;
 
 struct _cl_mem_image {
@@ -100,6 +100,7 @@ struct _cl_mem_image {
   size_t row_pitch, slice_pitch;
   size_t host_row_pitch, host_slice_pitch;
   cl_image_tiling_t tiling;       /* only IVB+ supports TILE_[X,Y] (image only) */
+  cl_tiling_swizzle_t swizzle;    /* bit 6 swizzling seen by the CPU mappings */
   size_t tile_x, tile_y;          /* tile offset, used for mipmap images.  */
   size_t offset;                  /* offset for dri_bo, used when it's reloc. */
 };
@@ -139,10 +140,12 @@ cl_mem_image_init(struct _cl_mem_image *image, size_t w, size_t h,
 struct _cl_mem_buffer {
   _cl_mem base;
   struct _cl_mem_buffer* subs;         /* Sub buf objects. */
-  size_t sub_offset;                   /* The sub start offset. */
+  size_t sub_offset;                   /* The sub start offset (or the offset in the pool slab). */
   struct _cl_mem_buffer* sub_prev, *sub_next;/* We chain the sub memory buffers together */
   pthread_mutex_t sub_lock;            /* Sub buffers list lock*/
   struct _cl_mem_buffer* parent;       /* Point to the parent buffer if is sub-buffer */
+  struct _cl_mem_slab* slab;           /* The context pool slab holding it or NULL */
+  cl_buffer batch;                     /* Batch buffer of the last NDRange using the slab chunk */
 };
 
 inline static struct _cl_mem_image *
@@ -166,6 +169,27 @@ cl_mem_buffer(cl_mem mem)
   return (struct _cl_mem_buffer *)mem;
 }
 
+/* The content of the memory object may have been changed by the host or by a
+ * kernel. Copies of it (like the constant buffers) must be done again
+ */
+inline static void
+cl_mem_touch(cl_mem mem)
+{
+  atomic_inc(&mem->write_gen);
+  if (mem->type == CL_MEM_SUBBUFFER_TYPE)
+    atomic_inc(&cl_mem_buffer(mem)->parent->base.write_gen);
+}
+
+/* Changes each time the memory object or its parent buffer is touched */
+inline static int
+cl_mem_write_gen(cl_mem mem)
+{
+  int gen = mem->write_gen;
+  if (mem->type == CL_MEM_SUBBUFFER_TYPE)
+    gen += cl_mem_buffer(mem)->parent->base.write_gen;
+  return gen;
+}
+
 /* Query information about a memory object */
 extern cl_int cl_get_mem_object_info(cl_mem, cl_mem_info, size_t, void *, size_t *);
 
@@ -200,6 +224,14 @@ extern void cl_mem_add_ref(cl_mem);
 extern cl_int cl_mem_copy(cl_command_queue queue, cl_mem src_buf, cl_mem dst_buf,
               size_t src_offset, size_t dst_offset, size_t cb);
 
+/* api clEnqueueFillBuffer help function */
+extern cl_int cl_mem_fill(cl_command_queue queue, const void *pattern, size_t pattern_size,
+              cl_mem buffer, size_t offset, size_t size);
+
+/* api clEnqueueFillImage help function */
+extern cl_int cl_mem_fill_image(cl_command_queue, const void *, struct _cl_mem_image*,
+                                const size_t *, const size_t *);
+
 /* api clEnqueueCopyBufferRect help function */
 extern cl_int cl_mem_copy_buffer_rect(cl_command_queue, cl_mem, cl_mem,
                                      const size_t *, const size_t *, const size_t *,
@@ -217,6 +249,9 @@ extern cl_int cl_mem_copy_image_to_buffer(cl_command_queue, struct _cl_mem_image
 extern cl_int cl_mem_copy_buffer_to_image(cl_command_queue, cl_mem, struct _cl_mem_image*,
                                           const size_t, const size_t *, const size_t *);
 
+/* Remember the batch buffer of an NDRange using a pooled buffer */
+extern void cl_mem_set_batch(cl_mem, cl_buffer batch);
+
 /* Directly map a memory object */
 extern void *cl_mem_map(cl_mem);
 
@@ -254,7 +289,18 @@ void
 cl_mem_copy_image_region(const size_t *origin, const size_t *region,
                          void *dst, size_t dst_row_pitch, size_t dst_slice_pitch,
                          const void *src, size_t src_row_pitch, size_t src_slice_pitch,
-                         const struct _cl_mem_image *image);
+                         const struct _cl_mem_image *image, int copy_flags);
+
+/* Tiled images whose swizzling is known are copied by the CPU through a
+ * cached mapping rather than detiled by the GTT fences
+ */
+extern cl_bool cl_mem_image_cpu_tiling(const struct _cl_mem_image *image);
+
+/* Copy a region between the host and the CPU mapping of a tiled image */
+extern void cl_mem_image_tiling_copy(const struct _cl_mem_image *image, void *tiled,
+                                     const size_t *origin, const size_t *region,
+                                     void *host, size_t host_row_pitch, size_t host_slice_pitch,
+                                     cl_bool to_image);
 
 extern cl_mem cl_mem_new_libva_buffer(cl_context ctx,
                                       unsigned int bo_name,
@@ -0,0 +1,237 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cl_mem_pool.h"
+#include "cl_driver.h"
+#include "cl_alloc.h"
+#include "cl_utils.h"
+#include "cl_command_queue.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+DEFINE_ENV_INT(cl_mem_pool_enabled, "OCL_BUFFER_POOL", 1)
+
+/* Index of the smallest size class holding sz bytes */
+static uint32_t
+cl_mem_pool_class(size_t sz)
+{
+  uint32_t cls = 0;
+  while ((size_t) (CL_MEM_POOL_MIN_CHUNK << cls) < sz)
+    cls++;
+  assert(cls < CL_MEM_POOL_CLASS_N);
+  return cls;
+}
+
+static cl_mem_slab*
+cl_mem_slab_new(cl_buffer_mgr bufmgr, uint32_t chunk_sz)
+{
+  cl_mem_slab *slab = NULL;
+  uint32_t i;
+
+  TRY_ALLOC_NO_ERR (slab, CALLOC(cl_mem_slab));
+  slab->bo = cl_buffer_alloc(bufmgr, "CL memory pool", CL_MEM_POOL_SLAB_SZ, 4096);
+  if (UNLIKELY(slab->bo == NULL))
+    goto error;
+  slab->chunk_sz = chunk_sz;
+  slab->chunk_n = CL_MEM_POOL_SLAB_SZ / chunk_sz;
+  /* The bits past the last chunk are never free */
+  for (i = slab->chunk_n; i < CL_MEM_POOL_SLAB_CHUNK_N; ++i)
+    slab->used[i / 64] |= 1ull << (i % 64);
+
+exit:
+  return slab;
+error:
+  cl_free(slab);
+  slab = NULL;
+  goto exit;
+}
+
+static void
+cl_mem_slab_delete(cl_mem_slab *slab)
+{
+  cl_buffer_unreference(slab->bo);
+  cl_free(slab);
+}
+
+static void
+cl_mem_pool_unlink(cl_mem_pool *pool, uint32_t cls, cl_mem_slab *slab)
+{
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    pool->slabs[cls] = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+  slab->prev = slab->next = NULL;
+}
+
+static void
+cl_mem_pool_push_front(cl_mem_pool *pool, uint32_t cls, cl_mem_slab *slab)
+{
+  slab->prev = NULL;
+  slab->next = pool->slabs[cls];
+  if (slab->next)
+    slab->next->prev = slab;
+  pool->slabs[cls] = slab;
+}
+
+/* First slab of the class with a free chunk */
+static cl_mem_slab*
+cl_mem_pool_find(cl_mem_pool *pool, uint32_t cls)
+{
+  cl_mem_slab *slab;
+  for (slab = pool->slabs[cls]; slab != NULL; slab = slab->next)
+    if (slab->used_n < slab->chunk_n)
+      break;
+  return slab;
+}
+
+/* The retired chunks of the idle slabs are free again */
+static void
+cl_mem_pool_reclaim(cl_mem_pool *pool, uint32_t cls)
+{
+  cl_mem_slab *slab;
+  uint32_t w;
+  for (slab = pool->slabs[cls]; slab != NULL; slab = slab->next) {
+    if (slab->retired_n == 0 || cl_buffer_is_busy(slab->bo))
+      continue;
+    for (w = 0; w < CL_MEM_POOL_SLAB_CHUNK_N / 64; ++w) {
+      slab->used[w] &= ~slab->retired[w];
+      slab->retired[w] = 0;
+    }
+    slab->used_n -= slab->retired_n;
+    slab->retired_n = 0;
+  }
+}
+
+static uint32_t
+cl_mem_pool_retired_n(cl_mem_pool *pool, uint32_t cls)
+{
+  cl_mem_slab *slab;
+  uint32_t n = 0;
+  for (slab = pool->slabs[cls]; slab != NULL; slab = slab->next)
+    n += slab->retired_n;
+  return n;
+}
+
+LOCAL void
+cl_mem_pool_init(cl_mem_pool *pool, cl_context ctx)
+{
+  memset(pool->slabs, 0, sizeof(pool->slabs));
+  pool->ctx = ctx;
+  pthread_mutex_init(&pool->lock, NULL);
+}
+
+LOCAL void
+cl_mem_pool_destroy(cl_mem_pool *pool)
+{
+  uint32_t cls;
+  for (cls = 0; cls < CL_MEM_POOL_CLASS_N; ++cls)
+    while (pool->slabs[cls]) {
+      cl_mem_slab *slab = pool->slabs[cls];
+      assert(slab->used_n == slab->retired_n);
+      pool->slabs[cls] = slab->next;
+      cl_mem_slab_delete(slab);
+    }
+  pthread_mutex_destroy(&pool->lock);
+}
+
+LOCAL cl_mem_slab*
+cl_mem_pool_alloc(cl_mem_pool *pool, cl_buffer_mgr bufmgr, size_t sz, size_t *offset)
+{
+  cl_mem_slab *slab = NULL;
+  uint32_t cls, w;
+
+  if (sz == 0 || sz > CL_MEM_POOL_MAX_CHUNK || !cl_mem_pool_enabled())
+    return NULL;
+  cls = cl_mem_pool_class(sz);
+
+  pthread_mutex_lock(&pool->lock);
+  slab = cl_mem_pool_find(pool, cls);
+
+  /* Reuse the retired chunks before growing the pool. The batches which may
+   * still use them are submitted first, out of the pool lock since flushing
+   * takes the queue locks
+   */
+  if (slab == NULL && cl_mem_pool_retired_n(pool, cls) != 0) {
+    pthread_mutex_unlock(&pool->lock);
+    cl_command_queue_flush_all(pool->ctx);
+    pthread_mutex_lock(&pool->lock);
+    cl_mem_pool_reclaim(pool, cls);
+    slab = cl_mem_pool_find(pool, cls);
+  }
+
+  /* Keep the slab with free chunks first to find it quickly next time */
+  if (slab == NULL) {
+    slab = cl_mem_slab_new(bufmgr, CL_MEM_POOL_MIN_CHUNK << cls);
+    if (UNLIKELY(slab == NULL))
+      goto exit;
+    cl_mem_pool_push_front(pool, cls, slab);
+  } else if (slab->prev != NULL) {
+    cl_mem_pool_unlink(pool, cls, slab);
+    cl_mem_pool_push_front(pool, cls, slab);
+  }
+
+  for (w = 0; w < CL_MEM_POOL_SLAB_CHUNK_N / 64; ++w)
+    if (~slab->used[w]) {
+      const uint32_t bit = __builtin_ctzll(~slab->used[w]);
+      slab->used[w] |= 1ull << bit;
+      slab->used_n++;
+      *offset = (w * 64 + bit) * slab->chunk_sz;
+      break;
+    }
+  assert(w < CL_MEM_POOL_SLAB_CHUNK_N / 64);
+  cl_buffer_reference(slab->bo);
+
+exit:
+  pthread_mutex_unlock(&pool->lock);
+  return slab;
+}
+
+LOCAL void
+cl_mem_pool_free(cl_mem_pool *pool, cl_mem_slab *slab, size_t offset)
+{
+  const uint32_t cls = cl_mem_pool_class(slab->chunk_sz);
+  const uint32_t chunk = offset / slab->chunk_sz;
+  cl_buffer bo = slab->bo;
+  cl_mem_slab *other = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  assert(slab->used[chunk / 64] & (1ull << (chunk % 64)));
+  assert((slab->retired[chunk / 64] & (1ull << (chunk % 64))) == 0);
+  slab->retired[chunk / 64] |= 1ull << (chunk % 64);
+  slab->retired_n++;
+
+  /* Only one slab without allocated chunks is kept per class: the others go
+   * back to the system as soon as their last chunk is freed. The batch
+   * buffers still using them hold their own reference
+   */
+  if (slab->used_n == slab->retired_n) {
+    for (other = pool->slabs[cls]; other != NULL; other = other->next)
+      if (other != slab && other->used_n < other->chunk_n)
+        break;
+    if (other != NULL) {
+      cl_mem_pool_unlink(pool, cls, slab);
+      cl_mem_slab_delete(slab);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  cl_buffer_unreference(bo);
+}
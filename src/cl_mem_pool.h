@@ -0,0 +1,82 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CL_MEM_POOL_H__
+#define __CL_MEM_POOL_H__
+
+#include "cl_driver_type.h"
+#include "CL/cl.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* Small buffers are carved out of larger buffer objects (slabs) instead of
+ * getting one buffer object each. A slab is cut in chunks of one power of two
+ * size class. The smallest class matches the sub-buffer alignment.
+ *
+ * A freed chunk may still be read or written by an NDRange which is batched
+ * but not submitted yet: it is retired and only reused once the batches of
+ * the context are flushed and the GPU is done with its slab
+ */
+enum {
+  CL_MEM_POOL_MIN_CHUNK = 128,
+  CL_MEM_POOL_MAX_CHUNK = 16 * 1024,
+  CL_MEM_POOL_CLASS_N = 8,             /* 128 bytes to 16KB */
+  CL_MEM_POOL_SLAB_SZ = 128 * 1024,
+  CL_MEM_POOL_SLAB_CHUNK_N = CL_MEM_POOL_SLAB_SZ / CL_MEM_POOL_MIN_CHUNK
+};
+
+typedef struct _cl_mem_slab {
+  cl_buffer bo;                 /* Shared by all the chunks */
+  uint32_t chunk_sz;            /* Size of one chunk */
+  uint32_t chunk_n;             /* Number of chunks in the slab */
+  uint32_t used_n;              /* Number of allocated or retired chunks */
+  uint32_t retired_n;           /* Number of retired chunks */
+  uint64_t used[CL_MEM_POOL_SLAB_CHUNK_N / 64];    /* One bit per allocated or retired chunk */
+  uint64_t retired[CL_MEM_POOL_SLAB_CHUNK_N / 64]; /* One bit per retired chunk */
+  struct _cl_mem_slab *prev, *next;
+} cl_mem_slab;
+
+typedef struct _cl_mem_pool {
+  pthread_mutex_t lock;
+  cl_context ctx;               /* Its queues are flushed before reusing chunks */
+  cl_mem_slab *slabs[CL_MEM_POOL_CLASS_N]; /* The slabs with free chunks first */
+} cl_mem_pool;
+
+/* Initialize an empty pool */
+extern void cl_mem_pool_init(cl_mem_pool *pool, cl_context ctx);
+
+/* Release all the slabs. All the chunks must have been freed */
+extern void cl_mem_pool_destroy(cl_mem_pool *pool);
+
+/* Return the slab holding a chunk of at least sz bytes and the offset of the
+ * chunk in its buffer object. The caller gets a new reference on it. NULL if
+ * the buffer is too large for the pool or if the pool is disabled
+ * (OCL_BUFFER_POOL=0)
+ */
+extern cl_mem_slab *cl_mem_pool_alloc(cl_mem_pool *pool,
+                                      cl_buffer_mgr bufmgr,
+                                      size_t sz,
+                                      size_t *offset);
+
+/* Retire a chunk allocated with cl_mem_pool_alloc and drop the reference */
+extern void cl_mem_pool_free(cl_mem_pool *pool,
+                             cl_mem_slab *slab,
+                             size_t offset);
+
+#endif /* __CL_MEM_POOL_H__ */
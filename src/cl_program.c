@@ -22,6 +22,7 @@
 #include "cl_device_id.h"
 #include "cl_context.h"
 #include "cl_alloc.h"
+#include "cl_trace.h"
 #include "cl_utils.h"
 #include "cl_khr_icd.h"
 #include "CL/cl.h"
@@ -92,7 +93,7 @@ cl_program_delete(cl_program p)
   cl_context_delete(p->ctx);
 
   /* Free the program as allocated by the compiler */
-  if (p->opaque) gbe_program_delete(p->opaque);
+  if (p->opaque && !p->opaque_shared) gbe_program_delete(p->opaque);
 
   p->magic = CL_MAGIC_DEAD_HEADER; /* For safety */
   cl_free(p);
@@ -245,6 +246,32 @@ error:
   goto exit;
 }
 
+LOCAL cl_program
+cl_program_create_from_gbe(cl_context ctx, gbe_program opaque, cl_int *errcode_ret)
+{
+  cl_program program = NULL;
+  cl_int err = CL_SUCCESS;
+
+  assert(ctx && opaque);
+  TRY_ALLOC (program, cl_program_new(ctx));
+  program->opaque = opaque;
+  program->opaque_shared = 1;
+
+  /* Create all the kernels */
+  TRY (cl_program_load_gen_program, program);
+  program->source_type = FROM_LLVM;
+  program->is_built = 1;
+
+exit:
+  if (errcode_ret)
+    *errcode_ret = err;
+  return program;
+error:
+  cl_program_delete(program);
+  program = NULL;
+  goto exit;
+}
+
 LOCAL cl_program
 cl_program_create_from_source(cl_context ctx,
                               cl_uint count,
@@ -298,6 +325,7 @@ error:
 LOCAL cl_int
 cl_program_build(cl_program p, const char *options)
 {
+  CL_TRACE_SCOPE("build", "compile");
   cl_int err = CL_SUCCESS;
   int i = 0;
   int copyed = 0;
@@ -53,6 +53,7 @@ struct _cl_program {
   uint32_t ker_n;         /* Number of declared kernels */
   uint32_t source_type:2; /* Built from binary, source or LLVM */
   uint32_t is_built:1;    /* Did we call clBuildProgram on it? */
+  uint32_t opaque_shared:1; /* opaque belongs to the internal program cache */
   char *build_opts;       /* The build options for this program */
   size_t build_log_max_sz; /*build log maximum size in byte.*/
   char *build_log;         /* The build log for this program. */
@@ -92,6 +93,14 @@ cl_program_create_from_binary(cl_context             context,
                               cl_int *               binary_status,
                               cl_int *               errcode_ret);
 
+/* Create a built program around a compiler program which outlives it. Only
+ * its kernels (and their code) are created
+ */
+extern cl_program
+cl_program_create_from_gbe(cl_context context,
+                           gbe_program opaque,
+                           cl_int *errcode_ret);
+
 /* Directly create a program from a LLVM source file */
 extern cl_program
 cl_program_create_from_llvm(cl_context             context,
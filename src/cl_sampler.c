@@ -54,22 +54,25 @@ uint32_t cl_to_clk(cl_bool normalized_coords,
 
 #define IS_SAMPLER_ARG(v) (v & __CLK_SAMPLER_ARG_KEY_BIT)
 #define SAMPLER_ARG_ID(v) ((v & __CLK_SAMPLER_ARG_MASK) >> __CLK_SAMPLER_ARG_BASE)
-int cl_set_sampler_arg_slot(cl_kernel k, int index, cl_sampler sampler)
+int cl_get_sampler_arg_slot(cl_kernel k, int index)
 {
   int slot_id;
   for(slot_id = 0; slot_id < k->sampler_sz; slot_id++)
   {
     if (IS_SAMPLER_ARG(k->samplers[slot_id])) {
-     if (SAMPLER_ARG_ID(k->samplers[slot_id]) == index) {
-       k->samplers[slot_id] = (k->samplers[slot_id] & (~__CLK_SAMPLER_MASK))
-                              | sampler->clkSamplerValue;
+     if (SAMPLER_ARG_ID(k->samplers[slot_id]) == index)
        return slot_id;
-     }
     }
   }
   return -1;
 }
 
+void cl_set_sampler_arg_slot(cl_kernel k, int slot, cl_sampler sampler)
+{
+  k->samplers[slot] = (k->samplers[slot] & (~__CLK_SAMPLER_MASK))
+                      | sampler->clkSamplerValue;
+}
+
 LOCAL cl_sampler
 cl_sampler_new(cl_context ctx,
                cl_bool normalized_coords,
@@ -50,8 +50,12 @@ extern void cl_sampler_delete(cl_sampler);
 /* Add one more reference to this object */
 extern void cl_sampler_add_ref(cl_sampler);
 
-/* set a sampler kernel argument */
-int cl_set_sampler_arg_slot(cl_kernel k, int index, cl_sampler sampler);
+/* Slot of the sampler argument index in the samplers of the kernel, -1 if the
+ * kernel does not use it */
+int cl_get_sampler_arg_slot(cl_kernel k, int index);
+
+/* set a sampler kernel argument in its slot */
+void cl_set_sampler_arg_slot(cl_kernel k, int slot, cl_sampler sampler);
 
 #endif /* __CL_SAMPLER_H__ */
 
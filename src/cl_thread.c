@@ -24,6 +24,7 @@ static __thread void* thread_batch_buf = NULL;
 
 typedef struct _cl_thread_spec_data {
   cl_gpgpu gpgpu ;
+  cl_command_queue queue;
   int valid;
 }cl_thread_spec_data;
 
@@ -53,6 +54,7 @@ cl_gpgpu cl_get_thread_gpgpu(cl_command_queue queue)
 
   if (!thread_spec_data->valid) {
     TRY_ALLOC_NO_ERR(thread_spec_data->gpgpu, cl_gpgpu_new(queue->ctx->drv));
+    thread_spec_data->queue = queue;
     thread_spec_data->valid = 1;
   }
 
@@ -74,6 +76,7 @@ void cl_invalid_thread_gpgpu(cl_command_queue queue)
   }
 
   assert(thread_spec_data->gpgpu);
+  cl_command_queue_forget_gpgpu(queue, thread_spec_data->gpgpu);
   cl_gpgpu_delete(thread_spec_data->gpgpu);
   thread_spec_data->valid = 0;
 }
@@ -86,8 +89,10 @@ static void thread_data_destructor(void *data) {
     thread_batch_buf = NULL;
   }
 
-  if (thread_spec_data->valid)
+  if (thread_spec_data->valid) {
+    cl_command_queue_forget_gpgpu(thread_spec_data->queue, thread_spec_data->gpgpu);
     cl_gpgpu_delete(thread_spec_data->gpgpu);
+  }
   cl_free(thread_spec_data);
 }
 
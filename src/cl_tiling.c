@@ -0,0 +1,208 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cl_tiling.h"
+#include "cl_utils.h"
+
+#include <emmintrin.h>
+#include <string.h>
+
+static INLINE size_t
+cl_tiling_swizzle(size_t off, cl_tiling_swizzle_t swizzle)
+{
+  switch (swizzle) {
+    case CL_SWIZZLE_9:       return off ^ ((off >> 3) & 64);
+    case CL_SWIZZLE_9_10:    return off ^ (((off >> 3) ^ (off >> 4)) & 64);
+    case CL_SWIZZLE_9_11:    return off ^ (((off >> 3) ^ (off >> 5)) & 64);
+    case CL_SWIZZLE_9_10_11: return off ^ (((off >> 3) ^ (off >> 4) ^ (off >> 5)) & 64);
+    default:                 return off;
+  }
+}
+
+/* Offset of the row y in its row of tiles */
+static INLINE size_t
+cl_tiling_row(cl_image_tiling_t tiling, size_t pitch, size_t y)
+{
+  switch (tiling) {
+    case CL_TILE_X: return (y / CL_TILEX_H) * pitch * CL_TILEX_H + (y % CL_TILEX_H) * CL_TILEX_W;
+    case CL_TILE_Y: return (y / CL_TILEY_H) * pitch * CL_TILEY_H + (y % CL_TILEY_H) * 16;
+    default:        return y * pitch;
+  }
+}
+
+/* Offset of the byte x in its row */
+static INLINE size_t
+cl_tiling_column(cl_image_tiling_t tiling, size_t x)
+{
+  switch (tiling) {
+    case CL_TILE_X: return (x / CL_TILEX_W) * CL_TILE_SZ + x % CL_TILEX_W;
+    case CL_TILE_Y: return (x / CL_TILEY_W) * CL_TILE_SZ + (x % CL_TILEY_W / 16) * CL_TILEY_H * 16 + x % 16;
+    default:        return x;
+  }
+}
+
+LOCAL size_t
+cl_tiling_offset(cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                 size_t pitch, size_t x, size_t y)
+{
+  const size_t off = cl_tiling_row(tiling, pitch, y) + cl_tiling_column(tiling, x);
+  return tiling == CL_NO_TILE ? off : cl_tiling_swizzle(off, swizzle);
+}
+
+/* Both layouts keep spans of 64 bytes (X, the swizzling moves 64 bytes
+ * blocks) or 16 bytes (Y, one column) contiguous: full spans are copied with
+ * SSE, the partial ones at the edges of the rectangle with memcpy. Y tiles are
+ * walked column by column over a band of 32 rows so that the tiled side is
+ * read or written sequentially
+ */
+static INLINE void
+cl_tiling_copy_span(char *t, char *l, size_t n, int to_tiled)
+{
+  if (n == 64) {
+    const __m128i *src = (const __m128i *) (to_tiled ? l : t);
+    __m128i *dst = (__m128i *) (to_tiled ? t : l);
+    const __m128i a = _mm_loadu_si128(src + 0);
+    const __m128i b = _mm_loadu_si128(src + 1);
+    const __m128i c = _mm_loadu_si128(src + 2);
+    const __m128i d = _mm_loadu_si128(src + 3);
+    _mm_storeu_si128(dst + 0, a);
+    _mm_storeu_si128(dst + 1, b);
+    _mm_storeu_si128(dst + 2, c);
+    _mm_storeu_si128(dst + 3, d);
+  } else if (n == 16) {
+    if (to_tiled)
+      _mm_storeu_si128((__m128i *) t, _mm_loadu_si128((const __m128i *) l));
+    else
+      _mm_storeu_si128((__m128i *) l, _mm_loadu_si128((const __m128i *) t));
+  } else if (to_tiled)
+    memcpy(t, l, n);
+  else
+    memcpy(l, t, n);
+}
+
+static INLINE void
+cl_tiling_copy(char *tiled, size_t pitch,
+               cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+               size_t x, size_t y, char *linear, size_t linear_pitch,
+               size_t w, size_t h, int to_tiled)
+{
+  const size_t span = tiling == CL_TILE_X ? 64 : 16;
+  const size_t band = tiling == CL_TILE_Y ? CL_TILEY_H : 1;
+  size_t i, j, j0, j1;
+
+  for (j0 = 0; j0 < h; j0 = j1) {
+    j1 = (y + j0) / band * band + band - y;
+    if (j1 > h)
+      j1 = h;
+    for (i = 0; i < w;) {
+      const size_t column = cl_tiling_column(tiling, x + i);
+      size_t n = span - (x + i) % span;
+      if (n > w - i)
+        n = w - i;
+      for (j = j0; j < j1; ++j) {
+        const size_t off = cl_tiling_swizzle(cl_tiling_row(tiling, pitch, y + j) + column, swizzle);
+        cl_tiling_copy_span(tiled + off, linear + j * linear_pitch + i, n, to_tiled);
+      }
+      i += n;
+    }
+  }
+}
+
+/* Linear surfaces are plain rectangles */
+static void
+cl_tiling_copy_linear(char *tiled, size_t pitch, size_t x, size_t y,
+                      char *linear, size_t linear_pitch, size_t w, size_t h, int to_tiled)
+{
+  size_t j;
+  tiled += y * pitch + x;
+  for (j = 0; j < h; ++j, tiled += pitch, linear += linear_pitch)
+    if (to_tiled)
+      memcpy(tiled, linear, w);
+    else
+      memcpy(linear, tiled, w);
+}
+
+/* One instance per tiling and swizzling: the offset computations then fold
+ * into shifts and masks
+ */
+#define DECL_TILING_COPY(TILING, SWIZZLE, NAME)                                \
+static void                                                                    \
+cl_tiling_copy_##NAME(char *tiled, size_t pitch, size_t x, size_t y,           \
+                      char *linear, size_t linear_pitch,                       \
+                      size_t w, size_t h, int to_tiled)                        \
+{                                                                              \
+  cl_tiling_copy(tiled, pitch, TILING, SWIZZLE, x, y, linear, linear_pitch,    \
+                 w, h, to_tiled);                                              \
+}
+DECL_TILING_COPY(CL_TILE_X, CL_SWIZZLE_NONE, x)
+DECL_TILING_COPY(CL_TILE_X, CL_SWIZZLE_9, x_9)
+DECL_TILING_COPY(CL_TILE_X, CL_SWIZZLE_9_10, x_9_10)
+DECL_TILING_COPY(CL_TILE_X, CL_SWIZZLE_9_11, x_9_11)
+DECL_TILING_COPY(CL_TILE_X, CL_SWIZZLE_9_10_11, x_9_10_11)
+DECL_TILING_COPY(CL_TILE_Y, CL_SWIZZLE_NONE, y)
+DECL_TILING_COPY(CL_TILE_Y, CL_SWIZZLE_9, y_9)
+DECL_TILING_COPY(CL_TILE_Y, CL_SWIZZLE_9_10, y_9_10)
+DECL_TILING_COPY(CL_TILE_Y, CL_SWIZZLE_9_11, y_9_11)
+DECL_TILING_COPY(CL_TILE_Y, CL_SWIZZLE_9_10_11, y_9_10_11)
+#undef DECL_TILING_COPY
+
+typedef void (cl_tiling_copy_cb)(char*, size_t, size_t, size_t, char*, size_t, size_t, size_t, int);
+
+static void
+cl_tiling_dispatch(char *tiled, size_t pitch,
+                   cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                   size_t x, size_t y, char *linear, size_t linear_pitch,
+                   size_t w, size_t h, int to_tiled)
+{
+  static cl_tiling_copy_cb *const x_copies[] = {
+    cl_tiling_copy_x, cl_tiling_copy_x, cl_tiling_copy_x_9, cl_tiling_copy_x_9_10,
+    cl_tiling_copy_x_9_11, cl_tiling_copy_x_9_10_11
+  };
+  static cl_tiling_copy_cb *const y_copies[] = {
+    cl_tiling_copy_y, cl_tiling_copy_y, cl_tiling_copy_y_9, cl_tiling_copy_y_9_10,
+    cl_tiling_copy_y_9_11, cl_tiling_copy_y_9_10_11
+  };
+
+  if (tiling == CL_TILE_X)
+    x_copies[swizzle](tiled, pitch, x, y, linear, linear_pitch, w, h, to_tiled);
+  else if (tiling == CL_TILE_Y)
+    y_copies[swizzle](tiled, pitch, x, y, linear, linear_pitch, w, h, to_tiled);
+  else
+    cl_tiling_copy_linear(tiled, pitch, x, y, linear, linear_pitch, w, h, to_tiled);
+}
+
+LOCAL void
+cl_tiling_tile(void *tiled, size_t pitch,
+               cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+               size_t x, size_t y,
+               const void *linear, size_t linear_pitch,
+               size_t w, size_t h)
+{
+  cl_tiling_dispatch((char *) tiled, pitch, tiling, swizzle, x, y,
+                     (char *) linear, linear_pitch, w, h, 1);
+}
+
+LOCAL void
+cl_tiling_untile(void *linear, size_t linear_pitch,
+                 const void *tiled, size_t pitch,
+                 cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                 size_t x, size_t y, size_t w, size_t h)
+{
+  cl_tiling_dispatch((char *) tiled, pitch, tiling, swizzle, x, y,
+                     (char *) linear, linear_pitch, w, h, 0);
+}
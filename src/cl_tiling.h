@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CL_TILING_H__
+#define __CL_TILING_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum cl_image_tiling {
+  CL_NO_TILE = 0,
+  CL_TILE_X  = 1,
+  CL_TILE_Y  = 2
+} cl_image_tiling_t;
+
+/* Address bits XORed into bit 6 by the memory controller. The GTT fences undo
+ * it for us but the CPU mappings see the swizzled layout. The modes using bit
+ * 17 depend on the physical pages and are left to the GTT (UNKNOWN)
+ */
+typedef enum cl_tiling_swizzle {
+  CL_SWIZZLE_UNKNOWN = 0,
+  CL_SWIZZLE_NONE,
+  CL_SWIZZLE_9,
+  CL_SWIZZLE_9_10,
+  CL_SWIZZLE_9_11,
+  CL_SWIZZLE_9_10_11
+} cl_tiling_swizzle_t;
+
+/* Tiles are 4KB: 512 bytes x 8 rows for X, 128 bytes x 32 rows for Y, the Y
+ * ones being made of 16 bytes wide columns
+ */
+enum {
+  CL_TILE_SZ = 4096,
+  CL_TILEX_W = 512,
+  CL_TILEX_H = 8,
+  CL_TILEY_W = 128,
+  CL_TILEY_H = 32
+};
+
+/* Offset of byte x of row y in a surface of pitch bytes per row */
+extern size_t cl_tiling_offset(cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                               size_t pitch, size_t x, size_t y);
+
+/* Copy w bytes x h rows from a linear layout to the (x, y) corner of a tiled
+ * surface
+ */
+extern void cl_tiling_tile(void *tiled, size_t pitch,
+                           cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                           size_t x, size_t y,
+                           const void *linear, size_t linear_pitch,
+                           size_t w, size_t h);
+
+/* Copy w bytes x h rows from the (x, y) corner of a tiled surface to a
+ * linear layout
+ */
+extern void cl_tiling_untile(void *linear, size_t linear_pitch,
+                             const void *tiled, size_t pitch,
+                             cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                             size_t x, size_t y, size_t w, size_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CL_TILING_H__ */
+
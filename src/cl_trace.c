@@ -0,0 +1,295 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cl_trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+  CL_TRACE_RING_SZ = 4096,     /* Spans formatted at once */
+  CL_TRACE_WALKER_SZ = 256,    /* Walkers waiting for their timestamps */
+  CL_TRACE_QUEUE_SZ = 64,      /* GPU lanes */
+  CL_TRACE_NAME_SZ = 48
+};
+
+/* The host spans are in the process lane, the GPU ones in a fake process */
+#define CL_TRACE_GPU_PID 0
+
+typedef struct cl_trace_record {
+  char name[CL_TRACE_NAME_SZ]; /* Kernel names do not outlive their kernel */
+  const char *cat;
+  uint64_t begin, end;         /* Host ns */
+  uint32_t pid, tid;
+} cl_trace_record;
+
+typedef struct cl_trace_walker {
+  cl_command_queue queue;
+  cl_gpgpu gpgpu;
+  cl_gpgpu_event event;        /* Keeps the timestamp buffer */
+  int submitted;
+  char name[CL_TRACE_NAME_SZ];
+} cl_trace_walker;
+
+LOCAL int cl_trace_state = -1;
+static pthread_once_t cl_trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t cl_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *cl_trace_file = NULL;
+static uint64_t cl_trace_t0 = 0;
+static int cl_trace_first = 1;
+static uint32_t cl_trace_pid = 0;
+static __thread uint32_t cl_trace_tid = 0;
+
+static cl_trace_record cl_trace_ring[CL_TRACE_RING_SZ];
+static uint32_t cl_trace_ring_n = 0;
+
+static cl_trace_walker cl_trace_walkers[CL_TRACE_WALKER_SZ];
+static uint32_t cl_trace_walker_n = 0;
+static uint32_t cl_trace_dropped_n = 0;
+
+/* The GPU lane of a queue is its index here */
+static cl_command_queue cl_trace_queues[CL_TRACE_QUEUE_SZ];
+static uint32_t cl_trace_queue_n = 0;
+
+/* GPU time + cl_trace_gpu_offset = host time */
+static int64_t cl_trace_gpu_offset = 0;
+static int cl_trace_gpu_calibrated = 0;
+
+LOCAL uint64_t
+cl_trace_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Called with the lock held */
+static void
+cl_trace_write_ring(void)
+{
+  uint32_t i;
+  for (i = 0; i < cl_trace_ring_n; ++i) {
+    const cl_trace_record *r = &cl_trace_ring[i];
+    const uint64_t begin = r->begin > cl_trace_t0 ? r->begin - cl_trace_t0 : 0;
+    const uint64_t end = r->end > r->begin ? r->end - r->begin : 0;
+    fprintf(cl_trace_file,
+            "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%u,\"tid\":%u}",
+            cl_trace_first ? "" : ",\n", r->name, r->cat,
+            begin * 1e-3, end * 1e-3, r->pid, r->tid);
+    cl_trace_first = 0;
+  }
+  cl_trace_ring_n = 0;
+}
+
+/* Called with the lock held */
+static void
+cl_trace_push(const char *name, const char *cat, uint64_t begin, uint64_t end,
+              uint32_t pid, uint32_t tid)
+{
+  cl_trace_record *r;
+
+  if (cl_trace_ring_n == CL_TRACE_RING_SZ)
+    cl_trace_write_ring();
+  r = &cl_trace_ring[cl_trace_ring_n++];
+  strncpy(r->name, name, CL_TRACE_NAME_SZ - 1);
+  r->name[CL_TRACE_NAME_SZ - 1] = '\0';
+  r->cat = cat;
+  r->begin = begin;
+  r->end = end;
+  r->pid = pid;
+  r->tid = tid;
+}
+
+static void
+cl_trace_close(void)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&cl_trace_lock);
+  cl_trace_write_ring();
+  fprintf(cl_trace_file,
+          "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"OpenCL host\"}},\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"GPU\"}}",
+          cl_trace_first ? "" : ",\n", cl_trace_pid, CL_TRACE_GPU_PID);
+  for (i = 0; i < cl_trace_queue_n; ++i)
+    fprintf(cl_trace_file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+            "\"args\":{\"name\":\"queue %u\"}}", CL_TRACE_GPU_PID, i, i);
+  fprintf(cl_trace_file, "\n]}\n");
+  if (cl_trace_dropped_n)
+    fprintf(stderr, "Beignet: %u walkers were not traced\n", cl_trace_dropped_n);
+  fclose(cl_trace_file);
+  cl_trace_file = NULL;
+  cl_trace_state = 0;
+  pthread_mutex_unlock(&cl_trace_lock);
+}
+
+static void
+cl_trace_setup(void)
+{
+  const char *path = getenv("OCL_TRACE");
+
+  if (path == NULL || *path == '\0' || strcmp(path, "0") == 0) {
+    cl_trace_state = 0;
+    return;
+  }
+  cl_trace_file = fopen(path, "w");
+  if (cl_trace_file == NULL) {
+    fprintf(stderr, "Beignet: cannot open the trace file %s\n", path);
+    cl_trace_state = 0;
+    return;
+  }
+  fprintf(cl_trace_file, "{\"traceEvents\":[\n");
+  cl_trace_pid = getpid();
+  cl_trace_t0 = cl_trace_now();
+  atexit(cl_trace_close);
+  cl_trace_state = 1;
+}
+
+LOCAL int
+cl_trace_init(void)
+{
+  pthread_once(&cl_trace_once, cl_trace_setup);
+  return cl_trace_state;
+}
+
+LOCAL void
+cl_trace_span(const char *name, const char *cat, uint64_t begin, uint64_t end)
+{
+  if (cl_trace_tid == 0)
+    cl_trace_tid = (uint32_t) syscall(SYS_gettid);
+  pthread_mutex_lock(&cl_trace_lock);
+  if (cl_trace_file)
+    cl_trace_push(name, cat, begin, end, cl_trace_pid, cl_trace_tid);
+  pthread_mutex_unlock(&cl_trace_lock);
+}
+
+/* Called with the lock held */
+static uint32_t
+cl_trace_queue_lane(cl_command_queue queue)
+{
+  uint32_t i;
+  for (i = 0; i < cl_trace_queue_n; ++i)
+    if (cl_trace_queues[i] == queue)
+      return i;
+  if (cl_trace_queue_n == CL_TRACE_QUEUE_SZ)
+    return CL_TRACE_QUEUE_SZ - 1;
+  cl_trace_queues[cl_trace_queue_n] = queue;
+  return cl_trace_queue_n++;
+}
+
+/* Called with the lock held. Add the span of the walker if it has run and
+ * release it
+ */
+static void
+cl_trace_walker_done(uint32_t i, int has_run)
+{
+  cl_trace_walker *w = &cl_trace_walkers[i];
+
+  if (has_run) {
+    uint64_t start = 0, end = 0;
+    cl_gpgpu_event_get_exec_timestamp(w->event, 0, &start);
+    cl_gpgpu_event_get_exec_timestamp(w->event, 1, &end);
+    if (start != 0 && end >= start && cl_trace_file)
+      cl_trace_push(w->name, "gpu", start + cl_trace_gpu_offset, end + cl_trace_gpu_offset,
+                    CL_TRACE_GPU_PID, cl_trace_queue_lane(w->queue));
+  }
+  cl_gpgpu_event_delete(w->event);
+  cl_trace_walkers[i] = cl_trace_walkers[--cl_trace_walker_n];
+}
+
+LOCAL void
+cl_trace_gpu_walker(cl_command_queue queue, cl_gpgpu gpgpu, const char *name)
+{
+  cl_trace_walker *w;
+  uint32_t i;
+
+  pthread_mutex_lock(&cl_trace_lock);
+  if (!cl_trace_gpu_calibrated) {
+    uint64_t gpu_now = 0;
+    cl_gpgpu_event_get_gpu_cur_timestamp(gpgpu, &gpu_now);
+    cl_trace_gpu_offset = (int64_t) cl_trace_now() - (int64_t) gpu_now;
+    cl_trace_gpu_calibrated = 1;
+  }
+
+  /* Make room with the walkers which completed, else drop one */
+  if (cl_trace_walker_n == CL_TRACE_WALKER_SZ) {
+    for (i = 0; i < cl_trace_walker_n;) {
+      cl_trace_walker *old = &cl_trace_walkers[i];
+      if (old->submitted && cl_gpgpu_event_update_status(old->event, 0) == command_complete)
+        cl_trace_walker_done(i, 1);
+      else
+        ++i;
+    }
+  }
+  if (cl_trace_walker_n == CL_TRACE_WALKER_SZ) {
+    cl_trace_walker_done(0, 0);
+    cl_trace_dropped_n++;
+  }
+
+  w = &cl_trace_walkers[cl_trace_walker_n];
+  w->event = cl_gpgpu_event_new(gpgpu);
+  if (w->event) {
+    w->queue = queue;
+    w->gpgpu = gpgpu;
+    w->submitted = 0;
+    strncpy(w->name, name ? name : "kernel", CL_TRACE_NAME_SZ - 1);
+    w->name[CL_TRACE_NAME_SZ - 1] = '\0';
+    cl_trace_walker_n++;
+  }
+  pthread_mutex_unlock(&cl_trace_lock);
+}
+
+LOCAL void
+cl_trace_gpu_submitted(cl_gpgpu gpgpu)
+{
+  uint32_t i;
+  pthread_mutex_lock(&cl_trace_lock);
+  for (i = 0; i < cl_trace_walker_n; ++i)
+    if (cl_trace_walkers[i].gpgpu == gpgpu)
+      cl_trace_walkers[i].submitted = 1;
+  pthread_mutex_unlock(&cl_trace_lock);
+}
+
+LOCAL void
+cl_trace_gpu_collect(cl_command_queue queue, cl_gpgpu gpgpu, int wait)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&cl_trace_lock);
+  for (i = 0; i < cl_trace_walker_n;) {
+    cl_trace_walker *w = &cl_trace_walkers[i];
+    if (w->queue != queue || (gpgpu != NULL && w->gpgpu != gpgpu)) {
+      ++i;
+      continue;
+    }
+    if (w->submitted && cl_gpgpu_event_update_status(w->event, wait) == command_complete)
+      cl_trace_walker_done(i, 1);
+    else if (wait && !w->submitted)
+      cl_trace_walker_done(i, 0);
+    else
+      ++i;
+  }
+  pthread_mutex_unlock(&cl_trace_lock);
+}
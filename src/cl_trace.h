@@ -0,0 +1,82 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CL_TRACE_H__
+#define __CL_TRACE_H__
+
+#include "cl_driver.h"
+#include "cl_utils.h"
+#include "CL/cl.h"
+
+#include <stdint.h>
+
+/* Timeline of the API calls, of the phases of the enqueues and of the GPU
+ * execution of the walkers in the chrome://tracing JSON format.
+ * OCL_TRACE=<file> enables it: the spans are kept in a ring written to the
+ * file each time it is full and at exit. Host spans get one lane per thread,
+ * GPU spans one lane per command queue
+ */
+extern int cl_trace_state; /* -1 until the environment is read, then 0 or 1 */
+
+/* Read OCL_TRACE and open the file. Return cl_trace_state */
+extern int cl_trace_init(void);
+
+static INLINE int
+cl_trace_enabled(void)
+{
+  return UNLIKELY(cl_trace_state < 0) ? cl_trace_init() : cl_trace_state;
+}
+
+/* Monotonic host time in ns */
+extern uint64_t cl_trace_now(void);
+
+/* Add the span [begin, end] of the calling thread */
+extern void cl_trace_span(const char *name, const char *cat, uint64_t begin, uint64_t end);
+
+/* Keep the timestamps of the NDRange just emitted by gpgpu until it completes */
+extern void cl_trace_gpu_walker(cl_command_queue queue, cl_gpgpu gpgpu, const char *name);
+
+/* The walkers emitted by gpgpu so far are submitted */
+extern void cl_trace_gpu_submitted(cl_gpgpu gpgpu);
+
+/* Add the spans of the completed walkers of the queue (of gpgpu only if not
+ * NULL). With wait, wait for the submitted ones and drop the other ones
+ */
+extern void cl_trace_gpu_collect(cl_command_queue queue, cl_gpgpu gpgpu, int wait);
+
+/* A span from the declaration to the end of the enclosing block */
+typedef struct cl_trace_scope {
+  const char *name;
+  const char *cat;
+  uint64_t begin;                    /* 0 when the tracer is disabled */
+} cl_trace_scope;
+
+static INLINE void
+cl_trace_scope_end(cl_trace_scope *scope)
+{
+  if (UNLIKELY(scope->begin != 0))
+    cl_trace_span(scope->name, scope->cat, scope->begin, cl_trace_now());
+}
+
+#define CL_TRACE_SCOPE(NAME, CAT)                                              \
+  cl_trace_scope __cl_trace_scope __attribute__((cleanup(cl_trace_scope_end))) = \
+    { NAME, CAT, cl_trace_enabled() ? cl_trace_now() : 0 }
+
+#define CL_TRACE_API() CL_TRACE_SCOPE(__func__, "api")
+
+#endif /* __CL_TRACE_H__ */
@@ -20,6 +20,9 @@
 #ifndef __CL_UTILS_H__
 #define __CL_UTILS_H__
 
+#include <limits.h>
+#include <stdlib.h>
+
 /* INLINE is forceinline */
 #define INLINE __attribute__((always_inline)) inline
 
@@ -255,6 +258,21 @@ do {                                                    \
 /* For all internal functions */
 #define LOCAL __attribute__ ((visibility ("internal")))
 
+/* Define FN returning the integer environment variable NAME. It is read by
+ * the first call, DEF is used when it is not set. The switches default to 1
+ * and are off with NAME=0
+ */
+#define DEFINE_ENV_INT(FN, NAME, DEF)                   \
+static int FN(void)                                     \
+{                                                       \
+  static int value = INT_MIN;                           \
+  if (value == INT_MIN) {                               \
+    const char *env = getenv(NAME);                     \
+    value = env ? atoi(env) : (DEF);                    \
+  }                                                     \
+  return value;                                         \
+}
+
 /* Align a structure or a variable */
 #define ALIGNED(X) __attribute__ ((aligned (X)))
 
@@ -0,0 +1,183 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cl_worker.h"
+#include "cl_alloc.h"
+#include "cl_utils.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+/* The worker running in this thread if any */
+static __thread cl_worker *current_worker = NULL;
+
+DEFINE_ENV_INT(cl_worker_enabled, "OCL_QUEUE_WORKER", 1)
+
+/* Bounded ring with one sequence number per slot: a producer owns a slot once
+ * it moved the tail past it, and publishes the command by bumping the slot
+ * sequence. Return false if the ring is full
+ */
+static cl_bool
+cl_worker_try_push(cl_worker *worker, enqueue_callback *cb)
+{
+  cl_worker_slot *slot;
+  uint32_t pos = worker->tail;
+
+  for (;;) {
+    slot = &worker->slots[pos % CL_WORKER_RING_SZ];
+    const int32_t dif = (int32_t) (slot->seq - pos);
+    if (dif == 0) {
+      if (__sync_bool_compare_and_swap(&worker->tail, pos, pos + 1))
+        break;
+      pos = worker->tail;
+    } else if (dif < 0)
+      return CL_FALSE;
+    else
+      pos = worker->tail;
+  }
+  slot->cb = cb;
+  __sync_synchronize();
+  slot->seq = pos + 1;
+  return CL_TRUE;
+}
+
+/* Only called by the worker. NULL if the next command is not published yet */
+static enqueue_callback*
+cl_worker_pop(cl_worker *worker)
+{
+  cl_worker_slot *slot = &worker->slots[worker->head % CL_WORKER_RING_SZ];
+  enqueue_callback *cb;
+
+  if ((int32_t) (slot->seq - (worker->head + 1)) < 0)
+    return NULL;
+  cb = slot->cb;
+  __sync_synchronize();
+  slot->seq = worker->head + CL_WORKER_RING_SZ;
+  worker->head++;
+  return cb;
+}
+
+/* One less pending command: wake up the threads waiting for the last one */
+static void
+cl_worker_done(cl_worker *worker)
+{
+  if (atomic_dec(&worker->pending_n) == 1) {
+    pthread_mutex_lock(&worker->idle_lock);
+    pthread_cond_broadcast(&worker->idle);
+    pthread_mutex_unlock(&worker->idle_lock);
+  }
+}
+
+static void*
+cl_worker_main(void *arg)
+{
+  cl_worker *worker = (cl_worker *) arg;
+  enqueue_callback *cb;
+
+  current_worker = worker;
+  for (;;) {
+    sem_wait(&worker->ready);
+    /* The post may come before the command is published */
+    while ((cb = cl_worker_pop(worker)) == NULL) {
+      if (worker->stop)
+        return NULL;
+      sched_yield();
+    }
+    cl_event_run_deferred(cb);
+    cl_worker_done(worker);
+  }
+  return NULL;
+}
+
+LOCAL cl_worker*
+cl_worker_new(void)
+{
+  cl_worker *worker = NULL;
+  uint32_t i;
+
+  if (!cl_worker_enabled())
+    return NULL;
+  TRY_ALLOC_NO_ERR (worker, CALLOC(cl_worker));
+  for (i = 0; i < CL_WORKER_RING_SZ; ++i)
+    worker->slots[i].seq = i;
+  sem_init(&worker->ready, 0, 0);
+  pthread_mutex_init(&worker->idle_lock, NULL);
+  pthread_cond_init(&worker->idle, NULL);
+  if (pthread_create(&worker->thread, NULL, cl_worker_main, worker) != 0)
+    goto error;
+
+exit:
+  return worker;
+error:
+  sem_destroy(&worker->ready);
+  pthread_mutex_destroy(&worker->idle_lock);
+  pthread_cond_destroy(&worker->idle);
+  cl_free(worker);
+  worker = NULL;
+  goto exit;
+}
+
+LOCAL void
+cl_worker_delete(cl_worker *worker)
+{
+  if (worker == NULL)
+    return;
+  assert(!cl_worker_is_self(worker));
+  cl_worker_wait_idle(worker);
+  worker->stop = 1;
+  sem_post(&worker->ready);
+  pthread_join(worker->thread, NULL);
+  sem_destroy(&worker->ready);
+  pthread_mutex_destroy(&worker->idle_lock);
+  pthread_cond_destroy(&worker->idle);
+  cl_free(worker);
+}
+
+LOCAL cl_bool
+cl_worker_is_self(const cl_worker *worker)
+{
+  return current_worker == worker;
+}
+
+LOCAL void
+cl_worker_push(cl_worker *worker, enqueue_callback *cb)
+{
+  atomic_inc(&worker->pending_n);
+  while (!cl_worker_try_push(worker, cb)) {
+    /* Two workers pushing to each other could wait forever */
+    if (current_worker != NULL) {
+      cl_event_run_deferred(cb);
+      cl_worker_done(worker);
+      return;
+    }
+    sched_yield();
+  }
+  sem_post(&worker->ready);
+}
+
+LOCAL void
+cl_worker_wait_idle(cl_worker *worker)
+{
+  if (cl_worker_is_self(worker))
+    return;
+  pthread_mutex_lock(&worker->idle_lock);
+  while (worker->pending_n != 0)
+    pthread_cond_wait(&worker->idle, &worker->idle_lock);
+  pthread_mutex_unlock(&worker->idle_lock);
+}
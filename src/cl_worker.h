@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CL_WORKER_H__
+#define __CL_WORKER_H__
+
+#include "cl_event.h"
+#include "cl_utils.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+/* A thread running the host side commands of a command queue (transfers, maps
+ * and unmaps). The commands are pushed in a ring by any thread (the one
+ * enqueuing them or the one completing their last dependency) and popped by
+ * the worker only
+ */
+enum { CL_WORKER_RING_SZ = 256 };
+
+typedef struct _cl_worker_slot {
+  volatile uint32_t seq;             /* Tells if the slot is free or filled */
+  enqueue_callback *cb;              /* The command to run */
+} cl_worker_slot;
+
+typedef struct _cl_worker {
+  pthread_t thread;
+  sem_t ready;                       /* Posted once per pushed command */
+  volatile uint32_t tail;            /* Next slot to fill */
+  uint32_t head;                     /* Next slot to run (worker only) */
+  cl_worker_slot slots[CL_WORKER_RING_SZ];
+  atomic_t pending_n;                /* Pushed and not run yet */
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle;               /* Signaled when pending_n drops to 0 */
+  volatile int stop;                 /* Set to leave once the ring is empty */
+} cl_worker;
+
+/* Start a worker thread. NULL if OCL_QUEUE_WORKER=0 or if it fails */
+extern cl_worker *cl_worker_new(void);
+
+/* Run the remaining commands and stop the thread */
+extern void cl_worker_delete(cl_worker *worker);
+
+/* Return true when called from the worker thread */
+extern cl_bool cl_worker_is_self(const cl_worker *worker);
+
+/* Hand the command over to the worker. From another worker, the command runs
+ * in place if the ring is full
+ */
+extern void cl_worker_push(cl_worker *worker, enqueue_callback *cb);
+
+/* Wait until all the pushed commands have run */
+extern void cl_worker_wait_idle(cl_worker *worker);
+
+#endif /* __CL_WORKER_H__ */
+
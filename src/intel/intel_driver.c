@@ -652,6 +652,32 @@ static int intel_buffer_set_tiling(cl_buffer bo,
   return ret;
 }
 
+static cl_buffer intel_buffer_alloc_userptr(cl_buffer_mgr bufmgr, const char *name,
+                                            void *ptr, size_t sz, unsigned long flags)
+{
+#ifdef HAS_USERPTR
+  return (cl_buffer)drm_intel_bo_alloc_userptr((drm_intel_bufmgr *)bufmgr, name, ptr,
+                                               I915_TILING_NONE, 0, sz, flags);
+#else
+  return NULL;
+#endif
+}
+
+static int intel_buffer_get_swizzle(cl_buffer bo)
+{
+  uint32_t intel_tiling, intel_swizzle_mode;
+  if (drm_intel_bo_get_tiling((drm_intel_bo*)bo, &intel_tiling, &intel_swizzle_mode) != 0)
+    return CL_SWIZZLE_UNKNOWN;
+  switch (intel_swizzle_mode) {
+    case I915_BIT_6_SWIZZLE_NONE: return CL_SWIZZLE_NONE;
+    case I915_BIT_6_SWIZZLE_9: return CL_SWIZZLE_9;
+    case I915_BIT_6_SWIZZLE_9_10: return CL_SWIZZLE_9_10;
+    case I915_BIT_6_SWIZZLE_9_11: return CL_SWIZZLE_9_11;
+    case I915_BIT_6_SWIZZLE_9_10_11: return CL_SWIZZLE_9_10_11;
+    default: return CL_SWIZZLE_UNKNOWN;
+  }
+}
+
 LOCAL void
 intel_setup_callbacks(void)
 {
@@ -661,7 +687,9 @@ intel_setup_callbacks(void)
   cl_driver_get_bufmgr = (cl_driver_get_bufmgr_cb *) intel_driver_get_bufmgr;
   cl_driver_get_device_id = (cl_driver_get_device_id_cb *) intel_get_device_id;
   cl_buffer_alloc = (cl_buffer_alloc_cb *) drm_intel_bo_alloc;
+  cl_buffer_alloc_userptr = (cl_buffer_alloc_userptr_cb *) intel_buffer_alloc_userptr;
   cl_buffer_set_tiling = (cl_buffer_set_tiling_cb *) intel_buffer_set_tiling;
+  cl_buffer_get_swizzle = (cl_buffer_get_swizzle_cb *) intel_buffer_get_swizzle;
 #if defined(HAS_EGL)
   cl_buffer_alloc_from_texture = (cl_buffer_alloc_from_texture_cb *) intel_alloc_buffer_from_texture;
   cl_buffer_release_from_texture = (cl_buffer_release_from_texture_cb *) intel_release_buffer_from_texture;
@@ -682,5 +710,7 @@ intel_setup_callbacks(void)
   cl_buffer_unpin = (cl_buffer_unpin_cb *) drm_intel_bo_unpin;
   cl_buffer_subdata = (cl_buffer_subdata_cb *) drm_intel_bo_subdata;
   cl_buffer_wait_rendering = (cl_buffer_wait_rendering_cb *) drm_intel_bo_wait_rendering;
+  cl_buffer_is_busy = (cl_buffer_is_busy_cb *) drm_intel_bo_busy;
+  cl_buffer_references = (cl_buffer_references_cb *) drm_intel_bo_references;
   intel_set_gpgpu_callbacks();
 }
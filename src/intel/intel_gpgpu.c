@@ -75,6 +75,26 @@ enum { max_img_n = 128};
 
 enum {max_sampler_n = 16 };
 
+/* Number of NDRanges accumulated in one batch buffer */
+enum { max_walker_n = 8 };
+
+/* Number of state buffer sets kept around. When a batch buffer is submitted,
+ * the sets of the previous one are the next to be recycled */
+enum { max_states_n = 2 * max_walker_n };
+
+/* Buffers written for each enqueue. They are recycled once the GPU retired the
+ * batch buffer which used them and they only grow
+ */
+typedef struct intel_gpgpu_states {
+  drm_intel_bo *batch;        /* batch buffer using the set (or NULL) */
+  drm_intel_bo *curbe;
+  drm_intel_bo *surface_heap;
+  drm_intel_bo *idrt;
+  drm_intel_bo *sampler_state;
+  drm_intel_bo *sampler_border_color_state;
+  drm_intel_bo *stack;
+} intel_gpgpu_states_t;
+
 /* Handle GPGPU state */
 struct intel_gpgpu
 {
@@ -92,6 +112,20 @@ struct intel_gpgpu
 
   unsigned long sampler_bitmap;          /* sampler usage bitmap. */
 
+  intel_gpgpu_states_t states[max_states_n]; /* ring of state buffer sets */
+  uint32_t states_index;                     /* set used by the current call */
+
+  uint32_t walker_n;           /* NDRanges in the pending batch buffer */
+  struct {
+    uint32_t use_slm;          /* L3 configuration */
+    uint32_t max_threads;      /* VFE state */
+    uint32_t per_thread_scratch;
+    drm_intel_bo *scratch;
+  } emitted;                   /* states already set by the pending batch */
+
+  /* The state buffers below (except perf, scratch, constant and time stamp)
+   * are owned by the current state set. The constant buffer is owned by the
+   * kernel */
   struct { drm_intel_bo *bo; } stack_b;
   struct { drm_intel_bo *bo; } idrt_b;
   struct { drm_intel_bo *bo; } surface_heap_b;
@@ -102,7 +136,7 @@ struct intel_gpgpu
   struct { drm_intel_bo *bo; } perf_b;
   struct { drm_intel_bo *bo; } scratch_b;
   struct { drm_intel_bo *bo; } constant_b;
-  struct { drm_intel_bo *bo; } time_stamp_b;  /* time stamp buffer */
+  struct { drm_intel_bo *bo; int started; } time_stamp_b;  /* time stamp buffer */
 
   uint32_t per_thread_scratch;
   struct {
@@ -137,34 +171,65 @@ static void intel_gpgpu_unref_batch_buf(void *buf)
     drm_intel_bo_unreference((drm_intel_bo *)buf);
 }
 
+static void
+intel_gpgpu_states_release(intel_gpgpu_states_t *states)
+{
+  if (states->batch)
+    drm_intel_bo_unreference(states->batch);
+  if (states->curbe)
+    drm_intel_bo_unreference(states->curbe);
+  if (states->surface_heap)
+    drm_intel_bo_unreference(states->surface_heap);
+  if (states->idrt)
+    drm_intel_bo_unreference(states->idrt);
+  if (states->sampler_state)
+    drm_intel_bo_unreference(states->sampler_state);
+  if (states->sampler_border_color_state)
+    drm_intel_bo_unreference(states->sampler_border_color_state);
+  if (states->stack)
+    drm_intel_bo_unreference(states->stack);
+  memset(states, 0, sizeof(*states));
+}
+
+/* Reuse the buffer of the state set if it is large enough. The relocations
+ * emitted by the previous call are dropped
+ */
+static drm_intel_bo*
+intel_gpgpu_states_bo(intel_gpgpu_t *gpgpu, drm_intel_bo **bo,
+                      const char *name, unsigned long size, unsigned int align)
+{
+  if (*bo && (*bo)->size >= size) {
+    drm_intel_gem_bo_clear_relocs(*bo, 0);
+    return *bo;
+  }
+  if (*bo)
+    drm_intel_bo_unreference(*bo);
+  *bo = drm_intel_bo_alloc(gpgpu->drv->bufmgr, name, size, align);
+  assert(*bo);
+  return *bo;
+}
+
+static void intel_gpgpu_flush(intel_gpgpu_t *gpgpu);
+
 static void
 intel_gpgpu_delete(intel_gpgpu_t *gpgpu)
 {
+  uint32_t i;
   if (gpgpu == NULL)
     return;
+  /* The accumulated NDRanges must still run */
+  if (gpgpu->batch && gpgpu->batch->buffer)
+    intel_gpgpu_flush(gpgpu);
   if(gpgpu->time_stamp_b.bo)
     drm_intel_bo_unreference(gpgpu->time_stamp_b.bo);
-  if (gpgpu->surface_heap_b.bo)
-    drm_intel_bo_unreference(gpgpu->surface_heap_b.bo);
-  if (gpgpu->idrt_b.bo)
-    drm_intel_bo_unreference(gpgpu->idrt_b.bo);
   if (gpgpu->vfe_state_b.bo)
     drm_intel_bo_unreference(gpgpu->vfe_state_b.bo);
-  if (gpgpu->curbe_b.bo)
-    drm_intel_bo_unreference(gpgpu->curbe_b.bo);
-  if (gpgpu->sampler_state_b.bo)
-    drm_intel_bo_unreference(gpgpu->sampler_state_b.bo);
-  if (gpgpu->sampler_border_color_state_b.bo)
-    drm_intel_bo_unreference(gpgpu->sampler_border_color_state_b.bo);
   if (gpgpu->perf_b.bo)
     drm_intel_bo_unreference(gpgpu->perf_b.bo);
-  if (gpgpu->stack_b.bo)
-    drm_intel_bo_unreference(gpgpu->stack_b.bo);
   if (gpgpu->scratch_b.bo)
     drm_intel_bo_unreference(gpgpu->scratch_b.bo);
-
-  if(gpgpu->constant_b.bo)
-    drm_intel_bo_unreference(gpgpu->constant_b.bo);
+  for (i = 0; i < max_states_n; ++i)
+    intel_gpgpu_states_release(&gpgpu->states[i]);
 
   intel_batchbuffer_delete(gpgpu->batch);
   cl_free(gpgpu);
@@ -359,12 +424,28 @@ intel_gpgpu_set_L3(intel_gpgpu_t *gpgpu, uint32_t use_slm)
 static void
 intel_gpgpu_batch_start(intel_gpgpu_t *gpgpu)
 {
+  const int vfe_changed = gpgpu->emitted.max_threads != gpgpu->max_threads ||
+                          gpgpu->emitted.per_thread_scratch != gpgpu->per_thread_scratch ||
+                          gpgpu->emitted.scratch != gpgpu->scratch_b.bo;
+
   intel_batchbuffer_start_atomic(gpgpu->batch, 256);
+  /* When appended to a pending batch buffer, the previous walker may produce
+   * what this one reads: the pipe control waits for it and flushes the data
+   * cache. The pipeline select and the unchanged states are not emitted again
+   */
   intel_gpgpu_pipe_control(gpgpu);
-  intel_gpgpu_set_L3(gpgpu, gpgpu->ker->use_slm);
-  intel_gpgpu_select_pipeline(gpgpu);
+  if (gpgpu->walker_n == 0 || gpgpu->emitted.use_slm != gpgpu->ker->use_slm)
+    intel_gpgpu_set_L3(gpgpu, gpgpu->ker->use_slm);
+  if (gpgpu->walker_n == 0)
+    intel_gpgpu_select_pipeline(gpgpu);
   intel_gpgpu_set_base_address(gpgpu);
-  intel_gpgpu_load_vfe_state(gpgpu);
+  if (gpgpu->walker_n == 0 || vfe_changed)
+    intel_gpgpu_load_vfe_state(gpgpu);
+  gpgpu->emitted.use_slm = gpgpu->ker->use_slm;
+  gpgpu->emitted.max_threads = gpgpu->max_threads;
+  gpgpu->emitted.per_thread_scratch = gpgpu->per_thread_scratch;
+  gpgpu->emitted.scratch = gpgpu->scratch_b.bo;
+  gpgpu->walker_n++;
   intel_gpgpu_load_curbe_buffer(gpgpu);
   intel_gpgpu_load_idrt(gpgpu);
 
@@ -382,9 +463,11 @@ intel_gpgpu_batch_start(intel_gpgpu_t *gpgpu)
     ADVANCE_BATCH(gpgpu->batch);
   }
 
-  /* Insert PIPE_CONTROL for time stamp of start*/
-  if (gpgpu->time_stamp_b.bo)
+  /* Insert PIPE_CONTROL for time stamp of start (first walker only) */
+  if (gpgpu->time_stamp_b.bo && !gpgpu->time_stamp_b.started) {
     intel_gpgpu_write_timestamp(gpgpu, 0);
+    gpgpu->time_stamp_b.started = 1;
+  }
 }
 
 static void
@@ -416,7 +499,23 @@ intel_gpgpu_batch_end(intel_gpgpu_t *gpgpu, int32_t flush_mode)
 static void
 intel_gpgpu_batch_reset(intel_gpgpu_t *gpgpu, size_t sz)
 {
-  intel_batchbuffer_reset(gpgpu->batch, sz);
+  intel_gpgpu_states_t *states = &gpgpu->states[gpgpu->states_index];
+
+  /* Append to the pending batch buffer while there is room for the call */
+  if (gpgpu->batch->buffer == NULL ||
+      gpgpu->walker_n >= max_walker_n ||
+      intel_batchbuffer_space(gpgpu->batch) < 2 * sz) {
+    /* The buffers bound so far are the ones of this call: not checked */
+    intel_gpgpu_submit(gpgpu);
+    intel_batchbuffer_reset(gpgpu->batch, sz * max_walker_n);
+    gpgpu->walker_n = 0;
+  }
+
+  /* The state set is busy as long as this batch buffer is */
+  if (states->batch)
+    drm_intel_bo_unreference(states->batch);
+  states->batch = gpgpu->batch->buffer;
+  drm_intel_bo_reference(states->batch);
 }
 /* check we do not get a 0 starting address for binded buf */
 static void
@@ -427,11 +526,24 @@ intel_gpgpu_check_binded_buf_address(intel_gpgpu_t *gpgpu)
     assert(gpgpu->binded_buf[i]->offset != 0);
 }
 
+/* Submit the pending batch buffer */
 static void
-intel_gpgpu_flush(intel_gpgpu_t *gpgpu)
+intel_gpgpu_submit(intel_gpgpu_t *gpgpu)
 {
+  /* Nothing pending */
+  if (gpgpu->batch->buffer == NULL)
+    return;
+  gpgpu->walker_n = 0;
   intel_batchbuffer_emit_mi_flush(gpgpu->batch);
   intel_batchbuffer_flush(gpgpu->batch);
+}
+
+static void
+intel_gpgpu_flush(intel_gpgpu_t *gpgpu)
+{
+  if (gpgpu->batch->buffer == NULL)
+    return;
+  intel_gpgpu_submit(gpgpu);
   intel_gpgpu_check_binded_buf_address(gpgpu);
 }
 
@@ -441,7 +553,7 @@ intel_gpgpu_state_init(intel_gpgpu_t *gpgpu,
                        uint32_t size_cs_entry,
                        int profiling)
 {
-  drm_intel_bufmgr *bufmgr = gpgpu->drv->bufmgr;
+  intel_gpgpu_states_t *states = NULL;
   drm_intel_bo *bo;
 
   /* Binded buffers */
@@ -455,46 +567,55 @@ intel_gpgpu_state_init(intel_gpgpu_t *gpgpu,
   gpgpu->urb.size_cs_entry = size_cs_entry;
   gpgpu->max_threads = max_threads;
 
-  /* Set the profile buffer*/
-  if(gpgpu->time_stamp_b.bo)
-    dri_bo_unreference(gpgpu->time_stamp_b.bo);
-  gpgpu->time_stamp_b.bo = NULL;
-  if (profiling) {
-    bo = dri_bo_alloc(gpgpu->drv->bufmgr, "timestamp query", 4096, 4096);
-    assert(bo);
-    gpgpu->time_stamp_b.bo = bo;
+  /* Set the profile buffer. Events keep a reference on it so it is not
+   * recycled. The walkers of one NDRange share it */
+  if (profiling != GPGPU_PROFILING_KEEP || gpgpu->time_stamp_b.bo == NULL) {
+    if(gpgpu->time_stamp_b.bo)
+      dri_bo_unreference(gpgpu->time_stamp_b.bo);
+    gpgpu->time_stamp_b.bo = NULL;
+    gpgpu->time_stamp_b.started = 0;
+    if (profiling != GPGPU_NO_PROFILING) {
+      bo = dri_bo_alloc(gpgpu->drv->bufmgr, "timestamp query", 4096, 4096);
+      assert(bo);
+      gpgpu->time_stamp_b.bo = bo;
+    }
+  }
+
+  /* Take the oldest state set. If the GPU still uses it, we give it up (the
+   * kernel keeps its buffers alive until the batch is retired) and start a
+   * new one rather than waiting
+   */
+  gpgpu->states_index = (gpgpu->states_index + 1) % max_states_n;
+  states = &gpgpu->states[gpgpu->states_index];
+  if (states->batch && states->batch == gpgpu->batch->buffer)
+    intel_gpgpu_flush(gpgpu);
+  if (states->batch) {
+    if (drm_intel_bo_busy(states->batch))
+      intel_gpgpu_states_release(states);
+    else {
+      drm_intel_bo_unreference(states->batch);
+      states->batch = NULL;
+    }
   }
 
   /* Constant URB  buffer */
-  if(gpgpu->curbe_b.bo)
-    dri_bo_unreference(gpgpu->curbe_b.bo);
   uint32_t size_cb = gpgpu->urb.num_cs_entries * gpgpu->urb.size_cs_entry * 64;
   size_cb = ALIGN(size_cb, 4096);
-  bo = dri_bo_alloc(gpgpu->drv->bufmgr, "CURBE_BUFFER", size_cb, 64);
-  assert(bo);
-  gpgpu->curbe_b.bo = bo;
-
-  /* surface state */
-  if(gpgpu->surface_heap_b.bo)
-    dri_bo_unreference(gpgpu->surface_heap_b.bo);
-  bo = dri_bo_alloc(bufmgr,
-                    "SURFACE_HEAP",
-                    sizeof(surface_heap_t),
-                    32);
-  assert(bo);
+  gpgpu->curbe_b.bo =
+    intel_gpgpu_states_bo(gpgpu, &states->curbe, "CURBE_BUFFER", size_cb, 64);
+
+  /* surface state. Only the binding table needs to be cleared, the surface
+   * states are fully written when binded */
+  bo = intel_gpgpu_states_bo(gpgpu, &states->surface_heap,
+                             "SURFACE_HEAP", sizeof(surface_heap_t), 32);
   dri_bo_map(bo, 1);
-  memset(bo->virtual, 0, sizeof(surface_heap_t));
+  memset(bo->virtual, 0, sizeof(((surface_heap_t*)0)->binding_table));
   gpgpu->surface_heap_b.bo = bo;
 
   /* Interface descriptor remap table */
-  if(gpgpu->idrt_b.bo)
-    dri_bo_unreference(gpgpu->idrt_b.bo);
-  bo = dri_bo_alloc(bufmgr,
-                    "IDRT",
-                    MAX_IF_DESC * sizeof(struct gen6_interface_descriptor),
-                    32);
-  assert(bo);
-  gpgpu->idrt_b.bo = bo;
+  gpgpu->idrt_b.bo =
+    intel_gpgpu_states_bo(gpgpu, &states->idrt, "IDRT",
+                          MAX_IF_DESC * sizeof(struct gen6_interface_descriptor), 32);
 
   /* vfe state */
   if(gpgpu->vfe_state_b.bo)
@@ -502,32 +623,22 @@ intel_gpgpu_state_init(intel_gpgpu_t *gpgpu,
   gpgpu->vfe_state_b.bo = NULL;
 
   /* sampler state */
-  if (gpgpu->sampler_state_b.bo)
-    dri_bo_unreference(gpgpu->sampler_state_b.bo);
-  bo = dri_bo_alloc(gpgpu->drv->bufmgr,
-                    "SAMPLER_STATE",
-                    GEN_MAX_SAMPLERS * sizeof(gen6_sampler_state_t),
-                    32);
-  assert(bo);
+  bo = intel_gpgpu_states_bo(gpgpu, &states->sampler_state, "SAMPLER_STATE",
+                             GEN_MAX_SAMPLERS * sizeof(gen6_sampler_state_t), 32);
   dri_bo_map(bo, 1);
   memset(bo->virtual, 0, sizeof(gen6_sampler_state_t) * GEN_MAX_SAMPLERS);
   gpgpu->sampler_state_b.bo = bo;
 
   /* sampler border color state */
-  if (gpgpu->sampler_border_color_state_b.bo)
-    dri_bo_unreference(gpgpu->sampler_border_color_state_b.bo);
-  bo = dri_bo_alloc(gpgpu->drv->bufmgr,
-                    "SAMPLER_BORDER_COLOR_STATE",
-                    sizeof(gen7_sampler_border_color_t),
-                    32);
-  assert(bo);
+  bo = intel_gpgpu_states_bo(gpgpu, &states->sampler_border_color_state,
+                             "SAMPLER_BORDER_COLOR_STATE",
+                             sizeof(gen7_sampler_border_color_t), 32);
   dri_bo_map(bo, 1);
   memset(bo->virtual, 0, sizeof(gen7_sampler_border_color_t));
   gpgpu->sampler_border_color_state_b.bo = bo;
 
-  /* stack */
-  if (gpgpu->stack_b.bo)
-    dri_bo_unreference(gpgpu->stack_b.bo);
+  /* constant buffer and stack are only set if the kernel needs them */
+  gpgpu->constant_b.bo = NULL;
   gpgpu->stack_b.bo = NULL;
 }
 
@@ -546,8 +657,8 @@ intel_gpgpu_set_buf_reloc_gen7(intel_gpgpu_t *gpgpu, int32_t index, dri_bo* obj_
                     obj_bo);
 }
 
-static dri_bo*
-intel_gpgpu_alloc_constant_buffer(intel_gpgpu_t *gpgpu, uint32_t size)
+static void
+intel_gpgpu_bind_constant_buffer(intel_gpgpu_t *gpgpu, drm_intel_bo *bo, uint32_t size)
 {
   uint32_t s = size - 1;
   assert(size != 0);
@@ -563,10 +674,7 @@ intel_gpgpu_alloc_constant_buffer(intel_gpgpu_t *gpgpu, uint32_t size)
   ss2->ss5.cache_control = cc_llc_l3;
   heap->binding_table[2] = offsetof(surface_heap_t, surface) + 2* sizeof(gen7_surface_state_t);
 
-  if(gpgpu->constant_b.bo)
-    dri_bo_unreference(gpgpu->constant_b.bo);
-  gpgpu->constant_b.bo = drm_intel_bo_alloc(gpgpu->drv->bufmgr, "CONSTANT_BUFFER", s, 64);
-  assert(gpgpu->constant_b.bo);
+  gpgpu->constant_b.bo = bo;
   ss2->ss1.base_addr = gpgpu->constant_b.bo->offset;
   dri_bo_emit_reloc(gpgpu->surface_heap_b.bo,
                       I915_GEM_DOMAIN_RENDER,
@@ -575,7 +683,6 @@ intel_gpgpu_alloc_constant_buffer(intel_gpgpu_t *gpgpu, uint32_t size)
                       heap->binding_table[2] +
                       offsetof(gen7_surface_state_t, ss1),
                       gpgpu->constant_b.bo);
-  return gpgpu->constant_b.bo;
 }
 
 
@@ -691,8 +798,9 @@ intel_gpgpu_set_scratch(intel_gpgpu_t * gpgpu, uint32_t per_thread_size)
 static void
 intel_gpgpu_set_stack(intel_gpgpu_t *gpgpu, uint32_t offset, uint32_t size, uint32_t cchint)
 {
-  drm_intel_bufmgr *bufmgr = gpgpu->drv->bufmgr;
-  gpgpu->stack_b.bo = drm_intel_bo_alloc(bufmgr, "STACK", size, 64);
+  gpgpu->stack_b.bo =
+    intel_gpgpu_states_bo(gpgpu, &gpgpu->states[gpgpu->states_index].stack,
+                          "STACK", size, 64);
   intel_gpgpu_bind_buf(gpgpu, gpgpu->stack_b.bo, offset, 0, cchint);
 }
 
@@ -932,15 +1040,10 @@ static void
 intel_gpgpu_walker(intel_gpgpu_t *gpgpu,
                    uint32_t simd_sz,
                    uint32_t thread_n,
-                   const size_t global_wk_off[3],
-                   const size_t global_wk_sz[3],
+                   const size_t group_off[3],
+                   const size_t group_n[3],
                    const size_t local_wk_sz[3])
 {
-  const uint32_t global_wk_dim[3] = {
-    global_wk_sz[0] / local_wk_sz[0],
-    global_wk_sz[1] / local_wk_sz[1],
-    global_wk_sz[2] / local_wk_sz[2]
-  };
   uint32_t right_mask = ~0x0;
   size_t group_sz = local_wk_sz[0] * local_wk_sz[1] * local_wk_sz[2];
 
@@ -957,12 +1060,13 @@ intel_gpgpu_walker(intel_gpgpu_t *gpgpu,
     OUT_BATCH(gpgpu->batch, (1 << 30) | (thread_n-1)); /* SIMD16 | thread max */
   else
     OUT_BATCH(gpgpu->batch, (0 << 30) | (thread_n-1)); /* SIMD8  | thread max */
-  OUT_BATCH(gpgpu->batch, 0);
-  OUT_BATCH(gpgpu->batch, global_wk_dim[0]);
-  OUT_BATCH(gpgpu->batch, 0);
-  OUT_BATCH(gpgpu->batch, global_wk_dim[1]);
-  OUT_BATCH(gpgpu->batch, 0);
-  OUT_BATCH(gpgpu->batch, global_wk_dim[2]);
+  /* The group IDs go from the starting ones to the dimensions excluded */
+  OUT_BATCH(gpgpu->batch, group_off[0]);
+  OUT_BATCH(gpgpu->batch, group_off[0] + group_n[0]);
+  OUT_BATCH(gpgpu->batch, group_off[1]);
+  OUT_BATCH(gpgpu->batch, group_off[1] + group_n[1]);
+  OUT_BATCH(gpgpu->batch, group_off[2]);
+  OUT_BATCH(gpgpu->batch, group_off[2] + group_n[2]);
   OUT_BATCH(gpgpu->batch, right_mask);
   OUT_BATCH(gpgpu->batch, ~0x0);                     /* we always set height as 1, so set bottom mask as all 1*/
   ADVANCE_BATCH(gpgpu->batch);
@@ -1035,6 +1139,16 @@ intel_gpgpu_event_pending(intel_gpgpu_t *gpgpu, intel_event_t *event)
   *event->batch = *gpgpu->batch;
   if(event->batch->buffer)
     drm_intel_bo_reference(event->batch->buffer);
+
+  /* The batch buffer now belongs to the event, the next calls start a new one.
+   * Its state buffers are not recycled either since we do not know when it is
+   * submitted (its relocations keep them alive) */
+  if (gpgpu->batch->buffer)
+    drm_intel_bo_unreference(gpgpu->batch->buffer);
+  gpgpu->batch->buffer = NULL;
+  gpgpu->batch->map = gpgpu->batch->ptr = NULL;
+  gpgpu->walker_n = 0;
+  intel_gpgpu_states_release(&gpgpu->states[gpgpu->states_index]);
 }
 
 static void
@@ -1108,7 +1222,7 @@ intel_set_gpgpu_callbacks(void)
   cl_gpgpu_state_init = (cl_gpgpu_state_init_cb *) intel_gpgpu_state_init;
   cl_gpgpu_set_perf_counters = (cl_gpgpu_set_perf_counters_cb *) intel_gpgpu_set_perf_counters;
   cl_gpgpu_upload_curbes = (cl_gpgpu_upload_curbes_cb *) intel_gpgpu_upload_curbes;
-  cl_gpgpu_alloc_constant_buffer  = (cl_gpgpu_alloc_constant_buffer_cb *) intel_gpgpu_alloc_constant_buffer;
+  cl_gpgpu_bind_constant_buffer  = (cl_gpgpu_bind_constant_buffer_cb *) intel_gpgpu_bind_constant_buffer;
   cl_gpgpu_states_setup = (cl_gpgpu_states_setup_cb *) intel_gpgpu_states_setup;
   cl_gpgpu_upload_samplers = (cl_gpgpu_upload_samplers_cb *) intel_gpgpu_upload_samplers;
   cl_gpgpu_batch_reset = (cl_gpgpu_batch_reset_cb *) intel_gpgpu_batch_reset;
@@ -0,0 +1,39 @@
+/* Copy of region1 x region2 rows of region0 bytes, a linear copy being a
+ * single row. Each lane writes one 16 bytes aligned chunk of a destination
+ * row: the chunks fully inside the row are stored at once from 4 dwords of the
+ * source, shifted and merged with the next one when the source is not dword
+ * aligned at the same place, the head and tail chunks are copied byte by byte
+ */
+kernel void __cl_cpy_region_unalign ( global char* src, unsigned int src_offset,
+                                      global char* dst, unsigned int dst_offset,
+                                      unsigned int region0, unsigned int region1,
+                                      unsigned int region2,
+                                      unsigned int src_row_pitch, unsigned int src_slice_pitch,
+                                      unsigned int dst_row_pitch, unsigned int dst_slice_pitch)
+{
+    unsigned int j = get_global_id(1);
+    unsigned int k = get_global_id(2);
+    if (j >= region1 || k >= region2)
+        return;
+
+    unsigned int src_begin = src_offset + k * src_slice_pitch + j * src_row_pitch;
+    unsigned int dst_begin = dst_offset + k * dst_slice_pitch + j * dst_row_pitch;
+    unsigned int dst_end = dst_begin + region0;
+    unsigned int d = ((dst_begin >> 4) + get_global_id(0)) << 4;
+    if (d >= dst_end)
+        return;
+
+    if (d >= dst_begin && d + 16 <= dst_end) {
+        unsigned int s = d - dst_begin + src_begin;
+        unsigned int shift = (s & 3) * 8;
+        global uint* words = (global uint*)(src + (s & ~3));
+        uint4 v = vload4(0, words);
+        if (shift)
+            v = (v >> shift) | ((uint4)(v.yzw, words[4]) << (32 - shift));
+        *(global uint4*)(dst + d) = v;
+    } else {
+        unsigned int end = min(d + 16, dst_end);
+        for (unsigned int i = max(d, dst_begin); i < end; i++)
+            dst[i] = src[i - dst_begin + src_begin];
+    }
+}
@@ -0,0 +1,26 @@
+kernel void __cl_fill_region_align128 ( global uint4* dst, unsigned int offset,
+                                        unsigned int size,
+                                        uint4 pattern0, uint4 pattern1,
+                                        uint4 pattern2, uint4 pattern3,
+                                        uint4 pattern4, uint4 pattern5,
+                                        uint4 pattern6, uint4 pattern7,
+                                        unsigned int pattern_n)
+{
+    /* One lane per pattern of 2, 4 or 8 uint4 */
+    int i = get_global_id(0);
+    if (i < size) {
+        global uint4* p = dst + offset + i * pattern_n;
+        p[0] = pattern0;
+        p[1] = pattern1;
+        if (pattern_n > 2) {
+            p[2] = pattern2;
+            p[3] = pattern3;
+        }
+        if (pattern_n > 4) {
+            p[4] = pattern4;
+            p[5] = pattern5;
+            p[6] = pattern6;
+            p[7] = pattern7;
+        }
+    }
+}
@@ -0,0 +1,7 @@
+kernel void __cl_fill_region_align16 ( global uint4* dst, unsigned int offset,
+                                       unsigned int size, uint4 pattern)
+{
+    int i = get_global_id(0);
+    if (i < size)
+        dst[i+offset] = pattern;
+}
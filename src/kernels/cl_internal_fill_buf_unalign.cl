@@ -0,0 +1,18 @@
+kernel void __cl_fill_region_unalign ( global char* dst, unsigned int offset,
+                                       unsigned int size, uint4 pattern)
+{
+    /* One lane per 16 bytes chunk of the buffer: the inner ones are stored at
+     * once, the two at the edges of the region byte by byte */
+    unsigned int begin = (get_global_id(0) + (offset >> 4)) << 4;
+    unsigned int end = offset + size;
+    if (begin >= end)
+        return;
+    if (begin >= offset && begin + 16 <= end) {
+        *(global uint4*)(dst + begin) = pattern;
+    } else {
+        char bytes[16];
+        vstore16(as_char16(pattern), 0, bytes);
+        for (unsigned int i = max(begin, offset); i < min(begin + 16, end); i++)
+            dst[i] = bytes[i & 15];
+    }
+}
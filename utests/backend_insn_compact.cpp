@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Check the compaction of instruction streams which end with an EOT send
+ * after an odd or even number of compacted instructions. No device is needed
+ */
+#include "backend/gen_insn_compact.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+static int status = 0;
+
+#define CHECK(COND) do {                                          \
+  if (!(COND)) {                                                  \
+    fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #COND); \
+    status = 1;                                                   \
+  }                                                               \
+} while (0)
+
+/* A mov built from its compacted form, so that it compacts back */
+static GenInstruction
+compactable_mov(uint32_t dst, uint32_t src)
+{
+  GenCompactInstruction compact;
+  GenInstruction insn;
+  memset(&compact, 0, sizeof(compact));
+  compact.bits1.opcode = GEN_OPCODE_MOV;
+  compact.bits1.control_index = 1;
+  compact.bits1.cmpt_control = 1;
+  compact.bits2.dest_reg_nr = dst;
+  compact.bits2.src0_reg_nr = src;
+  gbe::decompactInstruction(compact, insn);
+  return insn;
+}
+
+/* send (8) null r112 with the end of thread bit, as GenEncoder::EOT */
+static GenInstruction
+eot(void)
+{
+  GenInstruction insn;
+  memset(&insn, 0, sizeof(insn));
+  insn.header.opcode = GEN_OPCODE_SEND;
+  insn.header.execution_size = GEN_WIDTH_8;
+  insn.bits1.da1.src1_reg_file = GEN_IMMEDIATE_VALUE;
+  insn.bits3.generic_gen5.msg_length = 1;
+  insn.bits3.generic_gen5.end_of_thread = 1;
+  return insn;
+}
+
+static void
+check_stream(uint32_t before_n)
+{
+  gbe::vector<GenInstruction> insns;
+  gbe::vector<GenCompactInstruction> code;
+  gbe::vector<uint32_t> offsets;
+  GenCompactInstruction tmp;
+
+  for (uint32_t i = 0; i < before_n; ++i)
+    insns.push_back(compactable_mov(i + 1, i + 2));
+  insns.push_back(compactable_mov(112, 0)); /* As GenContext::emitEotInstruction */
+  insns.push_back(eot());
+  insns.push_back(compactable_mov(3, 4));   /* Code after the EOT (other blocks) */
+  const uint32_t eot_id = insns.size() - 2;
+
+  CHECK(gbe::compactInstruction(insns[0], tmp));
+  CHECK(!gbe::compactInstruction(insns[eot_id], tmp));
+  const uint32_t compact_n = gbe::compactInstructionStream(insns, code, offsets);
+  CHECK(compact_n == before_n + 2);
+  CHECK(code.size() % 2 == 0);
+
+  /* The send starts on 16 bytes, after a compacted NOP if needed */
+  CHECK(offsets[eot_id] % 2 == 0);
+  CHECK(offsets[eot_id] == before_n + 1 + (before_n + 1) % 2);
+  if (offsets[eot_id] != offsets[eot_id - 1] + 1) {
+    CHECK(gbe::isCompacted(&code[offsets[eot_id] - 1]));
+    CHECK(code[offsets[eot_id] - 1].bits1.opcode == GEN_OPCODE_NOP);
+  }
+  CHECK(memcmp(&code[offsets[eot_id]], &insns[eot_id], sizeof(GenInstruction)) == 0);
+
+  /* All the other instructions decompact to what was emitted */
+  for (uint32_t i = 0; i < insns.size(); ++i) {
+    GenInstruction native;
+    if (i == eot_id)
+      continue;
+    CHECK(gbe::isCompacted(&code[offsets[i]]));
+    gbe::decompactInstruction(code[offsets[i]], native);
+    CHECK(memcmp(&native, &insns[i], sizeof(native)) == 0);
+  }
+}
+
+int main(void)
+{
+  for (uint32_t n = 0; n < 6; ++n)
+    check_stream(n);
+  printf("instruction compaction check: %s\n", status ? "failed" : "passed");
+  return status;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Check the NoDDClr / NoDDChk hints set on hand built instruction streams.
+ * No device is needed
+ */
+#include "backend/gen_insn_peephole.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+static int status = 0;
+
+#define CHECK(COND) do {                                          \
+  if (!(COND)) {                                                  \
+    fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #COND); \
+    status = 1;                                                   \
+  }                                                               \
+} while (0)
+
+/* mov (width) r<nr>.<subnr><hstride>:ud imm */
+static GenInstruction
+mov_imm(uint32_t width, uint32_t nr, uint32_t subnr, uint32_t hstride)
+{
+  GenInstruction insn;
+  memset(&insn, 0, sizeof(insn));
+  insn.header.opcode = GEN_OPCODE_MOV;
+  insn.header.access_mode = GEN_ALIGN_1;
+  insn.header.execution_size = width;
+  insn.bits1.da1.dest_reg_file = GEN_GENERAL_REGISTER_FILE;
+  insn.bits1.da1.dest_reg_type = GEN_TYPE_UD;
+  insn.bits1.da1.dest_horiz_stride = hstride;
+  insn.bits1.da1.dest_subreg_nr = subnr * 4;
+  insn.bits1.da1.dest_reg_nr = nr;
+  insn.bits1.da1.src0_reg_file = GEN_IMMEDIATE_VALUE;
+  insn.bits1.da1.src0_reg_type = GEN_TYPE_UD;
+  insn.bits1.da1.src1_reg_file = GEN_IMMEDIATE_VALUE;
+  return insn;
+}
+
+/* add (1) r<nr>.<subnr>:ud r<src_nr>.<src_subnr><0,1,0>:ud imm */
+static GenInstruction
+add_scalar(uint32_t nr, uint32_t subnr, uint32_t src_nr, uint32_t src_subnr)
+{
+  GenInstruction insn = mov_imm(GEN_WIDTH_1, nr, subnr, GEN_HORIZONTAL_STRIDE_1);
+  insn.header.opcode = GEN_OPCODE_ADD;
+  insn.bits1.da1.src0_reg_file = GEN_GENERAL_REGISTER_FILE;
+  insn.bits2.da1.src0_subreg_nr = src_subnr * 4;
+  insn.bits2.da1.src0_reg_nr = src_nr;
+  insn.bits2.da1.src0_vert_stride = GEN_VERTICAL_STRIDE_0;
+  insn.bits2.da1.src0_width = GEN_WIDTH_1;
+  insn.bits2.da1.src0_horiz_stride = GEN_HORIZONTAL_STRIDE_0;
+  return insn;
+}
+
+/* jmpi over jump instructions (in units of 64 bits as the encoder does) */
+static GenInstruction
+jmpi(int32_t jump)
+{
+  GenInstruction insn;
+  memset(&insn, 0, sizeof(insn));
+  insn.header.opcode = GEN_OPCODE_JMPI;
+  insn.bits1.da1.src1_reg_file = GEN_IMMEDIATE_VALUE;
+  insn.bits3.d = jump * 2;
+  return insn;
+}
+
+static uint32_t
+hint(const gbe::vector<GenInstruction> &insns, uint32_t insnID)
+{
+  return insns[insnID].header.dependency_control;
+}
+
+/* A payload built one dword at a time is one chain */
+static void
+check_payload(void)
+{
+  gbe::vector<GenInstruction> insns;
+  for (uint32_t i = 0; i < 4; ++i)
+    insns.push_back(mov_imm(GEN_WIDTH_1, 10, i, GEN_HORIZONTAL_STRIDE_1));
+  CHECK(gbe::setDependencyControl(insns) == 3);
+  CHECK(hint(insns, 0) == GEN_DEPENDENCY_NOTCLEARED);
+  CHECK(hint(insns, 1) == (GEN_DEPENDENCY_NOTCLEARED | GEN_DEPENDENCY_NOTCHECKED));
+  CHECK(hint(insns, 2) == (GEN_DEPENDENCY_NOTCLEARED | GEN_DEPENDENCY_NOTCHECKED));
+  CHECK(hint(insns, 3) == GEN_DEPENDENCY_NOTCHECKED);
+}
+
+/* The low and high halves of 64 bits values, over two GRFs */
+static void
+check_64bits_halves(void)
+{
+  gbe::vector<GenInstruction> insns;
+  insns.push_back(mov_imm(GEN_WIDTH_8, 20, 0, GEN_HORIZONTAL_STRIDE_2));
+  insns.push_back(mov_imm(GEN_WIDTH_8, 20, 1, GEN_HORIZONTAL_STRIDE_2));
+  CHECK(gbe::setDependencyControl(insns) == 1);
+  CHECK(hint(insns, 0) == GEN_DEPENDENCY_NOTCLEARED);
+  CHECK(hint(insns, 1) == GEN_DEPENDENCY_NOTCHECKED);
+}
+
+/* A write reaching a GRF the first one did not write is checked: it starts
+ * a new chain
+ */
+static void
+check_growing_span(void)
+{
+  gbe::vector<GenInstruction> insns;
+  insns.push_back(mov_imm(GEN_WIDTH_1, 30, 0, GEN_HORIZONTAL_STRIDE_1));
+  insns.push_back(mov_imm(GEN_WIDTH_8, 30, 1, GEN_HORIZONTAL_STRIDE_2));
+  insns.push_back(mov_imm(GEN_WIDTH_8, 30, 0, GEN_HORIZONTAL_STRIDE_2));
+  CHECK(gbe::setDependencyControl(insns) == 1);
+  CHECK(hint(insns, 0) == GEN_DEPENDENCY_NORMAL);
+  CHECK(hint(insns, 1) == GEN_DEPENDENCY_NOTCLEARED);
+  CHECK(hint(insns, 2) == GEN_DEPENDENCY_NOTCHECKED);
+}
+
+/* Reading the chain registers in between needs the scoreboard */
+static void
+check_read_between(void)
+{
+  gbe::vector<GenInstruction> insns;
+  insns.push_back(mov_imm(GEN_WIDTH_1, 40, 0, GEN_HORIZONTAL_STRIDE_1));
+  insns.push_back(add_scalar(40, 1, 40, 0));
+  insns.push_back(add_scalar(40, 2, 41, 0));
+  CHECK(gbe::setDependencyControl(insns) == 1);
+  CHECK(hint(insns, 0) == GEN_DEPENDENCY_NORMAL);
+  CHECK(hint(insns, 1) == GEN_DEPENDENCY_NOTCLEARED);
+  CHECK(hint(insns, 2) == GEN_DEPENDENCY_NOTCHECKED);
+}
+
+/* No chain goes through a jump target */
+static void
+check_jump_target(void)
+{
+  gbe::vector<GenInstruction> insns;
+  insns.push_back(jmpi(1));
+  insns.push_back(mov_imm(GEN_WIDTH_1, 50, 0, GEN_HORIZONTAL_STRIDE_1));
+  insns.push_back(mov_imm(GEN_WIDTH_1, 50, 1, GEN_HORIZONTAL_STRIDE_1));
+  insns.push_back(mov_imm(GEN_WIDTH_1, 50, 2, GEN_HORIZONTAL_STRIDE_1));
+  CHECK(gbe::setDependencyControl(insns) == 1);
+  CHECK(hint(insns, 0) == GEN_DEPENDENCY_NORMAL);
+  CHECK(hint(insns, 1) == GEN_DEPENDENCY_NORMAL);
+  CHECK(hint(insns, 2) == GEN_DEPENDENCY_NOTCLEARED);
+  CHECK(hint(insns, 3) == GEN_DEPENDENCY_NOTCHECKED);
+}
+
+int main(void)
+{
+  check_payload();
+  check_64bits_halves();
+  check_growing_span();
+  check_read_between();
+  check_jump_target();
+  printf("dependency control check: %s\n", status ? "failed" : "passed");
+  return status;
+}
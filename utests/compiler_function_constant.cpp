@@ -32,3 +32,45 @@ void compiler_function_constant(void)
 }
 
 MAKE_UTEST_FROM_FUNCTION(compiler_function_constant);
+
+/* The constant buffer is kept between two runs: check it follows the changes
+ * of the __constant argument content
+ */
+void compiler_function_constant_update(void)
+{
+  const size_t n = 2048;
+  const uint32_t value = 34;
+  short table[69];
+
+  OCL_CREATE_KERNEL("compiler_function_constant");
+  OCL_CREATE_BUFFER(buf[0], 0, 75 * sizeof(short), NULL);
+  OCL_CREATE_BUFFER(buf[1], 0, n * sizeof(uint32_t), NULL);
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+  OCL_SET_ARG(2, sizeof(uint32_t), &value);
+  globals[0] = n;
+  locals[0] = 16;
+
+  for (int run = 0; run < 4; ++run) {
+    // Written with a map, with a write, and not written at all
+    if (run == 0 || run == 3) {
+      OCL_MAP_BUFFER(0);
+      for(uint32_t i = 0; i < 69; ++i)
+        ((short *)buf_data[0])[i] = i * (run + 1);
+      OCL_UNMAP_BUFFER(0);
+    } else if (run == 1) {
+      for(uint32_t i = 0; i < 69; ++i)
+        table[i] = i * (run + 1);
+      OCL_CALL(clEnqueueWriteBuffer, queue, buf[0], CL_TRUE, 0, sizeof(table), table, 0, NULL, NULL);
+    }
+    const int factor = run == 2 ? 2 : run + 1;
+
+    OCL_NDRANGE(1);
+    OCL_MAP_BUFFER(1);
+    for (uint32_t i = 0; i < n; ++i)
+      OCL_ASSERT(((uint32_t *)buf_data[1])[i] == (value + (i%69) * factor));
+    OCL_UNMAP_BUFFER(1);
+  }
+}
+
+MAKE_UTEST_FROM_FUNCTION(compiler_function_constant_update);
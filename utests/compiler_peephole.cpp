@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Kernels giving work to the post allocation peephole pass: copy forwarding,
+ * abs / neg folding, dead writes and flag reuse
+ */
+#include "utest_helper.hpp"
+#include <cmath>
+
+static const size_t n = 64;
+
+static void peephole_run(const char *name, size_t src_n)
+{
+  OCL_CREATE_KERNEL_FROM_FILE("compiler_peephole", name);
+  OCL_CREATE_BUFFER(buf[0], 0, src_n * sizeof(uint32_t), NULL);
+  OCL_CREATE_BUFFER(buf[1], 0, n * sizeof(uint32_t), NULL);
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+  globals[0] = n;
+  locals[0] = 16;
+}
+
+static void compiler_peephole_copy(void)
+{
+  int32_t src[n];
+  peephole_run("compiler_peephole_copy", n);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < n; ++i)
+    src[i] = ((int32_t*)buf_data[0])[i] = (rand() & 31) - 8;
+  OCL_UNMAP_BUFFER(0);
+  OCL_NDRANGE(1);
+  OCL_MAP_BUFFER(1);
+  for (int32_t i = 0; i < (int32_t) n; ++i) {
+    const int32_t x = src[i];
+    const int32_t y = i & 1 ? x : i;
+    const int32_t z = x > 8 ? x + y : y;
+    OCL_ASSERT(((int32_t*)buf_data[1])[i] == z * 3);
+  }
+  OCL_UNMAP_BUFFER(1);
+}
+
+static void compiler_peephole_abs_neg(void)
+{
+  float src[2*n];
+  peephole_run("compiler_peephole_abs_neg", 2*n);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < 2*n; ++i)
+    src[i] = ((float*)buf_data[0])[i] = .25f * (rand() & 31) - 4.f;
+  OCL_UNMAP_BUFFER(0);
+  OCL_NDRANGE(1);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    const float a = -fabsf(src[2*i]);
+    const float b = -src[2*i+1];
+    OCL_ASSERT(((float*)buf_data[1])[i] == a * src[2*i+1] + b - fabsf(b));
+  }
+  OCL_UNMAP_BUFFER(1);
+}
+
+static void compiler_peephole_dead(void)
+{
+  uint32_t src[n];
+  peephole_run("compiler_peephole_dead", n);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < n; ++i)
+    src[i] = ((uint32_t*)buf_data[0])[i] = rand();
+  OCL_UNMAP_BUFFER(0);
+  OCL_NDRANGE(1);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    const uint64_t w = (uint64_t) src[i] * 0x9e3779b9u;
+    OCL_ASSERT(((uint32_t*)buf_data[1])[i] == (uint32_t) w + src[i] / 7);
+  }
+  OCL_UNMAP_BUFFER(1);
+}
+
+static void compiler_peephole_flag(void)
+{
+  int32_t src[2*n];
+  peephole_run("compiler_peephole_flag", 2*n);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < 2*n; ++i)
+    src[i] = ((int32_t*)buf_data[0])[i] = (rand() & 255) - 128;
+  OCL_UNMAP_BUFFER(0);
+  OCL_NDRANGE(1);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    const int32_t x = src[2*i], y = src[2*i+1];
+    const int32_t m = x < y ? x : y;
+    const int32_t k = x < y ? y - x : x - y;
+    OCL_ASSERT(((int32_t*)buf_data[1])[i] == m + (x < y ? 1 : 2) * k);
+  }
+  OCL_UNMAP_BUFFER(1);
+}
+
+MAKE_UTEST_FROM_FUNCTION(compiler_peephole_copy);
+MAKE_UTEST_FROM_FUNCTION(compiler_peephole_abs_neg);
+MAKE_UTEST_FROM_FUNCTION(compiler_peephole_dead);
+MAKE_UTEST_FROM_FUNCTION(compiler_peephole_flag);
@@ -0,0 +1,48 @@
+#include "utest_helper.hpp"
+
+static uint32_t cpu_scramble(uint32_t x, uint32_t k)
+{
+  for (int i = 0; i < 64; ++i) {
+    x = (x ^ (x >> 7)) * 0x9e3779b1u + k;
+    k = k * 3u + 1u;
+  }
+  return x;
+}
+
+static void compiler_subroutine(void)
+{
+  const size_t n = 64;
+
+  // Setup kernel and buffers
+  OCL_CREATE_KERNEL("compiler_subroutine");
+  buf_data[0] = (uint32_t*) malloc(sizeof(uint32_t) * n);
+  for (uint32_t i = 0; i < n; ++i) ((uint32_t*)buf_data[0])[i] = i * 0x01234567u;
+  OCL_CREATE_BUFFER(buf[0], CL_MEM_COPY_HOST_PTR, n * sizeof(uint32_t), buf_data[0]);
+  OCL_CREATE_BUFFER(buf[1], 0, n * sizeof(uint32_t), NULL);
+  free(buf_data[0]);
+  buf_data[0] = NULL;
+
+  // Run the kernel
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+  globals[0] = n;
+  locals[0] = 16;
+  OCL_NDRANGE(1);
+
+  // Both call paths of the subroutine
+  OCL_MAP_BUFFER(0);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    const uint32_t x = ((uint32_t*)buf_data[0])[i];
+    uint32_t y;
+    if (i & 1)
+      y = cpu_scramble(x, 1u);
+    else
+      y = cpu_scramble(x + 7u, 2u) ^ cpu_scramble(x, 3u);
+    OCL_ASSERT(((uint32_t*)buf_data[1])[i] == cpu_scramble(y, i));
+  }
+  OCL_UNMAP_BUFFER(0);
+  OCL_UNMAP_BUFFER(1);
+}
+
+MAKE_UTEST_FROM_FUNCTION(compiler_subroutine);
@@ -1,4 +1,5 @@
 #include "utest_helper.hpp"
+#include <string.h>
 
 void test_copy_buf(size_t sz, size_t src_off, size_t dst_off, size_t cb)
 {
@@ -64,3 +65,48 @@ void enqueue_copy_buf(void)
 }
 
 MAKE_UTEST_FROM_FUNCTION(enqueue_copy_buf);
+
+/* Every source and destination misalignment, with the bytes around the
+ * destination left untouched, then rectangles with odd pitches
+ */
+void enqueue_copy_buf_unaligned(void)
+{
+    const size_t sz = 4096;
+    char *src = (char *) malloc(sz), *dst = (char *) malloc(sz);
+
+    for (size_t i = 0; i < sz; ++i)
+        src[i] = (char) (i * 7 + 1);
+    OCL_CREATE_BUFFER(buf[0], CL_MEM_COPY_HOST_PTR, sz, src);
+    OCL_CREATE_BUFFER(buf[1], 0, sz, NULL);
+
+    for (size_t src_off = 0; src_off < 20; ++src_off)
+        for (size_t dst_off = 0; dst_off < 20; dst_off += 3) {
+            const size_t cb = 1000 + src_off;
+            memset(dst, 0, sz);
+            OCL_CALL(clEnqueueWriteBuffer, queue, buf[1], CL_TRUE, 0, sz, dst, 0, NULL, NULL);
+            OCL_CALL(clEnqueueCopyBuffer, queue, buf[0], buf[1], src_off, dst_off, cb, 0, NULL, NULL);
+            OCL_CALL(clEnqueueReadBuffer, queue, buf[1], CL_TRUE, 0, sz, dst, 0, NULL, NULL);
+            for (size_t i = 0; i < sz; ++i)
+                OCL_ASSERT(dst[i] == (i >= dst_off && i < dst_off + cb ? src[i - dst_off + src_off] : 0));
+        }
+
+    const size_t src_origin[] = {3, 2, 0}, dst_origin[] = {5, 1, 0}, region[] = {61, 9, 1};
+    const size_t src_pitch = 101, dst_pitch = 80;
+    memset(dst, 0, sz);
+    OCL_CALL(clEnqueueWriteBuffer, queue, buf[1], CL_TRUE, 0, sz, dst, 0, NULL, NULL);
+    OCL_CALL(clEnqueueCopyBufferRect, queue, buf[0], buf[1], src_origin, dst_origin, region,
+             src_pitch, 0, dst_pitch, 0, 0, NULL, NULL);
+    OCL_CALL(clEnqueueReadBuffer, queue, buf[1], CL_TRUE, 0, sz, dst, 0, NULL, NULL);
+    for (size_t y = 0; y < 16; ++y)
+        for (size_t x = 0; x < dst_pitch; ++x) {
+            const bool in = x >= dst_origin[0] && x < dst_origin[0] + region[0] &&
+                            y >= dst_origin[1] && y < dst_origin[1] + region[1];
+            const size_t s = (y - dst_origin[1] + src_origin[1]) * src_pitch + x - dst_origin[0] + src_origin[0];
+            OCL_ASSERT(dst[y * dst_pitch + x] == (in ? src[s] : 0));
+        }
+
+    free(src);
+    free(dst);
+}
+
+MAKE_UTEST_FROM_FUNCTION(enqueue_copy_buf_unaligned);
@@ -0,0 +1,61 @@
+#include "utest_helper.hpp"
+#include <pthread.h>
+
+enum { ALLOC_STRESS_ITER_N = 4096, ALLOC_STRESS_LIVE_N = 16, ALLOC_STRESS_MAX_THREAD_N = 8 };
+
+/* Each thread keeps a few live buffers and events and replaces them in turn */
+static void *alloc_stress_thread(void *arg)
+{
+  cl_mem mems[ALLOC_STRESS_LIVE_N] = {NULL};
+  cl_event events[ALLOC_STRESS_LIVE_N] = {NULL};
+  int *failed = (int *) arg;
+  cl_int err;
+
+  for (int i = 0; i < ALLOC_STRESS_ITER_N; ++i) {
+    const int slot = i % ALLOC_STRESS_LIVE_N;
+    if (mems[slot] && clReleaseMemObject(mems[slot]) != CL_SUCCESS)
+      *failed = 1;
+    if (events[slot] && clReleaseEvent(events[slot]) != CL_SUCCESS)
+      *failed = 1;
+    mems[slot] = clCreateBuffer(ctx, 0, 64 + 64 * slot, NULL, &err);
+    if (err != CL_SUCCESS)
+      *failed = 1;
+    events[slot] = clCreateUserEvent(ctx, &err);
+    if (err != CL_SUCCESS)
+      *failed = 1;
+  }
+  for (int slot = 0; slot < ALLOC_STRESS_LIVE_N; ++slot) {
+    if (mems[slot] && clReleaseMemObject(mems[slot]) != CL_SUCCESS)
+      *failed = 1;
+    if (events[slot] && clReleaseEvent(events[slot]) != CL_SUCCESS)
+      *failed = 1;
+  }
+  return NULL;
+}
+
+/* Buffers and events created and released from thread_n threads at once.
+ * alloc_stress (runtime_alloc_stress_bench.cpp) times it
+ */
+void alloc_stress_run(int thread_n)
+{
+  pthread_t threads[ALLOC_STRESS_MAX_THREAD_N];
+  int failed[ALLOC_STRESS_MAX_THREAD_N];
+
+  OCL_ASSERT(thread_n <= ALLOC_STRESS_MAX_THREAD_N);
+  for (int i = 0; i < thread_n; ++i) {
+    failed[i] = 0;
+    OCL_ASSERT(pthread_create(&threads[i], NULL, alloc_stress_thread, &failed[i]) == 0);
+  }
+  for (int i = 0; i < thread_n; ++i) {
+    pthread_join(threads[i], NULL);
+    OCL_ASSERT(failed[i] == 0);
+  }
+}
+
+void runtime_alloc_stress(void)
+{
+  for (int thread_n = 1; thread_n <= ALLOC_STRESS_MAX_THREAD_N; thread_n *= 2)
+    alloc_stress_run(thread_n);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_alloc_stress);
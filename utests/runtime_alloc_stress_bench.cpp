@@ -0,0 +1,23 @@
+#include "utest_helper.hpp"
+
+/* In runtime_alloc_stress.cpp: each thread creates and releases 4096 buffers
+ * and 4096 user events
+ */
+extern void alloc_stress_run(int thread_n);
+
+/* Number of objects per second for each thread count */
+static void alloc_stress(void)
+{
+  for (int thread_n = 1; thread_n <= 8; thread_n *= 2) {
+    const double t0 = cl_time_us();
+    alloc_stress_run(thread_n);
+    const double us = cl_time_us() - t0;
+    printf("%d threads: %.0f Kobj/s\n", thread_n, 2.0 * thread_n * 4096 / us * 1e3);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  return cl_bench_run(alloc_stress);
+}
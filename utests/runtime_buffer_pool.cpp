@@ -0,0 +1,104 @@
+#include "utest_helper.hpp"
+
+static size_t buffer_pool_elem_n(int i) { return 1 + (i * 37) % 1024; }
+
+/* Small buffers share their buffer objects: check that they do not overlap,
+ * that they are copied at the right place and that their sub-buffers report
+ * an offset relative to them
+ */
+void runtime_buffer_pool(void)
+{
+  const int buffer_n = 256;
+  cl_mem small[buffer_n];
+  int data[1024];
+  cl_int err;
+
+  for (int i = 0; i < buffer_n; ++i) {
+    const size_t n = buffer_pool_elem_n(i);
+    for (size_t j = 0; j < n; ++j)
+      data[j] = i * 4096 + j;
+    small[i] = clCreateBuffer(ctx, CL_MEM_COPY_HOST_PTR, n * sizeof(int), data, &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+  }
+
+  // Free half of them and fill the holes with copies of their neighbours
+  for (int i = 0; i < buffer_n; i += 2)
+    OCL_CALL(clReleaseMemObject, small[i]);
+  for (int i = 0; i < buffer_n; i += 2) {
+    const size_t n = buffer_pool_elem_n(i);
+    small[i] = clCreateBuffer(ctx, 0, n * sizeof(int), NULL, &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+    if (n <= buffer_pool_elem_n(i + 1))
+      OCL_CALL(clEnqueueCopyBuffer, queue, small[i + 1], small[i], 0, 0,
+               n * sizeof(int), 0, NULL, NULL);
+  }
+  OCL_FINISH();
+
+  for (int i = 0; i < buffer_n; ++i) {
+    const size_t n = buffer_pool_elem_n(i);
+    const int from = i % 2 ? i : i + 1;
+    if (i % 2 == 0 && n > buffer_pool_elem_n(i + 1))
+      continue;
+    OCL_CALL(clEnqueueReadBuffer, queue, small[i], CL_TRUE, 0, n * sizeof(int), data, 0, NULL, NULL);
+    for (size_t j = 0; j < n; ++j)
+      OCL_ASSERT(data[j] == (int) (from * 4096 + j));
+  }
+
+  // Sub-buffer of a small buffer (1000 ints)
+  cl_buffer_region region = {128, 256};
+  cl_mem sub = clCreateSubBuffer(small[27], 0, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  size_t offset = 0;
+  OCL_CALL(clGetMemObjectInfo, sub, CL_MEM_OFFSET, sizeof(offset), &offset, NULL);
+  OCL_ASSERT(offset == 128);
+  OCL_CALL(clEnqueueReadBuffer, queue, sub, CL_TRUE, 0, 256, data, 0, NULL, NULL);
+  for (size_t j = 0; j < 64; ++j)
+    OCL_ASSERT(data[j] == (int) (27 * 4096 + 32 + j));
+  OCL_CALL(clReleaseMemObject, sub);
+
+  for (int i = 0; i < buffer_n; ++i)
+    OCL_CALL(clReleaseMemObject, small[i]);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_buffer_pool);
+
+/* A released small buffer may still be read by a batched copy: a new buffer
+ * of the same size must not get its chunk and overwrite it before the copy ran
+ */
+void runtime_buffer_pool_reuse(void)
+{
+  const int buffer_n = 16;
+  const size_t n = 1024;
+  cl_mem dst[buffer_n], reused[buffer_n];
+  int data[n];
+  cl_int err;
+
+  for (int i = 0; i < buffer_n; ++i) {
+    for (size_t j = 0; j < n; ++j)
+      data[j] = i * 4096 + j;
+    cl_mem src = clCreateBuffer(ctx, CL_MEM_COPY_HOST_PTR, n * sizeof(int), data, &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+    dst[i] = clCreateBuffer(ctx, 0, n * sizeof(int), NULL, &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+    OCL_CALL(clEnqueueCopyBuffer, queue, src, dst[i], 0, 0, n * sizeof(int), 0, NULL, NULL);
+    OCL_CALL(clReleaseMemObject, src);
+    for (size_t j = 0; j < n; ++j)
+      data[j] = -1;
+    reused[i] = clCreateBuffer(ctx, CL_MEM_COPY_HOST_PTR, n * sizeof(int), data, &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+  }
+  OCL_FINISH();
+
+  for (int i = 0; i < buffer_n; ++i) {
+    OCL_CALL(clEnqueueReadBuffer, queue, dst[i], CL_TRUE, 0, n * sizeof(int), data, 0, NULL, NULL);
+    for (size_t j = 0; j < n; ++j)
+      OCL_ASSERT(data[j] == (int) (i * 4096 + j));
+    OCL_CALL(clEnqueueReadBuffer, queue, reused[i], CL_TRUE, 0, n * sizeof(int), data, 0, NULL, NULL);
+    for (size_t j = 0; j < n; ++j)
+      OCL_ASSERT(data[j] == -1);
+    OCL_CALL(clReleaseMemObject, dst[i]);
+    OCL_CALL(clReleaseMemObject, reused[i]);
+  }
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_buffer_pool_reuse);
@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host memory bandwidth of the copies done by the transfer commands (linear
+ * and rectangles) against a plain memcpy. No device is needed
+ */
+#include "../src/cl_copy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* Best GB/s over a few runs of a pitch x row_n rectangle of row_sz bytes */
+static double
+bandwidth(char *dst, const char *src, size_t pitch, size_t row_sz, size_t row_n, int flags)
+{
+  const size_t total = row_sz * row_n;
+  const int run_n = total >= 16 * 1024 * 1024 ? 8 : 64;
+  double best = 0.;
+
+  for (int run = 0; run < run_n; ++run) {
+    const double t = now();
+    if (pitch == row_sz)
+      cl_copy(dst, src, total, flags);
+    else
+      cl_copy_rect(dst, pitch, pitch * row_n, src, pitch, pitch * row_n,
+                   row_sz, row_n, 1, flags);
+    const double dt = now() - t;
+    if (dt > 0. && total / dt > best)
+      best = total / dt;
+  }
+  return best * 1e-9;
+}
+
+static int
+check(const char *dst, const char *src, size_t pitch, size_t row_sz, size_t row_n)
+{
+  for (size_t y = 0; y < row_n; ++y)
+    if (memcmp(dst + y * pitch, src + y * pitch, row_sz) != 0)
+      return 0;
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const size_t linear[] = {64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024};
+  static const struct { size_t row_sz, pitch, row_n; } rects[] = {
+    {1000, 1024, 1024}, {4000, 4096, 4096}, {8188, 8192, 8192}
+  };
+  static const size_t max_sz = 8192 * 8192;
+  static const struct { const char *name; int flags; } modes[] = {
+    {"memcpy", CL_COPY_MEMCPY},
+    {"cl_copy", 0},
+    {"cl_copy dst wc", CL_COPY_DST_WC},
+    {"cl_copy src wc", CL_COPY_SRC_WC}
+  };
+  const size_t mode_n = sizeof(modes) / sizeof(modes[0]);
+  char *src = NULL, *dst = NULL;
+  int status = 0;
+
+  if (posix_memalign((void **) &src, 64, max_sz + 64) ||
+      posix_memalign((void **) &dst, 64, max_sz + 64)) {
+    fprintf(stderr, "cannot allocate the buffers\n");
+    return 1;
+  }
+  for (size_t i = 0; i < max_sz + 64; ++i)
+    src[i] = (char) (i * 7 + 3);
+  memset(dst, 0, max_sz + 64);
+
+  printf("%-24s", "size (GB/s)");
+  for (size_t m = 0; m < mode_n; ++m)
+    printf("%16s", modes[m].name);
+  printf("\n");
+
+  /* Misaligned by 4 bytes to go through the heads of the aligned loops */
+  for (size_t i = 0; i < sizeof(linear) / sizeof(linear[0]); ++i) {
+    printf("linear %-17zu", linear[i]);
+    for (size_t m = 0; m < mode_n; ++m) {
+      memset(dst, 0, linear[i] + 4);
+      printf("%16.2f", bandwidth(dst + 4, src + 4, linear[i], linear[i], 1, modes[m].flags));
+      if (!check(dst + 4, src + 4, linear[i], linear[i], 1))
+        status = 1;
+    }
+    printf("\n");
+  }
+
+  for (size_t i = 0; i < sizeof(rects) / sizeof(rects[0]); ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "rect %zux%zu", rects[i].row_sz, rects[i].row_n);
+    printf("%-24s", name);
+    for (size_t m = 0; m < mode_n; ++m) {
+      memset(dst, 0, rects[i].pitch * rects[i].row_n);
+      printf("%16.2f", bandwidth(dst, src, rects[i].pitch, rects[i].row_sz,
+                                 rects[i].row_n, modes[m].flags));
+      if (!check(dst, src, rects[i].pitch, rects[i].row_sz, rects[i].row_n))
+        status = 1;
+    }
+    printf("\n");
+  }
+
+  if (status)
+    fprintf(stderr, "copy mismatch\n");
+  free(src);
+  free(dst);
+  return status;
+}
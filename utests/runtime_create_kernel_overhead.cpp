@@ -0,0 +1,73 @@
+#include "utest_helper.hpp"
+
+/* Sets the arguments of a kernel, a is the only one which differs */
+static void create_kernel_set_args(cl_kernel k, cl_mem dst, cl_int a)
+{
+  const float b = 2.f;
+  const cl_float4 c = {{0.5f, 0.f, 0.f, 0.25f}};
+  const cl_uint d = 3;
+
+  OCL_CALL (clSetKernelArg, k, 0, sizeof(cl_mem), &dst);
+  OCL_CALL (clSetKernelArg, k, 1, sizeof(cl_mem), &buf[1]);
+  OCL_CALL (clSetKernelArg, k, 2, sizeof(cl_int), &a);
+  OCL_CALL (clSetKernelArg, k, 3, sizeof(float), &b);
+  OCL_CALL (clSetKernelArg, k, 4, sizeof(cl_float4), &c);
+  OCL_CALL (clSetKernelArg, k, 5, sizeof(cl_uint), &d);
+  OCL_CALL (clSetKernelArg, k, 6, 16 * sizeof(float), NULL);
+  OCL_CALL (clSetKernelArg, k, 7, sizeof(cl_mem), &buf[3]);
+}
+
+/* Creates and releases kernels over and over. Then checks that two kernels
+ * of the same program run with their own arguments: they share everything but
+ * the curbe. create_kernel_overhead times the creations
+ */
+void runtime_create_kernel_overhead(void)
+{
+  const size_t n = 64;
+  const int round_n = 16;
+  cl_kernel other;
+  cl_int err;
+
+  OCL_CREATE_KERNEL("runtime_set_arg_overhead");
+  for (int r = 0; r < round_n; ++r) {
+    cl_kernel k = clCreateKernel(program, "runtime_set_arg_overhead", &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+    OCL_CALL (clReleaseKernel, k);
+  }
+
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[1], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[2], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[3], 0, 4 * sizeof(float), NULL);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i)
+    ((float*)buf_data[1])[i] = (float) i;
+  OCL_UNMAP_BUFFER(1);
+  OCL_MAP_BUFFER(3);
+  for (uint32_t i = 0; i < 4; ++i)
+    ((float*)buf_data[3])[i] = (float) (i * 10);
+  OCL_UNMAP_BUFFER(3);
+
+  /* The second kernel is created once the arguments of the first one are set */
+  create_kernel_set_args(kernel, buf[0], 1);
+  other = clCreateKernel(program, "runtime_set_arg_overhead", &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  create_kernel_set_args(other, buf[2], 2);
+
+  globals[0] = n;
+  locals[0] = 16;
+  OCL_NDRANGE(1);
+  OCL_CALL (clEnqueueNDRangeKernel, queue, other, 1, NULL, globals, locals, 0, NULL, NULL);
+  OCL_MAP_BUFFER(0);
+  OCL_MAP_BUFFER(2);
+  for (uint32_t i = 0; i < n; ++i) {
+    const float expected = i * 2.f + 0.5f + 0.25f + 3 + (i & 3) * 10;
+    OCL_ASSERT(((float*)buf_data[0])[i] == expected + 1);
+    OCL_ASSERT(((float*)buf_data[2])[i] == expected + 2);
+  }
+  OCL_UNMAP_BUFFER(0);
+  OCL_UNMAP_BUFFER(2);
+  OCL_CALL (clReleaseKernel, other);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_create_kernel_overhead);
@@ -0,0 +1,24 @@
+#include "utest_helper.hpp"
+
+/* Number of kernels created (and released) per second from a built program */
+static void create_kernel_overhead(void)
+{
+  const int round_n = 100000;
+  cl_int err;
+
+  OCL_CREATE_KERNEL("runtime_set_arg_overhead");
+  const double t0 = cl_time_us();
+  for (int r = 0; r < round_n; ++r) {
+    cl_kernel k = clCreateKernel(program, "runtime_set_arg_overhead", &err);
+    OCL_ASSERT(err == CL_SUCCESS);
+    OCL_CALL (clReleaseKernel, k);
+  }
+  const double us = cl_time_us() - t0;
+  printf("%.0f kernels created per second\n", round_n / us * 1e6);
+}
+
+int
+main(int argc, char *argv[])
+{
+  return cl_bench_run(create_kernel_overhead);
+}
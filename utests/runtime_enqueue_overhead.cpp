@@ -0,0 +1,34 @@
+#include "utest_helper.hpp"
+
+/* Many tiny kernels in a row: checks the recycled state buffers. The time
+ * per enqueue is in runtime_enqueue_overhead_bench.cpp
+ */
+void runtime_enqueue_overhead(void)
+{
+  const size_t n = 64;
+  const int enqueue_n = 4096;
+  const int value = 1;
+
+  OCL_CREATE_KERNEL("compiler_event");
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(int), NULL);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < n; ++i)
+    ((int*)buf_data[0])[i] = 0;
+  OCL_UNMAP_BUFFER(0);
+
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(int), &value);
+  globals[0] = n;
+  locals[0] = 16;
+
+  for (int i = 0; i < enqueue_n; ++i)
+    OCL_NDRANGE(1);
+  OCL_FINISH();
+
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < n; ++i)
+    OCL_ASSERT(((int*)buf_data[0])[i] == enqueue_n * value);
+  OCL_UNMAP_BUFFER(0);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_enqueue_overhead);
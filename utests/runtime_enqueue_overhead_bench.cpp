@@ -0,0 +1,52 @@
+#include "utest_helper.hpp"
+#include <dlfcn.h>
+
+/* Every buffer object of the driver comes from drm_intel_bo_alloc. The
+ * benchmark defines it first to count them and forwards to libdrm
+ */
+static int bo_alloc_n = 0;
+
+extern "C" void *
+drm_intel_bo_alloc(void *bufmgr, const char *name, unsigned long size, unsigned int alignment)
+{
+  typedef void *(bo_alloc_t)(void*, const char*, unsigned long, unsigned int);
+  static bo_alloc_t *bo_alloc = (bo_alloc_t*) dlsym(RTLD_NEXT, "drm_intel_bo_alloc");
+  bo_alloc_n++;
+  return bo_alloc(bufmgr, name, size, alignment);
+}
+
+/* CPU time and buffer objects allocated per clEnqueueNDRangeKernel, for
+ * many tiny kernels in a row
+ */
+static void enqueue_overhead(void)
+{
+  const size_t n = 64;
+  const int enqueue_n = 4096;
+  const int value = 1;
+
+  OCL_CREATE_KERNEL("compiler_event");
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(int), NULL);
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(int), &value);
+  globals[0] = n;
+  locals[0] = 16;
+
+  // The first enqueue allocates what the next ones recycle
+  OCL_NDRANGE(1);
+  OCL_FINISH();
+
+  const int bo_alloc_n0 = bo_alloc_n;
+  const double t0 = cl_time_us();
+  for (int i = 0; i < enqueue_n; ++i)
+    OCL_NDRANGE(1);
+  const double us = cl_time_us() - t0;
+  OCL_FINISH();
+  printf("%.2f us and %.3f buffer objects allocated per enqueue\n",
+         us / enqueue_n, double(bo_alloc_n - bo_alloc_n0) / enqueue_n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  return cl_bench_run(enqueue_overhead);
+}
@@ -58,3 +58,41 @@ void runtime_event(void)
 }
 
 MAKE_UTEST_FROM_FUNCTION(runtime_event);
+
+/* A long chain of deferred writes, each waiting on the previous one: they
+ * all run in order once the user event at its head completes
+ */
+void runtime_event_chain(void)
+{
+  const int chain_n = 1024;
+  cl_event user, ev[chain_n];
+  cl_int values[chain_n];
+  cl_int status = 0, result = -1;
+
+  OCL_CREATE_BUFFER(buf[0], 0, sizeof(int), NULL);
+  OCL_CREATE_USER_EVENT(user);
+  for (int i = 0; i < chain_n; ++i) {
+    values[i] = i;
+    OCL_CALL(clEnqueueWriteBuffer, queue, buf[0], CL_FALSE, 0, sizeof(int), &values[i],
+             1, i == 0 ? &user : &ev[i - 1], &ev[i]);
+  }
+
+  clGetEventInfo(ev[chain_n - 1], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+  OCL_ASSERT(status > CL_COMPLETE);
+
+  OCL_SET_USER_EVENT_STATUS(user, CL_COMPLETE);
+  OCL_FINISH();
+
+  for (int i = 0; i < chain_n; ++i) {
+    clGetEventInfo(ev[i], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+    OCL_ASSERT(status == CL_COMPLETE);
+  }
+  OCL_CALL(clEnqueueReadBuffer, queue, buf[0], CL_TRUE, 0, sizeof(int), &result, 0, NULL, NULL);
+  OCL_ASSERT(result == chain_n - 1);
+
+  for (int i = 0; i < chain_n; ++i)
+    clReleaseEvent(ev[i]);
+  clReleaseEvent(user);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_event_chain);
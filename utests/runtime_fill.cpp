@@ -0,0 +1,100 @@
+#include "utest_helper.hpp"
+#include <string.h>
+
+#ifndef CL_VERSION_1_2
+extern "C" {
+cl_int clEnqueueFillBuffer(cl_command_queue, cl_mem, const void *, size_t, size_t, size_t,
+                           cl_uint, const cl_event *, cl_event *);
+cl_int clEnqueueFillImage(cl_command_queue, cl_mem, const void *, const size_t *, const size_t *,
+                          cl_uint, const cl_event *, cl_event *);
+}
+#endif
+
+/* Fill regions of a buffer with patterns of all the sizes, through the
+ * unaligned, 16 bytes and large pattern kernels, and check that the bytes
+ * around them are left untouched
+ */
+static void runtime_fill_buffer(void)
+{
+  const size_t sz = 8192;
+  static const struct { size_t pattern_size, offset, size; } fills[] = {
+    {1, 3, 1000}, {2, 6, 34}, {4, 0, 4096}, {4, 8, 20}, {8, 8, 4000},
+    {16, 16, 4096}, {16, 48, 80}, {32, 64, 4064}, {64, 128, 1024}, {128, 256, 2048}
+  };
+  unsigned char pattern[128], *data = (unsigned char *) malloc(sz);
+
+  for (size_t i = 0; i < sizeof(pattern); ++i)
+    pattern[i] = (unsigned char) (i * 13 + 1);
+  OCL_CREATE_BUFFER(buf[0], 0, sz, NULL);
+
+  for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); ++f) {
+    memset(data, 0xcc, sz);
+    OCL_CALL(clEnqueueWriteBuffer, queue, buf[0], CL_TRUE, 0, sz, data, 0, NULL, NULL);
+    OCL_CALL(clEnqueueFillBuffer, queue, buf[0], pattern, fills[f].pattern_size,
+             fills[f].offset, fills[f].size, 0, NULL, NULL);
+    OCL_CALL(clEnqueueReadBuffer, queue, buf[0], CL_TRUE, 0, sz, data, 0, NULL, NULL);
+    for (size_t i = 0; i < sz; ++i) {
+      if (i < fills[f].offset || i >= fills[f].offset + fills[f].size)
+        OCL_ASSERT(data[i] == 0xcc);
+      else
+        OCL_ASSERT(data[i] == pattern[(i - fills[f].offset) % fills[f].pattern_size]);
+    }
+  }
+
+  OCL_ASSERT(clEnqueueFillBuffer(queue, buf[0], pattern, 3, 0, 3, 0, NULL, NULL) == CL_INVALID_VALUE);
+  OCL_ASSERT(clEnqueueFillBuffer(queue, buf[0], pattern, 4, 2, 4, 0, NULL, NULL) == CL_INVALID_VALUE);
+  OCL_ASSERT(clEnqueueFillBuffer(queue, buf[0], pattern, 4, 0, sz + 4, 0, NULL, NULL) == CL_INVALID_VALUE);
+
+  // A rejected wait list leaves the buffer untouched
+  memset(data, 0xcc, sz);
+  OCL_CALL(clEnqueueWriteBuffer, queue, buf[0], CL_TRUE, 0, sz, data, 0, NULL, NULL);
+  OCL_ASSERT(clEnqueueFillBuffer(queue, buf[0], pattern, 4, 0, sz, 1, NULL, NULL) == CL_INVALID_EVENT_WAIT_LIST);
+  OCL_FINISH();
+  OCL_CALL(clEnqueueReadBuffer, queue, buf[0], CL_TRUE, 0, sz, data, 0, NULL, NULL);
+  for (size_t i = 0; i < sz; ++i)
+    OCL_ASSERT(data[i] == 0xcc);
+
+  // A fill waiting for a user event runs once it completes
+  cl_int err;
+  cl_event user = clCreateUserEvent(ctx, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  OCL_CALL(clEnqueueFillBuffer, queue, buf[0], pattern, 4, 0, sz, 1, &user, NULL);
+  OCL_CALL(clSetUserEventStatus, user, CL_COMPLETE);
+  OCL_CALL(clEnqueueReadBuffer, queue, buf[0], CL_TRUE, 0, sz, data, 0, NULL, NULL);
+  for (size_t i = 0; i < sz; ++i)
+    OCL_ASSERT(data[i] == pattern[i % 4]);
+  OCL_CALL(clReleaseEvent, user);
+  free(data);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_fill_buffer);
+
+static void runtime_fill_image(void)
+{
+  const size_t w = 64, h = 64;
+  const size_t origin[] = {3, 5, 0};
+  const size_t region[] = {20, 30, 1};
+  const size_t all[] = {w, h, 1};
+  const size_t zero[] = {0, 0, 0};
+  const cl_uint color[] = {1, 2, 3, 4};
+  cl_image_format format;
+  uint32_t *data = (uint32_t *) malloc(w * h * sizeof(uint32_t));
+
+  format.image_channel_order = CL_RGBA;
+  format.image_channel_data_type = CL_UNSIGNED_INT8;
+  for (size_t i = 0; i < w * h; ++i)
+    data[i] = 0xcccccccc;
+  OCL_CREATE_IMAGE2D(buf[0], CL_MEM_COPY_HOST_PTR, &format, w, h, w * sizeof(uint32_t), data);
+
+  OCL_CALL(clEnqueueFillImage, queue, buf[0], color, origin, region, 0, NULL, NULL);
+  OCL_CALL(clEnqueueReadImage, queue, buf[0], CL_TRUE, zero, all, 0, 0, data, 0, NULL, NULL);
+  for (size_t y = 0; y < h; ++y)
+    for (size_t x = 0; x < w; ++x) {
+      const bool in = x >= origin[0] && x < origin[0] + region[0] &&
+                      y >= origin[1] && y < origin[1] + region[1];
+      OCL_ASSERT(data[y * w + x] == (in ? 0x04030201u : 0xccccccccu));
+    }
+  free(data);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_fill_image);
@@ -0,0 +1,51 @@
+#include "utest_helper.hpp"
+#include <string.h>
+
+/* Copies a buffer in a new context and checks the copy. Returns the time of
+ * the clEnqueueCopyBuffer in us: only the first context of the process loads
+ * the internal program, the other ones just upload its code
+ */
+double internal_program_cache_copy(void)
+{
+  const size_t n = 1024;
+  uint32_t src[n], dst[n];
+  cl_int err;
+
+  for (size_t i = 0; i < n; ++i)
+    src[i] = i * 3;
+
+  cl_context other_ctx = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  cl_command_queue other_queue = clCreateCommandQueue(other_ctx, device, 0, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  cl_mem src_buf = clCreateBuffer(other_ctx, CL_MEM_COPY_HOST_PTR, sizeof(src), src, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  cl_mem dst_buf = clCreateBuffer(other_ctx, 0, sizeof(dst), NULL, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+
+  const double t0 = cl_time_us();
+  OCL_CALL (clEnqueueCopyBuffer, other_queue, src_buf, dst_buf, 0, 0, sizeof(src), 0, NULL, NULL);
+  const double us = cl_time_us() - t0;
+
+  memset(dst, 0, sizeof(dst));
+  OCL_CALL (clEnqueueReadBuffer, other_queue, dst_buf, CL_TRUE, 0, sizeof(dst), dst, 0, NULL, NULL);
+  for (size_t i = 0; i < n; ++i)
+    OCL_ASSERT(dst[i] == src[i]);
+
+  OCL_CALL (clReleaseMemObject, src_buf);
+  OCL_CALL (clReleaseMemObject, dst_buf);
+  OCL_CALL (clReleaseCommandQueue, other_queue);
+  OCL_CALL (clReleaseContext, other_ctx);
+  return us;
+}
+
+/* The contexts share the internal program: each one still copies right.
+ * internal_program_cache reports the copy times
+ */
+void runtime_internal_program_cache(void)
+{
+  for (int c = 0; c < 8; ++c)
+    internal_program_cache_copy();
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_internal_program_cache);
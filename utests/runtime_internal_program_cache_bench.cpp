@@ -0,0 +1,29 @@
+#include "utest_helper.hpp"
+
+/* In runtime_internal_program_cache.cpp: the time of a copy in a new context */
+extern double internal_program_cache_copy(void);
+
+/* The first copy of the first context loads the internal program, the next
+ * contexts reuse it
+ */
+static void internal_program_cache(void)
+{
+  const int context_n = 8;
+  double first_us = 0., other_us = 0.;
+
+  for (int c = 0; c < context_n; ++c) {
+    const double us = internal_program_cache_copy();
+    if (c == 0)
+      first_us = us;
+    else
+      other_us += us;
+  }
+  printf("first copy %.0f us in the first context, %.0f us in the next ones\n",
+         first_us, other_us / (context_n - 1));
+}
+
+int
+main(int argc, char *argv[])
+{
+  return cl_bench_run(internal_program_cache);
+}
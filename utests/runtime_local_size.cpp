@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Check the automatic local size heuristic on a model of an IVB GT2 device.
+ * No device is needed
+ */
+#include "../src/cl_local_size.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int status = 0;
+
+#define CHECK(COND) do {                                          \
+  if (!(COND)) {                                                  \
+    fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #COND); \
+    status = 1;                                                   \
+  }                                                               \
+} while (0)
+
+static cl_local_size_info
+gt2(uint32_t simd_width, uint32_t group_slm_sz)
+{
+  cl_local_size_info info;
+  info.max_group_sz = 1024;
+  info.max_item_sz[0] = info.max_item_sz[1] = info.max_item_sz[2] = 1024;
+  info.simd_width = simd_width;
+  info.thread_per_group = 64;
+  info.eu_n = 16;
+  info.thread_per_eu = 8;
+  info.half_slice_n = 2;
+  info.slm_sz = 64 * 1024;
+  info.group_slm_sz = group_slm_sz;
+  return info;
+}
+
+/* Whatever the sizes, the result is valid for the device */
+static void
+check_valid(const cl_local_size_info &info, uint32_t work_dim, const size_t *global, const size_t *local)
+{
+  size_t group_sz = 1;
+  for (uint32_t i = 0; i < 3; ++i) {
+    const size_t g = i < work_dim ? global[i] : 1;
+    CHECK(local[i] >= 1 && g % local[i] == 0 && local[i] <= info.max_item_sz[i]);
+    group_sz *= local[i];
+  }
+  CHECK(group_sz <= info.max_group_sz);
+  CHECK((group_sz + info.simd_width - 1) / info.simd_width <= info.thread_per_group);
+}
+
+int
+main(int argc, char *argv[])
+{
+  size_t local[3];
+
+  /* Large 1D ranges get the largest full groups */
+  {
+    const cl_local_size_info info = gt2(16, 0);
+    const size_t global[] = {1 << 20};
+    cl_local_size_pick(&info, 1, global, local);
+    CHECK(local[0] == 1024 && local[1] == 1 && local[2] == 1);
+  }
+
+  /* SIMD8 kernels are limited to 64 threads of 8 lanes */
+  {
+    const cl_local_size_info info = gt2(8, 0);
+    const size_t global[] = {1 << 20};
+    cl_local_size_pick(&info, 1, global, local);
+    CHECK(local[0] == 512);
+  }
+
+  /* A prime size below the limits is one group rather than single lanes */
+  {
+    const cl_local_size_info info = gt2(16, 0);
+    const size_t global[] = {997};
+    cl_local_size_pick(&info, 1, global, local);
+    CHECK(local[0] == 997);
+  }
+
+  /* Beyond one wave, full SIMD16 threads win over the groups with idle
+   * lanes */
+  {
+    const cl_local_size_info info = gt2(16, 0);
+    const size_t global[] = {16 * 1031};
+    cl_local_size_pick(&info, 1, global, local);
+    CHECK(local[0] == 16);
+  }
+  {
+    const cl_local_size_info info = gt2(16, 0);
+    const size_t global[] = {64 * 3 * 1031};
+    cl_local_size_pick(&info, 1, global, local);
+    CHECK(local[0] % 16 == 0);
+  }
+
+  /* 2D ranges fill full threads, widest along x */
+  {
+    const cl_local_size_info info = gt2(16, 0);
+    const size_t global[] = {1920, 1080};
+    cl_local_size_pick(&info, 2, global, local);
+    check_valid(info, 2, global, local);
+    CHECK((local[0] * local[1]) % 16 == 0);
+  }
+
+  /* With 24KB of SLM only 2 groups fit on a half slice: they have to be
+   * large enough to keep its 64 threads busy */
+  {
+    const cl_local_size_info info = gt2(16, 24 * 1024);
+    const size_t global[] = {1 << 20};
+    cl_local_size_pick(&info, 1, global, local);
+    CHECK(local[0] >= 512);
+  }
+
+  /* No group fits in the SLM: nothing better than 1 */
+  {
+    const cl_local_size_info info = gt2(16, 128 * 1024);
+    const size_t global[] = {4096, 16};
+    cl_local_size_pick(&info, 2, global, local);
+    CHECK(local[0] == 1 && local[1] == 1 && local[2] == 1);
+  }
+
+  /* Random sizes are always valid, and picked again identically */
+  srand(1);
+  for (int n = 0; n < 200; ++n) {
+    const cl_local_size_info info = gt2(n % 2 ? 8 : 16, (rand() % 4) * 8 * 1024);
+    const uint32_t work_dim = 1 + n % 3;
+    const size_t global[] = {(size_t) (1 + rand() % 5000), (size_t) (1 + rand() % 300),
+                             (size_t) (1 + rand() % 40)};
+    size_t again[3];
+    cl_local_size_pick(&info, work_dim, global, local);
+    cl_local_size_pick(&info, work_dim, global, again);
+    check_valid(info, work_dim, global, local);
+    CHECK(local[0] == again[0] && local[1] == again[1] && local[2] == again[2]);
+  }
+
+  printf("local size check: %s\n", status ? "failed" : "passed");
+  return status;
+}
@@ -0,0 +1,49 @@
+#include "utest_helper.hpp"
+#include <string.h>
+
+/* The global size is not a multiple of the local size: the last groups of
+ * each dimension are smaller and every work item must run exactly once with
+ * the IDs of an NDRange padded to full groups
+ */
+static void non_uniform_wg_run(size_t w, size_t h, size_t lw, size_t lh)
+{
+  const size_t off[2] = {3, 5};
+
+  OCL_CREATE_BUFFER(buf[0], 0, w * h * 8 * sizeof(uint32_t), NULL);
+  OCL_MAP_BUFFER(0);
+  memset(buf_data[0], 0xff, w * h * 8 * sizeof(uint32_t));
+  OCL_UNMAP_BUFFER(0);
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  globals[0] = w;
+  globals[1] = h;
+  locals[0] = lw;
+  locals[1] = lh;
+  OCL_CALL (clEnqueueNDRangeKernel, queue, kernel, 2, off, globals, locals, 0, NULL, NULL);
+
+  OCL_MAP_BUFFER(0);
+  const uint32_t *dst = (const uint32_t *) buf_data[0];
+  for (uint32_t y = 0; y < h; ++y)
+    for (uint32_t x = 0; x < w; ++x) {
+      const uint32_t *d = dst + 8 * (y * w + x);
+      const uint32_t gx = x / lw, gy = y / lh;
+      OCL_ASSERT(d[0] == gx && d[1] == gy);
+      OCL_ASSERT(d[2] == x % lw && d[3] == y % lh);
+      OCL_ASSERT(d[4] == (gx == w / lw ? w % lw : lw));
+      OCL_ASSERT(d[5] == (gy == h / lh ? h % lh : lh));
+      OCL_ASSERT(d[6] == lw && d[7] == (w + lw - 1) / lw);
+    }
+  OCL_UNMAP_BUFFER(0);
+  OCL_CALL (clReleaseMemObject, buf[0]);
+  buf[0] = NULL;
+}
+
+void runtime_non_uniform_wg(void)
+{
+  OCL_CREATE_KERNEL("runtime_non_uniform_wg");
+  non_uniform_wg_run(37, 13, 8, 4);
+  /* The edge group only fills a part of a SIMD thread */
+  non_uniform_wg_run(20, 1, 16, 1);
+  non_uniform_wg_run(5, 3, 16, 4);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_non_uniform_wg);
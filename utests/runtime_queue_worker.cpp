@@ -0,0 +1,106 @@
+#include "utest_helper.hpp"
+#include <string.h>
+
+/* Non-blocking writes return before the copy is done. The commands queued
+ * after them (a kernel, a blocking read) still see the written data
+ */
+void runtime_queue_worker(void)
+{
+  const size_t n = 256 * 1024;
+  const int write_n = 16;
+  const int value = 1;
+  int *src = (int *) malloc(n * sizeof(int));
+  int *dst = (int *) malloc(n * sizeof(int));
+
+  for (size_t i = 0; i < n; ++i)
+    src[i] = i;
+  OCL_CREATE_KERNEL("compiler_event");
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(int), NULL);
+
+  for (int i = 0; i < write_n; ++i)
+    OCL_CALL(clEnqueueWriteBuffer, queue, buf[0], CL_FALSE, 0, n * sizeof(int), src, 0, NULL, NULL);
+
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(int), &value);
+  globals[0] = n;
+  locals[0] = 16;
+  OCL_NDRANGE(1);
+
+  OCL_CALL(clEnqueueReadBuffer, queue, buf[0], CL_TRUE, 0, n * sizeof(int), dst, 0, NULL, NULL);
+  for (size_t i = 0; i < n; ++i)
+    OCL_ASSERT(dst[i] == (int) i + value);
+
+  // Out of order queue: independent reads, waited for with their events
+  cl_int err;
+  cl_command_queue ooo = clCreateCommandQueue(ctx, device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  cl_event ev[2];
+  memset(dst, 0, n * sizeof(int));
+  OCL_CALL(clEnqueueReadBuffer, ooo, buf[0], CL_FALSE, 0, n / 2 * sizeof(int), dst, 0, NULL, &ev[0]);
+  OCL_CALL(clEnqueueReadBuffer, ooo, buf[0], CL_FALSE, n / 2 * sizeof(int), n / 2 * sizeof(int),
+           dst + n / 2, 0, NULL, &ev[1]);
+  OCL_CALL(clWaitForEvents, 2, ev);
+  for (size_t i = 0; i < n; ++i)
+    OCL_ASSERT(dst[i] == (int) i + value);
+  clReleaseEvent(ev[0]);
+  clReleaseEvent(ev[1]);
+  clReleaseCommandQueue(ooo);
+
+  free(src);
+  free(dst);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_queue_worker);
+
+/* A non-blocking write of a __constant argument still queued on the worker
+ * when the kernel is enqueued: the kernel sees the written data
+ */
+void runtime_queue_worker_constant(void)
+{
+  const size_t n = 64, big_n = 1024 * 1024;
+  const cl_int a = 1;
+  const float b = 2.f;
+  const cl_float4 c = {{0.f, 0.f, 0.f, 0.f}};
+  const cl_uint d = 0;
+  const float old_cst[4] = {0.f, 0.f, 0.f, 0.f};
+  const float new_cst[4] = {10.f, 20.f, 30.f, 40.f};
+  float *big = (float *) calloc(big_n, sizeof(float));
+
+  OCL_CREATE_KERNEL("runtime_set_arg_overhead");
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[1], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[2], 0, 4 * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[3], 0, big_n * sizeof(float), NULL);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i)
+    ((float*)buf_data[1])[i] = (float) i;
+  OCL_UNMAP_BUFFER(1);
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+  OCL_SET_ARG(2, sizeof(cl_int), &a);
+  OCL_SET_ARG(3, sizeof(float), &b);
+  OCL_SET_ARG(4, sizeof(cl_float4), &c);
+  OCL_SET_ARG(5, sizeof(cl_uint), &d);
+  OCL_SET_ARG(6, 16 * sizeof(float), NULL);
+  OCL_SET_ARG(7, sizeof(cl_mem), &buf[2]);
+  globals[0] = n;
+  locals[0] = 16;
+
+  /* The constant buffer is built with the old values first */
+  OCL_CALL(clEnqueueWriteBuffer, queue, buf[2], CL_TRUE, 0, sizeof(old_cst), old_cst, 0, NULL, NULL);
+  OCL_NDRANGE(1);
+  OCL_CALL(clFinish, queue);
+
+  /* The large write keeps the worker busy while the next ones are queued */
+  OCL_CALL(clEnqueueWriteBuffer, queue, buf[3], CL_FALSE, 0, big_n * sizeof(float), big, 0, NULL, NULL);
+  OCL_CALL(clEnqueueWriteBuffer, queue, buf[2], CL_FALSE, 0, sizeof(new_cst), new_cst, 0, NULL, NULL);
+  OCL_NDRANGE(1);
+  OCL_CALL(clFinish, queue);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < n; ++i)
+    OCL_ASSERT(((float*)buf_data[0])[i] == i * b + a + new_cst[i & 3]);
+  OCL_UNMAP_BUFFER(0);
+  free(big);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_queue_worker_constant);
@@ -0,0 +1,30 @@
+#include "utest_helper.hpp"
+
+/* CPU time of a non-blocking write: the copy itself is done by the worker
+ * thread of the queue (OCL_QUEUE_WORKER=0 to compare)
+ */
+static void queue_worker(void)
+{
+  const size_t n = 256 * 1024;
+  const int write_n = 16;
+  int *src = (int *) malloc(n * sizeof(int));
+
+  for (size_t i = 0; i < n; ++i)
+    src[i] = i;
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(int), NULL);
+
+  const double t0 = cl_time_us();
+  for (int i = 0; i < write_n; ++i)
+    OCL_CALL(clEnqueueWriteBuffer, queue, buf[0], CL_FALSE, 0, n * sizeof(int), src, 0, NULL, NULL);
+  const double us = cl_time_us() - t0;
+  OCL_CALL(clFinish, queue);
+  printf("%.2f us per non-blocking write of %zu KB\n", us / write_n, n * sizeof(int) / 1024);
+
+  free(src);
+}
+
+int
+main(int argc, char *argv[])
+{
+  return cl_bench_run(queue_worker);
+}
@@ -0,0 +1,48 @@
+#include "utest_helper.hpp"
+
+/* Sets the 8 arguments of a kernel over and over, then checks the last values
+ * reach the kernel. set_arg_overhead times clSetKernelArg
+ */
+void runtime_set_arg_overhead(void)
+{
+  const size_t n = 64;
+  const int round_n = 16;
+  const float b = 2.f;
+  const cl_float4 c = {{0.5f, 0.f, 0.f, 0.25f}};
+  const cl_uint d = 3;
+
+  OCL_CREATE_KERNEL("runtime_set_arg_overhead");
+  OCL_CREATE_BUFFER(buf[0], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[1], 0, n * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[2], 0, 4 * sizeof(float), NULL);
+  OCL_MAP_BUFFER(1);
+  for (uint32_t i = 0; i < n; ++i)
+    ((float*)buf_data[1])[i] = (float) i;
+  OCL_UNMAP_BUFFER(1);
+  OCL_MAP_BUFFER(2);
+  for (uint32_t i = 0; i < 4; ++i)
+    ((float*)buf_data[2])[i] = (float) (i * 10);
+  OCL_UNMAP_BUFFER(2);
+
+  for (int r = 0; r < round_n; ++r) {
+    const cl_int a = r;
+    OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+    OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+    OCL_SET_ARG(2, sizeof(cl_int), &a);
+    OCL_SET_ARG(3, sizeof(float), &b);
+    OCL_SET_ARG(4, sizeof(cl_float4), &c);
+    OCL_SET_ARG(5, sizeof(cl_uint), &d);
+    OCL_SET_ARG(6, 16 * sizeof(float), NULL);
+    OCL_SET_ARG(7, sizeof(cl_mem), &buf[2]);
+  }
+
+  globals[0] = n;
+  locals[0] = 16;
+  OCL_NDRANGE(1);
+  OCL_MAP_BUFFER(0);
+  for (uint32_t i = 0; i < n; ++i)
+    OCL_ASSERT(((float*)buf_data[0])[i] == i * b + (round_n - 1) + c.s[0] + c.s[3] + d + (i & 3) * 10);
+  OCL_UNMAP_BUFFER(0);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_set_arg_overhead);
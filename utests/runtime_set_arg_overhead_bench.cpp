@@ -0,0 +1,38 @@
+#include "utest_helper.hpp"
+
+/* CPU time per clSetKernelArg, setting the 8 arguments of a kernel (buffers,
+ * scalars, a vector, local memory and a constant buffer) over and over
+ */
+static void set_arg_overhead(void)
+{
+  const int round_n = 100000;
+  const float b = 2.f;
+  const cl_float4 c = {{0.5f, 0.f, 0.f, 0.25f}};
+  const cl_uint d = 3;
+
+  OCL_CREATE_KERNEL("runtime_set_arg_overhead");
+  OCL_CREATE_BUFFER(buf[0], 0, 64 * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[1], 0, 64 * sizeof(float), NULL);
+  OCL_CREATE_BUFFER(buf[2], 0, 4 * sizeof(float), NULL);
+
+  const double t0 = cl_time_us();
+  for (int r = 0; r < round_n; ++r) {
+    const cl_int a = r;
+    OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+    OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+    OCL_SET_ARG(2, sizeof(cl_int), &a);
+    OCL_SET_ARG(3, sizeof(float), &b);
+    OCL_SET_ARG(4, sizeof(cl_float4), &c);
+    OCL_SET_ARG(5, sizeof(cl_uint), &d);
+    OCL_SET_ARG(6, 16 * sizeof(float), NULL);
+    OCL_SET_ARG(7, sizeof(cl_mem), &buf[2]);
+  }
+  const double ns = (cl_time_us() - t0) * 1e3;
+  printf("%.1f ns per clSetKernelArg\n", ns / (8. * round_n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  return cl_bench_run(set_arg_overhead);
+}
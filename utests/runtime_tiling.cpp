@@ -0,0 +1,166 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Check the CPU tiling of the images against a bit by bit reference for all
+ * the tilings and swizzlings, then print its bandwidth. No device is needed
+ */
+#include "../src/cl_tiling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* Address of byte x of row y as given by the hardware documentation */
+static size_t
+reference_offset(cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle,
+                 size_t pitch, size_t x, size_t y)
+{
+  size_t tile, in_tile, addr;
+
+  if (tiling == CL_NO_TILE)
+    return y * pitch + x;
+  if (tiling == CL_TILE_X) {
+    tile = (y / 8) * (pitch / 512) + x / 512;
+    in_tile = (x & 0x1ff) | ((y & 0x7) << 9);
+  } else {
+    tile = (y / 32) * (pitch / 128) + x / 128;
+    in_tile = (x & 0xf) | ((y & 0x1f) << 4) | (((x >> 4) & 0x7) << 9);
+  }
+  addr = tile * 4096 + in_tile;
+
+  size_t bit6 = (addr >> 6) & 1;
+  switch (swizzle) {
+    case CL_SWIZZLE_9:       bit6 ^= (addr >> 9) & 1; break;
+    case CL_SWIZZLE_9_10:    bit6 ^= ((addr >> 9) ^ (addr >> 10)) & 1; break;
+    case CL_SWIZZLE_9_11:    bit6 ^= ((addr >> 9) ^ (addr >> 11)) & 1; break;
+    case CL_SWIZZLE_9_10_11: bit6 ^= ((addr >> 9) ^ (addr >> 10) ^ (addr >> 11)) & 1; break;
+    default: break;
+  }
+  return (addr & ~(size_t) 64) | (bit6 << 6);
+}
+
+static const char *tiling_names[] = {"linear", "X", "Y"};
+static const char *swizzle_names[] = {"unknown", "none", "9", "9_10", "9_11", "9_10_11"};
+
+static int
+check(cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle)
+{
+  const size_t pitch = 2048, h = 96, sz = pitch * h;
+  static const size_t rects[][4] = { /* x, y, w, h */
+    {0, 0, 2048, 96}, {3, 1, 1000, 50}, {16, 8, 16, 1}, {511, 7, 130, 33},
+    {64, 32, 64, 32}, {1, 95, 2047, 1}, {2040, 0, 8, 96}
+  };
+  const size_t linear_sz = (pitch + 5) * h;
+  char *tiled = (char *) malloc(sz), *expected = (char *) malloc(sz);
+  char *linear = (char *) malloc(linear_sz), *back = (char *) malloc(linear_sz);
+  int status = 0;
+
+  for (size_t i = 0; i < linear_sz; ++i)
+    linear[i] = (char) rand();
+
+  for (size_t r = 0; r < sizeof(rects) / sizeof(rects[0]); ++r) {
+    const size_t x = rects[r][0], y = rects[r][1], w = rects[r][2], rh = rects[r][3];
+    const size_t linear_pitch = w + 5;
+
+    if (cl_tiling_offset(tiling, swizzle, pitch, x, y) != reference_offset(tiling, swizzle, pitch, x, y))
+      status = 1;
+
+    memset(tiled, 0, sz);
+    memset(expected, 0, sz);
+    for (size_t j = 0; j < rh; ++j)
+      for (size_t i = 0; i < w; ++i)
+        expected[reference_offset(tiling, swizzle, pitch, x + i, y + j)] = linear[j * linear_pitch + i];
+    cl_tiling_tile(tiled, pitch, tiling, swizzle, x, y, linear, linear_pitch, w, rh);
+    if (memcmp(tiled, expected, sz) != 0)
+      status = 1;
+
+    memset(back, 0, linear_sz);
+    cl_tiling_untile(back, linear_pitch, tiled, pitch, tiling, swizzle, x, y, w, rh);
+    for (size_t j = 0; j < rh; ++j)
+      if (memcmp(back + j * linear_pitch, linear + j * linear_pitch, w) != 0)
+        status = 1;
+  }
+
+  if (status)
+    fprintf(stderr, "tiling %s swizzle %s: mismatch\n",
+            tiling_names[tiling], swizzle_names[swizzle]);
+  free(tiled);
+  free(expected);
+  free(linear);
+  free(back);
+  return status;
+}
+
+/* Best GB/s over a few runs for a 4096 x 2048 bytes surface */
+static void
+bandwidth(cl_image_tiling_t tiling, cl_tiling_swizzle_t swizzle)
+{
+  const size_t pitch = 4096, h = 2048, sz = pitch * h;
+  char *tiled = (char *) malloc(sz), *linear = (char *) malloc(sz);
+  double tile = 0., untile = 0., copy = 0.;
+
+  memset(tiled, 1, sz);
+  memset(linear, 2, sz);
+  for (int run = 0; run < 16; ++run) {
+    double t = now();
+    cl_tiling_tile(tiled, pitch, tiling, swizzle, 0, 0, linear, pitch, pitch, h);
+    double dt = now() - t;
+    if (dt > 0. && sz / dt > tile) tile = sz / dt;
+
+    t = now();
+    cl_tiling_untile(linear, pitch, tiled, pitch, tiling, swizzle, 0, 0, pitch, h);
+    dt = now() - t;
+    if (dt > 0. && sz / dt > untile) untile = sz / dt;
+
+    t = now();
+    memcpy(linear, tiled, sz);
+    dt = now() - t;
+    if (dt > 0. && sz / dt > copy) copy = sz / dt;
+  }
+  printf("%-8s%-10s%12.2f%12.2f%12.2f\n", tiling_names[tiling], swizzle_names[swizzle],
+         tile * 1e-9, untile * 1e-9, copy * 1e-9);
+  free(tiled);
+  free(linear);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int status = 0;
+
+  for (int tiling = CL_NO_TILE; tiling <= CL_TILE_Y; ++tiling)
+    for (int swizzle = CL_SWIZZLE_NONE; swizzle <= CL_SWIZZLE_9_10_11; ++swizzle)
+      if (tiling != CL_NO_TILE || swizzle == CL_SWIZZLE_NONE)
+        status |= check((cl_image_tiling_t) tiling, (cl_tiling_swizzle_t) swizzle);
+  printf("tiling check: %s\n", status ? "failed" : "passed");
+
+  printf("%-8s%-10s%12s%12s%12s\n", "tiling", "swizzle", "tile GB/s", "untile GB/s", "memcpy GB/s");
+  for (int tiling = CL_TILE_X; tiling <= CL_TILE_Y; ++tiling) {
+    bandwidth((cl_image_tiling_t) tiling, CL_SWIZZLE_NONE);
+    bandwidth((cl_image_tiling_t) tiling, CL_SWIZZLE_9_10);
+  }
+  return status;
+}
@@ -0,0 +1,69 @@
+#include "utest_helper.hpp"
+#include <stdlib.h>
+
+/* Run test_copy_buffer between two CL_MEM_USE_HOST_PTR buffers and check the
+ * results through a map, which must return host_ptr + offset, then write
+ * through a map and copy back
+ */
+static void use_host_ptr_run(float *src_host, float *dst_host, size_t n)
+{
+  cl_int err;
+
+  for (size_t i = 0; i < n; ++i) {
+    src_host[i] = i * 0.5f;
+    dst_host[i] = 0.f;
+  }
+  OCL_CREATE_BUFFER(buf[0], CL_MEM_USE_HOST_PTR, n * sizeof(float), src_host);
+  OCL_CREATE_BUFFER(buf[1], CL_MEM_USE_HOST_PTR, n * sizeof(float), dst_host);
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[0]);
+  OCL_SET_ARG(1, sizeof(cl_mem), &buf[1]);
+  globals[0] = n;
+  locals[0] = 16;
+  OCL_NDRANGE(1);
+
+  float *mapped = (float *) clEnqueueMapBuffer(queue, buf[1], CL_TRUE, CL_MAP_READ,
+                                               64 * sizeof(float), (n - 64) * sizeof(float),
+                                               0, NULL, NULL, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  OCL_ASSERT(mapped == dst_host + 64);
+  for (size_t i = 0; i < n - 64; ++i)
+    OCL_ASSERT(mapped[i] == (i + 64) * 0.5f);
+  OCL_CALL(clEnqueueUnmapMemObject, queue, buf[1], mapped, 0, NULL, NULL);
+
+  mapped = (float *) clEnqueueMapBuffer(queue, buf[1], CL_TRUE, CL_MAP_WRITE,
+                                        0, n * sizeof(float), 0, NULL, NULL, &err);
+  OCL_ASSERT(err == CL_SUCCESS);
+  OCL_ASSERT(mapped == dst_host);
+  for (size_t i = 0; i < n; ++i)
+    mapped[i] = i * 2.f;
+  OCL_CALL(clEnqueueUnmapMemObject, queue, buf[1], mapped, 0, NULL, NULL);
+
+  OCL_SET_ARG(0, sizeof(cl_mem), &buf[1]);
+  OCL_SET_ARG(1, sizeof(cl_mem), &buf[0]);
+  OCL_NDRANGE(1);
+  OCL_CALL(clEnqueueReadBuffer, queue, buf[0], CL_TRUE, 0, n * sizeof(float),
+           dst_host, 0, NULL, NULL);
+  for (size_t i = 0; i < n; ++i)
+    OCL_ASSERT(dst_host[i] == i * 2.f);
+
+  OCL_CALL(clReleaseMemObject, buf[0]);
+  OCL_CALL(clReleaseMemObject, buf[1]);
+  buf[0] = buf[1] = NULL;
+}
+
+/* Page aligned memory is used in place, the other one is copied */
+void runtime_use_host_ptr(void)
+{
+  const size_t n = 4096 + 16;
+  void *src = NULL, *dst = NULL;
+
+  OCL_CREATE_KERNEL("test_copy_buffer");
+  OCL_ASSERT(posix_memalign(&src, 4096, (n + 16) * sizeof(float)) == 0);
+  OCL_ASSERT(posix_memalign(&dst, 4096, (n + 16) * sizeof(float)) == 0);
+  use_host_ptr_run((float *) src, (float *) dst, n);
+  use_host_ptr_run((float *) src + 1, (float *) dst + 3, n);
+  free(src);
+  free(dst);
+}
+
+MAKE_UTEST_FROM_FUNCTION(runtime_use_host_ptr);
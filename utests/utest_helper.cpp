@@ -20,6 +20,7 @@
 #include "utest_file_map.hpp"
 #include "utest_helper.hpp"
 #include "utest_error.h"
+#include "utest_exception.hpp"
 #include "CL/cl.h"
 #include "CL/cl_intel.h"
 
@@ -28,6 +29,7 @@
 #include <cstring>
 #include <cassert>
 #include <cmath>
+#include <ctime>
 
 #define FATAL(...) \
 do { \
@@ -679,3 +681,26 @@ const int cl_INT_ULP(int int_number)
 {
   return 0;
 }
+
+double cl_time_us(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec * 1e-3;
+}
+
+int cl_bench_run(void (*fn)(void))
+{
+  int status = 0;
+  try {
+    OCL_CALL (cl_ocl_init);
+    fn();
+  } catch (Exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    status = 1;
+  }
+  cl_buffer_destroy();
+  cl_kernel_destroy();
+  cl_ocl_destroy();
+  return status;
+}
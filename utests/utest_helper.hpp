@@ -227,5 +227,13 @@ extern const float cl_FLT_ULP(float float_number);
 /* Calculator ULP of each INT value */
 extern const int cl_INT_ULP(int int_number);
 
+/* Monotonic time in us, for the benchmarks */
+extern double cl_time_us(void);
+
+/* Main of the benchmark executables: init OpenCL, run fn and release
+ * everything. Return the exit status
+ */
+extern int cl_bench_run(void (*fn)(void));
+
 #endif /* __UTEST_HELPER_HPP__ */
 